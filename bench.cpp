@@ -8,6 +8,9 @@
 #include <vector>
 #include <array>
 #include <algorithm>
+#include <limits>
+#include <cmath>
+#include <memory>
 // std::filesystem was added in C++17, but was still experimental in C++14
 #if __cplusplus >= 201700L
 #include <filesystem>
@@ -20,6 +23,8 @@ namespace fs = std::experimental::filesystem;
 #include "json.hpp"
 
 #include "graph_io.h"
+#include "reorder.h"
+#include "perf_counters.h"
 
 #ifdef GRIDCUT_IS_AVAILABLE
 #include "grid_cut/GridGraph_2D_4C.h"
@@ -40,8 +45,10 @@ namespace fs = std::experimental::filesystem;
 #include "reimpls/eibfs_i_nr.h"
 #include "reimpls/parallel_pr.h"
 #include "reimpls/strandmarkkahl.h"
+#include "reimpls/block_merge.h"
 #include "ibfs/ibfs.h"
 #include "reimpls/hpf.h"
+#include "reimpls/hpf_i.h"
 #include "hi_pr/hi_pr.h"
 #include "sppr/maxFlow.h"
 
@@ -58,6 +65,45 @@ namespace fs = std::experimental::filesystem;
 using Duration = std::chrono::duration<double>;
 static const auto now = std::chrono::steady_clock::now;
 
+// Hardware counters for the solve step. Only created if enabled in the config.
+static std::unique_ptr<PerfCounters> solve_counters;
+
+// Whether the output has columns for dynamic files. Set if any data set is dynamic.
+static bool dynamic_columns = false;
+
+// Threads for recovering the flows after the min. cut for the HPF solvers. Zero if only the cut is computed.
+static unsigned int recover_flow_threads = 0;
+
+// Time to recover the flows in the last run. Zero for solvers without a separate flow recovery.
+static double recover_time = 0;
+
+// Whether the output has columns for the phase times of the block-parallel solvers.
+static bool phase_columns = false;
+
+// Phase times and thread load imbalance (max. over mean busy time) of the last run. Zero for solvers that
+// do not report them.
+static double init_time = 0;
+static double phase1_time = 0;
+static double boundary_time = 0;
+static double phase2_time = 0;
+static double tail_time = 0;
+static double phase1_imbalance = 0;
+static double phase2_imbalance = 0;
+
+inline void start_solve_counters()
+{
+    if (solve_counters) {
+        solve_counters->start();
+    }
+}
+
+inline void stop_solve_counters()
+{
+    if (solve_counters) {
+        solve_counters->stop();
+    }
+}
+
 using json = nlohmann::json;
 
 struct Vec3i {
@@ -84,6 +130,8 @@ enum Algorithm {
     ALGO_NBK,
     ALGO_MBK,
     ALGO_MBK2,
+    ALGO_MBK_PF,
+    ALGO_MBK2_PF,
     ALGO_EIBFS,
     ALGO_EIBFS2,
     ALGO_EIBFS_OLD,
@@ -92,12 +140,18 @@ enum Algorithm {
     ALGO_HPF_HL,
     ALGO_HPF_LF,
     ALGO_HPF_LL,
+    ALGO_HPF_I,
+    ALGO_HPF_I_HF,
+    ALGO_HPF_I_HL,
+    ALGO_HPF_I_LF,
+    ALGO_HPF_I_LL,
     ALGO_HI_PR,
     ALGO_GRIDCUT,
 
     // Parallel algorithms
     ALGO_PMBK,
     ALGO_PPR,
+    ALGO_PPR_I,
     ALGO_PSK,
     ALGO_PARD,
     ALGO_PEIBFS,
@@ -110,9 +164,40 @@ enum Algorithm {
 enum FileType {
     FTYPE_DIMACS,
     FTYPE_BBK,
-    FTYPE_BQ
+    FTYPE_BQ,
+    FTYPE_DBK
+};
+
+enum DynamicSolve {
+    DYNAMIC_INCREMENTAL,
+    DYNAMIC_SCRATCH
+};
+
+enum ReorderType {
+    REORDER_NONE,
+    REORDER_BFS,
+    REORDER_MORTON,
+    REORDER_HILBERT,
+    REORDER_BLOCK
 };
 
+enum BlockSolverType {
+    BLOCK_SOLVER_DEFAULT,
+    BLOCK_SOLVER_MBK,
+    BLOCK_SOLVER_MBK_R,
+    BLOCK_SOLVER_EIBFS_I
+};
+
+// Solver for the blocks of the psk and liusun solvers. The default is each solver's own BK variant.
+static BlockSolverType block_solver = BLOCK_SOLVER_DEFAULT;
+
+// Block scheduling of the liusun and peibfs solvers. The adaptive policy also splits oversized blocks.
+static reimpls::BlockPolicy block_policy = reimpls::BLOCK_POLICY_FIXED;
+
+// Block pairs left in phase 2 of the liusun and peibfs solvers when they switch to parallel push-relabel.
+// Zero to always merge.
+static size_t tail_pairs = 0;
+
 enum GridType {
     GRID_TYPE_NO_GRID = 0,
     GRID_TYPE_2D_4C,
@@ -133,6 +218,8 @@ struct BenchConfig {
 
     int num_run;
     int num_threads;
+
+    ReorderType reorder;
 };
 
 struct DataConfig {
@@ -149,15 +236,28 @@ struct DataConfig {
     size_t grid_width;
     size_t grid_height;
     size_t grid_depth;
+
+    // How to re-solve after each batch of changes. Only used for dynamic files.
+    std::vector<DynamicSolve> dynamic_solves;
+};
+
+// Latencies of the re-solves after each batch of a dynamic file.
+struct StepStats {
+    DynamicSolve solve;
+    size_t num_steps;
+    double p50;
+    double p90;
+    double p99;
+    double max;
 };
 
 #define SWITCH_ON_SIGNED_TYPE(type, name, ...) switch (type) { \
-    /*case TYPE_INT8: { using name = int8_t; __VA_ARGS__ } break;*/ \
-    /*case TYPE_INT16: { using name = int16_t; __VA_ARGS__ } break;*/ \
+    case TYPE_INT8: { using name = int8_t; __VA_ARGS__ } break; \
+    case TYPE_INT16: { using name = int16_t; __VA_ARGS__ } break; \
     case TYPE_INT32: { using name = int32_t; __VA_ARGS__ } break; \
     case TYPE_INT64: { using name = int64_t; __VA_ARGS__ } break; \
-    /*case TYPE_FLOAT: { using name = float; __VA_ARGS__ } break;*/ \
-    /*case TYPE_DOUBLE: { using name = double; __VA_ARGS__ } break;*/ \
+    case TYPE_FLOAT: { using name = float; __VA_ARGS__ } break; \
+    case TYPE_DOUBLE: { using name = double; __VA_ARGS__ } break; \
     default: throw std::runtime_error("Invalid type code for signed type."); \
 }
 
@@ -173,7 +273,7 @@ struct DataConfig {
 
 #define SWITCH_ON_FLOW_TYPE(type, name, ...) switch (type) { \
     case TYPE_INT64: { using name = int64_t; __VA_ARGS__ } break; \
-    /*case TYPE_DOUBLE: { using name = double; __VA_ARGS__ } break;*/ \
+    case TYPE_DOUBLE: { using name = double; __VA_ARGS__ } break; \
     default: throw std::runtime_error("Invalid type code for flow."); \
 }
 
@@ -181,16 +281,27 @@ struct DataConfig {
     SWITCH_ON_SIGNED_TYPE(bench_config.cap_type, CapType, \
         SWITCH_ON_FLOW_TYPE(bench_config.flow_type, FlowType, \
             SWITCH_ON_INDEX_TYPE(bench_config.index_type, IndexType, \
-                func<CapType, CapType, FlowType, IndexType, decltype(data)>(data_config, bench_config, data);))) \
+                func<CapType, reimpls::PromotedCap<CapType>, FlowType, IndexType, decltype(data)>( \
+                    data_config, bench_config, data);))) \
 } while (false)
 
 TypeCode code_from_string(const std::string& str);
 Algorithm algo_from_string(const std::string& str);
 const char* algo_to_string(Algorithm algo);
 FileType ftype_from_string(const std::string& str);
+const char* reorder_to_string(ReorderType reorder);
+ReorderType reorder_from_string(const std::string& str);
+const char* dynamic_solve_to_string(DynamicSolve solve);
+DynamicSolve dynamic_solve_from_string(const std::string& str);
+reimpls::AllocPolicy alloc_policy_from_string(const std::string& str);
+BlockSolverType block_solver_from_string(const std::string& str);
+reimpls::BlockPolicy block_policy_from_string(const std::string& str);
 
 bool algo_is_parallel(Algorithm algo);
+bool algo_is_incremental(Algorithm algo);
 bool algo_requires_grid(Algorithm algo);
+bool algo_has_term_arcs(Algorithm algo);
+bool reorder_requires_grid(ReorderType reorder);
 
 std::vector<BenchConfig> gen_bench_configs(json config);
 std::vector<DataConfig> gen_data_configs(json config);
@@ -211,9 +322,11 @@ std::tuple<Flow, double, double> bench_bk(BenchConfig config, const Data& data)
     Duration build_dur = now() - build_begin;
 
     // Solve graph.
+    start_solve_counters();
     auto solve_begin = now();
     auto flow = graph.maxflow();
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
 
     return std::make_tuple(flow, build_dur.count(), solve_dur.count());
 }
@@ -234,19 +347,21 @@ std::tuple<Flow, double, double> bench_nbk(BenchConfig config, const Data& data)
 	Duration build_dur = now() - build_begin;
 
 	// Solve graph.
+	start_solve_counters();
 	auto solve_begin = now();
 	auto flow = graph.maxflow();
 	Duration solve_dur = now() - solve_begin;
+	stop_solve_counters();
 
 	return std::make_tuple(flow, build_dur.count(), solve_dur.count());
 }
 
-template <class Cap, class Term, class Flow, class Index, class Data>
+template <class Cap, class Term, class Flow, class Index, class Data, bool Prefetch = false>
 std::tuple<Flow, double, double> bench_mbk(BenchConfig config, const Data& data)
 {
     // Build graph.
     auto build_begin = now();
-    reimpls::Graph<Cap, Term, Flow, Index, Index> graph(data.num_nodes, data.neighbor_arcs.size());
+    reimpls::Graph<Cap, Term, Flow, Index, Index, Prefetch> graph(data.num_nodes, data.neighbor_arcs.size());
     graph.add_node(data.num_nodes);
     for (const auto& tarc : data.terminal_arcs) {
         graph.add_tweights(tarc.node, tarc.source_cap, tarc.sink_cap);
@@ -257,19 +372,21 @@ std::tuple<Flow, double, double> bench_mbk(BenchConfig config, const Data& data)
     Duration build_dur = now() - build_begin;
 
     // Solve graph.
+    start_solve_counters();
     auto solve_begin = now();
     auto flow = graph.maxflow();
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
 
     return std::make_tuple(flow, build_dur.count(), solve_dur.count());
 }
 
-template <class Cap, class Term, class Flow, class Index, class Data>
+template <class Cap, class Term, class Flow, class Index, class Data, bool Prefetch = false>
 std::tuple<Flow, double, double> bench_mbk2(BenchConfig config, const Data& data)
 {
     // Build graph.
     auto build_begin = now();
-    reimpls::Graph2<Cap, Term, Flow, Index, Index> graph(data.num_nodes, data.neighbor_arcs.size());
+    reimpls::Graph2<Cap, Term, Flow, Index, Index, Prefetch> graph(data.num_nodes, data.neighbor_arcs.size());
     graph.add_node(data.num_nodes);
     for (const auto& tarc : data.terminal_arcs) {
         graph.add_tweights(tarc.node, tarc.source_cap, tarc.sink_cap);
@@ -277,13 +394,15 @@ std::tuple<Flow, double, double> bench_mbk2(BenchConfig config, const Data& data
     for (const auto& narc : data.neighbor_arcs) {
         graph.add_edge(narc.i, narc.j, narc.cap, narc.rev_cap, false);
     }
-    graph.init_maxflow();
+    graph.init_maxflow(config.num_threads);
     Duration build_dur = now() - build_begin;
 
     // Solve graph.
+    start_solve_counters();
     auto solve_begin = now();
     auto flow = graph.maxflow();
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
 
     return std::make_tuple(flow, build_dur.count(), solve_dur.count());
 }
@@ -302,13 +421,15 @@ std::tuple<Flow, double, double> bench_eibfs(BenchConfig config, const Data& dat
     for (const auto& narc : data.neighbor_arcs) {
         graph.addEdge(narc.i, narc.j, narc.cap, narc.rev_cap);
     }
-    graph.initGraph();
+    graph.initGraph(config.num_threads);
     Duration build_dur = now() - build_begin;
 
     // Solve graph.
+    start_solve_counters();
     auto solve_begin = now();
     auto flow = graph.computeMaxFlow();
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
 
     return std::make_tuple(flow, build_dur.count(), solve_dur.count());
 }
@@ -331,9 +452,11 @@ std::tuple<Flow, double, double> bench_eibfs2(BenchConfig config, const Data& da
     Duration build_dur = now() - build_begin;
 
     // Solve graph.
+    start_solve_counters();
     auto solve_begin = now();
     auto flow = graph.computeMaxFlow();
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
 
     return std::make_tuple(flow, build_dur.count(), solve_dur.count());
 }
@@ -357,9 +480,11 @@ std::tuple<Flow, double, double> bench_eibfs_old(BenchConfig config, const Data&
     Duration build_dur = now() - build_begin;
 
     // Solve graph.
+    start_solve_counters();
     auto solve_begin = now();
     auto flow = graph.computeMaxFlow();
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
 
     return std::make_tuple(flow, build_dur.count(), solve_dur.count());
 }
@@ -370,14 +495,13 @@ std::tuple<Flow, double, double> bench_hpf(BenchConfig config, const Data& data)
     // Build graph.
     auto build_begin = now();
     // reimpls::Hpf<Cap, mbk::LabelOrder::HIGHEST_FIRST, reimpls::RootOrder::FIFO> graph(
-    reimpls::Hpf<Cap, LO, RO> graph(
-        data.num_nodes + 2, data.neighbor_arcs.size() + data.terminal_arcs.size());;
+    reimpls::Hpf<Cap, LO, RO, Index, Index> graph(
+        data.num_nodes + 2, 2 * data.neighbor_arcs.size());
     graph.set_source(0);
     graph.set_sink(1);
     graph.add_node(data.num_nodes + 2);
     for (const auto& tarc : data.terminal_arcs) {
-        graph.add_edge(0, tarc.node + 2, tarc.source_cap);
-        graph.add_edge(tarc.node + 2, 1, tarc.sink_cap);
+        graph.add_tweights(tarc.node + 2, tarc.source_cap, tarc.sink_cap);
     }
     for (const auto& narc : data.neighbor_arcs) {
         if (narc.cap) {
@@ -390,11 +514,65 @@ std::tuple<Flow, double, double> bench_hpf(BenchConfig config, const Data& data)
     Duration build_dur = now() - build_begin;
 
     // Solve graph.
+    start_solve_counters();
     auto solve_begin = now();
     graph.mincut();
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
 
     auto flow = graph.compute_maxflow();
+
+    // Recover flows. Timed separately since the cut and flow value are known at this point.
+    if (recover_flow_threads > 0) {
+        auto recover_begin = now();
+        graph.recover_flow(recover_flow_threads);
+        Duration recover_dur = now() - recover_begin;
+        recover_time = recover_dur.count();
+    }
+
+    return std::make_tuple(flow, build_dur.count(), solve_dur.count());
+}
+
+template <class Cap, class Term, class Flow, class Index, class Data, reimpls::LabelOrder LO, reimpls::RootOrder RO>
+std::tuple<Flow, double, double> bench_hpf_i(BenchConfig config, const Data& data)
+{
+    // Build graph.
+    auto build_begin = now();
+    reimpls::Hpf2<Cap, uint32_t, Index, LO, RO> graph(
+        data.num_nodes + 2, 2 * data.neighbor_arcs.size());
+    graph.set_source(0);
+    graph.set_sink(1);
+    graph.add_node(data.num_nodes + 2);
+    for (const auto& tarc : data.terminal_arcs) {
+        graph.add_tweights(tarc.node + 2, tarc.source_cap, tarc.sink_cap);
+    }
+    for (const auto& narc : data.neighbor_arcs) {
+        if (narc.cap) {
+            graph.add_edge(narc.i + 2, narc.j + 2, narc.cap);
+        }
+        if (narc.rev_cap) {
+            graph.add_edge(narc.j + 2, narc.i + 2, narc.rev_cap);
+        }
+    }
+    Duration build_dur = now() - build_begin;
+
+    // Solve graph.
+    start_solve_counters();
+    auto solve_begin = now();
+    graph.mincut();
+    Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
+
+    auto flow = graph.compute_maxflow();
+
+    // Recover flows. Timed separately since the cut and flow value are known at this point.
+    if (recover_flow_threads > 0) {
+        auto recover_begin = now();
+        graph.recover_flow(recover_flow_threads);
+        Duration recover_dur = now() - recover_begin;
+        recover_time = recover_dur.count();
+    }
+
     return std::make_tuple(flow, build_dur.count(), solve_dur.count());
 }
 
@@ -428,9 +606,11 @@ std::tuple<Flow, double, double> bench_hi_pr(BenchConfig config, const Data& dat
     Duration build_dur = now() - build_begin;
 
     // Solve graph.
+    start_solve_counters();
     auto solve_begin = now();
     graph.stageOne();
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
 
     auto flow = graph.flow - graph.flow0;
     return std::make_tuple(flow, build_dur.count(), solve_dur.count());
@@ -457,40 +637,40 @@ std::tuple<Flow, double, double> bench_gridcut(
 
     // Prepare arrays with neighbor capacities
     std::array<std::array<std::array<std::vector<Cap>, 3>, 3>, 3> nbor_cap_arrays;
-    switch (data_config.grid_type)
-    {
-    case GRID_TYPE_2D_4C:
-        nbor_cap_arrays[1][0][0].resize(data.num_nodes, 0);
-        nbor_cap_arrays[1][2][0].resize(data.num_nodes, 0);
-        nbor_cap_arrays[0][1][0].resize(data.num_nodes, 0);
-        nbor_cap_arrays[2][1][0].resize(data.num_nodes, 0);
-        break;
-    case GRID_TYPE_2D_8C:
-        for (size_t i = 0; i < 3; ++i) {
-            for (size_t j = 0; j < 3; ++j) {
-                nbor_cap_arrays[i][j][0].resize(data.num_nodes, 0);
-            }
-        }
-        break;
-    case GRID_TYPE_3D_6C:
-        nbor_cap_arrays[1][1][0].resize(data.num_nodes, 0);
-        nbor_cap_arrays[1][1][2].resize(data.num_nodes, 0);
-        nbor_cap_arrays[1][0][1].resize(data.num_nodes, 0);
-        nbor_cap_arrays[1][2][1].resize(data.num_nodes, 0);
-        nbor_cap_arrays[0][1][1].resize(data.num_nodes, 0);
-        nbor_cap_arrays[2][1][1].resize(data.num_nodes, 0);
-        break;
-    case GRID_TYPE_3D_26C:
-        for (size_t i = 0; i < 3; ++i) {
-            for (size_t j = 0; j < 3; ++j) {
-                for (size_t k = 0; k < 3; ++k) {
-                    nbor_cap_arrays[i][j][k].resize(data.num_nodes, 0);
-                }
-            }
-        }
-        break;
+    switch (data_config.grid_type)
+    {
+    case GRID_TYPE_2D_4C:
+        nbor_cap_arrays[1][0][0].resize(data.num_nodes, 0);
+        nbor_cap_arrays[1][2][0].resize(data.num_nodes, 0);
+        nbor_cap_arrays[0][1][0].resize(data.num_nodes, 0);
+        nbor_cap_arrays[2][1][0].resize(data.num_nodes, 0);
+        break;
+    case GRID_TYPE_2D_8C:
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < 3; ++j) {
+                nbor_cap_arrays[i][j][0].resize(data.num_nodes, 0);
+            }
+        }
+        break;
+    case GRID_TYPE_3D_6C:
+        nbor_cap_arrays[1][1][0].resize(data.num_nodes, 0);
+        nbor_cap_arrays[1][1][2].resize(data.num_nodes, 0);
+        nbor_cap_arrays[1][0][1].resize(data.num_nodes, 0);
+        nbor_cap_arrays[1][2][1].resize(data.num_nodes, 0);
+        nbor_cap_arrays[0][1][1].resize(data.num_nodes, 0);
+        nbor_cap_arrays[2][1][1].resize(data.num_nodes, 0);
+        break;
+    case GRID_TYPE_3D_26C:
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < 3; ++j) {
+                for (size_t k = 0; k < 3; ++k) {
+                    nbor_cap_arrays[i][j][k].resize(data.num_nodes, 0);
+                }
+            }
+        }
+        break;
     default:
-        throw std::invalid_argument("Benching GridCut but data is not grid.");
+        throw std::invalid_argument("Benching GridCut but data is not grid.");
     }
 
     for (const auto& narc : data.neighbor_arcs) {
@@ -529,10 +709,13 @@ std::tuple<Flow, double, double> bench_gridcut(
         );
         build_dur = now() - build_begin;
         
+        start_solve_counters();
+        
         auto solve_begin = now();
         graph.compute_maxflow();
         flow = graph.get_flow();
         solve_dur = now() - solve_begin;
+        stop_solve_counters();
     } else if (data_config.grid_type == GRID_TYPE_2D_8C) {
         auto build_begin = now();
         GridGraph_2D_8C<Term, Cap, Flow> graph(width, height);
@@ -550,10 +733,13 @@ std::tuple<Flow, double, double> bench_gridcut(
         );
         build_dur = now() - build_begin;
 
+        start_solve_counters();
+
         auto solve_begin = now();
         graph.compute_maxflow();
         flow = graph.get_flow();
         solve_dur = now() - solve_begin;
+        stop_solve_counters();
     } else if (data_config.grid_type == GRID_TYPE_3D_6C) {
         auto build_begin = now();
         GridGraph_3D_6C<Term, Cap, Flow> graph(width, height, depth);
@@ -569,10 +755,13 @@ std::tuple<Flow, double, double> bench_gridcut(
         );
         build_dur = now() - build_begin;
 
+        start_solve_counters();
+
         auto solve_begin = now();
         graph.compute_maxflow();
         flow = graph.get_flow();
         solve_dur = now() - solve_begin;
+        stop_solve_counters();
     } else if (data_config.grid_type == GRID_TYPE_3D_26C) {
         auto build_begin = now();
         GridGraph_3D_26C<Term, Cap, Flow> graph(width, height, depth);
@@ -612,10 +801,13 @@ std::tuple<Flow, double, double> bench_gridcut(
         );
         build_dur = now() - build_begin;
 
+        start_solve_counters();
+
         auto solve_begin = now();
         graph.compute_maxflow();
         flow = graph.get_flow();
         solve_dur = now() - solve_begin;
+        stop_solve_counters();
     }
 
     return std::make_tuple(flow, build_dur.count(), solve_dur.count());
@@ -624,15 +816,16 @@ std::tuple<Flow, double, double> bench_gridcut(
 #endif
 }
 
-template <class Cap, class Term, class Flow, class Index, class Data>
-std::tuple<Flow, double, double, uint16_t> bench_parallel_mbk(
+template <class Cap, class Term, class Flow, class Index, class Data, class BlockSolver>
+std::tuple<Flow, double, double, uint16_t> bench_block_merge(
     BenchConfig config, const Data& data, std::vector<uint16_t> node_blocks, uint16_t num_blocks)
 {
     auto block_intervals = split_block_intervals(node_blocks);
 
     // Build graph.
     auto build_begin = now();
-    reimpls::ParallelGraph<Cap, Term, Flow> graph(data.num_nodes, data.neighbor_arcs.size(), num_blocks);
+    reimpls::BlockMergeGraph<Cap, Term, Flow, BlockSolver> graph(
+        data.num_nodes, data.neighbor_arcs.size(), num_blocks);
     graph.set_num_threads(config.num_threads);
 
     Index added_nodes = 0;
@@ -653,47 +846,133 @@ std::tuple<Flow, double, double, uint16_t> bench_parallel_mbk(
         graph.add_tweights(tarc.node, tarc.source_cap, tarc.sink_cap);
     }
     for (const auto& narc : data.neighbor_arcs) {
-        graph.add_edge(narc.i, narc.j, narc.cap, narc.rev_cap, false);
+        graph.add_edge(narc.i, narc.j, narc.cap, narc.rev_cap);
     }
     Duration build_dur = now() - build_begin;
 
     // Solve graph.
+    start_solve_counters();
     auto solve_begin = now();
     auto flow = graph.maxflow();
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
 
     return std::make_tuple(flow, build_dur.count(), solve_dur.count(), num_blocks);
 }
 
 template <class Cap, class Term, class Flow, class Index, class Data>
-std::tuple<Flow, double, double, uint16_t> bench_parallel_pr(
+std::tuple<Flow, double, double, uint16_t> bench_parallel_mbk(
     BenchConfig config, const Data& data, std::vector<uint16_t> node_blocks, uint16_t num_blocks)
 {
-    if (!std::is_same<Cap, int32_t>::value) {
-        throw std::runtime_error("Only int32_t cap is supported for ppr");
+    // A non-default block solver uses the generic bottom-up merging instead of in-place BK merging
+    switch (block_solver) {
+    case BLOCK_SOLVER_MBK:
+        return bench_block_merge<Cap, Term, Flow, Index, Data, reimpls::MbkBlockSolver<Cap, Term, Flow>>(
+            config, data, node_blocks, num_blocks);
+    case BLOCK_SOLVER_MBK_R:
+        return bench_block_merge<Cap, Term, Flow, Index, Data, reimpls::MbkrBlockSolver<Cap, Term, Flow>>(
+            config, data, node_blocks, num_blocks);
+    case BLOCK_SOLVER_EIBFS_I:
+        return bench_block_merge<Cap, Term, Flow, Index, Data, reimpls::EibfsBlockSolver<Cap, Term, Flow>>(
+            config, data, node_blocks, num_blocks);
+    default:
+        break;
     }
-    /*auto build_begin = now();
-    reimpls::ParallelPushRelabel<int32_t, int64_t, Index, Index> graph(
-        data.num_nodes + 2, data.neighbor_arcs.size() + data.terminal_arcs.size());
-    graph.set_source(0);
-    graph.set_sink(1);
+
+    if (tail_pairs > 0 && !std::is_integral<Cap>::value) {
+        throw std::runtime_error("Only integer caps are supported for tail_pairs");
+    }
+    if (block_policy == reimpls::BLOCK_POLICY_ADAPTIVE) {
+        num_blocks = split_heavy_blocks(node_blocks, num_blocks);
+    }
+    auto block_intervals = split_block_intervals(node_blocks);
+
+    // Build graph.
+    auto build_begin = now();
+    reimpls::ParallelGraph<Cap, Term, Flow> graph(data.num_nodes, data.neighbor_arcs.size(), num_blocks);
+    graph.set_num_threads(config.num_threads);
+    graph.set_block_policy(block_policy);
+    graph.set_tail_pairs(tail_pairs);
+
+    Index added_nodes = 0;
+    for (const auto& itv : block_intervals) {
+        // itv = { interval_length, block_index }
+        graph.add_node(itv.first, itv.second);
+        added_nodes += itv.first;
+    }
+    if (added_nodes < data.num_nodes) {
+        // Data was likely a .bq file so need to repeat blocks
+        for (const auto& itv : block_intervals) {
+            // itv = { interval_length, block_index }
+            graph.add_node(itv.first, itv.second);
+        }
+    }
+
+    graph.bulk_add_tweights(data.terminal_arcs.size(), [&](size_t k) {
+        const auto& tarc = data.terminal_arcs[k];
+        return std::make_tuple(tarc.node, tarc.source_cap, tarc.sink_cap);
+    });
+    graph.bulk_add_edges(data.neighbor_arcs.size(), [&](size_t k) {
+        const auto& narc = data.neighbor_arcs[k];
+        return std::make_tuple(narc.i, narc.j, narc.cap, narc.rev_cap);
+    });
+    Duration build_dur = now() - build_begin;
+
+    // Solve graph.
+    start_solve_counters();
+    auto solve_begin = now();
+    auto flow = graph.maxflow();
+    Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
+
+    phase1_time = graph.ph1_dur.count();
+    boundary_time = graph.bs_dur.count();
+    phase2_time = graph.ph2_dur.count();
+    tail_time = graph.tail_dur.count();
+    phase1_imbalance = reimpls::load_imbalance(graph.ph1_busy);
+    phase2_imbalance = reimpls::load_imbalance(graph.ph2_busy);
+
+    return std::make_tuple(flow, build_dur.count(), solve_dur.count(), num_blocks);
+}
+
+template <class Cap, class Term, class Flow, class Index, class Data>
+std::tuple<Flow, double, double, uint16_t> bench_reimpls_parallel_pr(BenchConfig config, const Data& data)
+{
+    if (!std::is_integral<Cap>::value) {
+        throw std::runtime_error("Only integer caps are supported for ppr");
+    }
+    auto build_begin = now();
+    reimpls::ParallelPushRelabel<Cap, Flow, Index, Index> graph(data.num_nodes, data.neighbor_arcs.size());
 
     for (const auto& tarc : data.terminal_arcs) {
-        graph.add_edge(0, tarc.node + 2, tarc.source_cap, 0);
-        graph.add_edge(tarc.node + 2, 1, tarc.sink_cap, 0);
+        graph.add_tweights(tarc.node, tarc.source_cap, tarc.sink_cap);
     }
     for (const auto& narc : data.neighbor_arcs) {
-        graph.add_edge(narc.i + 2, narc.j + 2, narc.cap, narc.rev_cap);
+        graph.add_edge(narc.i, narc.j, narc.cap, narc.rev_cap);
     }
     Duration build_dur = now() - build_begin;
 
     graph.set_num_threads(config.num_threads);
 
+    start_solve_counters();
+
     auto solve_begin = now();
     graph.mincut();
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
+
+    Flow flow = graph.get_flow();
+    return std::make_tuple(flow, build_dur.count(), solve_dur.count(), data.num_nodes);
+}
 
-    return std::make_tuple(graph.get_flow(), build_dur.count(), solve_dur.count(), data.num_nodes);*/
+template <class Cap, class Term, class Flow, class Index, class Data>
+std::tuple<Flow, double, double, uint16_t> bench_parallel_pr(
+    BenchConfig config, const Data& data, std::vector<uint16_t> node_blocks, uint16_t num_blocks)
+{
+    // The sppr code is hard-wired to int for both capacities and node numbers
+    if (!std::is_same<Cap, int32_t>::value || sizeof(Index) > sizeof(int32_t)) {
+        return bench_reimpls_parallel_pr<Cap, Term, Flow, Index, Data>(config, data);
+    }
 
     auto build_begin = now();
 
@@ -774,15 +1053,18 @@ std::tuple<Flow, double, double, uint16_t> bench_parallel_pr(
 
     Duration build_dur = now() - build_begin;
 
+    start_solve_counters();
+
     auto solve_begin = now();
     flow += maxFlow();
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
 
     return std::make_tuple(flow, build_dur.count(), solve_dur.count(), data.num_nodes);
 }
 
-template <class Cap, class Term, class Flow, class Index, class Data>
-std::tuple<Flow, double, double, uint16_t> bench_parallel_sk(
+template <class Cap, class Term, class Flow, class Index, class Data, class BlockSolver>
+std::tuple<Flow, double, double, uint16_t> bench_parallel_sk_impl(
     BenchConfig config, const Data& data, std::vector<uint16_t> node_blocks, uint16_t num_blocks)
 {
     if (node_blocks.size() < data.num_nodes) {
@@ -823,7 +1105,7 @@ std::tuple<Flow, double, double, uint16_t> bench_parallel_sk(
 
     auto build_begin = now();
     size_t edges_per_block = data.neighbor_arcs.size() / config.num_threads;
-    reimpls::ParallelSkGraph<Cap, Term, Flow, typename std::make_signed<Index>::type> graph(
+    reimpls::ParallelSkGraph<Cap, Term, Flow, typename std::make_signed<Index>::type, BlockSolver> graph(
         data.num_nodes, edges_per_block + edges_per_block / 5);
     graph.add_node(data.num_nodes);
 
@@ -852,13 +1134,33 @@ std::tuple<Flow, double, double, uint16_t> bench_parallel_sk(
 
     Duration build_dur = now() - build_begin;
 
+    start_solve_counters();
+
     auto solve_begin = now();
     auto flow = graph.maxflow() / 2;
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
 
     return std::make_tuple(flow, build_dur.count(), solve_dur.count(), config.num_threads);
 }
 
+template <class Cap, class Term, class Flow, class Index, class Data>
+std::tuple<Flow, double, double, uint16_t> bench_parallel_sk(
+    BenchConfig config, const Data& data, std::vector<uint16_t> node_blocks, uint16_t num_blocks)
+{
+    switch (block_solver) {
+    case BLOCK_SOLVER_MBK_R:
+        return bench_parallel_sk_impl<Cap, Term, Flow, Index, Data, reimpls::MbkrBlockSolver<Cap, Term, Flow>>(
+            config, data, node_blocks, num_blocks);
+    case BLOCK_SOLVER_EIBFS_I:
+        return bench_parallel_sk_impl<Cap, Term, Flow, Index, Data, reimpls::EibfsBlockSolver<Cap, Term, Flow>>(
+            config, data, node_blocks, num_blocks);
+    default:
+        return bench_parallel_sk_impl<Cap, Term, Flow, Index, Data, reimpls::MbkBlockSolver<Cap, Term, Flow>>(
+            config, data, node_blocks, num_blocks);
+    }
+}
+
 template <class Cap, class Term, class Flow, class Index, class Data>
 std::tuple<Flow, double, double, uint16_t> bench_parallel_rd(
     BenchConfig config, const Data& data, std::vector<uint16_t> node_blocks, uint16_t num_blocks)
@@ -946,12 +1248,20 @@ std::tuple<Flow, double, double, uint16_t> bench_parallel_eibfs(
     BenchConfig config, const Data& data, std::vector<uint16_t> node_blocks, uint16_t num_blocks)
 {
     using Ibfs = reimpls::ParallelIbfs<Cap, Term, Flow>;
+    if (tail_pairs > 0 && !std::is_integral<Cap>::value) {
+        throw std::runtime_error("Only integer caps are supported for tail_pairs");
+    }
+    if (block_policy == reimpls::BLOCK_POLICY_ADAPTIVE) {
+        num_blocks = split_heavy_blocks(node_blocks, num_blocks);
+    }
     auto block_intervals = split_block_intervals(node_blocks);
 
     // Build graph.
     auto build_begin = now();
     Ibfs graph(data.num_nodes, data.neighbor_arcs.size());
     graph.setNumThreads(config.num_threads);
+    graph.setBlockPolicy(block_policy);
+    graph.setTailPairs(tail_pairs);
 
     Index added_nodes = 0;
     for (const auto& itv : block_intervals) {
@@ -964,6 +1274,7 @@ std::tuple<Flow, double, double, uint16_t> bench_parallel_eibfs(
         for (const auto& itv : block_intervals) {
             // itv = { interval_length, block_index }
             graph.registerNodes(added_nodes, added_nodes + itv.first, itv.second);
+            added_nodes += itv.first;
         }
     }
 
@@ -977,9 +1288,19 @@ std::tuple<Flow, double, double, uint16_t> bench_parallel_eibfs(
     Duration build_dur = now() - build_begin;
 
     // Solve graph.
+    start_solve_counters();
     auto solve_begin = now();
     auto flow = graph.computeMaxFlow();
     Duration solve_dur = now() - solve_begin;
+    stop_solve_counters();
+
+    init_time = graph.init_dur.count();
+    phase1_time = graph.ph1_dur.count();
+    boundary_time = graph.bs_dur.count();
+    phase2_time = graph.ph2_dur.count();
+    tail_time = graph.tail_dur.count();
+    phase1_imbalance = reimpls::load_imbalance(graph.ph1_busy);
+    phase2_imbalance = reimpls::load_imbalance(graph.ph2_busy);
 
     return std::make_tuple(flow, build_dur.count(), solve_dur.count(), num_blocks);
 }
@@ -1005,24 +1326,24 @@ std::tuple<Flow, double, double, uint16_t> bench_parallel_gridcut(
 
     // Prepare arrays with neighbor capacities
     std::array<std::array<std::array<std::vector<Cap>, 3>, 3>, 3> nbor_cap_arrays;
-    switch (data_config.grid_type)
-    {
-    case GRID_TYPE_2D_4C:
-        nbor_cap_arrays[1][0][0].resize(data.num_nodes, 0);
-        nbor_cap_arrays[1][2][0].resize(data.num_nodes, 0);
-        nbor_cap_arrays[0][1][0].resize(data.num_nodes, 0);
-        nbor_cap_arrays[2][1][0].resize(data.num_nodes, 0);
-        break;
-    case GRID_TYPE_3D_6C:
-        nbor_cap_arrays[1][1][0].resize(data.num_nodes, 0);
-        nbor_cap_arrays[1][1][2].resize(data.num_nodes, 0);
-        nbor_cap_arrays[1][0][1].resize(data.num_nodes, 0);
-        nbor_cap_arrays[1][2][1].resize(data.num_nodes, 0);
-        nbor_cap_arrays[0][1][1].resize(data.num_nodes, 0);
-        nbor_cap_arrays[2][1][1].resize(data.num_nodes, 0);
-        break;
+    switch (data_config.grid_type)
+    {
+    case GRID_TYPE_2D_4C:
+        nbor_cap_arrays[1][0][0].resize(data.num_nodes, 0);
+        nbor_cap_arrays[1][2][0].resize(data.num_nodes, 0);
+        nbor_cap_arrays[0][1][0].resize(data.num_nodes, 0);
+        nbor_cap_arrays[2][1][0].resize(data.num_nodes, 0);
+        break;
+    case GRID_TYPE_3D_6C:
+        nbor_cap_arrays[1][1][0].resize(data.num_nodes, 0);
+        nbor_cap_arrays[1][1][2].resize(data.num_nodes, 0);
+        nbor_cap_arrays[1][0][1].resize(data.num_nodes, 0);
+        nbor_cap_arrays[1][2][1].resize(data.num_nodes, 0);
+        nbor_cap_arrays[0][1][1].resize(data.num_nodes, 0);
+        nbor_cap_arrays[2][1][1].resize(data.num_nodes, 0);
+        break;
     default:
-        throw std::invalid_argument("Parallel GridCut cannot handle grid type");
+        throw std::invalid_argument("Parallel GridCut cannot handle grid type");
     }
 
     for (const auto& narc : data.neighbor_arcs) {
@@ -1102,10 +1423,13 @@ std::tuple<Flow, double, double, uint16_t> bench_parallel_gridcut(
         );
         build_dur = now() - build_begin;
 
+        start_solve_counters();
+
         auto solve_begin = now();
         graph.compute_maxflow();
         flow = graph.get_flow();
         solve_dur = now() - solve_begin;
+        stop_solve_counters();
     } else if (data_config.grid_type == GRID_TYPE_3D_6C) {
         auto build_begin = now();
         GridGraph_3D_6C_MT<Term, Cap, Flow> graph(width, height, depth, config.num_threads, block_size);
@@ -1121,10 +1445,13 @@ std::tuple<Flow, double, double, uint16_t> bench_parallel_gridcut(
         );
         build_dur = now() - build_begin;
 
+        start_solve_counters();
+
         auto solve_begin = now();
         graph.compute_maxflow();
         flow = graph.get_flow();
         solve_dur = now() - solve_begin;
+        stop_solve_counters();
     }
 
     return std::make_tuple(flow, build_dur.count(), solve_dur.count(), used_blocks);
@@ -1148,10 +1475,27 @@ void print_config_header()
     std::cout << "algorithm,";
     std::cout << "number_of_runs,";
     std::cout << "num_threads,";
+    std::cout << "reorder,";
+    std::cout << "reorder_time,";
     std::cout << "num_blocks,";
     std::cout << "build_time,";
     std::cout << "solve_time,";
-    std::cout << "maxflow" << std::endl;
+    std::cout << "maxflow";
+    if (dynamic_columns) {
+        std::cout << ",dynamic_solve,num_steps,step_p50,step_p90,step_p99,step_max";
+    }
+    if (recover_flow_threads > 0) {
+        std::cout << ",recover_time";
+    }
+    if (phase_columns) {
+        std::cout << ",init_time,phase1_time,boundary_time,phase2_time,tail_time,phase1_imbalance,phase2_imbalance";
+    }
+    if (solve_counters) {
+        for (int e = 0; e < PERF_NUM_EVENTS; ++e) {
+            std::cout << "," << PerfCounters::event_name(static_cast<PerfEvent>(e));
+        }
+    }
+    std::cout << std::endl;
 }
 
 void print_data_config_values(DataConfig config)
@@ -1180,115 +1524,469 @@ void print_bench_config_values(BenchConfig config)
     std::cout << algo_to_string(config.algo) << ",";
     std::cout << config.num_run << ",";
     std::cout << config.num_threads << ",";
+    std::cout << reorder_to_string(config.reorder) << ",";
     std::cout << std::flush;
 }
 
 template <class Cap, class Term, class Flow>
-void print_results(double build_time, double solve_time, Flow maxflow)
+void print_results(double build_time, double solve_time, Flow maxflow, const StepStats *steps = nullptr)
 {
     std::cout << build_time << ",";
     std::cout << solve_time << ",";
-    std::cout << maxflow << std::endl;
+    std::cout << maxflow;
+    if (dynamic_columns) {
+        if (steps != nullptr) {
+            std::cout << "," << dynamic_solve_to_string(steps->solve);
+            std::cout << "," << steps->num_steps;
+            std::cout << "," << steps->p50 << "," << steps->p90 << "," << steps->p99 << "," << steps->max;
+        } else {
+            std::cout << ",none,0,0,0,0,0";
+        }
+    }
+    if (recover_flow_threads > 0) {
+        std::cout << "," << recover_time;
+    }
+    if (phase_columns) {
+        std::cout << "," << init_time << "," << phase1_time << "," << boundary_time << "," << phase2_time;
+        std::cout << "," << tail_time;
+        std::cout << "," << phase1_imbalance << "," << phase2_imbalance;
+    }
+    if (solve_counters) {
+        for (int e = 0; e < PERF_NUM_EVENTS; ++e) {
+            std::cout << "," << solve_counters->count(static_cast<PerfEvent>(e));
+        }
+    }
+    std::cout << std::endl;
+}
+
+template <class Data>
+NodeOrder make_node_order(
+    ReorderType reorder, const DataConfig& data_config, const Data& data, const std::vector<uint16_t>& node_blocks)
+{
+    switch (reorder) {
+    case REORDER_BFS:
+        return bfs_order(data);
+    case REORDER_MORTON:
+    case REORDER_HILBERT:
+        if (data.num_nodes != data_config.grid_width * data_config.grid_height * data_config.grid_depth) {
+            throw std::runtime_error("Grid size does not match number of nodes.");
+        }
+        if (reorder == REORDER_MORTON) {
+            return morton_order(data_config.grid_width, data_config.grid_height, data_config.grid_depth);
+        } else {
+            return hilbert_order(data_config.grid_width, data_config.grid_height, data_config.grid_depth);
+        }
+    case REORDER_BLOCK:
+        return block_order(node_blocks, data.num_nodes);
+    default:
+        throw std::runtime_error("Unsupported node order.");
+    }
+}
+
+template <class Cap, class Term, class Data>
+bool capacities_fit(const Data& data)
+{
+    // The residual capacity of an arc can grow to the sum of its own and its sister's capacity
+    const double max_cap = std::numeric_limits<Cap>::max();
+    const double max_term = std::numeric_limits<Term>::max();
+    for (const auto& narc : data.neighbor_arcs) {
+        if (double(narc.cap) + double(narc.rev_cap) > max_cap) {
+            return false;
+        }
+    }
+    for (const auto& tarc : data.terminal_arcs) {
+        if (double(tarc.source_cap) > max_term || double(tarc.sink_cap) > max_term) {
+            return false;
+        }
+    }
+    return true;
 }
 
 template <class Cap, class Term, class Flow, class Index, class Data>
-void bench_data(DataConfig data_config, BenchConfig bench_config, const Data& data)
+std::tuple<Flow, double, double, uint16_t> run_algo(const DataConfig& data_config, const BenchConfig& bench_config,
+    const Data& data, const std::vector<uint16_t>& node_blocks, uint16_t num_blocks)
 {
     Flow flow;
     double build_time, solve_time;
+    uint16_t used_blocks = 1;
+    switch (bench_config.algo) {
+    // Serial algorithms
+    case ALGO_BK:
+        std::tie(flow, build_time, solve_time) = bench_bk<Cap, Term, Flow, Index, Data>(bench_config, data);
+        break;
+    case ALGO_NBK:
+        std::tie(flow, build_time, solve_time) = bench_nbk<Cap, Term, Flow, Index, Data>(bench_config, data);
+        break;
+    case ALGO_MBK:
+        std::tie(flow, build_time, solve_time) = bench_mbk<Cap, Term, Flow, Index, Data>(bench_config, data);
+        break;
+    case ALGO_MBK2:
+        std::tie(flow, build_time, solve_time) = bench_mbk2<Cap, Term, Flow, Index, Data>(bench_config, data);
+        break;
+    case ALGO_MBK_PF:
+        std::tie(flow, build_time, solve_time) = bench_mbk<Cap, Term, Flow, Index, Data, true>(bench_config, data);
+        break;
+    case ALGO_MBK2_PF:
+        std::tie(flow, build_time, solve_time) = bench_mbk2<Cap, Term, Flow, Index, Data, true>(bench_config, data);
+        break;
+    case ALGO_EIBFS:
+        std::tie(flow, build_time, solve_time) = bench_eibfs<Cap, Term, Flow, Index, Data>(bench_config, data);
+        break;
+    case ALGO_EIBFS2:
+        std::tie(flow, build_time, solve_time) = bench_eibfs2<Cap, Term, Flow, Index, Data>(bench_config, data);
+        break;
+    case ALGO_EIBFS_OLD:
+        std::tie(flow, build_time, solve_time) = bench_eibfs_old<Cap, Term, Flow, Index, Data>(bench_config, data);
+        break;
+    case ALGO_HPF: // Fall through to default HPF config
+    case ALGO_HPF_HF:
+        std::tie(flow, build_time, solve_time) = bench_hpf<Cap, Term, Flow, Index, Data, reimpls::LabelOrder::HIGHEST_FIRST, reimpls::RootOrder::FIFO>(bench_config, data);
+        break;
+    case ALGO_HPF_HL:
+        std::tie(flow, build_time, solve_time) = bench_hpf<Cap, Term, Flow, Index, Data, reimpls::LabelOrder::HIGHEST_FIRST, reimpls::RootOrder::LIFO>(bench_config, data);
+        break;
+    case ALGO_HPF_LF:
+        std::tie(flow, build_time, solve_time) = bench_hpf<Cap, Term, Flow, Index, Data, reimpls::LabelOrder::LOWEST_FIRST, reimpls::RootOrder::FIFO>(bench_config, data);
+        break;
+    case ALGO_HPF_LL:
+        std::tie(flow, build_time, solve_time) = bench_hpf<Cap, Term, Flow, Index, Data, reimpls::LabelOrder::LOWEST_FIRST, reimpls::RootOrder::LIFO>(bench_config, data);
+        break;
+    case ALGO_HPF_I: // Fall through to default HPF config
+    case ALGO_HPF_I_HF:
+        std::tie(flow, build_time, solve_time) = bench_hpf_i<Cap, Term, Flow, Index, Data, reimpls::LabelOrder::HIGHEST_FIRST, reimpls::RootOrder::FIFO>(bench_config, data);
+        break;
+    case ALGO_HPF_I_HL:
+        std::tie(flow, build_time, solve_time) = bench_hpf_i<Cap, Term, Flow, Index, Data, reimpls::LabelOrder::HIGHEST_FIRST, reimpls::RootOrder::LIFO>(bench_config, data);
+        break;
+    case ALGO_HPF_I_LF:
+        std::tie(flow, build_time, solve_time) = bench_hpf_i<Cap, Term, Flow, Index, Data, reimpls::LabelOrder::LOWEST_FIRST, reimpls::RootOrder::FIFO>(bench_config, data);
+        break;
+    case ALGO_HPF_I_LL:
+        std::tie(flow, build_time, solve_time) = bench_hpf_i<Cap, Term, Flow, Index, Data, reimpls::LabelOrder::LOWEST_FIRST, reimpls::RootOrder::LIFO>(bench_config, data);
+        break;
+    case ALGO_HI_PR:
+        std::tie(flow, build_time, solve_time) = bench_hi_pr<Cap, Term, Flow, Index, Data>(bench_config, data);
+        break;
+    case ALGO_GRIDCUT:
+        std::tie(flow, build_time, solve_time) = bench_gridcut<Cap, Term, Flow, Index, Data>(bench_config, data, data_config);
+        break;
+    // Parallel algorithms
+    case ALGO_PMBK:
+        std::tie(flow, build_time, solve_time, used_blocks) = bench_parallel_mbk<Cap, Term, Flow, Index, Data>(bench_config, data, node_blocks, num_blocks);
+        break;
+    case ALGO_PPR:
+        std::tie(flow, build_time, solve_time, used_blocks) = bench_parallel_pr<Cap, Term, Flow, Index, Data>(bench_config, data, node_blocks, num_blocks);
+        break;
+    case ALGO_PPR_I:
+        std::tie(flow, build_time, solve_time, used_blocks) = bench_reimpls_parallel_pr<Cap, Term, Flow, Index, Data>(bench_config, data);
+        break;
+    case ALGO_PSK:
+        std::tie(flow, build_time, solve_time, used_blocks) = bench_parallel_sk<Cap, Term, Flow, Index, Data>(bench_config, data, node_blocks, num_blocks);
+        break;
+    case ALGO_PARD:
+        std::tie(flow, build_time, solve_time, used_blocks) = bench_parallel_rd<Cap, Term, Flow, Index, Data>(bench_config, data, node_blocks, num_blocks);
+        break;
+    case ALGO_PEIBFS:
+        std::tie(flow, build_time, solve_time, used_blocks) = bench_parallel_eibfs<Cap, Term, Flow, Index, Data>(bench_config, data, node_blocks, num_blocks);
+        break;
+    case ALGO_GRIDCUT_MT:
+        std::tie(flow, build_time, solve_time, used_blocks) = bench_parallel_gridcut<Cap, Term, Flow, Index, Data>(bench_config, data, data_config, node_blocks, num_blocks);
+        break;
+    // Dummy and default
+    case ALGO_DUMMY:
+        flow = 0;
+        build_time = 0;
+        solve_time = 0;
+        break;
+    default:
+        throw std::runtime_error("Unsupported algorithm.");
+    }
+    return std::make_tuple(flow, build_time, solve_time, used_blocks);
+}
+
+template <class Cap, class Term, class Flow, class Index, class Data>
+void bench_data(DataConfig data_config, BenchConfig bench_config, const Data& original_data)
+{
+    // Algorithms with explicit terminal arcs store terminal capacities as Cap instead of Term
+    bool fits = algo_has_term_arcs(bench_config.algo) ?
+        capacities_fit<Cap, Cap>(original_data) : capacities_fit<Cap, Term>(original_data);
+    if (!fits) {
+        std::cerr << "    (SKIPPING: capacities do not fit in " << typeid(Cap).name() << ")" << std::endl;
+        return;
+    }
 
     uint16_t num_blocks = 1;
     std::vector<uint16_t> node_blocks;
-    if (algo_is_parallel(bench_config.algo)) {
-        // Algorithms is parallel so try to load a block file
+    if (algo_is_parallel(bench_config.algo) || bench_config.reorder == REORDER_BLOCK) {
+        // Algorithms is parallel or we order by blocks so try to load a block file
         std::tie(node_blocks, num_blocks) = read_blocks(data_config.file_name + ".blk");
     }
 
+    // Renumber nodes before benchmarking. This is a one-off preprocessing step so it is timed separately.
+    Data reordered_data;
+    double reorder_time = 0;
+    if (bench_config.reorder != REORDER_NONE) {
+        auto reorder_begin = now();
+        NodeOrder order = make_node_order(bench_config.reorder, data_config, original_data, node_blocks);
+        reordered_data = relabel_graph(original_data, order);
+        if (!node_blocks.empty()) {
+            // Blocks must follow their nodes. Data may be a .bq file so we expand the repeated blocks first.
+            std::vector<uint16_t> all_blocks(original_data.num_nodes);
+            for (size_t i = 0; i < all_blocks.size(); ++i) {
+                all_blocks[i] = node_blocks[i % node_blocks.size()];
+            }
+            node_blocks = order.to_reordered(all_blocks);
+        }
+        Duration reorder_dur = now() - reorder_begin;
+        reorder_time = reorder_dur.count();
+    }
+    const Data& data = bench_config.reorder != REORDER_NONE ? reordered_data : original_data;
+
     for (size_t i = 0; i < bench_config.num_run; i++) {
         print_data_config_values(data_config);
         print_data_sizes(data);
         print_bench_config_values<Cap, Term, Flow, Index>(bench_config);
+        std::cout << reorder_time << "," << std::flush;
 
+        Flow flow;
+        double build_time, solve_time;
         uint16_t used_blocks;
-        switch (bench_config.algo) {
-        // Serial algorithms
-        case ALGO_BK:
-            std::tie(flow, build_time, solve_time) = bench_bk<Cap, Term, Flow, Index, Data>(bench_config, data);
-            break;
-	    case ALGO_NBK:
-	        std::tie(flow, build_time, solve_time) = bench_nbk<Cap, Term, Flow, Index, Data>(bench_config, data);
-	        break;
-        case ALGO_MBK:
-            std::tie(flow, build_time, solve_time) = bench_mbk<Cap, Term, Flow, Index, Data>(bench_config, data);
-            break;
-        case ALGO_MBK2:
-            std::tie(flow, build_time, solve_time) = bench_mbk2<Cap, Term, Flow, Index, Data>(bench_config, data);
-            break;
-        case ALGO_EIBFS:
-            std::tie(flow, build_time, solve_time) = bench_eibfs<Cap, Term, Flow, Index, Data>(bench_config, data);
-            break;
-        case ALGO_EIBFS2:
-            std::tie(flow, build_time, solve_time) = bench_eibfs2<Cap, Term, Flow, Index, Data>(bench_config, data);
-            break;
-        case ALGO_EIBFS_OLD:
-            std::tie(flow, build_time, solve_time) = bench_eibfs_old<Cap, Term, Flow, Index, Data>(bench_config, data);
-            break;
-        case ALGO_HPF: // Fall through to default HPF config
-        case ALGO_HPF_HF:
-            std::tie(flow, build_time, solve_time) = bench_hpf<Cap, Term, Flow, Index, Data, reimpls::LabelOrder::HIGHEST_FIRST, reimpls::RootOrder::FIFO>(bench_config, data);
-            break;
-        case ALGO_HPF_HL:
-            std::tie(flow, build_time, solve_time) = bench_hpf<Cap, Term, Flow, Index, Data, reimpls::LabelOrder::HIGHEST_FIRST, reimpls::RootOrder::LIFO>(bench_config, data);
-            break;
-        case ALGO_HPF_LF:
-            std::tie(flow, build_time, solve_time) = bench_hpf<Cap, Term, Flow, Index, Data, reimpls::LabelOrder::LOWEST_FIRST, reimpls::RootOrder::FIFO>(bench_config, data);
-            break;
-        case ALGO_HPF_LL:
-            std::tie(flow, build_time, solve_time) = bench_hpf<Cap, Term, Flow, Index, Data, reimpls::LabelOrder::LOWEST_FIRST, reimpls::RootOrder::LIFO>(bench_config, data);
-            break;
-        case ALGO_HI_PR:
-            std::tie(flow, build_time, solve_time) = bench_hi_pr<Cap, Term, Flow, Index, Data>(bench_config, data);
-            break;
-        case ALGO_GRIDCUT:
-            std::tie(flow, build_time, solve_time) = bench_gridcut<Cap, Term, Flow, Index, Data>(bench_config, data, data_config);
-            break;
-        // Parallel algorithms
-        case ALGO_PMBK:
-            std::tie(flow, build_time, solve_time, used_blocks) = bench_parallel_mbk<Cap, Term, Flow, Index, Data>(bench_config, data, node_blocks, num_blocks);
-            break;
-        case ALGO_PPR:
-            std::tie(flow, build_time, solve_time, used_blocks) = bench_parallel_pr<Cap, Term, Flow, Index, Data>(bench_config, data, node_blocks, num_blocks);
-            break;
-        case ALGO_PSK:
-            std::tie(flow, build_time, solve_time, used_blocks) = bench_parallel_sk<Cap, Term, Flow, Index, Data>(bench_config, data, node_blocks, num_blocks);
-            break;
-        case ALGO_PARD:
-            std::tie(flow, build_time, solve_time, used_blocks) = bench_parallel_rd<Cap, Term, Flow, Index, Data>(bench_config, data, node_blocks, num_blocks);
-            break;
-        case ALGO_PEIBFS:
-            std::tie(flow, build_time, solve_time, used_blocks) = bench_parallel_eibfs<Cap, Term, Flow, Index, Data>(bench_config, data, node_blocks, num_blocks);
-            break;
-        case ALGO_GRIDCUT_MT:
-            std::tie(flow, build_time, solve_time, used_blocks) = bench_parallel_gridcut<Cap, Term, Flow, Index, Data>(bench_config, data, data_config, node_blocks, num_blocks);
-            break;
-        // Dummy and default
-        case ALGO_DUMMY:
-            flow = 0;
-            build_time = 0;
-            solve_time = 0;
-            break;
-        default:
-            throw std::runtime_error("Unsupported algorithm.");
-        }
+        recover_time = 0;
+        init_time = phase1_time = boundary_time = phase2_time = tail_time = 0;
+        phase1_imbalance = phase2_imbalance = 0;
+        std::tie(flow, build_time, solve_time, used_blocks) = run_algo<Cap, Term, Flow, Index, Data>(
+            data_config, bench_config, data, node_blocks, num_blocks);
 
         std::cout << used_blocks << "," << std::flush;
 	    print_results<Cap, Term, Flow>(build_time, solve_time, flow);
     }
 }
 
+StepStats make_step_stats(DynamicSolve solve, std::vector<double> step_times)
+{
+    // Nearest-rank percentiles
+    StepStats stats = { solve, step_times.size(), 0, 0, 0, 0 };
+    if (step_times.empty()) {
+        return stats;
+    }
+    std::sort(step_times.begin(), step_times.end());
+    auto percentile = [&](double p) {
+        size_t rank = static_cast<size_t>(std::ceil(p * step_times.size()));
+        return step_times[std::max(rank, size_t(1)) - 1];
+    };
+    stats.p50 = percentile(0.50);
+    stats.p90 = percentile(0.90);
+    stats.p99 = percentile(0.99);
+    stats.max = step_times.back();
+    return stats;
+}
+
+template <class Cap, class Term, class Flow, class Index, class Data>
+std::tuple<Flow, double, double, std::vector<double>> bench_mbk_dynamic(BenchConfig config, const Data& dyn)
+{
+    const auto& base = dyn.base;
+
+    // Build graph.
+    auto build_begin = now();
+    reimpls::Graph<Cap, Term, Flow, Index, Index> graph(base.num_nodes, base.neighbor_arcs.size());
+    graph.add_node(base.num_nodes);
+    for (const auto& tarc : base.terminal_arcs) {
+        graph.add_tweights(tarc.node, tarc.source_cap, tarc.sink_cap);
+    }
+    for (const auto& narc : base.neighbor_arcs) {
+        graph.add_edge(narc.i, narc.j, narc.cap, narc.rev_cap, false);
+    }
+    Duration build_dur = now() - build_begin;
+
+    // Solve base graph.
+    auto solve_begin = now();
+    auto flow = graph.maxflow();
+    Duration solve_dur = now() - solve_begin;
+
+    // Apply each batch and re-solve, reusing the search trees from the previous step.
+    std::vector<double> step_times;
+    step_times.reserve(dyn.batches.size());
+    for (const auto& batch : dyn.batches) {
+        start_solve_counters();
+        auto step_begin = now();
+        for (const auto& tdelta : batch.terminal_deltas) {
+            graph.add_tweights(tdelta.node, tdelta.source_delta, tdelta.sink_delta);
+            graph.mark_node(tdelta.node);
+        }
+        for (const auto& ndelta : batch.neighbor_deltas) {
+            const auto& narc = base.neighbor_arcs[ndelta.arc];
+            graph.update_edge(narc.i, narc.j, ndelta.cap_delta, ndelta.rev_cap_delta);
+            graph.mark_node(narc.i);
+            graph.mark_node(narc.j);
+        }
+        flow = graph.maxflow(true);
+        Duration step_dur = now() - step_begin;
+        stop_solve_counters();
+        step_times.push_back(step_dur.count());
+    }
+
+    return std::make_tuple(flow, build_dur.count(), solve_dur.count(), step_times);
+}
+
+template <class Cap, class Term, class Flow, class Index, class Data>
+std::tuple<Flow, double, double, std::vector<double>> bench_eibfs_dynamic(BenchConfig config, const Data& dyn)
+{
+    using Ibfs = reimpls::IBFSGraph<Cap, Term, Flow, uint32_t, Index>;
+    const auto& base = dyn.base;
+
+    // Build graph.
+    auto build_begin = now();
+    Ibfs graph(base.num_nodes, base.neighbor_arcs.size());
+    for (const auto& tarc : base.terminal_arcs) {
+        graph.addNode(tarc.node, tarc.source_cap, tarc.sink_cap);
+    }
+    for (const auto& narc : base.neighbor_arcs) {
+        graph.addEdge(narc.i, narc.j, narc.cap, narc.rev_cap);
+    }
+    graph.initGraph(config.num_threads);
+    Duration build_dur = now() - build_begin;
+
+    // Solve base graph. Increments must be allowed so the trees are kept for the next step.
+    auto solve_begin = now();
+    auto flow = graph.computeMaxFlow(true);
+    Duration solve_dur = now() - solve_begin;
+
+    // Apply each batch and re-solve incrementally.
+    std::vector<double> step_times;
+    step_times.reserve(dyn.batches.size());
+    for (const auto& batch : dyn.batches) {
+        start_solve_counters();
+        auto step_begin = now();
+        for (const auto& tdelta : batch.terminal_deltas) {
+            graph.incNode(tdelta.node, tdelta.source_delta, tdelta.sink_delta);
+        }
+        for (const auto& ndelta : batch.neighbor_deltas) {
+            const auto& narc = base.neighbor_arcs[ndelta.arc];
+            graph.incEdge(narc.i, narc.j, ndelta.cap_delta, ndelta.rev_cap_delta);
+        }
+        flow = graph.computeMaxFlow(true);
+        Duration step_dur = now() - step_begin;
+        stop_solve_counters();
+        step_times.push_back(step_dur.count());
+    }
+
+    return std::make_tuple(flow, build_dur.count(), solve_dur.count(), step_times);
+}
+
+template <class Cap, class Term, class Flow, class Index, class Data>
+std::tuple<Flow, double, double, std::vector<double>> bench_scratch_dynamic(const DataConfig& data_config,
+    const BenchConfig& bench_config, const Data& dyn, const std::vector<uint16_t>& node_blocks, uint16_t num_blocks)
+{
+    using Graph = decltype(dyn.base);
+
+    // Solve base graph.
+    Flow flow;
+    double build_time, solve_time;
+    std::tie(flow, build_time, solve_time, std::ignore) = run_algo<Cap, Term, Flow, Index, Graph>(
+        data_config, bench_config, dyn.base, node_blocks, num_blocks);
+
+    // Apply each batch to a copy of the graph and solve it from scratch. The time to apply the changes to the
+    // copy is not counted since a from-scratch solver would be handed the updated graph directly.
+    Graph graph = dyn.base;
+    merge_terminal_arcs(graph);
+    std::vector<double> step_times;
+    step_times.reserve(dyn.batches.size());
+    for (const auto& batch : dyn.batches) {
+        apply_delta_batch(graph, batch);
+        double step_build_time, step_solve_time;
+        std::tie(flow, step_build_time, step_solve_time, std::ignore) = run_algo<Cap, Term, Flow, Index, Graph>(
+            data_config, bench_config, graph, node_blocks, num_blocks);
+        step_times.push_back(step_build_time + step_solve_time);
+    }
+
+    return std::make_tuple(flow, build_time, solve_time, step_times);
+}
+
+template <class Cap, class Term, class Flow, class Index, class Data>
+void bench_dynamic_data(DataConfig data_config, BenchConfig bench_config, const Data& dyn)
+{
+    bool fits = algo_has_term_arcs(bench_config.algo) ?
+        capacities_fit<Cap, Cap>(dyn.base) : capacities_fit<Cap, Term>(dyn.base);
+    if (!fits) {
+        std::cerr << "    (SKIPPING: capacities do not fit in " << typeid(Cap).name() << ")" << std::endl;
+        return;
+    }
+    if (bench_config.reorder != REORDER_NONE) {
+        std::cerr << "    (SKIPPING: reordering is not supported for dynamic graphs)" << std::endl;
+        return;
+    }
+
+    uint16_t num_blocks = 1;
+    std::vector<uint16_t> node_blocks;
+    if (algo_is_parallel(bench_config.algo)) {
+        std::tie(node_blocks, num_blocks) = read_blocks(data_config.file_name + ".blk");
+    }
+
+    for (DynamicSolve solve : data_config.dynamic_solves) {
+        if (solve == DYNAMIC_INCREMENTAL && !algo_is_incremental(bench_config.algo)) {
+            std::cerr << "    (SKIPPING incremental: not supported by " << algo_to_string(bench_config.algo) << ")"
+                << std::endl;
+            continue;
+        }
+        for (size_t i = 0; i < bench_config.num_run; i++) {
+            print_data_config_values(data_config);
+            print_data_sizes(dyn.base);
+            print_bench_config_values<Cap, Term, Flow, Index>(bench_config);
+            std::cout << 0 << "," << std::flush;
+
+            Flow flow;
+            double build_time, solve_time;
+            std::vector<double> step_times;
+            uint16_t used_blocks = 1;
+            recover_time = 0;
+            init_time = phase1_time = boundary_time = phase2_time = tail_time = 0;
+            phase1_imbalance = phase2_imbalance = 0;
+            if (solve == DYNAMIC_SCRATCH) {
+                std::tie(flow, build_time, solve_time, step_times) = bench_scratch_dynamic<Cap, Term, Flow, Index>(
+                    data_config, bench_config, dyn, node_blocks, num_blocks);
+                used_blocks = num_blocks;
+            } else if (bench_config.algo == ALGO_MBK) {
+                std::tie(flow, build_time, solve_time, step_times) = bench_mbk_dynamic<Cap, Term, Flow, Index>(
+                    bench_config, dyn);
+            } else {
+                std::tie(flow, build_time, solve_time, step_times) = bench_eibfs_dynamic<Cap, Term, Flow, Index>(
+                    bench_config, dyn);
+            }
+
+            StepStats stats = make_step_stats(solve, step_times);
+            std::cout << used_blocks << "," << std::flush;
+            print_results<Cap, Term, Flow>(build_time, solve_time, flow, &stats);
+        }
+    }
+}
+
+template <class DataCap, class DataTerm>
+void bench_dynamic(DataConfig config, std::vector<BenchConfig> bench_configs)
+{
+    BkDynamicGraph<DataCap, DataTerm> dyn = read_dbk_to_dynamic<DataCap, DataTerm>(config.file_name);
+
+    std::cerr << "Benching " << config.file_name << " (" << dyn.batches.size() << " steps)" << std::endl;
+    for (const auto& bc : bench_configs) {
+        std::cerr << "... " << algo_to_string(bc.algo);
+        if (algo_is_parallel(bc.algo)) {
+            std::cerr << "(" << bc.num_threads << ")";
+        }
+        if (algo_requires_grid(bc.algo) && config.grid_type == GRID_TYPE_NO_GRID) {
+            std::cerr << " (SKIPPING: algo needs grid but data is non-grid)";
+        }
+        std::cerr << std::endl;
+        RUN_BENCH_FUNC(config, bc, dyn, bench_dynamic_data);
+    }
+}
+
 template <class DataCap, class DataTerm>
 void bench(DataConfig config, std::vector<BenchConfig> bench_configs)
 {
+    if (config.file_type == FTYPE_DBK) {
+        bench_dynamic<DataCap, DataTerm>(config, bench_configs);
+        return;
+    }
+
     BkGraph<DataCap, DataTerm> data;
     if (config.file_type == FTYPE_DIMACS) {
         data = read_dimacs_to_bk<DataCap, DataTerm>(config.file_name);
@@ -1304,9 +2002,16 @@ void bench(DataConfig config, std::vector<BenchConfig> bench_configs)
         if (algo_is_parallel(bc.algo)) {
             std::cerr << "(" << bc.num_threads << ")";
         }
+        if (bc.reorder != REORDER_NONE) {
+            std::cerr << " [" << reorder_to_string(bc.reorder) << "]";
+        }
         if (algo_requires_grid(bc.algo) && config.grid_type == GRID_TYPE_NO_GRID) {
             std::cerr << " (SKIPPING: algo needs grid but data is non-grid)";
         }
+        if (reorder_requires_grid(bc.reorder) && config.grid_type == GRID_TYPE_NO_GRID) {
+            std::cerr << " (SKIPPING: reorder needs grid but data is non-grid)" << std::endl;
+            continue;
+        }
         std::cerr << std::endl;
         RUN_BENCH_FUNC(config, bc, data, bench_data);
     }
@@ -1331,6 +2036,27 @@ int main(int argc, const char* argv[])
         std::vector<BenchConfig> bench_configs = gen_bench_configs(config);
         std::vector<DataConfig> data_configs = gen_data_configs(config);
 
+        if (config.value("hw_counters", false)) {
+            solve_counters = std::make_unique<PerfCounters>();
+        }
+        reimpls::set_alloc_policy(alloc_policy_from_string(config.value("alloc", "heap")));
+        reimpls::set_arc_scan(config.value("arc_scan", false));
+        recover_flow_threads = config.value("recover_flow", 0u);
+        reimpls::set_in_place_arcs(config.value("in_place_arcs", size_t(0)));
+        block_solver = block_solver_from_string(config.value("block_solver", "default"));
+        phase_columns = config.value("phase_times", false);
+        block_policy = block_policy_from_string(config.value("block_policy", "fixed"));
+        tail_pairs = config.value("tail_pairs", size_t(0));
+        if (config.value("pin_threads", false)) {
+            // Pin the pool workers but not the main thread, as threads created by other solvers inherit its affinity
+            reimpls::default_thread_pool().set_thread_init([](unsigned int w) {
+                reimpls::pin_thread_to_cpu((w + 1) % std::max(1u, std::thread::hardware_concurrency()));
+            });
+        }
+        for (const auto& dc : data_configs) {
+            dynamic_columns = dynamic_columns || dc.file_type == FTYPE_DBK;
+        }
+
 	    print_config_header();
 
         for (const auto& dc : data_configs) {
@@ -1372,6 +2098,10 @@ const char* algo_to_string(Algorithm algo)
         return "mbk";
     case ALGO_MBK2:
         return "mbk_r";
+    case ALGO_MBK_PF:
+        return "mbk_pf";
+    case ALGO_MBK2_PF:
+        return "mbk_r_pf";
     case ALGO_EIBFS:
         return "eibfs_i";
     case ALGO_EIBFS2:
@@ -1388,6 +2118,16 @@ const char* algo_to_string(Algorithm algo)
         return "hpf_lf";
     case ALGO_HPF_LL:
         return "hpf_ll";
+    case ALGO_HPF_I:
+        return "hpf_i";
+    case ALGO_HPF_I_HF:
+        return "hpf_i_hf";
+    case ALGO_HPF_I_HL:
+        return "hpf_i_hl";
+    case ALGO_HPF_I_LF:
+        return "hpf_i_lf";
+    case ALGO_HPF_I_LL:
+        return "hpf_i_ll";
     case ALGO_HI_PR:
         return "hi_pr";
     case ALGO_GRIDCUT:
@@ -1397,6 +2137,8 @@ const char* algo_to_string(Algorithm algo)
         return "liusun";
     case ALGO_PPR:
         return "ppr";
+    case ALGO_PPR_I:
+        return "ppr_i";
     case ALGO_PSK:
         return "psk";
     case ALGO_PARD:
@@ -1419,6 +2161,8 @@ Algorithm algo_from_string(const std::string& str)
     if (str == algo_to_string(ALGO_NBK)) return ALGO_NBK;
     if (str == algo_to_string(ALGO_MBK)) return ALGO_MBK;
     if (str == algo_to_string(ALGO_MBK2)) return ALGO_MBK2;
+    if (str == algo_to_string(ALGO_MBK_PF)) return ALGO_MBK_PF;
+    if (str == algo_to_string(ALGO_MBK2_PF)) return ALGO_MBK2_PF;
     if (str == algo_to_string(ALGO_EIBFS)) return ALGO_EIBFS;
     if (str == algo_to_string(ALGO_EIBFS2)) return ALGO_EIBFS2;
     if (str == algo_to_string(ALGO_EIBFS_OLD)) return ALGO_EIBFS_OLD;
@@ -1427,11 +2171,17 @@ Algorithm algo_from_string(const std::string& str)
     if (str == algo_to_string(ALGO_HPF_HL)) return ALGO_HPF_HL;
     if (str == algo_to_string(ALGO_HPF_LF)) return ALGO_HPF_LF;
     if (str == algo_to_string(ALGO_HPF_LL)) return ALGO_HPF_LL;
+    if (str == algo_to_string(ALGO_HPF_I)) return ALGO_HPF_I;
+    if (str == algo_to_string(ALGO_HPF_I_HF)) return ALGO_HPF_I_HF;
+    if (str == algo_to_string(ALGO_HPF_I_HL)) return ALGO_HPF_I_HL;
+    if (str == algo_to_string(ALGO_HPF_I_LF)) return ALGO_HPF_I_LF;
+    if (str == algo_to_string(ALGO_HPF_I_LL)) return ALGO_HPF_I_LL;
     if (str == algo_to_string(ALGO_HI_PR)) return ALGO_HI_PR;
     if (str == algo_to_string(ALGO_GRIDCUT)) return ALGO_GRIDCUT;
 
     if (str == algo_to_string(ALGO_PMBK)) return ALGO_PMBK;
     if (str == algo_to_string(ALGO_PPR)) return ALGO_PPR;
+    if (str == algo_to_string(ALGO_PPR_I)) return ALGO_PPR_I;
     if (str == algo_to_string(ALGO_PSK)) return ALGO_PSK;
     if (str == algo_to_string(ALGO_PARD)) return ALGO_PARD;
     if (str == algo_to_string(ALGO_PEIBFS)) return ALGO_PEIBFS;
@@ -1446,25 +2196,26 @@ FileType ftype_from_string(const std::string& str)
     if (str == "dimacs") return FTYPE_DIMACS;
     if (str == "bbk") return FTYPE_BBK;
     if (str == "bq") return FTYPE_BQ;
+    if (str == "dbk") return FTYPE_DBK;
     throw std::invalid_argument("Invalid file type.");
 }
 
 const char* grid_type_to_string(GridType grid_type)
 {
-    switch (grid_type)
-    {
-    case GRID_TYPE_NO_GRID:
-        return "no_grid";
-    case GRID_TYPE_2D_4C:
-        return "2D_4C";
-    case GRID_TYPE_2D_8C:
-        return "2D_8C";
-    case GRID_TYPE_3D_6C:
-        return "3D_6C";
-    case GRID_TYPE_3D_26C:
-        return "3D_26C";
-    default:
-        throw std::invalid_argument("Invalid grid info.");
+    switch (grid_type)
+    {
+    case GRID_TYPE_NO_GRID:
+        return "no_grid";
+    case GRID_TYPE_2D_4C:
+        return "2D_4C";
+    case GRID_TYPE_2D_8C:
+        return "2D_8C";
+    case GRID_TYPE_3D_6C:
+        return "3D_6C";
+    case GRID_TYPE_3D_26C:
+        return "3D_26C";
+    default:
+        throw std::invalid_argument("Invalid grid info.");
     }
 }
 
@@ -1490,26 +2241,146 @@ bool algo_is_parallel(Algorithm algo)
     return 
         algo == ALGO_PMBK || 
         algo == ALGO_PPR || 
+        algo == ALGO_PPR_I || 
         algo == ALGO_PSK || 
         algo == ALGO_PARD || 
         algo == ALGO_PEIBFS ||
         algo == ALGO_GRIDCUT_MT;
 }
 
+bool algo_is_incremental(Algorithm algo)
+{
+    return algo == ALGO_MBK || algo == ALGO_EIBFS;
+}
+
 bool algo_requires_grid(Algorithm algo)
 {
     return algo == ALGO_GRIDCUT || algo == ALGO_GRIDCUT_MT;
 }
 
+bool algo_has_term_arcs(Algorithm algo)
+{
+    return
+        algo == ALGO_HPF ||
+        algo == ALGO_HPF_HF ||
+        algo == ALGO_HPF_HL ||
+        algo == ALGO_HPF_LF ||
+        algo == ALGO_HPF_LL ||
+        algo == ALGO_HPF_I ||
+        algo == ALGO_HPF_I_HF ||
+        algo == ALGO_HPF_I_HL ||
+        algo == ALGO_HPF_I_LF ||
+        algo == ALGO_HPF_I_LL;
+}
+
+const char* reorder_to_string(ReorderType reorder)
+{
+    switch (reorder) {
+    case REORDER_NONE:
+        return "none";
+    case REORDER_BFS:
+        return "bfs";
+    case REORDER_MORTON:
+        return "morton";
+    case REORDER_HILBERT:
+        return "hilbert";
+    case REORDER_BLOCK:
+        return "block";
+    default:
+        throw std::invalid_argument("Invalid reorder.");
+    }
+}
+
+ReorderType reorder_from_string(const std::string& str)
+{
+    if (str == reorder_to_string(REORDER_NONE)) return REORDER_NONE;
+    if (str == reorder_to_string(REORDER_BFS)) return REORDER_BFS;
+    if (str == reorder_to_string(REORDER_MORTON)) return REORDER_MORTON;
+    if (str == reorder_to_string(REORDER_HILBERT)) return REORDER_HILBERT;
+    if (str == reorder_to_string(REORDER_BLOCK)) return REORDER_BLOCK;
+    throw std::invalid_argument("Invalid reorder.");
+}
+
+const char* dynamic_solve_to_string(DynamicSolve solve)
+{
+    switch (solve) {
+    case DYNAMIC_INCREMENTAL:
+        return "incremental";
+    case DYNAMIC_SCRATCH:
+        return "scratch";
+    default:
+        throw std::invalid_argument("Invalid dynamic solve.");
+    }
+}
+
+DynamicSolve dynamic_solve_from_string(const std::string& str)
+{
+    if (str == dynamic_solve_to_string(DYNAMIC_INCREMENTAL)) return DYNAMIC_INCREMENTAL;
+    if (str == dynamic_solve_to_string(DYNAMIC_SCRATCH)) return DYNAMIC_SCRATCH;
+    throw std::invalid_argument("Invalid dynamic solve.");
+}
+
+reimpls::AllocPolicy alloc_policy_from_string(const std::string& str)
+{
+    if (str == "heap") return reimpls::ALLOC_HEAP;
+    if (str == "huge_pages") return reimpls::ALLOC_HUGE_PAGES;
+    if (str == "numa_interleave") return reimpls::ALLOC_NUMA_INTERLEAVE;
+    throw std::invalid_argument("Invalid alloc.");
+}
+
+BlockSolverType block_solver_from_string(const std::string& str)
+{
+    if (str == "default") return BLOCK_SOLVER_DEFAULT;
+    if (str == "mbk") return BLOCK_SOLVER_MBK;
+    if (str == "mbk_r") return BLOCK_SOLVER_MBK_R;
+    if (str == "eibfs_i") return BLOCK_SOLVER_EIBFS_I;
+    throw std::invalid_argument("Invalid block solver.");
+}
+
+reimpls::BlockPolicy block_policy_from_string(const std::string& str)
+{
+    if (str == "fixed") return reimpls::BLOCK_POLICY_FIXED;
+    if (str == "adaptive") return reimpls::BLOCK_POLICY_ADAPTIVE;
+    throw std::invalid_argument("Invalid block policy.");
+}
+
+bool reorder_requires_grid(ReorderType reorder)
+{
+    return reorder == REORDER_MORTON || reorder == REORDER_HILBERT;
+}
+
 std::vector<BenchConfig> gen_bench_configs(json config)
 {
+    std::vector<ReorderType> reorders;
+    if (config.contains("reorder")) {
+        for (auto& reorder : config["reorder"]) {
+            reorders.push_back(reorder_from_string(reorder));
+        }
+    } else {
+        reorders.push_back(REORDER_NONE);
+    }
+
     std::vector<BenchConfig> out;
     for (auto& type_config : config["types"]) {
         for (auto& algo : config["algorithms"]) {
             auto algorithm = algo_from_string(algo);
-            if (algo_is_parallel(algorithm) && config.contains("parallel")) {
-                auto& parallel = config["parallel"];
-                for (auto& threads : parallel["threads"]) {
+            for (auto reorder : reorders) {
+                if (algo_is_parallel(algorithm) && config.contains("parallel")) {
+                    auto& parallel = config["parallel"];
+                    for (auto& threads : parallel["threads"]) {
+                        out.push_back({
+                            config["name"],
+                            code_from_string(type_config["cap"]),
+                            code_from_string(type_config["term"]),
+                            code_from_string(type_config["flow"]),
+                            code_from_string(type_config["index"]),
+                            algorithm,
+                            config["num_run"],
+                            threads.get<int>(),
+                            reorder
+                        });
+                    }
+                } else {
                     out.push_back({
                         config["name"],
                         code_from_string(type_config["cap"]),
@@ -1518,20 +2389,10 @@ std::vector<BenchConfig> gen_bench_configs(json config)
                         code_from_string(type_config["index"]),
                         algorithm,
                         config["num_run"],
-                        threads.get<int>()
+                        1,
+                        reorder
                     });
                 }
-            } else {
-                out.push_back({
-                    config["name"],
-                    code_from_string(type_config["cap"]),
-                    code_from_string(type_config["term"]),
-                    code_from_string(type_config["flow"]),
-                    code_from_string(type_config["index"]),
-                    algorithm,
-                    config["num_run"],
-                    1
-                });
             }
         }
     }
@@ -1557,6 +2418,13 @@ std::vector<DataConfig> gen_data_configs(json config)
         } else {
             data_config.grid_type = GRID_TYPE_NO_GRID;
         }
+        if (data.contains("dynamic_solves")) {
+            for (const auto& solve : data["dynamic_solves"]) {
+                data_config.dynamic_solves.push_back(dynamic_solve_from_string(solve));
+            }
+        } else {
+            data_config.dynamic_solves = { DYNAMIC_INCREMENTAL, DYNAMIC_SCRATCH };
+        }
         out.push_back(data_config);
     }
     return out;
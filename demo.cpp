@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include <chrono>
 #include <stdexcept>
 #include <thread>
@@ -19,8 +20,10 @@
 #include "reimpls/eibfs_i.h"
 #include "reimpls/eibfs_i_nr.h"
 #include "reimpls/parallel_ibfs.h"
+#include "reimpls/parallel_pr.h"
 #include "ibfs/ibfs.h"
 #include "reimpls/hpf.h"
+#include "reimpls/hpf_i.h"
 #include "hi_pr/hi_pr.h"
 #include "reimpls/strandmarkkahl.h"
 
@@ -332,26 +335,21 @@ void bench_pibfs(const BkGraph<capty, tcapty>& bkg)
     std::cout << " seconds, maxflow: " << flow << std::endl;
 }
 
-/*void bench_ppr(const BkGraph<int, int>& bkg)
+void bench_ppr(const BkGraph<int, int>& bkg)
 {
     std::cout << "init... ";
     auto init_begin = now();
-    reimpls::ParallelPushRelabel<int, int> graph(
-        bkg.num_nodes + 2, bkg.neighbor_arcs.size() + bkg.terminal_arcs.size());
-
-    graph.set_source(0);
-    graph.set_sink(1);
+    reimpls::ParallelPushRelabel<int, int> graph(bkg.num_nodes, bkg.neighbor_arcs.size());
     Duration init_dur = now() - init_begin;
     std::cout << init_dur.count() << " seconds\n";
 
     std::cout << "building... ";
     auto build_begin = now();
     for (const auto& tarc : bkg.terminal_arcs) {
-        graph.add_edge(0, tarc.node + 2, tarc.source_cap, 0);
-        graph.add_edge(tarc.node + 2, 1, tarc.sink_cap, 0);
+        graph.add_tweights(tarc.node, tarc.source_cap, tarc.sink_cap);
     }
     for (const auto& narc : bkg.neighbor_arcs) {
-        graph.add_edge(narc.i + 2, narc.j + 2, narc.cap, narc.rev_cap);
+        graph.add_edge(narc.i, narc.j, narc.cap, narc.rev_cap);
     }
     Duration build_dur = now() - build_begin;
     std::cout << build_dur.count() << " seconds\n";
@@ -365,14 +363,14 @@ void bench_pibfs(const BkGraph<capty, tcapty>& bkg)
 
     std::cout << "total: " << (init_dur + build_dur + solve_dur).count();
     std::cout << " seconds, flow: " << graph.get_flow() << "\n";
-}*/
+}
 
 template <class capty>
 void bench_hpf(const BkGraph<capty, capty> bkg)
 {
     auto init_begin = now();
     reimpls::Hpf<int, reimpls::LabelOrder::LOWEST_FIRST, reimpls::RootOrder::FIFO> graph(
-        bkg.num_nodes + 2, bkg.neighbor_arcs.size() + bkg.terminal_arcs.size());
+        bkg.num_nodes + 2, 2 * bkg.neighbor_arcs.size());
     graph.set_source(0);
     graph.set_sink(1);
 
@@ -380,8 +378,43 @@ void bench_hpf(const BkGraph<capty, capty> bkg)
     auto build_begin = now();
     graph.add_node(bkg.num_nodes + 2);
     for (const auto& tarc : bkg.terminal_arcs) {
-        graph.add_edge(0, tarc.node + 2, tarc.source_cap);
-        graph.add_edge(tarc.node + 2, 1, tarc.sink_cap);
+        graph.add_tweights(tarc.node + 2, tarc.source_cap, tarc.sink_cap);
+    }
+    for (const auto& narc : bkg.neighbor_arcs) {
+        if (narc.cap) {
+            graph.add_edge(narc.i + 2, narc.j + 2, narc.cap);
+        }
+        if (narc.rev_cap) {
+            graph.add_edge(narc.j + 2, narc.i + 2, narc.rev_cap);
+        }
+    }
+    Duration build_dur = now() - build_begin;
+    std::cout << build_dur.count() << " seconds\n";
+
+    std::cout << "solving... ";
+    auto solve_begin = now();
+    graph.mincut();
+    Duration solve_dur = now() - solve_begin;
+    std::cout << solve_dur.count() << " seconds\n";
+
+    std::cout << "total: " << (build_dur + solve_dur).count();
+    std::cout << " seconds, flow: " << graph.compute_maxflow() << "\n";
+}
+
+template <class capty>
+void bench_hpf_i(const BkGraph<capty, capty> bkg)
+{
+    auto init_begin = now();
+    reimpls::Hpf2<int, uint32_t, uint32_t, reimpls::LabelOrder::LOWEST_FIRST, reimpls::RootOrder::FIFO> graph(
+        bkg.num_nodes + 2, 2 * bkg.neighbor_arcs.size());
+    graph.set_source(0);
+    graph.set_sink(1);
+
+    std::cout << "building... ";
+    auto build_begin = now();
+    graph.add_node(bkg.num_nodes + 2);
+    for (const auto& tarc : bkg.terminal_arcs) {
+        graph.add_tweights(tarc.node + 2, tarc.source_cap, tarc.sink_cap);
     }
     for (const auto& narc : bkg.neighbor_arcs) {
         if (narc.cap) {
@@ -802,6 +835,160 @@ void bench_gridcut_mt(const BkGraph<capty, tcapty> bkg)
 }
 #endif
 
+template <class capty, class tcapty>
+void bench_ibfs_dynamic(const BkDynamicGraph<capty, tcapty>& dyn)
+{
+    using Ibfs = reimpls::IBFSGraph<int, int, int, uint32_t, uint64_t>;
+    const auto& bkg = dyn.base;
+    std::cout << "building... ";
+    auto build_begin = now();
+    Ibfs graph(bkg.num_nodes, bkg.neighbor_arcs.size());
+    for (const auto& tarc : bkg.terminal_arcs) {
+        graph.addNode(tarc.node, tarc.source_cap, tarc.sink_cap);
+    }
+    for (const auto& narc : bkg.neighbor_arcs) {
+        graph.addEdge(narc.i, narc.j, narc.cap, narc.rev_cap);
+    }
+    graph.initGraph();
+    Duration build_dur = now() - build_begin;
+    std::cout << build_dur.count() << " seconds" << std::endl;
+
+    std::cout << "solving... ";
+    auto solve_begin = now();
+    auto flow = graph.computeMaxFlow(true);
+    Duration solve_dur = now() - solve_begin;
+    std::cout << solve_dur.count() << " seconds, maxflow: " << flow << std::endl;
+
+    std::cout << "replaying " << dyn.batches.size() << " steps... ";
+    Duration total_step_dur(0), max_step_dur(0);
+    for (const auto& batch : dyn.batches) {
+        auto step_begin = now();
+        for (const auto& tdelta : batch.terminal_deltas) {
+            graph.incNode(tdelta.node, tdelta.source_delta, tdelta.sink_delta);
+        }
+        for (const auto& ndelta : batch.neighbor_deltas) {
+            const auto& narc = bkg.neighbor_arcs[ndelta.arc];
+            graph.incEdge(narc.i, narc.j, ndelta.cap_delta, ndelta.rev_cap_delta);
+        }
+        flow = graph.computeMaxFlow(true);
+        Duration step_dur = now() - step_begin;
+        total_step_dur += step_dur;
+        max_step_dur = std::max(max_step_dur, step_dur);
+    }
+    std::cout << total_step_dur.count() << " seconds (max step: " << max_step_dur.count() << " seconds)" << std::endl;
+
+    std::cout << "total: " << (build_dur + solve_dur + total_step_dur).count();
+    std::cout << " seconds, final maxflow: " << flow << std::endl;
+}
+
+template <class capty, class tcapty>
+void bench_mbk_dynamic(const BkDynamicGraph<capty, tcapty>& dyn)
+{
+    const auto& bkg = dyn.base;
+    std::cout << "building... ";
+    auto build_begin = now();
+    reimpls::Graph<int, int, int, uint32_t, uint32_t> graph(bkg.num_nodes, bkg.neighbor_arcs.size());
+    graph.add_node(bkg.num_nodes);
+    for (const auto& tarc : bkg.terminal_arcs) {
+        graph.add_tweights(tarc.node, tarc.source_cap, tarc.sink_cap);
+    }
+    for (const auto& narc : bkg.neighbor_arcs) {
+        graph.add_edge(narc.i, narc.j, narc.cap, narc.rev_cap, false);
+    }
+    Duration build_dur = now() - build_begin;
+    std::cout << build_dur.count() << " seconds" << std::endl;
+
+    std::cout << "solving... ";
+    auto solve_begin = now();
+    auto flow = graph.maxflow();
+    Duration solve_dur = now() - solve_begin;
+    std::cout << solve_dur.count() << " seconds, maxflow: " << flow << std::endl;
+
+    std::cout << "replaying " << dyn.batches.size() << " steps... ";
+    Duration total_step_dur(0), max_step_dur(0);
+    for (const auto& batch : dyn.batches) {
+        auto step_begin = now();
+        for (const auto& tdelta : batch.terminal_deltas) {
+            graph.add_tweights(tdelta.node, tdelta.source_delta, tdelta.sink_delta);
+            graph.mark_node(tdelta.node);
+        }
+        for (const auto& ndelta : batch.neighbor_deltas) {
+            const auto& narc = bkg.neighbor_arcs[ndelta.arc];
+            graph.update_edge(narc.i, narc.j, ndelta.cap_delta, ndelta.rev_cap_delta);
+            graph.mark_node(narc.i);
+            graph.mark_node(narc.j);
+        }
+        flow = graph.maxflow(true);
+        Duration step_dur = now() - step_begin;
+        total_step_dur += step_dur;
+        max_step_dur = std::max(max_step_dur, step_dur);
+    }
+    std::cout << total_step_dur.count() << " seconds (max step: " << max_step_dur.count() << " seconds)" << std::endl;
+
+    std::cout << "total: " << (build_dur + solve_dur + total_step_dur).count();
+    std::cout << " seconds, final maxflow: " << flow << std::endl;
+}
+
+template <class capty, class tcapty>
+void bench_scratch_dynamic(const BkDynamicGraph<capty, tcapty>& dyn)
+{
+    auto solve = [](const BkGraph<capty, tcapty>& bkg) {
+        reimpls::Graph<int, int, int, uint32_t, uint32_t> graph(bkg.num_nodes, bkg.neighbor_arcs.size());
+        graph.add_node(bkg.num_nodes);
+        for (const auto& tarc : bkg.terminal_arcs) {
+            graph.add_tweights(tarc.node, tarc.source_cap, tarc.sink_cap);
+        }
+        for (const auto& narc : bkg.neighbor_arcs) {
+            graph.add_edge(narc.i, narc.j, narc.cap, narc.rev_cap, false);
+        }
+        return graph.maxflow();
+    };
+
+    std::cout << "solving... ";
+    auto solve_begin = now();
+    auto flow = solve(dyn.base);
+    Duration solve_dur = now() - solve_begin;
+    std::cout << solve_dur.count() << " seconds, maxflow: " << flow << std::endl;
+
+    std::cout << "replaying " << dyn.batches.size() << " steps... ";
+    BkGraph<capty, tcapty> bkg = dyn.base;
+    merge_terminal_arcs(bkg);
+    Duration total_step_dur(0), max_step_dur(0);
+    for (const auto& batch : dyn.batches) {
+        apply_delta_batch(bkg, batch);
+        auto step_begin = now();
+        flow = solve(bkg);
+        Duration step_dur = now() - step_begin;
+        total_step_dur += step_dur;
+        max_step_dur = std::max(max_step_dur, step_dur);
+    }
+    std::cout << total_step_dur.count() << " seconds (max step: " << max_step_dur.count() << " seconds)" << std::endl;
+
+    std::cout << "total: " << (solve_dur + total_step_dur).count();
+    std::cout << " seconds, final maxflow: " << flow << std::endl;
+}
+
+void run_dynamic(const std::string& fname, int num_algos, const char* algos[])
+{
+    auto dyn = read_dbk_to_dynamic<int, int>(fname);
+
+    for (int i = 0; i < num_algos; ++i) {
+        std::string algo = algos[i];
+        if (algo == "mbk") {
+            std::cerr << "MBK (reuse trees):" << std::endl;
+            bench_mbk_dynamic(dyn);
+        } else if (algo == "eibfs_i") {
+            std::cerr << "EIBFS new (incremental):" << std::endl;
+            bench_ibfs_dynamic(dyn);
+        } else if (algo == "scratch") {
+            std::cerr << "MBK (from scratch):" << std::endl;
+            bench_scratch_dynamic(dyn);
+        } else {
+            std::cerr << "Unknown algorithm for dynamic graph: " << algo << std::endl;
+        }
+    }
+}
+
 template <class capty, class tcapty>
 BkGraph<capty, tcapty> read_graph(const std::string& fname)
 {
@@ -829,7 +1016,9 @@ int main(int argc, const char* argv[])
         std::cout << "ERROR: must provide problem instance file\n";
         std::cout << "Usage: demo <file> [<algo>...]\n";
         std::cout << "  Benchmark FILE with ALGOs. ALGO must be one of:\n";
-        std::cout << "    bk mbk pmbk eilbfs_old eibfs eibfs2 peibfs ppr hpf hi_pr sk\n";
+        std::cout << "    bk mbk pmbk eilbfs_old eibfs eibfs2 peibfs ppr hpf hpf_i hi_pr sk\n";
+        std::cout << "  If FILE is a dynamic graph (.dbk), ALGO must be one of:\n";
+        std::cout << "    mbk eibfs_i scratch\n";
         return -1;
     } else {
         fname = argv[1];
@@ -837,6 +1026,11 @@ int main(int argc, const char* argv[])
     std::cout << "reading " << fname << "..." << std::endl;
 
     try {
+        if (fname.size() >= 4 && fname.compare(fname.size() - 4, 4, ".dbk") == 0) {
+            run_dynamic(fname, argc - 2, argv + 2);
+            return 0;
+        }
+
         auto bkg = read_graph<int, int>(fname);
 
         for (int i = 0; i < argc - 2; ++i) {
@@ -865,12 +1059,15 @@ int main(int argc, const char* argv[])
             } else if (algo =="peibfs") {
                 std::cerr << "Parallel EIBFS:" << std::endl;
                 bench_pibfs(bkg);
-            } /*else if (algo =="ppr") {
+            } else if (algo =="ppr") {
                 std::cerr << "Parallel PR:" << std::endl;
                 bench_ppr(bkg);
-            } */else if (algo =="hpf") {
+            } else if (algo =="hpf") {
                 std::cerr << "HPF:" << std::endl;
                 bench_hpf(bkg);
+            } else if (algo =="hpf_i") {
+                std::cerr << "HPF new:" << std::endl;
+                bench_hpf_i(bkg);
             } else if (algo =="hi_pr") {
                 std::cerr << "HI_PR:" << std::endl;
                 bench_hi_pr(bkg);
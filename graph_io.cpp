@@ -1,6 +1,8 @@
 #include "graph_io.h"
 #include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <limits>
 
 std::pair<std::vector<uint16_t>, uint16_t> read_blocks(const std::string & fname)
 {
@@ -57,6 +59,49 @@ std::vector<std::pair<size_t, uint16_t>> split_block_intervals(const std::vector
     return intervals;
 }
 
+uint16_t split_heavy_blocks(std::vector<uint16_t>& node_blocks, uint16_t num_blocks)
+{
+    if (node_blocks.empty() || num_blocks == 0) {
+        return num_blocks;
+    }
+    std::vector<size_t> sizes(num_blocks, 0);
+    for (uint16_t block : node_blocks) {
+        if (block >= sizes.size()) {
+            sizes.resize(block + 1, 0);
+        }
+        sizes[block]++;
+    }
+
+    // Decide how many pieces each block is split into. Stop if we run out of block indices.
+    const double mean = static_cast<double>(node_blocks.size()) / sizes.size();
+    std::vector<size_t> pieces(sizes.size(), 1);
+    std::vector<size_t> first_piece(sizes.size(), 0);
+    size_t next_block = sizes.size();
+    for (size_t b = 0; b < sizes.size(); ++b) {
+        if (sizes[b] > 2 * mean) {
+            const size_t num = static_cast<size_t>(std::ceil(sizes[b] / mean));
+            if (next_block + num - 1 > std::numeric_limits<uint16_t>::max()) {
+                break;
+            }
+            pieces[b] = num;
+            first_piece[b] = next_block;
+            next_block += num - 1;
+        }
+    }
+
+    std::vector<size_t> rank(sizes.size(), 0);
+    for (uint16_t& block : node_blocks) {
+        const uint16_t b = block;
+        if (pieces[b] > 1) {
+            const size_t piece = rank[b]++ * pieces[b] / sizes[b];
+            if (piece > 0) {
+                block = static_cast<uint16_t>(first_piece[b] + piece - 1);
+            }
+        }
+    }
+    return static_cast<uint16_t>(next_block);
+}
+
 std::pair<std::vector<std::pair<size_t, uint16_t>>, uint16_t> grid_block_intervals(
     size_t grid_h, size_t grid_w, size_t grid_d, size_t block_h, size_t block_w, size_t block_d)
 {
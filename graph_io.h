@@ -87,6 +87,36 @@ struct BkGraph {
     std::vector<BkTermArc<tcapty>> terminal_arcs;
 };
 
+/** Change of source and sink capacity for given node. */
+template <class Ty>
+struct BkTermDelta {
+    uint64_t node;
+    Ty source_delta;
+    Ty sink_delta;
+};
+
+/** Change of forward and reverse capacity for the neighbor arc with given index in the base graph. */
+template <class Ty>
+struct BkNborDelta {
+    uint64_t arc;
+    Ty cap_delta;
+    Ty rev_cap_delta;
+};
+
+/** Batch of capacity changes which are applied together before re-solving. */
+template <class capty, class tcapty>
+struct BkDeltaBatch {
+    std::vector<BkTermDelta<tcapty>> terminal_deltas;
+    std::vector<BkNborDelta<capty>> neighbor_deltas;
+};
+
+/** BK-like graph which changes over time. Batches of capacity changes are applied in order to the base graph. */
+template <class capty, class tcapty>
+struct BkDynamicGraph {
+    BkGraph<capty, tcapty> base;
+    std::vector<BkDeltaBatch<capty, tcapty>> batches;
+};
+
 /** Unary term */
 template <class Ty>
 struct BkUnaryTerm {
@@ -160,6 +190,13 @@ void write_blocks(const std::string& fname, const std::vector<uint16_t>& node_bl
  */
 std::vector<std::pair<size_t, uint16_t>> split_block_intervals(const std::vector<uint16_t>& node_blocks);
 
+/**
+ * Split blocks with more than twice the mean number of nodes into pieces of about the mean size. The nodes of
+ * a block are split in index order and new blocks get the indices after the existing ones.
+ * Returns the new number of blocks.
+ */
+uint16_t split_heavy_blocks(std::vector<uint16_t>& node_blocks, uint16_t num_blocks);
+
 /**
  * Make intervals of block indices corresponding to box-shaped blocks in a grid graph.
  * Returns vector of (interval length, block index) and max block index.
@@ -389,6 +426,178 @@ void write_bk_to_bbk(const std::string fname, const BkGraph<captype, tcaptype>&
     }
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Dynamic binary BK
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Dynamic binary BK files have the following format:
+ *
+ * Uncompressed
+ * ============
+ * Header: (3 x uint8) 'DBQ'
+ * Types codes: (2 x uint8) captype, tcaptype
+ * Sizes: (4 x uint64) num_nodes, num_terminal_arcs, num_neighbor_arcs, num_batches
+ * Terminal arcs: (num_terminal_arcs x BkTermArc)
+ * Neighbor arcs: (num_neighbor_arcs x BkNborArc)
+ * Batches: (num_batches x Batch)
+ *
+ * Where each Batch is:
+ * Sizes: (2 x uint64) num_terminal_deltas, num_neighbor_deltas
+ * Terminal deltas: (num_terminal_deltas x BkTermDelta)
+ * Neighbor deltas: (num_neighbor_deltas x BkNborDelta)
+ *
+ * Compressed
+ * ==========
+ * Header: (3 x uint8) 'dbq'
+ * Same as uncompressed, except that every list of arcs or deltas is stored as
+ *   (1 x uint64) compressed_bytes
+ *   (compressed_bytes x uint8) compressed list
+ *
+ * Neighbor deltas refer to arcs by their index in the list of neighbor arcs. Capacities must not become negative
+ * after applying a batch, where the terminal capacities of a node are the sum over all its terminal arcs.
+ */
+
+/** Read dynamic binary BK file */
+template <class captype, class tcaptype>
+BkDynamicGraph<captype, tcaptype> read_dbk_to_dynamic(const std::string fname)
+{
+    std::fstream file(fname, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + fname);
+    }
+
+    // Read file header
+    uint8_t header[3] = { 0 };
+    file.read((char *)header, sizeof(header));
+    if (std::strncmp((char *)header, "DBQ", 3) != 0 && std::strncmp((char *)header, "dbq", 3) != 0) {
+        throw std::runtime_error("Invalid file header for dynamic binary BK file.");
+    }
+
+    const bool compressed = std::islower(header[0]);
+
+    // Read graph types and ensure they are correct
+    uint8_t types[2] = { TYPE_INVALID };
+    file.read((char *)types, sizeof(types));
+    if (types[0] != type_code<captype>() || types[1] != type_code<tcaptype>()) {
+        throw std::runtime_error("Types for dynamic binary BK file do not match requested.");
+    }
+
+    // Read graph sizes
+    uint64_t sizes[4] = { 0 };
+    file.read((char *)sizes, sizeof(sizes));
+
+    std::string buffer;
+    auto read_list = [&](auto& vec, uint64_t size) {
+        vec.resize(size);
+        if (compressed) {
+            read_and_decompress(vec.data(), file, buffer);
+        } else {
+            file.read((char *)vec.data(), size * sizeof(vec[0]));
+        }
+    };
+
+    // Read base graph
+    BkDynamicGraph<captype, tcaptype> dyn;
+    dyn.base.num_nodes = sizes[0];
+    read_list(dyn.base.terminal_arcs, sizes[1]);
+    read_list(dyn.base.neighbor_arcs, sizes[2]);
+
+    // Read batches
+    dyn.batches.resize(sizes[3]);
+    for (auto& batch : dyn.batches) {
+        uint64_t batch_sizes[2] = { 0 };
+        file.read((char *)batch_sizes, sizeof(batch_sizes));
+        read_list(batch.terminal_deltas, batch_sizes[0]);
+        read_list(batch.neighbor_deltas, batch_sizes[1]);
+    }
+    if (!file) {
+        throw std::runtime_error("Unexpected end of dynamic binary BK file.");
+    }
+
+    return dyn;
+}
+
+/** Write dynamic binary BK file */
+template <class captype, class tcaptype>
+void write_dynamic_to_dbk(const std::string fname, const BkDynamicGraph<captype, tcaptype>& dyn,
+    bool compress = true)
+{
+    std::fstream file(fname, std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + fname);
+    }
+
+    // Write file header
+    if (compress) {
+        file.write("dbq", 3);
+    } else {
+        file.write("DBQ", 3);
+    }
+
+    // Write graph types and sizes
+    static const uint8_t types[2] = { type_code<captype>(), type_code<tcaptype>() };
+    const uint64_t sizes[4] = {
+        dyn.base.num_nodes, dyn.base.terminal_arcs.size(), dyn.base.neighbor_arcs.size(), dyn.batches.size()
+    };
+    file.write((char *)types, sizeof(types));
+    file.write((char *)sizes, sizeof(sizes));
+
+    std::string buffer;
+    auto write_list = [&](const auto& vec) {
+        if (compress) {
+            compress_and_write(vec, file, buffer);
+        } else {
+            file.write((char *)vec.data(), vec.size() * sizeof(vec[0]));
+        }
+    };
+
+    // Write base graph and batches
+    write_list(dyn.base.terminal_arcs);
+    write_list(dyn.base.neighbor_arcs);
+    for (const auto& batch : dyn.batches) {
+        const uint64_t batch_sizes[2] = { batch.terminal_deltas.size(), batch.neighbor_deltas.size() };
+        file.write((char *)batch_sizes, sizeof(batch_sizes));
+        write_list(batch.terminal_deltas);
+        write_list(batch.neighbor_deltas);
+    }
+}
+
+/**
+ * Sum the terminal arcs of each node into one, such that there is exactly one terminal arc per node and the
+ * arc for node i is at index i.
+ */
+template <class captype, class tcaptype>
+void merge_terminal_arcs(BkGraph<captype, tcaptype>& bkg)
+{
+    std::vector<BkTermArc<tcaptype>> merged(bkg.num_nodes);
+    for (uint64_t i = 0; i < bkg.num_nodes; ++i) {
+        merged[i] = { i, 0, 0 };
+    }
+    for (const auto& tarc : bkg.terminal_arcs) {
+        merged[tarc.node].source_cap += tarc.source_cap;
+        merged[tarc.node].sink_cap += tarc.sink_cap;
+    }
+    bkg.terminal_arcs = std::move(merged);
+}
+
+/** Add capacity changes to graph. Terminal arcs must have been merged with merge_terminal_arcs. */
+template <class captype, class tcaptype>
+void apply_delta_batch(BkGraph<captype, tcaptype>& bkg, const BkDeltaBatch<captype, tcaptype>& batch)
+{
+    assert(bkg.terminal_arcs.size() == bkg.num_nodes);
+    for (const auto& tdelta : batch.terminal_deltas) {
+        auto& tarc = bkg.terminal_arcs[tdelta.node];
+        tarc.source_cap += tdelta.source_delta;
+        tarc.sink_cap += tdelta.sink_delta;
+    }
+    for (const auto& ndelta : batch.neighbor_deltas) {
+        auto& narc = bkg.neighbor_arcs[ndelta.arc];
+        narc.cap += ndelta.cap_delta;
+        narc.rev_cap += ndelta.rev_cap_delta;
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Binary QPBO
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -109,6 +109,36 @@ def _bk_nbor_arc_dtype(cap_type: DTypeLike) -> np.dtype:
     ])
 
 
+BkDynamicGraph = namedtuple('BkDynamicGraph', [
+    'base',
+    'batches',
+])
+
+
+BkDeltaBatch = namedtuple('BkDeltaBatch', [
+    'term_deltas',
+    'nbor_deltas',
+])
+
+
+def _bk_term_delta_dtype(cap_type: DTypeLike) -> np.dtype:
+    """Construct numpy dtype for terminal capacity changes given a capacity type."""
+    return np.dtype([
+        ('node', np.uint64),
+        ('source_delta', cap_type),
+        ('sink_delta', cap_type),
+    ])
+
+
+def _bk_nbor_delta_dtype(cap_type: DTypeLike) -> np.dtype:
+    """Construct numpy dtype for neighbor capacity changes given a capacity type."""
+    return np.dtype([
+        ('arc', np.uint64),
+        ('cap_delta', cap_type),
+        ('rev_cap_delta', cap_type),
+    ])
+
+
 BkQpboHeader = namedtuple('BkQpboHeader', [
     'compressed',
     'captype',
@@ -673,6 +703,114 @@ def write_bqpbo(fname: str, qpbo: BkQpbo, compress: bool = False):
             f.write(compressed_binary)
 
 
+def read_dbk(fname: str) -> BkDynamicGraph:
+    """
+    Read dynamic binary BK file.
+
+    Args:
+        fname: File name of dynamic binary BK file.
+
+    Return:
+        dyn: Base graph and list of capacity change batches as BkDynamicGraph.
+    """
+    with open(fname, 'rb') as f:
+        header = f.read(3).decode()
+        if len(header) != 3 or header.lower() != 'dbq':
+            raise ValueError('file header is invalid')
+
+        compressed = header.islower()
+
+        types_bytes = f.read(2)  # Read type codes (2 * uint8)
+        captype = code_to_type(types_bytes[0])
+        tcaptype = code_to_type(types_bytes[1])
+
+        # Num. nodes, num. term. edges, num. nbor. edges, num. batches
+        sizes_bytes = f.read(4 * 8)
+        sizes = [int.from_bytes(sizes_bytes[i:i+8], sys.byteorder)
+                 for i in range(0, 4 * 8, 8)]
+
+        def read_list(dtype, count):
+            if not compressed:
+                return np.frombuffer(f.read(dtype.itemsize * count),
+                                     dtype=dtype)
+            size = int.from_bytes(f.read(8), sys.byteorder)
+            return np.frombuffer(snappy.uncompress(f.read(size)), dtype=dtype)
+
+        base = BkGraph(
+            num_nodes=sizes[0],
+            term_arcs=read_list(_bk_term_arc_dtype(tcaptype), sizes[1]),
+            nbor_arcs=read_list(_bk_nbor_arc_dtype(captype), sizes[2]),
+        )
+
+        batches = []
+        for _ in range(sizes[3]):
+            batch_sizes_bytes = f.read(2 * 8)
+            batch_sizes = [int.from_bytes(batch_sizes_bytes[i:i+8],
+                                          sys.byteorder) for i in (0, 8)]
+            batches.append(BkDeltaBatch(
+                term_deltas=read_list(_bk_term_delta_dtype(tcaptype),
+                                      batch_sizes[0]),
+                nbor_deltas=read_list(_bk_nbor_delta_dtype(captype),
+                                      batch_sizes[1]),
+            ))
+
+    return BkDynamicGraph(base=base, batches=batches)
+
+
+def write_dbk(fname: str, dyn: BkDynamicGraph, compress: bool = False):
+    """
+    Write dynamic graph to dynamic binary BK file.
+
+    Neighbor deltas refer to arcs by their index in dyn.base.nbor_arcs.
+    Capacities must not become negative after applying a batch.
+
+    Args:
+        fname: Name of dynamic binary BK file to save to.
+        dyn: BkDynamicGraph to save.
+        compress: Whether to use compression when saving.
+    """
+    base = dyn.base
+    captype = base.nbor_arcs['cap'].dtype
+    tcaptype = base.term_arcs['source_cap'].dtype
+    term_delta_type = _bk_term_delta_dtype(tcaptype)
+    nbor_delta_type = _bk_nbor_delta_dtype(captype)
+
+    header = b'dbq' if compress else b'DBQ'
+    with open(fname, 'wb') as f:
+        # Write header
+        f.write(header)
+
+        # Write data types
+        np.uint8(type_to_code(captype)).tofile(f)
+        np.uint8(type_to_code(tcaptype)).tofile(f)
+
+        # Write sizes
+        np.uint64([
+            base.num_nodes,
+            len(base.term_arcs),
+            len(base.nbor_arcs),
+            len(dyn.batches),
+        ]).tofile(f)
+
+        def write_list(arr):
+            if not compress:
+                arr.tofile(f)
+            else:
+                compressed_arr = snappy.compress(arr.tobytes())
+                np.uint64(len(compressed_arr)).tofile(f)
+                f.write(compressed_arr)
+
+        # Write base graph and batches
+        write_list(base.term_arcs)
+        write_list(base.nbor_arcs)
+        for batch in dyn.batches:
+            term_deltas = np.asarray(batch.term_deltas, dtype=term_delta_type)
+            nbor_deltas = np.asarray(batch.nbor_deltas, dtype=nbor_delta_type)
+            np.uint64([len(term_deltas), len(nbor_deltas)]).tofile(f)
+            write_list(term_deltas)
+            write_list(nbor_deltas)
+
+
 def main(argv):
     files = [f for f in os.listdir() if f.endswith('.bbk')]
     print('file_name,num_nodes,num_edges')
@@ -0,0 +1,149 @@
+#ifndef PERF_COUNTERS_H__
+#define PERF_COUNTERS_H__
+
+#include <inttypes.h>
+#include <array>
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/** Hardware events counted by PerfCounters. */
+enum PerfEvent {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_NUM_EVENTS
+};
+
+/**
+ * Hardware performance counters for user space code run by the calling thread and any threads it starts
+ * after construction. Uses perf_event_open on Linux. Counters which can not be opened, e.g. on other
+ * platforms or due to the perf_event_paranoid setting, report -1.
+ */
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    /** Reset and enable all counters. */
+    void start();
+
+    /** Disable all counters. */
+    void stop();
+
+    /** Count for event since the last call to start, or -1 if the counter is not available. */
+    int64_t count(PerfEvent event) const;
+
+    static const char *event_name(PerfEvent event);
+
+private:
+    std::array<int, PERF_NUM_EVENTS> fds;
+};
+
+#ifdef __linux__
+
+inline PerfCounters::PerfCounters()
+{
+    const uint32_t types[PERF_NUM_EVENTS] = {
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HW_CACHE
+    };
+    const uint64_t configs[PERF_NUM_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+    };
+    for (int e = 0; e < PERF_NUM_EVENTS; ++e) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[e];
+        attr.config = configs[e];
+        attr.disabled = 1;
+        attr.inherit = 1; // Also count threads started by the benchmarked algorithm
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fds[e] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+}
+
+inline PerfCounters::~PerfCounters()
+{
+    for (int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+inline void PerfCounters::start()
+{
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+inline void PerfCounters::stop()
+{
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+}
+
+inline int64_t PerfCounters::count(PerfEvent event) const
+{
+    uint64_t value;
+    if (fds[event] < 0 || read(fds[event], &value, sizeof(value)) != sizeof(value)) {
+        return -1;
+    }
+    return static_cast<int64_t>(value);
+}
+
+#else
+
+inline PerfCounters::PerfCounters()
+{
+    fds.fill(-1);
+}
+
+inline PerfCounters::~PerfCounters() {}
+inline void PerfCounters::start() {}
+inline void PerfCounters::stop() {}
+inline int64_t PerfCounters::count(PerfEvent event) const { return -1; }
+
+#endif // __linux__
+
+inline const char *PerfCounters::event_name(PerfEvent event)
+{
+    switch (event) {
+    case PERF_CYCLES:
+        return "cycles";
+    case PERF_INSTRUCTIONS:
+        return "instructions";
+    case PERF_L1D_MISSES:
+        return "l1d_misses";
+    case PERF_LLC_MISSES:
+        return "llc_misses";
+    default:
+        return "unknown";
+    }
+}
+
+#endif // PERF_COUNTERS_H__
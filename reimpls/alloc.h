@@ -0,0 +1,207 @@
+#ifndef REIMPLS_ALLOC_H__
+#define REIMPLS_ALLOC_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#ifdef __linux__
+#include <cstdio>
+#include <cstring>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace reimpls {
+
+// How the large node and arc arrays of the solvers are allocated. The policy is process wide and applies to
+// allocations made after it is set. Memory is always freed the way it was allocated, so the policy may be changed
+// at any time.
+//  - ALLOC_HEAP: Plain malloc.
+//  - ALLOC_HUGE_PAGES: Anonymous mmap backed by 2 MB pages. Explicit huge pages (MAP_HUGETLB) are used if any are
+//    reserved, otherwise the mapping is aligned to 2 MB and marked with madvise(MADV_HUGEPAGE) for transparent
+//    huge pages.
+//  - ALLOC_NUMA_INTERLEAVE: Anonymous mmap with pages interleaved across all online NUMA nodes.
+// Huge pages and NUMA interleave are only available on Linux. Elsewhere, and for allocations smaller than a huge
+// page, the heap is used.
+enum AllocPolicy : int {
+    ALLOC_HEAP,
+    ALLOC_HUGE_PAGES,
+    ALLOC_NUMA_INTERLEAVE
+};
+
+inline std::atomic<AllocPolicy>& alloc_policy_storage()
+{
+    static std::atomic<AllocPolicy> policy(ALLOC_HEAP);
+    return policy;
+}
+
+inline AllocPolicy get_alloc_policy() { return alloc_policy_storage().load(std::memory_order_relaxed); }
+inline void set_alloc_policy(AllocPolicy policy) { alloc_policy_storage().store(policy, std::memory_order_relaxed); }
+
+static constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+// Every allocation starts with a header recording how to free it. The header takes a full cache line so the
+// returned memory keeps the alignment of the underlying allocation.
+static constexpr size_t ALLOC_HEADER_SIZE = 64;
+
+struct AllocHeader {
+    size_t map_size; // 0 if the memory came from malloc
+};
+
+#ifdef __linux__
+
+inline void interleave_memory(void *addr, size_t size)
+{
+    // Parse the list of online nodes, e.g. "0-3,6"
+    constexpr size_t MAX_NODES = 1024;
+    constexpr size_t BITS = 8 * sizeof(unsigned long);
+    unsigned long mask[MAX_NODES / BITS] = { 0 };
+    int num_nodes = 0;
+    std::FILE *file = std::fopen("/sys/devices/system/node/online", "r");
+    if (file == nullptr) {
+        return;
+    }
+    unsigned int first, last;
+    while (std::fscanf(file, "%u", &first) == 1) {
+        last = first;
+        int c = std::fgetc(file);
+        if (c == '-') {
+            if (std::fscanf(file, "%u", &last) != 1) {
+                break;
+            }
+            c = std::fgetc(file);
+        }
+        for (unsigned int n = first; n <= last && n < MAX_NODES; ++n) {
+            mask[n / BITS] |= 1ul << (n % BITS);
+            ++num_nodes;
+        }
+        if (c != ',') {
+            break;
+        }
+    }
+    std::fclose(file);
+
+    if (num_nodes > 1) {
+        // Failure just leaves the default policy in place
+        syscall(SYS_mbind, addr, size, MPOL_INTERLEAVE, mask, MAX_NODES + 1, 0);
+    }
+}
+
+inline void *map_memory(size_t size, AllocPolicy policy)
+{
+    if (policy == ALLOC_HUGE_PAGES) {
+        void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            return ptr;
+        }
+    }
+
+    // Over-allocate by one huge page and trim, so the mapping starts on a huge page boundary. Transparent huge
+    // pages can only back aligned 2 MB ranges.
+    size_t raw_size = size + HUGE_PAGE_SIZE;
+    void *raw = mmap(nullptr, raw_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return nullptr;
+    }
+    char *begin = static_cast<char *>(raw);
+    char *ptr = reinterpret_cast<char *>(
+        (reinterpret_cast<uintptr_t>(begin) + HUGE_PAGE_SIZE - 1) & ~uintptr_t(HUGE_PAGE_SIZE - 1));
+    if (ptr != begin) {
+        munmap(begin, ptr - begin);
+    }
+    size_t tail = (begin + raw_size) - (ptr + size);
+    if (tail > 0) {
+        munmap(ptr + size, tail);
+    }
+
+    if (policy == ALLOC_HUGE_PAGES) {
+        madvise(ptr, size, MADV_HUGEPAGE);
+    } else {
+        interleave_memory(ptr, size);
+    }
+    return ptr;
+}
+
+#endif // __linux__
+
+// Allocate bytes of uninitialized memory according to the current policy. Throws std::bad_alloc on failure.
+inline void *alloc_memory(size_t bytes)
+{
+    size_t size = bytes + ALLOC_HEADER_SIZE;
+    AllocHeader *header = nullptr;
+#ifdef __linux__
+    AllocPolicy policy = get_alloc_policy();
+    if (policy != ALLOC_HEAP && size >= HUGE_PAGE_SIZE) {
+        size_t map_size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        header = static_cast<AllocHeader *>(map_memory(map_size, policy));
+        if (header == nullptr) {
+            throw std::bad_alloc();
+        }
+        header->map_size = map_size;
+        return reinterpret_cast<char *>(header) + ALLOC_HEADER_SIZE;
+    }
+#endif
+    header = static_cast<AllocHeader *>(std::malloc(size));
+    if (header == nullptr) {
+        throw std::bad_alloc();
+    }
+    header->map_size = 0;
+    return reinterpret_cast<char *>(header) + ALLOC_HEADER_SIZE;
+}
+
+// Free memory from alloc_memory. Does nothing for nullptr.
+inline void free_memory(void *ptr) noexcept
+{
+    if (ptr == nullptr) {
+        return;
+    }
+    AllocHeader *header = reinterpret_cast<AllocHeader *>(static_cast<char *>(ptr) - ALLOC_HEADER_SIZE);
+#ifdef __linux__
+    if (header->map_size > 0) {
+        munmap(header, header->map_size);
+        return;
+    }
+#endif
+    std::free(header);
+}
+
+template <class T>
+inline T *alloc_array(size_t n)
+{
+    static_assert(std::is_trivially_destructible<T>::value, "alloc_array does not run destructors");
+    return static_cast<T *>(alloc_memory(n * sizeof(T)));
+}
+
+// Standard allocator which allocates with the current policy
+template <class T>
+class PolicyAllocator {
+public:
+    using value_type = T;
+    using is_always_equal = std::true_type;
+
+    PolicyAllocator() noexcept = default;
+    template <class U>
+    PolicyAllocator(const PolicyAllocator<U>&) noexcept {}
+
+    T *allocate(size_t n) { return static_cast<T *>(alloc_memory(n * sizeof(T))); }
+    void deallocate(T *ptr, size_t) noexcept { free_memory(ptr); }
+};
+
+template <class T, class U>
+inline bool operator==(const PolicyAllocator<T>&, const PolicyAllocator<U>&) noexcept { return true; }
+
+template <class T, class U>
+inline bool operator!=(const PolicyAllocator<T>&, const PolicyAllocator<U>&) noexcept { return false; }
+
+template <class T>
+using PolicyVector = std::vector<T, PolicyAllocator<T>>;
+
+} // namespace reimpls
+
+#endif // REIMPLS_ALLOC_H__
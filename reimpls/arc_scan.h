@@ -0,0 +1,239 @@
+#ifndef REIMPLS_ARC_SCAN_H__
+#define REIMPLS_ARC_SCAN_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// The vector kernels use target attributes and runtime CPU detection, which are only available with GCC and
+// Clang on x86. Define REIMPLS_NO_SIMD to always use the scalar loops.
+#if !defined(REIMPLS_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define REIMPLS_ARC_SCAN_SIMD
+#include <immintrin.h>
+#endif
+
+namespace reimpls {
+
+// How the residual field of an arc is tested
+enum ResidualTest : uint8_t {
+    RESIDUAL_NONZERO, // field != 0
+    RESIDUAL_POSITIVE, // field > 0, field is signed
+    RESIDUAL_ZERO // field == 0, e.g. a saturation flag
+};
+
+// Byte layout of the arc and node fields read by the scan kernels. The residual field can be 1, 2, 4, or 8
+// bytes and must end at least 4 bytes into the arc. Heads are 32 bit node indices and labels are int32.
+struct ArcScanLayout {
+    size_t arc_size;
+    size_t res_offset;
+    size_t res_size;
+    ResidualTest res_test;
+    size_t head_offset;
+    size_t node_size;
+    size_t label_offset;
+};
+
+// Returns the first arc in [begin, end) which is residual and, if nodes is not null, whose head has a label
+// in [lo, hi]. Returns end if there is no such arc.
+using ArcScanFunc = size_t (*)(const ArcScanLayout& layout, const char *arcs, size_t begin, size_t end,
+    const char *nodes, int32_t lo, int32_t hi);
+
+// Below this many arcs the scalar loop is faster than setting up the gathers
+static constexpr size_t ARC_SCAN_MIN_ARCS = 8;
+
+#ifdef REIMPLS_ARC_SCAN_SIMD
+
+__attribute__((target("avx2")))
+inline size_t scan_arcs_avx2(const ArcScanLayout& layout, const char *arcs, size_t begin, size_t end,
+    const char *nodes, int32_t lo, int32_t hi)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i arc_offsets = _mm256_mullo_epi32(lane, _mm256_set1_epi32(int32_t(layout.arc_size)));
+    const __m256i node_size = _mm256_set1_epi64x(int64_t(layout.node_size));
+    const __m256i lo_v = _mm256_set1_epi32(lo);
+    const __m256i hi_v = _mm256_set1_epi32(hi);
+    const bool wide = layout.res_size == 8;
+    // Narrow fields are read as the 4 bytes ending with the field and shifted down
+    const size_t res_read = wide ? layout.res_offset : layout.res_offset + layout.res_size - 4;
+    const __m128i res_shift = _mm_cvtsi32_si128(wide ? 0 : int(32 - 8 * layout.res_size));
+
+    for (size_t ai = begin; ai < end; ai += 8) {
+        const char *block = arcs + ai * layout.arc_size;
+        const __m256i active = end - ai >= 8 ? ones : _mm256_cmpgt_epi32(_mm256_set1_epi32(int32_t(end - ai)), lane);
+
+        __m256i res;
+        if (wide) {
+            const __m256i res_lo = _mm256_mask_i32gather_epi32(
+                zero, (const int *)(block + res_read), arc_offsets, active, 1);
+            const __m256i res_hi = _mm256_mask_i32gather_epi32(
+                zero, (const int *)(block + res_read + 4), arc_offsets, active, 1);
+            const __m256i is_zero = _mm256_cmpeq_epi32(_mm256_or_si256(res_lo, res_hi), zero);
+            if (layout.res_test == RESIDUAL_POSITIVE) {
+                res = _mm256_or_si256(_mm256_cmpgt_epi32(res_hi, zero),
+                    _mm256_andnot_si256(is_zero, _mm256_cmpeq_epi32(res_hi, zero)));
+            } else if (layout.res_test == RESIDUAL_NONZERO) {
+                res = _mm256_xor_si256(is_zero, ones);
+            } else {
+                res = is_zero;
+            }
+        } else {
+            __m256i v = _mm256_mask_i32gather_epi32(zero, (const int *)(block + res_read), arc_offsets, active, 1);
+            if (layout.res_test == RESIDUAL_POSITIVE) {
+                res = _mm256_cmpgt_epi32(_mm256_sra_epi32(v, res_shift), zero);
+            } else {
+                res = _mm256_cmpeq_epi32(_mm256_srl_epi32(v, res_shift), zero);
+                if (layout.res_test == RESIDUAL_NONZERO) {
+                    res = _mm256_xor_si256(res, ones);
+                }
+            }
+        }
+        __m256i cand = _mm256_and_si256(res, active);
+
+        if (nodes != nullptr && !_mm256_testz_si256(cand, cand)) {
+            // Gather the head labels of the residual lanes. Node offsets may not fit in 32 bits.
+            const __m256i heads = _mm256_mask_i32gather_epi32(
+                zero, (const int *)(block + layout.head_offset), arc_offsets, cand, 1);
+            const __m256i offsets_lo = _mm256_mul_epu32(
+                _mm256_cvtepu32_epi64(_mm256_castsi256_si128(heads)), node_size);
+            const __m256i offsets_hi = _mm256_mul_epu32(
+                _mm256_cvtepu32_epi64(_mm256_extracti128_si256(heads, 1)), node_size);
+            const int *labels_base = (const int *)(nodes + layout.label_offset);
+            const __m128i labels_lo = _mm256_mask_i64gather_epi32(
+                _mm_setzero_si128(), labels_base, offsets_lo, _mm256_castsi256_si128(cand), 1);
+            const __m128i labels_hi = _mm256_mask_i64gather_epi32(
+                _mm_setzero_si128(), labels_base, offsets_hi, _mm256_extracti128_si256(cand, 1), 1);
+            const __m256i labels = _mm256_set_m128i(labels_hi, labels_lo);
+            const __m256i outside = _mm256_or_si256(
+                _mm256_cmpgt_epi32(lo_v, labels), _mm256_cmpgt_epi32(labels, hi_v));
+            cand = _mm256_andnot_si256(outside, cand);
+        }
+
+        const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(cand));
+        if (mask != 0) {
+            return ai + __builtin_ctz(mask);
+        }
+    }
+    return end;
+}
+
+__attribute__((target("avx512f")))
+inline size_t scan_arcs_avx512(const ArcScanLayout& layout, const char *arcs, size_t begin, size_t end,
+    const char *nodes, int32_t lo, int32_t hi)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i arc_offsets = _mm512_mullo_epi32(lane, _mm512_set1_epi32(int32_t(layout.arc_size)));
+    const __m512i node_size = _mm512_set1_epi64(int64_t(layout.node_size));
+    const __m512i lo_v = _mm512_set1_epi32(lo);
+    const __m512i hi_v = _mm512_set1_epi32(hi);
+    const bool wide = layout.res_size == 8;
+    // Narrow fields are read as the 4 bytes ending with the field and shifted down
+    const size_t res_read = wide ? layout.res_offset : layout.res_offset + layout.res_size - 4;
+    const __m128i res_shift = _mm_cvtsi32_si128(wide ? 0 : int(32 - 8 * layout.res_size));
+
+    for (size_t ai = begin; ai < end; ai += 16) {
+        const char *block = arcs + ai * layout.arc_size;
+        const __mmask16 active = end - ai >= 16 ? __mmask16(0xFFFF) : __mmask16((1u << (end - ai)) - 1);
+
+        __mmask16 cand;
+        if (wide) {
+            const __m512i res_lo = _mm512_mask_i32gather_epi32(zero, active, arc_offsets, block + res_read, 1);
+            const __m512i res_hi = _mm512_mask_i32gather_epi32(zero, active, arc_offsets, block + res_read + 4, 1);
+            const __mmask16 nonzero = _mm512_mask_test_epi32_mask(active, _mm512_or_si512(res_lo, res_hi),
+                _mm512_or_si512(res_lo, res_hi));
+            if (layout.res_test == RESIDUAL_POSITIVE) {
+                cand = _mm512_mask_cmpgt_epi32_mask(active, res_hi, zero) |
+                    _mm512_mask_cmpeq_epi32_mask(nonzero, res_hi, zero);
+            } else if (layout.res_test == RESIDUAL_NONZERO) {
+                cand = nonzero;
+            } else {
+                cand = active & ~nonzero;
+            }
+        } else {
+            const __m512i v = _mm512_mask_i32gather_epi32(zero, active, arc_offsets, block + res_read, 1);
+            if (layout.res_test == RESIDUAL_POSITIVE) {
+                cand = _mm512_mask_cmpgt_epi32_mask(active, _mm512_sra_epi32(v, res_shift), zero);
+            } else {
+                const __m512i field = _mm512_srl_epi32(v, res_shift);
+                cand = _mm512_mask_test_epi32_mask(active, field, field);
+                if (layout.res_test == RESIDUAL_ZERO) {
+                    cand = active & ~cand;
+                }
+            }
+        }
+
+        if (nodes != nullptr && cand != 0) {
+            // Gather the head labels of the residual lanes. Node offsets may not fit in 32 bits.
+            const __m512i heads = _mm512_mask_i32gather_epi32(zero, cand, arc_offsets, block + layout.head_offset, 1);
+            const __m512i offsets_lo = _mm512_mul_epu32(
+                _mm512_cvtepu32_epi64(_mm512_castsi512_si256(heads)), node_size);
+            const __m512i offsets_hi = _mm512_mul_epu32(
+                _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(heads, 1)), node_size);
+            const char *labels_base = nodes + layout.label_offset;
+            const __m256i labels_lo = _mm512_mask_i64gather_epi32(
+                _mm256_setzero_si256(), __mmask8(cand), offsets_lo, labels_base, 1);
+            const __m256i labels_hi = _mm512_mask_i64gather_epi32(
+                _mm256_setzero_si256(), __mmask8(cand >> 8), offsets_hi, labels_base, 1);
+            const __m512i labels = _mm512_inserti64x4(_mm512_castsi256_si512(labels_lo), labels_hi, 1);
+            cand = _mm512_mask_cmpge_epi32_mask(cand, labels, lo_v);
+            cand = _mm512_mask_cmple_epi32_mask(cand, labels, hi_v);
+        }
+
+        if (cand != 0) {
+            return ai + __builtin_ctz(cand);
+        }
+    }
+    return end;
+}
+
+#endif // REIMPLS_ARC_SCAN_SIMD
+
+inline ArcScanFunc select_arc_scan()
+{
+#ifdef REIMPLS_ARC_SCAN_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return scan_arcs_avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return scan_arcs_avx2;
+    }
+#endif
+    return nullptr;
+}
+
+// Whether solvers constructed from now on use the kernels. Off by default, since gathering fields from the packed
+// arcs can be slower than the scalar loops, e.g. on Intel CPUs with the gather data sampling microcode fix.
+inline std::atomic<bool>& arc_scan_storage()
+{
+    static std::atomic<bool> enabled(false);
+    return enabled;
+}
+
+inline bool get_arc_scan() { return arc_scan_storage().load(std::memory_order_relaxed); }
+inline void set_arc_scan(bool enabled) { arc_scan_storage().store(enabled, std::memory_order_relaxed); }
+
+// Kernel for this CPU or null if there is none or the kernels are disabled. Selected once on first use.
+inline ArcScanFunc arc_scan_func()
+{
+    static const ArcScanFunc func = select_arc_scan();
+    return get_arc_scan() ? func : nullptr;
+}
+
+// Skips the arcs at the start of [begin, end) which fail the test described for ArcScanFunc. All arcs before
+// the returned one fail, but the returned one must still be tested by the caller since begin is returned when
+// there is no kernel or too few arcs.
+inline size_t skip_arcs(ArcScanFunc func, const ArcScanLayout& layout, const void *arcs, size_t begin,
+    size_t end, const void *nodes = nullptr, int32_t lo = 0, int32_t hi = 0)
+{
+    if (func == nullptr || end - begin < ARC_SCAN_MIN_ARCS) {
+        return begin;
+    }
+    return func(layout, (const char *)arcs, begin, end, (const char *)nodes, lo, hi);
+}
+
+} // namespace reimpls
+
+#endif // REIMPLS_ARC_SCAN_H__
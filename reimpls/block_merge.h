@@ -0,0 +1,349 @@
+#ifndef REIMPLS_BLOCK_MERGE_H__
+#define REIMPLS_BLOCK_MERGE_H__
+
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <thread>
+#include <limits>
+#include <stdexcept>
+#include <cinttypes>
+#include <cassert>
+#include <algorithm>
+#include <type_traits>
+
+#include "util.h"
+#include "block_solver.h"
+
+namespace reimpls {
+
+// Bottom-up merging of blocks from Liu & Sun, "Parallel Graph-cuts by Adaptive Bottom-up Merging", 2010, CVPR,
+// with any block solver (see block_solver.h). ParallelGraph (liusun.h) merges blocks in place in one shared BK
+// graph. Here a merged block instead gets a new solver, which is built from the residual graphs of the two
+// blocks and the boundary edges between them. Blocks are merged in rounds. Each round greedily pairs up
+// neighbouring blocks, preferring pairs with many boundary edges between a source and a sink node, and then
+// merges all pairs in parallel.
+template <class Cap, class Term, class Flow, class BlockSolver, class NodeIdx = uint32_t>
+class BlockMergeGraph {
+    static_assert(std::is_integral<NodeIdx>::value, "NodeIdx must be an integer type");
+    static_assert(std::is_signed<Term>::value, "Term must be a signed type");
+
+    using BlockIdx = uint16_t; // We assume 65536 is enough blocks
+    using SolverIdx = typename BlockSolver::NodeIdx;
+
+    // Forward decls.
+    struct Edge;
+    struct Block;
+
+public:
+    BlockMergeGraph(size_t expected_nodes, size_t expected_edges, size_t expected_blocks);
+
+    NodeIdx add_node(size_t num = 1, BlockIdx block = 0);
+
+    void add_tweights(NodeIdx i, Term cap_source, Term cap_sink);
+
+    void add_edge(NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap);
+
+    int what_segment(NodeIdx i) const;
+
+    Flow maxflow();
+
+    inline unsigned int get_num_threads() const noexcept { return num_threads; }
+    inline void set_num_threads(unsigned int num) noexcept { num_threads = num; }
+
+    inline ThreadPool& get_thread_pool() const noexcept { return *pool; }
+    inline void set_thread_pool(ThreadPool& p) noexcept { pool = &p; }
+
+    inline unsigned int get_num_rounds() const noexcept { return num_rounds; }
+
+private:
+    struct Edge {
+        NodeIdx i;
+        NodeIdx j;
+        Cap cap;
+        Cap rev_cap;
+    };
+
+    struct Block {
+        std::unique_ptr<BlockSolver> solver;
+        std::vector<NodeIdx> nodes; // Node with solver index k is nodes[k]
+        std::vector<Edge> edges; // Edges within the block, in solver indices. Cleared once the block is solved.
+        size_t num_edges;
+        Flow flow;
+    };
+
+    std::vector<BlockIdx> node_blocks; // Current block of each node, which changes when blocks are merged
+    std::vector<SolverIdx> node_locals; // Index of each node in the solver of its block
+    std::vector<Term> tr_caps; // Terminal capacities until the base blocks are solved, as in BK
+
+    std::vector<Block> blocks;
+    std::vector<Edge> boundary_edges;
+
+    Flow flow; // Flow from terminal capacities that were added to both source and sink
+
+    unsigned int num_threads;
+    ThreadPool *pool;
+    unsigned int num_rounds;
+
+    void solve_block(BlockIdx b);
+    void merge_blocks(BlockIdx a, BlockIdx b, const std::vector<size_t>& edges);
+};
+
+template <class Cap, class Term, class Flow, class BlockSolver, class NodeIdx>
+BlockMergeGraph<Cap, Term, Flow, BlockSolver, NodeIdx>::BlockMergeGraph(
+    size_t expected_nodes, size_t expected_edges, size_t expected_blocks) :
+    node_blocks(),
+    node_locals(),
+    tr_caps(),
+    blocks(),
+    boundary_edges(),
+    flow(0),
+    num_threads(std::thread::hardware_concurrency()),
+    pool(&default_thread_pool()),
+    num_rounds(0)
+{
+    node_blocks.reserve(expected_nodes);
+    node_locals.reserve(expected_nodes);
+    tr_caps.reserve(expected_nodes);
+    blocks.reserve(expected_blocks);
+}
+
+template <class Cap, class Term, class Flow, class BlockSolver, class NodeIdx>
+inline NodeIdx BlockMergeGraph<Cap, Term, Flow, BlockSolver, NodeIdx>::add_node(size_t num, BlockIdx block)
+{
+    NodeIdx crnt = node_blocks.size();
+
+#ifndef REIMPLS_NO_OVERFLOW_CHECKS
+    if (crnt > std::numeric_limits<NodeIdx>::max() - num) {
+        throw std::overflow_error("Node count exceeds capacity of index type. "
+            "Please increase capacity of NodeIdx type.");
+    }
+#endif
+
+    if (block >= blocks.size()) {
+        // We assume that we always have blocks 0,1,2,...,N
+        blocks.resize(block + 1);
+    }
+    auto& nodes = blocks[block].nodes;
+    for (size_t k = 0; k < num; ++k) {
+        node_blocks.push_back(block);
+        node_locals.push_back(nodes.size());
+        nodes.push_back(crnt + k);
+    }
+    tr_caps.resize(crnt + num, 0);
+    return crnt;
+}
+
+template <class Cap, class Term, class Flow, class BlockSolver, class NodeIdx>
+inline void BlockMergeGraph<Cap, Term, Flow, BlockSolver, NodeIdx>::add_tweights(
+    NodeIdx i, Term cap_source, Term cap_sink)
+{
+    assert(i >= 0 && i < tr_caps.size());
+    Term delta = tr_caps[i];
+    if (delta > 0) {
+        cap_source += delta;
+    } else {
+        cap_sink -= delta;
+    }
+    flow += std::min(cap_source, cap_sink);
+    tr_caps[i] = cap_source - cap_sink;
+}
+
+template <class Cap, class Term, class Flow, class BlockSolver, class NodeIdx>
+inline void BlockMergeGraph<Cap, Term, Flow, BlockSolver, NodeIdx>::add_edge(
+    NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap)
+{
+    assert(i >= 0 && i < node_blocks.size());
+    assert(j >= 0 && j < node_blocks.size());
+    assert(i != j);
+
+    const BlockIdx bi = node_blocks[i];
+    const BlockIdx bj = node_blocks[j];
+    if (bi == bj) {
+        blocks[bi].edges.push_back({ static_cast<NodeIdx>(node_locals[i]), static_cast<NodeIdx>(node_locals[j]),
+            cap, rev_cap });
+    } else {
+        boundary_edges.push_back({ i, j, cap, rev_cap });
+    }
+}
+
+template <class Cap, class Term, class Flow, class BlockSolver, class NodeIdx>
+inline int BlockMergeGraph<Cap, Term, Flow, BlockSolver, NodeIdx>::what_segment(NodeIdx i) const
+{
+    return blocks[node_blocks[i]].solver->what_segment(node_locals[i]);
+}
+
+template <class Cap, class Term, class Flow, class BlockSolver, class NodeIdx>
+inline Flow BlockMergeGraph<Cap, Term, Flow, BlockSolver, NodeIdx>::maxflow()
+{
+    // Solve all base blocks.
+    const size_t num_blocks = blocks.size();
+    parallel_for_each(*pool, num_blocks, num_threads, [&](size_t b) {
+        solve_block(b);
+    });
+
+    // Merge blocks until no boundary edges are left
+    struct Segment {
+        size_t first; // Range of pending
+        size_t last;
+        BlockIdx a;
+        BlockIdx b;
+        size_t potential_activations;
+    };
+
+    std::vector<std::tuple<BlockIdx, BlockIdx, size_t>> pending;
+    pending.reserve(boundary_edges.size());
+    for (size_t e = 0; e < boundary_edges.size(); ++e) {
+        pending.emplace_back(0, 0, e);
+    }
+
+    num_rounds = 0;
+    while (!pending.empty()) {
+        num_rounds++;
+
+        // Sort pending boundary edges by the blocks they connect
+        for (auto& p : pending) {
+            const Edge& e = boundary_edges[std::get<2>(p)];
+            const BlockIdx bi = node_blocks[e.i];
+            const BlockIdx bj = node_blocks[e.j];
+            std::get<0>(p) = std::min(bi, bj);
+            std::get<1>(p) = std::max(bi, bj);
+        }
+        std::sort(pending.begin(), pending.end());
+
+        // Split into segments and count the edges which may carry new flow
+        std::vector<Segment> segments;
+        for (size_t first = 0, last; first < pending.size(); first = last) {
+            Segment seg = { first, first, std::get<0>(pending[first]), std::get<1>(pending[first]), 0 };
+            for (last = first; last < pending.size() &&
+                std::get<0>(pending[last]) == seg.a && std::get<1>(pending[last]) == seg.b; ++last) {
+                const Edge& e = boundary_edges[std::get<2>(pending[last])];
+                if (what_segment(e.i) != what_segment(e.j)) {
+                    seg.potential_activations++;
+                }
+            }
+            seg.last = last;
+            segments.push_back(seg);
+        }
+        std::stable_sort(segments.begin(), segments.end(), [](const Segment& s1, const Segment& s2) {
+            return s1.potential_activations > s2.potential_activations;
+        });
+
+        // Greedily pair up blocks. Edges between unpaired blocks wait for the next round.
+        std::vector<uint8_t> paired(num_blocks, false); // uint8_t to avoid "vector of bool" optim.
+        std::vector<Segment> merges;
+        std::vector<std::tuple<BlockIdx, BlockIdx, size_t>> next_pending;
+        for (const auto& seg : segments) {
+            if (!paired[seg.a] && !paired[seg.b]) {
+                paired[seg.a] = true;
+                paired[seg.b] = true;
+                merges.push_back(seg);
+            } else {
+                next_pending.insert(next_pending.end(), pending.begin() + seg.first, pending.begin() + seg.last);
+            }
+        }
+
+        // Merge pairs
+        parallel_for_each(*pool, merges.size(), num_threads, [&](size_t m) {
+            const Segment& seg = merges[m];
+            std::vector<size_t> edges;
+            edges.reserve(seg.last - seg.first);
+            for (size_t p = seg.first; p < seg.last; ++p) {
+                edges.push_back(std::get<2>(pending[p]));
+            }
+            merge_blocks(seg.a, seg.b, edges);
+        });
+
+        pending = std::move(next_pending);
+    }
+
+    // Sum up all subgraph flows
+    Flow total = flow;
+    for (const auto& block : blocks) {
+        total += block.flow;
+    }
+    return total;
+}
+
+template <class Cap, class Term, class Flow, class BlockSolver, class NodeIdx>
+inline void BlockMergeGraph<Cap, Term, Flow, BlockSolver, NodeIdx>::solve_block(BlockIdx b)
+{
+    Block& block = blocks[b];
+    if (block.nodes.empty()) {
+        return;
+    }
+
+    block.solver = std::make_unique<BlockSolver>(block.nodes.size(), block.edges.size());
+    block.solver->add_node(block.nodes.size());
+    for (size_t k = 0; k < block.nodes.size(); ++k) {
+        const Term tr_cap = tr_caps[block.nodes[k]];
+        if (tr_cap > 0) {
+            block.solver->add_tweights(k, tr_cap, 0);
+        } else if (tr_cap < 0) {
+            block.solver->add_tweights(k, 0, -tr_cap);
+        }
+    }
+    for (const Edge& e : block.edges) {
+        block.solver->add_edge(e.i, e.j, e.cap, e.rev_cap, false);
+    }
+    block.num_edges = block.edges.size();
+    block.edges = std::vector<Edge>();
+
+    block.flow = block.solver->solve();
+}
+
+template <class Cap, class Term, class Flow, class BlockSolver, class NodeIdx>
+inline void BlockMergeGraph<Cap, Term, Flow, BlockSolver, NodeIdx>::merge_blocks(
+    BlockIdx a, BlockIdx b, const std::vector<size_t>& edges)
+{
+    Block& block_a = blocks[a];
+    Block& block_b = blocks[b];
+    const size_t num_a = block_a.nodes.size();
+    const size_t num_b = block_b.nodes.size();
+    const size_t num_edges = block_a.num_edges + block_b.num_edges + edges.size();
+
+    auto solver = std::make_unique<BlockSolver>(num_a + num_b, num_edges);
+    solver->add_node(num_a + num_b);
+
+    // Continue from the residual graphs of both blocks. Node k of b becomes node num_a + k.
+    const auto add_residual = [&](const BlockSolver& from, size_t offset, size_t num) {
+        for (size_t k = 0; k < num; ++k) {
+            const Term tr_cap = from.residual_tweights(k);
+            if (tr_cap > 0) {
+                solver->add_tweights(offset + k, tr_cap, 0);
+            } else if (tr_cap < 0) {
+                solver->add_tweights(offset + k, 0, -tr_cap);
+            }
+        }
+        from.for_each_residual_edge([&](SolverIdx i, SolverIdx j, Cap r_cap, Cap rev_r_cap) {
+            if (r_cap != 0 || rev_r_cap != 0) {
+                solver->add_edge(offset + i, offset + j, r_cap, rev_r_cap, false);
+            }
+        });
+    };
+    add_residual(*block_a.solver, 0, num_a);
+    add_residual(*block_b.solver, num_a, num_b);
+    block_a.solver.reset();
+    block_b.solver.reset();
+
+    for (NodeIdx i : block_b.nodes) {
+        node_blocks[i] = a;
+        node_locals[i] += num_a;
+    }
+    block_a.nodes.insert(block_a.nodes.end(), block_b.nodes.begin(), block_b.nodes.end());
+    block_b.nodes = std::vector<NodeIdx>();
+
+    for (size_t e : edges) {
+        const Edge& edge = boundary_edges[e];
+        solver->add_edge(node_locals[edge.i], node_locals[edge.j], edge.cap, edge.rev_cap, false);
+    }
+
+    block_a.num_edges = num_edges;
+    block_a.flow += block_b.flow + solver->solve();
+    block_b.flow = 0;
+    block_a.solver = std::move(solver);
+}
+
+} // namespace reimpls
+
+#endif // REIMPLS_BLOCK_MERGE_H__
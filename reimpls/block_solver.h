@@ -0,0 +1,213 @@
+#ifndef REIMPLS_BLOCK_SOLVER_H__
+#define REIMPLS_BLOCK_SOLVER_H__
+
+#include <vector>
+#include <tuple>
+#include <cinttypes>
+#include <cassert>
+#include <algorithm>
+
+#include "mbk.h"
+#include "mbk_r.h"
+#include "eibfs_i.h"
+
+namespace reimpls {
+
+// Block solvers wrap a serial max-flow solver, so the parallel decomposition solvers can use any of them
+// for their blocks. A block solver has the following members:
+//
+//   BlockSolver(size_t expected_nodes, size_t expected_edges);
+//   NodeIdx add_node(size_t num);                                 // Returns index of first added node
+//   void add_tweights(NodeIdx i, Term cap_source, Term cap_sink);  // Before solve
+//   void add_edge(NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap, bool merge_duplicates = true); // Before solve
+//   Flow solve();                                                 // Returns total flow
+//   void update_tweights(NodeIdx i, Term delta_source, Term delta_sink); // After solve
+//   Flow resolve();                                               // Re-solve after updates, reusing state
+//   int what_segment(NodeIdx i, int default_segment = 0) const;   // 0 (SOURCE) or 1 (SINK)
+//   Term residual_tweights(NodeIdx i) const;                      // > 0 to source, < 0 to sink
+//   template <class Func> void for_each_residual_edge(Func func) const; // func(i, j, r_cap, rev_r_cap)
+//
+// The residual graph given by residual_tweights and for_each_residual_edge is valid after solve and lets a
+// solver for a union of blocks continue from where the block solvers stopped.
+
+// Graph (mbk) block solver
+template <class Cap, class Term, class Flow>
+class MbkBlockSolver {
+    using Solver = Graph<Cap, Term, Flow>;
+
+public:
+    using NodeIdx = int32_t;
+
+    MbkBlockSolver(size_t expected_nodes, size_t expected_edges) : graph(expected_nodes, expected_edges) {}
+
+    inline NodeIdx add_node(size_t num)
+    {
+        const NodeIdx first = graph.get_node_num();
+        graph.add_node(num);
+        return first;
+    }
+
+    inline void add_tweights(NodeIdx i, Term cap_source, Term cap_sink) { graph.add_tweights(i, cap_source, cap_sink); }
+
+    inline void add_edge(NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap, bool merge_duplicates = true)
+    {
+        graph.add_edge(i, j, cap, rev_cap, merge_duplicates);
+    }
+
+    inline Flow solve() { return graph.maxflow(); }
+
+    inline void update_tweights(NodeIdx i, Term delta_source, Term delta_sink)
+    {
+        graph.add_tweights(i, delta_source, delta_sink);
+        graph.mark_node(i);
+    }
+
+    inline Flow resolve() { return graph.maxflow(true); }
+
+    inline int what_segment(NodeIdx i, int default_segment = 0) const
+    {
+        return graph.what_segment(i, static_cast<typename Solver::TermType>(default_segment));
+    }
+
+    inline Term residual_tweights(NodeIdx i) const { return graph.get_trcap(i); }
+
+    template <class Func>
+    inline void for_each_residual_edge(Func func) const { graph.for_each_residual_edge(func); }
+
+private:
+    Solver graph;
+};
+
+// Graph2 (mbk_r) block solver
+template <class Cap, class Term, class Flow>
+class MbkrBlockSolver {
+    using Solver = Graph2<Cap, Term, Flow>;
+
+public:
+    using NodeIdx = int32_t;
+
+    MbkrBlockSolver(size_t expected_nodes, size_t expected_edges) : graph(expected_nodes, expected_edges) {}
+
+    inline NodeIdx add_node(size_t num)
+    {
+        const NodeIdx first = graph.get_node_num();
+        graph.add_node(num);
+        return first;
+    }
+
+    inline void add_tweights(NodeIdx i, Term cap_source, Term cap_sink) { graph.add_tweights(i, cap_source, cap_sink); }
+
+    inline void add_edge(NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap, bool merge_duplicates = true)
+    {
+        graph.add_edge(i, j, cap, rev_cap, merge_duplicates);
+    }
+
+    inline Flow solve() { return graph.maxflow(); }
+
+    inline void update_tweights(NodeIdx i, Term delta_source, Term delta_sink)
+    {
+        graph.add_tweights(i, delta_source, delta_sink);
+        graph.mark_node(i);
+    }
+
+    inline Flow resolve() { return graph.maxflow(true); }
+
+    inline int what_segment(NodeIdx i, int default_segment = 0) const
+    {
+        return graph.what_segment(i, static_cast<typename Solver::TermType>(default_segment));
+    }
+
+    inline Term residual_tweights(NodeIdx i) const { return graph.get_trcap(i); }
+
+    template <class Func>
+    inline void for_each_residual_edge(Func func) const { graph.for_each_residual_edge(func); }
+
+private:
+    Solver graph;
+};
+
+// IBFSGraph (eibfs_i) block solver. IBFSGraph needs the number of nodes and edges before any are added, so
+// terminal capacities and edges are buffered until the first solve. Duplicate edges are never merged.
+template <class Cap, class Term, class Flow>
+class EibfsBlockSolver {
+    using Solver = IBFSGraph<Cap, Term, Flow>;
+
+public:
+    using NodeIdx = uint32_t;
+
+    EibfsBlockSolver(size_t expected_nodes, size_t expected_edges) :
+        graph(),
+        num_nodes(0),
+        initialized(false),
+        tweights(),
+        edges()
+    {
+        edges.reserve(expected_edges);
+    }
+
+    inline NodeIdx add_node(size_t num)
+    {
+        assert(!initialized);
+        const NodeIdx first = num_nodes;
+        num_nodes += num;
+        return first;
+    }
+
+    inline void add_tweights(NodeIdx i, Term cap_source, Term cap_sink)
+    {
+        assert(!initialized);
+        tweights.emplace_back(i, cap_source, cap_sink);
+    }
+
+    inline void add_edge(NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap, bool merge_duplicates = true)
+    {
+        assert(!initialized);
+        edges.emplace_back(i, j, cap, rev_cap);
+    }
+
+    inline Flow solve()
+    {
+        graph.initSize(num_nodes, edges.size());
+        for (const auto& tw : tweights) {
+            graph.addNode(std::get<0>(tw), std::get<1>(tw), std::get<2>(tw));
+        }
+        for (const auto& e : edges) {
+            graph.addEdge(std::get<0>(e), std::get<1>(e), std::get<2>(e), std::get<3>(e));
+        }
+        tweights = std::vector<std::tuple<NodeIdx, Term, Term>>();
+        edges = std::vector<std::tuple<NodeIdx, NodeIdx, Cap, Cap>>();
+        graph.initGraph();
+        initialized = true;
+        // Keep the trees complete so the graph can be re-solved incrementally
+        return graph.computeMaxFlow(true);
+    }
+
+    inline void update_tweights(NodeIdx i, Term delta_source, Term delta_sink)
+    {
+        graph.incNode(i, delta_source, delta_sink);
+    }
+
+    inline Flow resolve() { return graph.computeMaxFlow(true); }
+
+    inline int what_segment(NodeIdx i, int default_segment = 0) const
+    {
+        return graph.isNodeOnSrcSide(i, default_segment == 0) ? 0 : 1;
+    }
+
+    inline Term residual_tweights(NodeIdx i) const { return graph.getNodeResidual(i); }
+
+    template <class Func>
+    inline void for_each_residual_edge(Func func) const { graph.forEachResidualEdge(func); }
+
+private:
+    Solver graph;
+    size_t num_nodes;
+    bool initialized;
+
+    std::vector<std::tuple<NodeIdx, Term, Term>> tweights;
+    std::vector<std::tuple<NodeIdx, NodeIdx, Cap, Cap>> edges;
+};
+
+} // namespace reimpls
+
+#endif // REIMPLS_BLOCK_SOLVER_H__
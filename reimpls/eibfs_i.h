@@ -55,14 +55,36 @@ If you require another license, please contact the above.
 #include <cstdio>
 #include <string>
 #include <cstdint>
+#include <cstddef>
+#include <limits>
 #include <algorithm>
 #include <type_traits>
 #include <cassert>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <stdexcept>
 
 #include "util.h"
+#include "alloc.h"
+#include "arc_scan.h"
 
 namespace reimpls {
 
+// If non-zero, IBFSGraph instances sized from now on stage added edges directly in the arc array instead of in a
+// separate list of temporary edges, which saves the memory for that list. initGraph then sorts the arcs in-place,
+// first into ranges of nodes whose arcs take about this many bytes on average and then within each range. Small
+// ranges keep the random accesses of the second step in cache. Arcs of a node end up sorted by head rather than by
+// the order their edges were added, and initGraph always runs on one thread and cannot store edge arcs.
+inline std::atomic<size_t>& in_place_arcs_storage()
+{
+    static std::atomic<size_t> budget(0);
+    return budget;
+}
+
+inline size_t get_in_place_arcs() { return in_place_arcs_storage().load(std::memory_order_relaxed); }
+inline void set_in_place_arcs(size_t budget) { in_place_arcs_storage().store(budget, std::memory_order_relaxed); }
+
 template <class Cap, class Term, class Flow, class NodeIdx = uint32_t, class ArcIdx = uint32_t>
 class IBFSGraph {
     static constexpr size_t ALLOC_INIT_LEVELS = 4096;
@@ -95,16 +117,26 @@ public:
     void incNode(NodeIdx node, Term deltaCapSource, Term deltaCapSink);
     bool incShouldResetTrees();
     void incArc(ArcIdx arc, Cap deltaCap);
-    void initGraph();
+    void initGraph(unsigned int num_threads = 1, bool storeEdgeArcs = false);
     Flow computeMaxFlow();
     Flow computeMaxFlow(bool allowIncrements);
+    Flow recomputeMaxFlow(const Cap *arcCaps, const Term *capSource, const Term *capSink);
     void resetTrees();
 
     inline Flow getFlow() const noexcept { return flow; }
     inline size_t getNumNodes() const noexcept { return nodeEnd - nodes; }
     inline size_t getNumArcs() const noexcept { return arcEnd - arcs; }
+    // Arc from tail to head of the edge added as number edge. Requires initGraph with storeEdgeArcs = true.
+    inline ArcIdx getEdgeArc(size_t edge) const { return edgeArcs[edge]; }
+    inline ArcIdx getReverseArc(ArcIdx arc) const { return arcs[arc].rev; }
     int isNodeOnSrcSide(NodeIdx node, int freeNodeValue = 0) const;
 
+    // Residual terminal capacity: > 0 capacity from s, < 0 -capacity to t
+    inline Term getNodeResidual(NodeIdx node) const { return nodes[node].excess; }
+
+    // Calls func(from, to, rCap, revRCap) once for every pair of sister arcs. Only valid after initGraph.
+    template <class Func> void forEachResidualEdge(Func func) const;
+
 #pragma pack (1)
     struct REIMPLS_PACKED Arc {
         NodeIdx head;
@@ -149,6 +181,20 @@ private:
     double testExcess;
     char *memArcs;
     TmpEdge *tmpEdges, *tmpEdgeLast;
+    size_t inPlaceArcs;
+    Arc *stagedArcLast;
+    PolicyVector<ArcIdx> edgeArcs;
+
+    // Capacities of the last recomputeMaxFlow. Empty if the capacities have not been set by recomputeMaxFlow.
+    PolicyVector<Cap> curArcCaps;
+    PolicyVector<Term> curCapSource, curCapSink;
+    bool treesComplete;
+
+    // Vector kernels for skipping arcs in growth and adoption. Labels are read as int32 by the kernels.
+    static constexpr bool ARC_SCAN = std::is_integral<Cap>::value && sizeof(NodeIdx) == sizeof(int32_t);
+    ArcScanFunc arcScan;
+    ArcScanLayout rCapScan, revResidualScan;
+    static ArcScanLayout arcScanLayout(bool useRCap);
 
     void augment(ArcIdx bridge);
     template <bool sTree> int64_t augmentPath(NodeIdx i, Cap push);
@@ -255,7 +301,7 @@ private:
                     allocLevels = ALLOC_INIT_LEVELS;
                 }
             }
-            buckets = new NodeIdx[allocLevels + 1];
+            buckets = alloc_array<NodeIdx>(allocLevels + 1);
             std::fill(buckets, buckets + allocLevels + 1, INVALID_NODE);
             maxBucket = 0;
         }
@@ -279,16 +325,16 @@ private:
         {
             if (numLevels > allocLevels) {
                 allocLevels <<= 1;
-                NodeIdx *alloc = new NodeIdx[allocLevels + 1];
+                NodeIdx *alloc = alloc_array<NodeIdx>(allocLevels + 1);
                 std::fill(alloc, alloc + allocLevels + 1, INVALID_NODE);
-                delete[] buckets;
+                free_memory(buckets);
                 buckets = alloc;
             }
         }
 
         inline void free()
         {
-            delete[] buckets;
+            free_memory(buckets);
             buckets = NULL;
         }
 
@@ -340,7 +386,7 @@ private:
                     allocLevels = ALLOC_INIT_LEVELS;
                 }
             }
-            buckets = new NodeIdx[allocLevels + 1];
+            buckets = alloc_array<NodeIdx>(allocLevels + 1);
             std::fill(buckets, buckets + allocLevels + 1, INVALID_NODE);
             maxBucket = 0;
         }
@@ -364,16 +410,16 @@ private:
         {
             if (numLevels > allocLevels) {
                 allocLevels <<= 1;
-                NodeIdx *alloc = new NodeIdx[allocLevels + 1];
+                NodeIdx *alloc = alloc_array<NodeIdx>(allocLevels + 1);
                 std::fill(alloc, alloc + allocLevels + 1, INVALID_NODE);
-                delete[] buckets;
+                free_memory(buckets);
                 buckets = alloc;
             }
         }
 
         inline void free()
         {
-            delete[] buckets;
+            free_memory(buckets);
             buckets = NULL;
         }
 
@@ -459,7 +505,7 @@ private:
                     allocLevels = ALLOC_INIT_LEVELS;
                 }
             }
-            buckets = new NodeIdx[allocLevels + 1];
+            buckets = alloc_array<NodeIdx>(allocLevels + 1);
             std::fill(buckets, buckets + allocLevels + 1, INVALID_NODE);
             ptrs = a_ptrs;
             reset();
@@ -485,16 +531,16 @@ private:
         {
             if (numLevels > allocLevels) {
                 allocLevels <<= 1;
-                NodeIdx *alloc = new NodeIdx[allocLevels + 1];
+                NodeIdx *alloc = alloc_array<NodeIdx>(allocLevels + 1);
                 std::fill(alloc, alloc + allocLevels + 1, INVALID_NODE);
-                delete[]buckets;
+                free_memory(buckets);
                 buckets = alloc;
             }
         }
 
         inline void free()
         {
-            delete[]buckets;
+            free_memory(buckets);
             buckets = NULL;
         }
 
@@ -593,7 +639,10 @@ private:
     //
     inline bool isInitializedGraph() const noexcept { return memArcs != NULL; }
     void initGraphFast();
+    void initGraphParallel(unsigned int num_threads);
+    void initGraphInPlace();
     void initNodes();
+    void resetCapacities(const Cap *arcCaps, const Term *capSource, const Term *capSink);
 };
 
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
@@ -618,9 +667,15 @@ inline IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::IBFSGraph() :
     memArcs(NULL),
     tmpEdges(NULL),
     tmpEdgeLast(NULL),
+    inPlaceArcs(0),
+    stagedArcLast(NULL),
     ptrs(NULL),
     testFlow(0),
-    testExcess(0)
+    testExcess(0),
+    treesComplete(false),
+    arcScan(ARC_SCAN ? arc_scan_func() : nullptr),
+    rCapScan(arcScanLayout(true)),
+    revResidualScan(arcScanLayout(false))
 {}
 
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
@@ -630,11 +685,25 @@ inline IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::IBFSGraph(int64_t numNodes,
     initSize(numNodes, numEdges);
 }
 
+template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
+inline ArcScanLayout IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::arcScanLayout(bool useRCap)
+{
+    ArcScanLayout layout;
+    layout.arc_size = sizeof(Arc);
+    layout.res_offset = useRCap ? offsetof(Arc, rCap) : offsetof(Arc, isRevResidual);
+    layout.res_size = useRCap ? sizeof(Cap) : sizeof(bool);
+    layout.res_test = RESIDUAL_NONZERO;
+    layout.head_offset = offsetof(Arc, head);
+    layout.node_size = sizeof(Node);
+    layout.label_offset = offsetof(Node, label);
+    return layout;
+}
+
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
 inline IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::~IBFSGraph()
 {
-    delete[]nodes;
-    delete[]memArcs;
+    free_memory(nodes);
+    free_memory(memArcs);
     orphanBuckets.free();
     orphan3PassBuckets.free();
     excessBuckets.free();
@@ -672,25 +741,26 @@ inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::resetTrees(
     uniqOrphansS = uniqOrphansT = 0;
     topLevelS = newTopLevelS;
     topLevelT = newTopLevelT;
-    for (Node *y = nodes; y != nodeEnd; y++) {
-        if (y->label < topLevelS && y->label > -topLevelT) {
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        Node& y = nodes[i];
+        if ((y.label < topLevelS) && (y.label > -topLevelT)) {
             continue;
         }
-        y->firstSon = INVALID_NODE;
-        if (y->label == topLevelS) {
-            activeS1.add(y);
-        } else if (y->label == -topLevelT) {
-            activeT1.add(y);
+        y.firstSon = INVALID_NODE;
+        if (y.label == topLevelS) {
+            activeS1.add(i);
+        } else if (y.label == -topLevelT) {
+            activeT1.add(i);
         } else {
-            y->parent = INVALID_ARC;
-            if (y->excess == 0) {
-                y->label = 0;
-            } else if (y->excess > 0) {
-                y->label = topLevelS;
-                activeS1.add(y);
+            y.parent = INVALID_ARC;
+            if (y.excess == 0) {
+                y.label = 0;
+            } else if (y.excess > 0) {
+                y.label = topLevelS;
+                activeS1.add(i);
             } else {
-                y->label = -topLevelT;
-                activeT1.add(y);
+                y.label = -topLevelT;
+                activeT1.add(i);
             }
         }
     }
@@ -793,7 +863,7 @@ inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::incArc(ArcIdx ai, Cap d
     }
     Arc& a = arcs[ai];
     Arc& sister = arcs[a.rev];
-    assert(a.rCap + sister.rCap + deltaCap < 0);
+    assert(a.rCap + sister.rCap + deltaCap >= 0);
 
     if (deltaCap > -a.rCap) {
         // there is enough residual capacity
@@ -806,7 +876,7 @@ inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::incArc(ArcIdx ai, Cap d
                 y.isParentCurr = false;
             } else if (x.label < 0 && y.label == (x.label + 1) && x.isParentCurr && ai < x.parent) {
                 x.isParentCurr = false;
-            } else if ((x->label > 0 && y.label <= 0)
+            } else if ((x.label > 0 && y.label <= 0)
                 || (x.label >= 0 && y.label < 0)
                 || (x.label > 0 && y.label > (x.label + 1))
                 || (x.label < (y.label - 1) && y.label < 0)) {
@@ -821,8 +891,6 @@ inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::incArc(ArcIdx ai, Cap d
     } else {
         // there is not enough residual capacity
         // saturate the reverse arc
-        Node& x = nodes[sister.head];
-        Node& y = nodes[a.head];
         Cap push = -(deltaCap + a.rCap);
         sister.rCap -= push;
         a.rCap = 0;
@@ -839,11 +907,23 @@ template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
 inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::addEdge(
     NodeIdx from, NodeIdx to, Cap capacity, Cap revCapacity)
 {
-    tmpEdgeLast->tail = from;
-    tmpEdgeLast->head = to;
-    tmpEdgeLast->cap = capacity;
-    tmpEdgeLast->revCap = revCapacity;
-    tmpEdgeLast++;
+    if (inPlaceArcs) {
+        // rev holds the tail until initGraph
+        stagedArcLast->head = to;
+        stagedArcLast->rev = from;
+        stagedArcLast->rCap = capacity;
+        stagedArcLast++;
+        stagedArcLast->head = from;
+        stagedArcLast->rev = to;
+        stagedArcLast->rCap = revCapacity;
+        stagedArcLast++;
+    } else {
+        tmpEdgeLast->tail = from;
+        tmpEdgeLast->head = to;
+        tmpEdgeLast->cap = capacity;
+        tmpEdgeLast->revCap = revCapacity;
+        tmpEdgeLast++;
+    }
 
     // use label as a temporary storage
     // to count the out degree of nodes
@@ -855,27 +935,41 @@ template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
 inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::incEdge(
     NodeIdx from, NodeIdx to, Cap capacity, Cap revCapacity)
 {
-    Node& x = nodes[from];
-    Node& y = nodes[to];
-    if (arcIter == NULL || arcIter->rev->head != x) {
-        arcIter = x->firstArc;
+    Arc *begin = arcs + nodes[from].firstArc;
+    Arc *end = arcs + nodes[from + 1].firstArc;
+    if (arcIter == NULL || arcIter < begin || arcIter >= end) {
+        arcIter = begin;
     }
-    Arc *end = (x + 1)->firstArc;
+    // search from the last found arc, since edges are often incremented in the order they were added
     Arc *initIter = arcIter;
-    if (arcIter->head != y)
-        for ((++arcIter) == end && (arcIter = x->firstArc); // TODO: Why is this a boolean!?
-            arcIter != initIter;
-            (++arcIter) == end && (arcIter = x->firstArc)) {
-            if (arcIter->head == y) {
-                break;
-            }
+    while (arcIter != end && arcIter->head != to) {
+        if (++arcIter == end) {
+            arcIter = begin;
+        }
+        if (arcIter == initIter) {
+            break;
         }
-    if (arcIter->head != y) {
-        fprintf(stdout, "Cannot increment arc (%d, %d)!\n", (int)(x - nodes), (int)(y - nodes));
+    }
+    if (arcIter == end || arcIter->head != to) {
+        fprintf(stdout, "Cannot increment arc (%d, %d)!\n", (int)from, (int)to);
         exit(1);
     }
-    incArc(arcIter, capacity);
-    incArc(arcIter->rev, revCapacity);
+    ArcIdx ai = arcIter - arcs;
+    incArc(ai, capacity);
+    incArc(arcs[ai].rev, revCapacity);
+}
+
+template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
+template <class Func>
+inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::forEachResidualEdge(Func func) const
+{
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        for (ArcIdx a = nodes[i].firstArc; a < nodes[i + 1].firstArc; ++a) {
+            if (a < arcs[a].rev) {
+                func(i, arcs[a].head, arcs[a].rCap, arcs[arcs[a].rev].rCap);
+            }
+        }
+    }
 }
 
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
@@ -889,9 +983,23 @@ inline int IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::isNodeOnSrcSide(
 }
 
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
-inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::initGraph()
+inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::initGraph(unsigned int num_threads, bool storeEdgeArcs)
 {
-    initGraphFast();
+    if (storeEdgeArcs) {
+        if (inPlaceArcs) {
+            throw std::runtime_error("Edge arcs are not available with in-place arcs");
+        }
+        edgeArcs.resize(tmpEdgeLast - tmpEdges);
+    } else {
+        edgeArcs.clear();
+    }
+    if (inPlaceArcs) {
+        initGraphInPlace();
+    } else if (num_threads > 1) {
+        initGraphParallel(num_threads);
+    } else {
+        initGraphFast();
+    }
     topLevelS = topLevelT = 1;
 }
 
@@ -900,8 +1008,9 @@ inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::initSize(int64_t numNod
 {
     init_n_nodes = numNodes;
     init_n_edges = numEdges;
+    inPlaceArcs = get_in_place_arcs();
     // compute allocation size
-    uint64_t arcTmpMemsize = (uint64_t)sizeof(TmpEdge) * (uint64_t)numEdges;
+    uint64_t arcTmpMemsize = inPlaceArcs ? 0 : (uint64_t)sizeof(TmpEdge) * (uint64_t)numEdges;
     uint64_t arcRealMemsize = (uint64_t)sizeof(Arc) * (uint64_t)(numEdges * 2);
     uint64_t nodeMemsize = (uint64_t)sizeof(NodeIdx) * (uint64_t)(numNodes * 5);
     uint64_t arcMemsize = 0;
@@ -911,15 +1020,16 @@ inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::initSize(int64_t numNod
     }
 
     // alocate arcs
-    memArcs = new char[arcMemsize];
+    memArcs = alloc_array<char>(arcMemsize);
     tmpEdges = (TmpEdge*)(memArcs + arcRealMemsize);
     tmpEdgeLast = tmpEdges; // will advance as edges are added
     arcs = (Arc*)memArcs;
+    stagedArcLast = arcs; // will advance as edges are added in place
     arcEnd = arcs + numEdges * 2;
 
     // allocate nodes
     this->numNodes = numNodes;
-    nodes = new Node[numNodes + 1];
+    nodes = alloc_array<Node>(numNodes + 1);
     memset(nodes, 0, sizeof(Node) * (numNodes + 1));
     nodeEnd = nodes + numNodes;
     // TODO: This likely uses too much memory
@@ -939,7 +1049,7 @@ template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
 inline  void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::reset()
 {
     // compute allocation size
-    uint64_t arcTmpMemsize = (uint64_t)sizeof(TmpEdge) * (uint64_t)init_n_edges;
+    uint64_t arcTmpMemsize = inPlaceArcs ? 0 : (uint64_t)sizeof(TmpEdge) * (uint64_t)init_n_edges;
     uint64_t arcRealMemsize = (uint64_t)sizeof(Arc) * (uint64_t)(init_n_edges * 2);
     uint64_t nodeMemsize = (uint64_t)sizeof(NodeIdx) * (uint64_t)(init_n_nodes * 5);
     uint64_t arcMemsize = 0;
@@ -952,6 +1062,7 @@ inline  void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::reset()
     tmpEdges = (TmpEdge*)(memArcs + arcRealMemsize);
     tmpEdgeLast = tmpEdges; // will advance as edges are added
     arcs = (Arc*)memArcs;
+    stagedArcLast = arcs; // will advance as edges are added in place
     arcEnd = arcs + init_n_edges * 2;
 
     // allocate nodes
@@ -969,6 +1080,10 @@ inline  void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::reset()
 
     // init members
     flow = 0;
+    curArcCaps.clear();
+    curCapSource.clear();
+    curCapSink.clear();
+    treesComplete = false;
 }
 
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
@@ -1009,7 +1124,11 @@ inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::initGraphFast()
     nodeEnd->label = arcEnd - arcs;
 
     // copy arcs
+    const bool storeEdgeArcs = !edgeArcs.empty();
     for (te = tmpEdges; te != tmpEdgeLast; te++) {
+        if (storeEdgeArcs) {
+            edgeArcs[te - tmpEdges] = nodes[te->tail].firstArc;
+        }
         Arc& a1 = arcs[nodes[te->tail].firstArc];
         a1.rev = nodes[te->head].firstArc;
         a1.head = te->head;
@@ -1029,6 +1148,199 @@ inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::initGraphFast()
     initNodes();
 }
 
+template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
+inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::initGraphParallel(unsigned int num_threads)
+{
+    // Same arc layout as initGraphFast: arcs are sorted by node and, within a node, by the order their edges were
+    // added. Each thread handles a contiguous chunk of the edges and keeps its own arc counts per node, such that
+    // it knows where its arcs go for every node. The counts take (numNodes + 1) indices per thread, so we limit
+    // the number of threads such that they use no more memory than the temporary edges.
+    const size_t numEdges = tmpEdgeLast - tmpEdges;
+    const size_t numCounts = numNodes + 1;
+    num_threads = static_cast<unsigned int>(std::min<size_t>(num_threads,
+        std::max<size_t>(1, numEdges * sizeof(TmpEdge) / (numCounts * sizeof(ArcIdx)))));
+    if (num_threads <= 1) {
+        initGraphFast();
+        return;
+    }
+
+    std::unique_ptr<ArcIdx[]> offsets(new ArcIdx[num_threads * numCounts]);
+    auto edgeBegin = [&](size_t t) { return tmpEdges + numEdges * t / num_threads; };
+    auto nodeBegin = [&](size_t t) { return static_cast<NodeIdx>(numNodes * t / num_threads); };
+
+    // count arcs per node for each chunk of edges
+    parallel_for_blocks(num_threads, num_threads, [&](size_t tb, size_t tbEnd)
+    {
+        for (size_t t = tb; t < tbEnd; ++t) {
+            ArcIdx *counts = &offsets[t * numCounts];
+            std::fill(counts, counts + numCounts, ArcIdx(0));
+            for (TmpEdge *te = edgeBegin(t); te != edgeBegin(t + 1); ++te) {
+                ++counts[te->tail];
+                ++counts[te->head];
+            }
+        }
+    });
+
+    // prefix sum over nodes: first sum the degrees (stored in label by addEdge) of each range of nodes...
+    std::vector<ArcIdx> rangeFirstArc(num_threads + 1, 0);
+    parallel_for_blocks(num_threads, num_threads, [&](size_t tb, size_t tbEnd)
+    {
+        for (size_t t = tb; t < tbEnd; ++t) {
+            ArcIdx sum = 0;
+            for (NodeIdx i = nodeBegin(t); i != nodeBegin(t + 1); ++i) {
+                sum += nodes[i].label;
+            }
+            rangeFirstArc[t + 1] = sum;
+        }
+    });
+    for (size_t t = 0; t < num_threads; ++t) {
+        rangeFirstArc[t + 1] += rangeFirstArc[t];
+    }
+
+    // ...then compute start arc offsets, labels and per-thread offsets for every node
+    parallel_for_blocks(num_threads, num_threads, [&](size_t tb, size_t tbEnd)
+    {
+        for (size_t t = tb; t < tbEnd; ++t) {
+            ArcIdx pos = rangeFirstArc[t];
+            for (NodeIdx i = nodeBegin(t); i != nodeBegin(t + 1); ++i) {
+                nodes[i].label = pos;
+                for (size_t u = 0; u < num_threads; ++u) {
+                    ArcIdx count = offsets[u * numCounts + i];
+                    offsets[u * numCounts + i] = pos;
+                    pos += count;
+                }
+            }
+        }
+    });
+    nodeEnd->label = arcEnd - arcs;
+
+    // copy arcs
+    const bool storeEdgeArcs = !edgeArcs.empty();
+    parallel_for_blocks(num_threads, num_threads, [&](size_t tb, size_t tbEnd)
+    {
+        for (size_t t = tb; t < tbEnd; ++t) {
+            ArcIdx *firstArc = &offsets[t * numCounts];
+            for (TmpEdge *te = edgeBegin(t); te != edgeBegin(t + 1); ++te) {
+                if (storeEdgeArcs) {
+                    edgeArcs[te - tmpEdges] = firstArc[te->tail];
+                }
+                Arc& a1 = arcs[firstArc[te->tail]];
+                a1.rev = firstArc[te->head];
+                a1.head = te->head;
+                a1.rCap = te->cap;
+                a1.isRevResidual = te->revCap != 0;
+
+                Arc& a2 = arcs[firstArc[te->head]];
+                a2.rev = firstArc[te->tail];
+                a2.head = te->tail;
+                a2.rCap = te->revCap;
+                a2.isRevResidual = te->cap != 0;
+
+                ++firstArc[te->head];
+                ++firstArc[te->tail];
+            }
+        }
+    });
+
+    initNodes();
+}
+
+template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
+inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::initGraphInPlace()
+{
+    // The staged arcs only know their tail, so we sort them by tail and then by head. Since the arcs of an edge
+    // are lost, the k-th arc from i to j is made the sister of the k-th arc from j to i instead. Pairing parallel
+    // edges differently does not change the capacity between two nodes, and so neither the max. flow nor the cut.
+    Node *x;
+    const ArcIdx numArcs = stagedArcLast - arcs;
+    const ArcIdx budgetArcs = static_cast<ArcIdx>(std::max<size_t>(1, inPlaceArcs / sizeof(Arc)));
+
+    // calculate start arc offsets and labels for every node
+    nodes->firstArc = 0;
+    for (x = nodes; x != nodeEnd; x++) {
+        (x + 1)->firstArc = x->firstArc + x->label;
+        x->label = x->firstArc;
+    }
+    nodeEnd->label = numArcs;
+
+    // split the nodes into ranges of 2^shift nodes such that a range has about budgetArcs arcs on average
+    int shift = 0;
+    while ((int64_t(1) << (shift + 1)) <= numNodes && numArcs / (numNodes >> (shift + 1)) <= budgetArcs) {
+        ++shift;
+    }
+    const size_t numRanges = (numNodes >> shift) + 1;
+    std::vector<ArcIdx> rangeNext(numRanges);
+    for (size_t r = 0; r < numRanges; ++r) {
+        rangeNext[r] = nodes[std::min<int64_t>(r << shift, numNodes)].label;
+    }
+    auto rangeEnd = [&](size_t r) { return nodes[std::min<int64_t>((r + 1) << shift, numNodes)].label; };
+
+    // move arcs to their range, like in American flag sort
+    for (size_t r = 0; r < numRanges; ++r) {
+        while (rangeNext[r] < rangeEnd(r)) {
+            Arc a = arcs[rangeNext[r]];
+            for (size_t ar = a.rev >> shift; ar != r; ar = a.rev >> shift) {
+                std::swap(a, arcs[rangeNext[ar]++]);
+            }
+            arcs[rangeNext[r]++] = a;
+        }
+    }
+
+    // same for the nodes within each range, which uses firstArc as the next place of each node, then sort the
+    // arcs of each node by head with insertion sort, since most nodes only have a few arcs
+    for (size_t r = 0; r < numRanges; ++r) {
+        const NodeIdx begin = std::min<int64_t>(r << shift, numNodes);
+        const NodeIdx end = std::min<int64_t>((r + 1) << shift, numNodes);
+        for (NodeIdx i = begin; i != end; ++i) {
+            nodes[i].firstArc = nodes[i].label;
+        }
+        for (NodeIdx i = begin; i != end; ++i) {
+            while (nodes[i].firstArc < nodes[i + 1].label) {
+                Arc a = arcs[nodes[i].firstArc];
+                for (NodeIdx tail = a.rev; tail != i; tail = a.rev) {
+                    std::swap(a, arcs[nodes[tail].firstArc++]);
+                }
+                arcs[nodes[i].firstArc++] = a;
+            }
+            for (ArcIdx ai = nodes[i].label + 1; ai < nodes[i + 1].label; ++ai) {
+                Arc a = arcs[ai];
+                ArcIdx aj = ai;
+                for (; aj > nodes[i].label && arcs[aj - 1].head > a.head; --aj) {
+                    arcs[aj] = arcs[aj - 1];
+                }
+                arcs[aj] = a;
+            }
+        }
+    }
+
+    // pair sisters, looking up the arcs from j to i for every run of arcs from i to j with i < j
+    auto byHead = [](const Arc& a, NodeIdx head) { return a.head < head; };
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        for (ArcIdx ai = nodes[i].label, runBegin = ai; ai != nodes[i + 1].label; ++ai) {
+            NodeIdx j = arcs[ai].head;
+            if (ai == runBegin || arcs[ai - 1].head != j) {
+                runBegin = ai;
+            }
+            ArcIdx si;
+            if (i < j) {
+                si = std::lower_bound(arcs + nodes[j].label, arcs + nodes[j + 1].label, i, byHead) - arcs;
+                si += ai - runBegin;
+            } else if (i == j && (ai - runBegin) % 2 == 0) {
+                si = ai + 1;
+            } else {
+                continue;
+            }
+            arcs[ai].rev = si;
+            arcs[si].rev = ai;
+            arcs[ai].isRevResidual = arcs[si].rCap != 0;
+            arcs[si].isRevResidual = arcs[ai].rCap != 0;
+        }
+    }
+    nodeEnd->label = arcEnd - arcs;
+
+    initNodes();
+}
+
 // @ret: minimum orphan level
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
 template<bool sTree>
@@ -1341,6 +1653,13 @@ inline  void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::adoption(int64_t fromL
             if (x.label != (sTree ? 1 : -1)) {
                 minLabel = x.label - (sTree ? 1 : -1);
                 for (; ai != a_end; ai++) {
+                    if (ARC_SCAN) {
+                        ai = skip_arcs(arcScan, sTree ? revResidualScan : rCapScan, arcs, ai, a_end, nodes,
+                            int32_t(minLabel), int32_t(minLabel));
+                        if (ai == a_end) {
+                            break;
+                        }
+                    }
                     const Arc& a = arcs[ai];
                     Node& y = nodes[a.head];
                     if ((sTree ? a.isRevResidual : a.rCap) != 0 && y.label == minLabel) {
@@ -1397,6 +1716,14 @@ inline  void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::adoption(int64_t fromL
             minLabel = (sTree ? topLevelS : -topLevelT);
             if (x.label != minLabel) {
                 for (ai = x.firstArc; ai != a_end; ai++) {
+                    if (ARC_SCAN) {
+                        // Only arcs to nodes strictly between the terminal and the current best can improve it
+                        ai = skip_arcs(arcScan, sTree ? revResidualScan : rCapScan, arcs, ai, a_end, nodes,
+                            int32_t(sTree ? 1 : minLabel + 1), int32_t(sTree ? minLabel - 1 : -1));
+                        if (ai == a_end) {
+                            break;
+                        }
+                    }
                     const Arc& a = arcs[ai];
                     const Node& y = nodes[a.head];
                     if ((sTree ? a.isRevResidual : a.rCap) &&
@@ -1553,6 +1880,14 @@ inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::growth()
         // grow or augment
         ArcIdx a_end = nodes[i + 1].firstArc;
         for (ArcIdx ai = x.firstArc; ai != a_end; ai++) {
+            if (ARC_SCAN) {
+                // Skip saturated arcs and arcs to nodes which are already in this tree
+                ai = skip_arcs(arcScan, dirS ? rCapScan : revResidualScan, arcs, ai, a_end, nodes,
+                    dirS ? std::numeric_limits<int32_t>::min() : 0, dirS ? 0 : std::numeric_limits<int32_t>::max());
+                if (ai == a_end) {
+                    break;
+                }
+            }
             Arc& a = arcs[ai];
             if (!(dirS ? a.rCap : a.isRevResidual)) {
                 continue;
@@ -1637,9 +1972,8 @@ inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::augmentIncrements()
     }
     if (orphanBuckets.maxBucket != 0) {
         adoption<sTree>(minOrphanLevel, false);
-    } else {
-        augmentExcesses<sTree>();
     }
+    augmentExcesses<sTree>();
 }
 
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
@@ -1707,9 +2041,101 @@ inline Flow IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::computeMaxFlow(
     }
 
     incIteration++;
+    treesComplete = allowIncrements;
     return flow;
 }
 
+// Re-solve the graph with new capacities but the same topology.
+// arcCaps is indexed as the internal arcs (see getEdgeArc and getReverseArc) and capSource and capSink by node.
+// If only few capacities changed since the last call, and the trees from that solve are still in good shape, the
+// changes are applied incrementally. Otherwise, the graph is reset and solved from scratch.
+template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
+inline Flow IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::recomputeMaxFlow(
+    const Cap *arcCaps, const Term *capSource, const Term *capSink)
+{
+    // Incremental updates have a higher cost per changed arc or node than a full solve has per arc or node, as they
+    // create orphans which must be adopted. So we only use them if few things changed. If the trees will be reset
+    // anyway (see incNode), we only keep the flow and must regrow the trees, so then we require even fewer changes.
+    constexpr int64_t INC_COST_FACTOR = 16;
+    constexpr int64_t INC_RESET_COST_FACTOR = 4;
+
+    const ArcIdx numArcs = arcEnd - arcs;
+    bool incremental = !curArcCaps.empty() && treesComplete;
+    if (incremental) {
+        int64_t numChanges = 0;
+        int64_t maxChanges = (numNodes + numArcs) / INC_COST_FACTOR;
+        if (incShouldResetTrees()) {
+            maxChanges /= INC_RESET_COST_FACTOR;
+        }
+        for (ArcIdx a = 0; a < numArcs && numChanges <= maxChanges; ++a) {
+            numChanges += arcCaps[a] != curArcCaps[a];
+        }
+        for (NodeIdx i = 0; i < numNodes && numChanges <= maxChanges; ++i) {
+            numChanges += capSource[i] != curCapSource[i] || capSink[i] != curCapSink[i];
+        }
+        incremental = numChanges <= maxChanges;
+    }
+
+    if (incremental) {
+        for (ArcIdx a = 0; a < numArcs; ++a) {
+            if (arcCaps[a] != curArcCaps[a]) {
+                incArc(a, arcCaps[a] - curArcCaps[a]);
+                curArcCaps[a] = arcCaps[a];
+            }
+        }
+        for (NodeIdx i = 0; i < numNodes; ++i) {
+            if (capSource[i] != curCapSource[i] || capSink[i] != curCapSink[i]) {
+                incNode(i, capSource[i] - curCapSource[i], capSink[i] - curCapSink[i]);
+                curCapSource[i] = capSource[i];
+                curCapSink[i] = capSink[i];
+            }
+        }
+    } else {
+        resetCapacities(arcCaps, capSource, capSink);
+    }
+    return computeMaxFlow(true);
+}
+
+template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
+inline void IBFSGraph<Cap, Term, Flow, NodeIdx, ArcIdx>::resetCapacities(
+    const Cap *arcCaps, const Term *capSource, const Term *capSink)
+{
+    const ArcIdx numArcs = arcEnd - arcs;
+    curArcCaps.assign(arcCaps, arcCaps + numArcs);
+    curCapSource.assign(capSource, capSource + numNodes);
+    curCapSink.assign(capSink, capSink + numNodes);
+
+    for (ArcIdx a = 0; a < numArcs; ++a) {
+        arcs[a].rCap = arcCaps[a];
+        arcs[a].isRevResidual = arcCaps[arcs[a].rev] != 0;
+    }
+
+    // initNodes expects the first arc of every node in label
+    flow = 0;
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        Node& x = nodes[i];
+        x.label = x.firstArc;
+        x.isParentCurr = false;
+        x.isIncremental = false;
+        x.excess = 0;
+        addNode(i, capSource[i], capSink[i]);
+    }
+    nodeEnd->label = nodeEnd->firstArc;
+
+    active0.clear();
+    activeS1.clear();
+    activeT1.clear();
+    excessBuckets.init_NoAlloc(nodes, ptrs, numNodes);
+    orphan3PassBuckets.init_NoAlloc(nodes, numNodes);
+    orphanBuckets.init_NoAlloc(nodes, numNodes);
+    initNodes();
+
+    topLevelS = topLevelT = 1;
+    uniqOrphansS = uniqOrphansT = 0;
+    incList = NULL;
+    incIteration = 0;
+}
+
 } // namespace reimpls
 
 #endif // REIMPLS_IBFS_H__
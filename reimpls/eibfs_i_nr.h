@@ -60,6 +60,7 @@ If you require another license, please contact the above.
 #include <cassert>
 
 #include "util.h"
+#include "alloc.h"
 
 namespace reimpls {
 
@@ -252,7 +253,7 @@ private:
                     allocLevels = ALLOC_INIT_LEVELS;
                 }
             }
-            buckets = new NodeIdx[allocLevels + 1];
+            buckets = alloc_array<NodeIdx>(allocLevels + 1);
             std::fill(buckets, buckets + allocLevels + 1, INVALID_NODE);
             maxBucket = 0;
         }
@@ -276,16 +277,16 @@ private:
         {
             if (numLevels > allocLevels) {
                 allocLevels <<= 1;
-                NodeIdx *alloc = new NodeIdx[allocLevels + 1];
+                NodeIdx *alloc = alloc_array<NodeIdx>(allocLevels + 1);
                 std::fill(alloc, alloc + allocLevels + 1, INVALID_NODE);
-                delete[] buckets;
+                free_memory(buckets);
                 buckets = alloc;
             }
         }
 
         inline void free()
         {
-            delete[] buckets;
+            free_memory(buckets);
             buckets = NULL;
         }
 
@@ -337,7 +338,7 @@ private:
                     allocLevels = ALLOC_INIT_LEVELS;
                 }
             }
-            buckets = new NodeIdx[allocLevels + 1];
+            buckets = alloc_array<NodeIdx>(allocLevels + 1);
             std::fill(buckets, buckets + allocLevels + 1, INVALID_NODE);
             maxBucket = 0;
         }
@@ -361,16 +362,16 @@ private:
         {
             if (numLevels > allocLevels) {
                 allocLevels <<= 1;
-                NodeIdx *alloc = new NodeIdx[allocLevels + 1];
+                NodeIdx *alloc = alloc_array<NodeIdx>(allocLevels + 1);
                 std::fill(alloc, alloc + allocLevels + 1, INVALID_NODE);
-                delete[] buckets;
+                free_memory(buckets);
                 buckets = alloc;
             }
         }
 
         inline void free()
         {
-            delete[] buckets;
+            free_memory(buckets);
             buckets = NULL;
         }
 
@@ -456,7 +457,7 @@ private:
                     allocLevels = ALLOC_INIT_LEVELS;
                 }
             }
-            buckets = new NodeIdx[allocLevels + 1];
+            buckets = alloc_array<NodeIdx>(allocLevels + 1);
             std::fill(buckets, buckets + allocLevels + 1, INVALID_NODE);
             ptrs = a_ptrs;
             reset();
@@ -482,16 +483,16 @@ private:
         {
             if (numLevels > allocLevels) {
                 allocLevels <<= 1;
-                NodeIdx *alloc = new NodeIdx[allocLevels + 1];
+                NodeIdx *alloc = alloc_array<NodeIdx>(allocLevels + 1);
                 std::fill(alloc, alloc + allocLevels + 1, INVALID_NODE);
-                delete[]buckets;
+                free_memory(buckets);
                 buckets = alloc;
             }
         }
 
         inline void free()
         {
-            delete[]buckets;
+            free_memory(buckets);
             buckets = NULL;
         }
 
@@ -626,8 +627,8 @@ inline IBFSGraph2<Cap, Term, Flow, NodeIdx, ArcIdx>::IBFSGraph2(int64_t numNodes
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
 inline IBFSGraph2<Cap, Term, Flow, NodeIdx, ArcIdx>::~IBFSGraph2()
 {
-    delete[]nodes;
-    delete[]memArcs;
+    free_memory(nodes);
+    free_memory(memArcs);
     orphanBuckets.free();
     orphan3PassBuckets.free();
     excessBuckets.free();
@@ -891,13 +892,13 @@ inline void IBFSGraph2<Cap, Term, Flow, NodeIdx, ArcIdx>::initSize(int64_t numNo
     uint64_t arcMemsize = (uint64_t)sizeof(Arc) * (uint64_t)(numEdges * 2); // = 0;
 
     // alocate arcs
-    memArcs = new char[arcMemsize + nodeMemsize];
+    memArcs = alloc_array<char>(arcMemsize + nodeMemsize);
     arcs = (Arc*)memArcs;
     arcEnd = arcs + numEdges * 2;
 
     // allocate nodes
     this->numNodes = numNodes;
-    nodes = new Node[numNodes + 1];
+    nodes = alloc_array<Node>(numNodes + 1);
     nodeEnd = nodes + numNodes;
     active0.init((NodeIdx*)(arcEnd));
     activeS1.init((NodeIdx*)(arcEnd)+numNodes);
@@ -33,8 +33,14 @@
  */
 
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <utility>
 #include <cinttypes>
 
+#include "util.h"
+
 namespace reimpls {
 
 enum class LabelOrder {
@@ -47,14 +53,74 @@ enum class RootOrder {
     LIFO
 };
 
+// Union-find with path halving over node indices
+template <class Idx>
+inline Idx find_group(std::vector<Idx>& group, Idx i)
+{
+    while (group[i] != i) {
+        group[i] = group[group[i]];
+        i = group[i];
+    }
+    return i;
+}
+
+template <class Idx>
+inline void union_groups(std::vector<Idx>& group, Idx a, Idx b)
+{
+    a = find_group(group, a);
+    b = find_group(group, b);
+    if (a != b) {
+        group[std::max(a, b)] = std::min(a, b);
+    }
+}
+
+// Call func(node, iteration) for all nodes where isExcess(node) is true. Nodes in different groups are
+// processed in parallel, while the nodes of one group are processed in increasing order by one thread with
+// its own iteration counter. Larger groups are handed out first.
+template <class Iter, class Idx, class IsExcess, class Func>
+inline void decompose_groups(std::vector<Idx>& group, unsigned int num_threads, IsExcess isExcess, Func func)
+{
+    std::vector<std::pair<Idx, Idx>> excessNodes; // (group, node)
+    for (Idx i = 0; i < static_cast<Idx>(group.size()); ++i) {
+        if (isExcess(i)) {
+            excessNodes.emplace_back(find_group(group, i), i);
+        }
+    }
+    std::sort(excessNodes.begin(), excessNodes.end());
+
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t begin = 0, end; begin < excessNodes.size(); begin = end) {
+        for (end = begin + 1; end < excessNodes.size() && excessNodes[end].first == excessNodes[begin].first; ++end) {
+            // Do nothing
+        }
+        ranges.emplace_back(begin, end);
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const auto& a, const auto& b) {
+        return a.second - a.first > b.second - b.first;
+    });
+
+    std::atomic<size_t> nextRange(0);
+    parallel_for_blocks(num_threads, num_threads, [&](size_t, size_t) {
+        Iter iteration = 1;
+        for (size_t r = nextRange++; r < ranges.size(); r = nextRange++) {
+            for (size_t k = ranges[r].first; k < ranges[r].second; ++k) {
+                func(excessNodes[k].second, iteration);
+            }
+        }
+    });
+}
+
 template <class Cap, LabelOrder LABEL_ORDER = LabelOrder::HIGHEST_FIRST,
-    RootOrder ROOT_ORDER = RootOrder::FIFO>
+    RootOrder ROOT_ORDER = RootOrder::FIFO, class NodeIdx = uint32_t, class ArcIdx = uint32_t>
 class Hpf {
     // Forward decls.
     struct Node;
     struct Arc;
     struct Root;
 
+    // Excesses are sums of many arc capacities so small integer types are promoted
+    using Excess = PromotedCap<Cap>;
+
 public:
     enum TermType : uint32_t {
         SOURCE = 0,
@@ -66,45 +132,58 @@ public:
     void reserve_nodes(size_t num);
     void reserve_edges(size_t num);
 
-    uint32_t add_node(uint32_t num = 1);
+    NodeIdx add_node(NodeIdx num = 1);
 
-    void add_edge(uint32_t from, uint32_t to, Cap capacity);
+    void add_edge(NodeIdx from, NodeIdx to, Cap capacity);
+    void add_tweights(NodeIdx node, Excess capSource, Excess capSink);
 
     void mincut();
 
-    TermType what_label(uint32_t node) const;
-    Cap compute_maxflow() const noexcept;
-    void recover_flow();
+    TermType what_label(NodeIdx node) const;
+    Excess compute_maxflow() const noexcept;
+    void recover_flow(unsigned int num_threads = 1);
 
-    inline void set_source(uint32_t s) { source = s; }
-    inline void set_sink(uint32_t t) { sink = t; }
+    inline void set_source(NodeIdx s) { source = s; }
+    inline void set_sink(NodeIdx t) { sink = t; }
 
 private:
-    uint32_t numNodes;
-    uint32_t numArcs;
-    uint32_t source;
-    uint32_t sink;
+    NodeIdx numNodes;
+    ArcIdx numArcs;
+    NodeIdx source;
+    NodeIdx sink;
 
-    uint32_t first;
-    uint32_t last;
+    NodeIdx first;
+    NodeIdx last;
 
-    uint32_t highestStrongLabel;
-    uint32_t lowestStrongLabel;
+    NodeIdx highestStrongLabel;
+    NodeIdx lowestStrongLabel;
 
     std::vector<Node> adjacencyList;
     std::vector<Root> strongRoots;
-    std::vector<uint32_t> labelCount;
+    std::vector<NodeIdx> labelCount;
     std::vector<Arc> arcList;
     std::vector<Arc *> outOfTreePtrs;
 
+    // Terminal capacities added with add_tweights are never turned into arcs. Like tr_cap in BK, we
+    // only keep the net capacity (source minus sink) per node, while the part which can be pushed
+    // straight from the source to the sink is accumulated in termFlow. The simple initialization
+    // saturates all terminal arcs, so the net capacity is exactly the initial excess/deficit.
+    std::vector<Excess> termCap;
+    Excess termFlow;
+
+    // Net terminal flow per node after recover_flow
+    std::vector<Excess> termFlows;
+
     void init_mincut();
 
-    uint32_t gap() const noexcept;
-    void decompose(Node *excessNode, const uint32_t source, uint32_t *iteration);
+    NodeIdx gap() const noexcept;
+    bool reachedSource(const Node *current) const noexcept;
+    void decompose(Node *excessNode, NodeIdx *visited, NodeIdx *iteration);
+    void decomposeParallel(unsigned int num_threads, NodeIdx *visited);
 
     void sort(Node *current);
     void minisort(Node *current);
-    void quickSort(Arc **arr, const uint32_t first, const uint32_t last);
+    void quickSort(Arc **arr, const ArcIdx first, const ArcIdx last);
 
     void addToStrongBucket(Node *newRoot, Root *rootBucket);
 
@@ -129,24 +208,22 @@ private:
     void liftAll(Node *rootNode);
 
     struct Node {
-        uint32_t visited;
-        uint32_t numAdjacent;
-        uint32_t number;
-        uint32_t label;
-        Cap excess;
+        ArcIdx numAdjacent;
+        NodeIdx number;
+        NodeIdx label;
+        Excess excess;
 
         Node *parent;
         Node *childList;
         Node *nextScan;
 
-        uint32_t numOutOfTree;
+        ArcIdx numOutOfTree;
         Arc **outOfTree;
-        uint32_t nextArc;
+        ArcIdx nextArc;
         Arc *arcToParent;
         Node *next;
 
         Node() :
-            visited(0),
             numAdjacent(0),
             number(0),
             label(0),
@@ -188,8 +265,8 @@ private:
     };
 };
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::Hpf(size_t expectedNodes, size_t expectedArcs) :
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::Hpf(size_t expectedNodes, size_t expectedArcs) :
     numNodes(0),
     numArcs(0),
     source(0),
@@ -202,39 +279,44 @@ inline Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::Hpf(size_t expectedNodes, size_t expec
     strongRoots(),
     labelCount(),
     arcList(),
-    outOfTreePtrs()
+    outOfTreePtrs(),
+    termCap(),
+    termFlow(0),
+    termFlows()
 {
     reserve_nodes(expectedNodes);
     reserve_edges(expectedArcs);
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::reserve_nodes(size_t num)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::reserve_nodes(size_t num)
 {
     adjacencyList.reserve(num);
     strongRoots.reserve(num);
     labelCount.reserve(num);
+    termCap.reserve(num);
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::reserve_edges(size_t num)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::reserve_edges(size_t num)
 {
     arcList.reserve(num);
     outOfTreePtrs.reserve(num * 2);
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline uint32_t Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::add_node(uint32_t num)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline NodeIdx Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::add_node(NodeIdx num)
 {
     numNodes += num;
     adjacencyList.resize(numNodes);
     strongRoots.resize(numNodes);
     labelCount.resize(numNodes, 0);
+    termCap.resize(numNodes, 0);
     return numNodes;
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::add_edge(uint32_t from, uint32_t to, Cap capacity)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::add_edge(NodeIdx from, NodeIdx to, Cap capacity)
 {
     arcList.emplace_back(
         &adjacencyList[from],
@@ -246,8 +328,22 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::add_edge(uint32_t from, uint32_t
     numArcs++;
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::mincut()
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::add_tweights(
+    NodeIdx node, Excess capSource, Excess capSink)
+{
+    Excess delta = termCap[node];
+    if (delta > 0) {
+        capSource += delta;
+    } else {
+        capSink -= delta;
+    }
+    termFlow += std::min(capSource, capSink);
+    termCap[node] = capSource - capSink;
+}
+
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::mincut()
 {
     init_mincut();
 
@@ -259,17 +355,18 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::mincut()
     }
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline typename Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::TermType Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::what_label(
-    uint32_t node) const
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline typename Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::TermType Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::what_label(
+    NodeIdx node) const
 {
     return adjacencyList[node].label >= gap() ? SOURCE : SINK;
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline Cap Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::compute_maxflow() const noexcept
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline typename Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::Excess
+Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::compute_maxflow() const noexcept
 {
-    Cap cut = 0;
+    Excess cut = termFlow;
 
     // Compute value of minimum cut which is equal to the max. flow
     for (const Arc& a : arcList) {
@@ -278,31 +375,57 @@ inline Cap Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::compute_maxflow() const noexcept
         }
     }
 
+    // Implicit terminal arcs
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        if (termCap[i] > 0 && adjacencyList[i].label < gap()) {
+            cut += termCap[i];
+        } else if (termCap[i] < 0 && adjacencyList[i].label >= gap()) {
+            cut -= termCap[i];
+        }
+    }
+
     return cut;
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::recover_flow()
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::recover_flow(unsigned int num_threads)
 {
-    uint32_t i, j, iteration = 1;
+    NodeIdx i, iteration = 1;
+    ArcIdx j;
     Arc *tempArc;
     Node *tempNode;
 
-    for (i = 0; i < adjacencyList[sink].numOutOfTree; ++i) {
-        tempArc = adjacencyList[sink].outOfTree[i];
+    for (j = 0; j < adjacencyList[sink].numOutOfTree; ++j) {
+        tempArc = adjacencyList[sink].outOfTree[j];
         if (tempArc->from->excess < 0) {
-            if ((tempArc->from->excess + (int)tempArc->flow) < 0) {
-                tempArc->from->excess += (int)tempArc->flow;
+            if ((tempArc->from->excess + tempArc->flow) < 0) {
+                tempArc->from->excess += tempArc->flow;
                 tempArc->flow = 0;
             } else {
-                tempArc->flow = (uint32_t)(tempArc->from->excess + (int)tempArc->flow);
+                tempArc->flow = static_cast<Cap>(tempArc->from->excess + tempArc->flow);
                 tempArc->from->excess = 0;
             }
         }
     }
 
-    for (i = 0; i < adjacencyList[source].numOutOfTree; ++i) {
-        tempArc = adjacencyList[source].outOfTree[i];
+    // Implicit terminal arcs start saturated. Deficits are removed from the sink arcs and excesses
+    // are first returned along the node's own source arc, the rest is decomposed below.
+    termFlows = termCap;
+    for (i = 0; i < numNodes; ++i) {
+        tempNode = &adjacencyList[i];
+        if (tempNode->excess < 0 && termFlows[i] < 0) {
+            Excess delta = std::max(tempNode->excess, termFlows[i]);
+            tempNode->excess -= delta;
+            termFlows[i] -= delta;
+        } else if (tempNode->excess > 0 && termFlows[i] > 0) {
+            Excess delta = std::min(tempNode->excess, termFlows[i]);
+            tempNode->excess -= delta;
+            termFlows[i] -= delta;
+        }
+    }
+
+    for (j = 0; j < adjacencyList[source].numOutOfTree; ++j) {
+        tempArc = adjacencyList[source].outOfTree[j];
         //addOutOfTreeNode(tempArc->to, tempArc);
         tempArc->to->addOutOfTree(tempArc);
     }
@@ -336,21 +459,62 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::recover_flow()
         }
     }
 
+    // Only needed for the flow decomposition, so a pure min. cut never allocates it
+    std::vector<NodeIdx> visited(numNodes, 0);
+
+    if (num_threads > 1) {
+        decomposeParallel(num_threads, visited.data());
+        return;
+    }
+
     for (i = 0; i < numNodes; ++i) {
         tempNode = &adjacencyList[i];
         while (tempNode->excess > 0) {
             ++iteration;
-            decompose(tempNode, source, &iteration);
+            decompose(tempNode, visited.data(), &iteration);
+        }
+    }
+}
+
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::decomposeParallel(unsigned int num_threads, NodeIdx *visited)
+{
+    // All excess is on the source side and the sorted out-of-tree lists of source side nodes only hold arcs
+    // into the node from other source side nodes or the source. Since decompose walks backwards along these
+    // arcs, nodes which are not linked by them can be decomposed independently. This gives the same flows
+    // as the serial decomposition.
+    std::vector<NodeIdx> group(numNodes);
+    std::iota(group.begin(), group.end(), 0);
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        const Node& n = adjacencyList[i];
+        if (i == source || i == sink || n.label < gap()) {
+            continue;
+        }
+        for (ArcIdx j = 0; j < n.numOutOfTree; ++j) {
+            const NodeIdx from = n.outOfTree[j]->from->number;
+            if (from != source && from != sink) {
+                union_groups(group, i, from);
+            }
         }
     }
+
+    decompose_groups<NodeIdx>(group, num_threads, [&](NodeIdx i) {
+        return adjacencyList[i].excess > 0;
+    }, [&](NodeIdx i, NodeIdx& iteration) {
+        Node *excessNode = &adjacencyList[i];
+        while (excessNode->excess > 0) {
+            ++iteration;
+            decompose(excessNode, visited, &iteration);
+        }
+    });
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::init_mincut()
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::init_mincut()
 {
     outOfTreePtrs.resize(2 * arcList.size());
     Arc **crntOutOfTree = outOfTreePtrs.data();
-    for (uint32_t i = 0; i < numNodes; ++i) {
+    for (NodeIdx i = 0; i < numNodes; ++i) {
         Node& n = adjacencyList[i];
         n.number = i;
         // createOutOfTree
@@ -361,8 +525,8 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::init_mincut()
     }
 
     for (Arc& a : arcList) {
-        uint32_t from = a.from->number;
-        uint32_t to = a.to->number;
+        NodeIdx from = a.from->number;
+        NodeIdx to = a.to->number;
         if (!(source == to || sink == from || from == to)) {
             if (source == from && to == sink) {
                 a.flow = a.capacity;
@@ -377,13 +541,13 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::init_mincut()
     }
 
     // simpleInitialization
-    for (uint32_t i = 0; i < adjacencyList[source].numOutOfTree; ++i) {
+    for (ArcIdx i = 0; i < adjacencyList[source].numOutOfTree; ++i) {
         Arc *tempArc = adjacencyList[source].outOfTree[i];
         tempArc->flow = tempArc->capacity;
         tempArc->to->excess += tempArc->capacity;
     }
 
-    for (uint32_t i = 0; i < adjacencyList[sink].numOutOfTree; ++i) {
+    for (ArcIdx i = 0; i < adjacencyList[sink].numOutOfTree; ++i) {
         Arc *tempArc = adjacencyList[sink].outOfTree[i];
         tempArc->flow = tempArc->capacity;
         tempArc->from->excess -= tempArc->capacity;
@@ -392,7 +556,8 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::init_mincut()
     adjacencyList[source].excess = 0;
     adjacencyList[sink].excess = 0;
 
-    for (uint32_t i = 0; i < numNodes; ++i) {
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        adjacencyList[i].excess += termCap[i];
         if (adjacencyList[i].excess > 0) {
             adjacencyList[i].label = 1;
             ++labelCount[1];
@@ -406,22 +571,29 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::init_mincut()
     labelCount[0] = (numNodes - 2) - labelCount[1];
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline uint32_t Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::gap() const noexcept
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline NodeIdx Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::gap() const noexcept
 {
     return LABEL_ORDER == LabelOrder::LOWEST_FIRST ? lowestStrongLabel : numNodes;
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::decompose(
-    Node * excessNode, const uint32_t source, uint32_t * iteration)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline bool Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::reachedSource(const Node *current) const noexcept
+{
+    // A node with flow left on its implicit source arc ends the path just like the source
+    return current->number == source || termFlows[current->number] > 0;
+}
+
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::decompose(
+    Node * excessNode, NodeIdx * visited, NodeIdx * iteration)
 {
     Node *current = excessNode;
     Arc *tempArc;
-    Cap bottleneck = excessNode->excess;
+    Excess bottleneck = excessNode->excess;
 
-    for (; current->number != source && current->visited < (*iteration); current = tempArc->from) {
-        current->visited = (*iteration);
+    for (; !reachedSource(current) && visited[current->number] < (*iteration); current = tempArc->from) {
+        visited[current->number] = (*iteration);
         tempArc = current->outOfTree[current->nextArc];
 
         if (tempArc->flow < bottleneck) {
@@ -429,11 +601,16 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::decompose(
         }
     }
 
-    if (current->number == source) {
+    if (reachedSource(current)) {
+        Node *end = current;
+        if (end->number != source && termFlows[end->number] < bottleneck) {
+            bottleneck = termFlows[end->number];
+        }
+
         excessNode->excess -= bottleneck;
         current = excessNode;
 
-        while (current->number != source) {
+        while (current != end) {
             tempArc = current->outOfTree[current->nextArc];
             tempArc->flow -= bottleneck;
 
@@ -444,6 +621,10 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::decompose(
             }
             current = tempArc->from;
         }
+
+        if (end->number != source) {
+            termFlows[end->number] -= bottleneck;
+        }
         return;
     }
 
@@ -451,8 +632,8 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::decompose(
 
     bottleneck = current->outOfTree[current->nextArc]->flow;
 
-    while (current->visited < (*iteration)) {
-        current->visited = (*iteration);
+    while (visited[current->number] < (*iteration)) {
+        visited[current->number] = (*iteration);
         tempArc = current->outOfTree[current->nextArc];
 
         if (tempArc->flow < bottleneck) {
@@ -463,8 +644,8 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::decompose(
 
     ++(*iteration);
 
-    while (current->visited < (*iteration)) {
-        current->visited = (*iteration);
+    while (visited[current->number] < (*iteration)) {
+        visited[current->number] = (*iteration);
 
         tempArc = current->outOfTree[current->nextArc];
         tempArc->flow -= bottleneck;
@@ -479,8 +660,8 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::decompose(
     }
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::sort(Node * current)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::sort(Node * current)
 {
     // TODO: Just use the sort algorithm from the standard, since that's also quicksort
     if (current->numOutOfTree > 1) {
@@ -488,11 +669,12 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::sort(Node * current)
     }
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::minisort(Node * current)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::minisort(Node * current)
 {
     Arc *temp = current->outOfTree[current->nextArc];
-    uint32_t i, size = current->numOutOfTree, tempflow = temp->flow;
+    ArcIdx i, size = current->numOutOfTree;
+    Cap tempflow = temp->flow;
 
     for (i = current->nextArc + 1; i < size && tempflow < current->outOfTree[i]->flow; ++i) {
         current->outOfTree[i - 1] = current->outOfTree[i];
@@ -500,11 +682,12 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::minisort(Node * current)
     current->outOfTree[i - 1] = temp;
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::quickSort(
-    Arc * *arr, const uint32_t first, const uint32_t last)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::quickSort(
+    Arc * *arr, const ArcIdx first, const ArcIdx last)
 {
-    uint32_t i, j, left = first, right = last, x1, x2, x3, mid, pivot, pivotval;
+    ArcIdx i, j, left = first, right = last, mid, pivot;
+    Cap x1, x2, x3, pivotval;
     Arc *swap;
 
     if ((right - left) <= 5) {// Bubble sort if 5 elements or less
@@ -584,8 +767,8 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::quickSort(
     }
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::addToStrongBucket(Node *newRoot, Root *rootBucket)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::addToStrongBucket(Node *newRoot, Root *rootBucket)
 {
     if (ROOT_ORDER == RootOrder::FIFO) {
         if (rootBucket->start) {
@@ -603,11 +786,11 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::addToStrongBucket(Node *newRoot,
     }
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline typename Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::Node *
-Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::getHighestStrongRoot()
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline typename Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::Node *
+Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::getHighestStrongRoot()
 {
-    uint32_t i;
+    NodeIdx i;
     Node *strongRoot;
 
     for (i = highestStrongLabel; i > 0; --i) {
@@ -651,11 +834,11 @@ Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::getHighestStrongRoot()
     return strongRoot;
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline typename Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::Node *
-Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::getLowestStrongRoot()
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline typename Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::Node *
+Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::getLowestStrongRoot()
 {
-    uint32_t i;
+    NodeIdx i;
     Node *strongRoot;
 
     if (lowestStrongLabel == 0) {
@@ -693,9 +876,9 @@ Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::getLowestStrongRoot()
     return nullptr;
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline typename Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::Node *
-Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::getNextStrongRoot()
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline typename Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::Node *
+Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::getNextStrongRoot()
 {
     if (LABEL_ORDER == LabelOrder::LOWEST_FIRST) {
         return getLowestStrongRoot();
@@ -704,8 +887,8 @@ Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::getNextStrongRoot()
     }
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::processRoot(Node *strongRoot)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::processRoot(Node *strongRoot)
 {
     Node *temp, *strongNode = strongRoot, *weakNode;
     Arc *out;
@@ -748,14 +931,14 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::processRoot(Node *strongRoot)
     }
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline typename Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::Arc *Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::findWeakNode(
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline typename Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::Arc *Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::findWeakNode(
     Node *strongNode, Node **weakNode)
 {
-    uint32_t i, size;
+    ArcIdx i, size;
     Arc *out;
 
-    const uint32_t extremumStrongLabel = LABEL_ORDER == LabelOrder::LOWEST_FIRST ?
+    const NodeIdx extremumStrongLabel = LABEL_ORDER == LabelOrder::LOWEST_FIRST ?
         lowestStrongLabel : highestStrongLabel;
     size = strongNode->numOutOfTree;
 
@@ -782,8 +965,8 @@ inline typename Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::Arc *Hpf<Cap, LABEL_ORDER, RO
     return nullptr;
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::merge(Node *parent, Node *child, Arc *newArc)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::merge(Node *parent, Node *child, Arc *newArc)
 {
     Arc *oldArc;
     Node *current = child, *oldParent, *newParent = parent;
@@ -804,16 +987,16 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::merge(Node *parent, Node *child,
     addRelationship(newParent, current);
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::addRelationship(Node * newParent, Node * child)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::addRelationship(Node * newParent, Node * child)
 {
     child->parent = newParent;
     child->next = newParent->childList;
     newParent->childList = child;
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::breakRelationship(Node * oldParent, Node * child)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::breakRelationship(Node * oldParent, Node * child)
 {
     Node *current;
 
@@ -833,12 +1016,12 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::breakRelationship(Node * oldParen
     child->next = nullptr;
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::pushExcess(Node *strongRoot)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::pushExcess(Node *strongRoot)
 {
     Node *current, *parent;
     Arc *arcToParent;
-    int prevEx = 1;
+    Excess prevEx = 1;
 
     for (current = strongRoot; current->excess && current->parent; current = parent) {
         parent = current->parent;
@@ -861,8 +1044,8 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::pushExcess(Node *strongRoot)
     }
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::pushUpward(
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::pushUpward(
     Arc *currentArc, Node *child, Node *parent, Cap resCap)
 {
     if (resCap >= child->excess) {
@@ -887,8 +1070,8 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::pushUpward(
     addToStrongBucket(child, &strongRoots[child->label]);
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::pushDownward(
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::pushDownward(
     Arc *currentArc, Node *child, Node *parent, Cap flow)
 {
     if (flow >= child->excess) {
@@ -913,8 +1096,8 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::pushDownward(
     addToStrongBucket(child, &strongRoots[child->label]);
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::checkChildren(Node *curNode)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::checkChildren(Node *curNode)
 {
     for (; curNode->nextScan; curNode->nextScan = curNode->nextScan->next) {
         if (curNode->nextScan->label == curNode->label) {
@@ -929,8 +1112,8 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::checkChildren(Node *curNode)
     curNode->nextArc = 0;
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::liftAll(Node *rootNode)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::liftAll(Node *rootNode)
 {
     Node *temp, *current = rootNode;
 
@@ -952,8 +1135,8 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::liftAll(Node *rootNode)
     }
 }
 
-template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
-inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::Node::addOutOfTree(Arc *out)
+template <class Cap, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER, class NodeIdx, class ArcIdx>
+inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER, NodeIdx, ArcIdx>::Node::addOutOfTree(Arc *out)
 {
     outOfTree[numOutOfTree] = out;
     numOutOfTree++;
@@ -961,4 +1144,4 @@ inline void Hpf<Cap, LABEL_ORDER, ROOT_ORDER>::Node::addOutOfTree(Arc *out)
 
 } // namespace reimpls
 
-#endif // REIMPLS_HPF_H__
\ No newline at end of file
+#endif // REIMPLS_HPF_H__
\ No newline at end of file
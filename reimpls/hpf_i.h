@@ -0,0 +1,975 @@
+#ifndef REIMPLS_HPF_I_H__
+#define REIMPLS_HPF_I_H__
+
+/* LICENSE
+ *
+ * The source code is subject to the following academic license.
+ * Note this is not an open source license.
+ *
+ * Copyright © 2001. The Regents of the University of California (Regents).
+ * All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and not-for-profit purposes,
+ * without fee and without a signed licensing agreement, is hereby granted,
+ * provided that the above copyright notice, this paragraph and the following
+ * two paragraphs appear in all copies, modifications, and distributions.
+ * Contact The Office of Technology Licensing, UC Berkeley, 2150 Shattuck
+ * Avenue, Suite 510, Berkeley, CA 94720-1620, (510) 643-7201, for commercial
+ * licensing opportunities. Created by Bala Chandran and Dorit S. Hochbaum,
+ * Department of Industrial Engineering and Operations Research,
+ * University of California, Berkeley.
+ *
+ * IN NO EVENT SHALL REGENTS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT,
+ * SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS,
+ * ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+ * REGENTS HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * REGENTS SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE. THE SOFTWARE AND ACCOMPANYING DOCUMENTATION, IF ANY, PROVIDED
+ * HEREUNDER IS PROVIDED "AS IS". REGENTS HAS NO OBLIGATION TO PROVIDE
+ * MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
+ */
+
+/*
+This is a version of hpf.h which uses indices instead of pointers. Nodes and arcs refer to each other
+with NodeIdx and ArcIdx indices and the out-of-tree arcs of all nodes are stored in one CSR array, so a
+node takes half the memory and an out-of-tree entry takes sizeof(ArcIdx) bytes instead of a pointer.
+*/
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cinttypes>
+
+#include "util.h"
+#include "hpf.h"
+
+namespace reimpls {
+
+template <class Cap, class NodeIdx = uint32_t, class ArcIdx = uint32_t,
+    LabelOrder LABEL_ORDER = LabelOrder::HIGHEST_FIRST, RootOrder ROOT_ORDER = RootOrder::FIFO>
+class Hpf2 {
+    static const NodeIdx INVALID_NODE = ~NodeIdx(0); // -1 for signed type, max. value for unsigned type
+    static const ArcIdx INVALID_ARC = ~ArcIdx(0); // -1 for signed type, max. value for unsigned type
+
+    // Forward decls.
+    struct Node;
+    struct Arc;
+    struct Root;
+
+    // Excesses are sums of many arc capacities so small integer types are promoted
+    using Excess = PromotedCap<Cap>;
+
+public:
+    enum TermType : uint32_t {
+        SOURCE = 0,
+        SINK = 1
+    };
+
+    Hpf2(size_t expectedNodes = 0, size_t expectedArcs = 0);
+
+    void reserve_nodes(size_t num);
+    void reserve_edges(size_t num);
+
+    NodeIdx add_node(NodeIdx num = 1);
+
+    void add_edge(NodeIdx from, NodeIdx to, Cap capacity);
+    void add_tweights(NodeIdx node, Excess capSource, Excess capSink);
+
+    void mincut();
+
+    TermType what_label(NodeIdx node) const;
+    Excess compute_maxflow() const noexcept;
+    void recover_flow(unsigned int num_threads = 1);
+
+    inline void set_source(NodeIdx s) { source = s; }
+    inline void set_sink(NodeIdx t) { sink = t; }
+
+private:
+    NodeIdx numNodes;
+    NodeIdx source;
+    NodeIdx sink;
+
+    NodeIdx highestStrongLabel;
+    NodeIdx lowestStrongLabel;
+
+    std::vector<Node> nodes;
+    std::vector<Root> strongRoots;
+    std::vector<NodeIdx> labelCount;
+    std::vector<Arc> arcs;
+
+    // Out-of-tree arcs of node i are outOfTree[nodes[i].firstOutOfTree + j] for j < nodes[i].numOutOfTree
+    std::vector<ArcIdx> outOfTree;
+
+    // Implicit terminal arcs, see Hpf
+    std::vector<Excess> termCap;
+    Excess termFlow;
+    std::vector<Excess> termFlows;
+
+    void init_mincut();
+
+    NodeIdx gap() const noexcept;
+    bool reachedSource(NodeIdx current) const noexcept;
+    void decompose(NodeIdx excessNode, std::vector<ArcIdx>& visited, ArcIdx& iteration);
+    void decomposeParallel(unsigned int num_threads, std::vector<ArcIdx>& visited);
+
+    void sort(NodeIdx current);
+    void minisort(NodeIdx current);
+
+    inline ArcIdx *outOfTreeBegin(NodeIdx i) { return outOfTree.data() + nodes[i].firstOutOfTree; }
+    inline ArcIdx currentArc(NodeIdx i) const { return outOfTree[nodes[i].firstOutOfTree + nodes[i].nextArc]; }
+    inline void addOutOfTree(NodeIdx i, ArcIdx out)
+    {
+        outOfTree[nodes[i].firstOutOfTree + nodes[i].numOutOfTree] = out;
+        nodes[i].numOutOfTree++;
+    }
+
+    void addToStrongBucket(NodeIdx newRoot, Root& rootBucket);
+
+    NodeIdx getHighestStrongRoot();
+    NodeIdx getLowestStrongRoot();
+    NodeIdx getNextStrongRoot();
+
+    void processRoot(NodeIdx strongRoot);
+
+    ArcIdx findWeakNode(NodeIdx strongNode, NodeIdx& weakNode);
+
+    void merge(NodeIdx parent, NodeIdx child, ArcIdx newArc);
+    void addRelationship(NodeIdx newParent, NodeIdx child);
+    void breakRelationship(NodeIdx oldParent, NodeIdx child);
+
+    void pushExcess(NodeIdx strongRoot);
+    void pushUpward(ArcIdx currentArc, NodeIdx child, NodeIdx parent, Cap resCap);
+    void pushDownward(ArcIdx currentArc, NodeIdx child, NodeIdx parent, Cap flow);
+
+    void checkChildren(NodeIdx curNode);
+
+    void liftAll(NodeIdx rootNode);
+
+    struct Node {
+        Excess excess;
+        NodeIdx label;
+
+        NodeIdx parent;
+        NodeIdx childList;
+        NodeIdx nextScan;
+        NodeIdx next;
+        ArcIdx arcToParent;
+
+        // Holds the number of adjacent arcs until init_mincut turns it into an offset
+        ArcIdx firstOutOfTree;
+        ArcIdx numOutOfTree;
+        ArcIdx nextArc;
+
+        Node() :
+            excess(0),
+            label(0),
+            parent(INVALID_NODE),
+            childList(INVALID_NODE),
+            nextScan(INVALID_NODE),
+            next(INVALID_NODE),
+            arcToParent(INVALID_ARC),
+            firstOutOfTree(0),
+            numOutOfTree(0),
+            nextArc(0) {}
+    };
+
+    struct Arc {
+        NodeIdx from;
+        NodeIdx to;
+        Cap flow;
+        Cap capacity;
+        bool direction;
+
+        Arc(NodeIdx from, NodeIdx to, Cap capacity) :
+            from(from),
+            to(to),
+            flow(0),
+            capacity(capacity),
+            direction(true) {}
+    };
+
+    struct Root {
+        NodeIdx start;
+        NodeIdx end;
+
+        Root() :
+            start(INVALID_NODE),
+            end(INVALID_NODE) {}
+    };
+};
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::Hpf2(size_t expectedNodes, size_t expectedArcs) :
+    numNodes(0),
+    source(0),
+    sink(0),
+    highestStrongLabel(1),
+    lowestStrongLabel(1),
+    nodes(),
+    strongRoots(),
+    labelCount(),
+    arcs(),
+    outOfTree(),
+    termCap(),
+    termFlow(0),
+    termFlows()
+{
+    reserve_nodes(expectedNodes);
+    reserve_edges(expectedArcs);
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::reserve_nodes(size_t num)
+{
+    nodes.reserve(num);
+    strongRoots.reserve(num);
+    labelCount.reserve(num);
+    termCap.reserve(num);
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::reserve_edges(size_t num)
+{
+    arcs.reserve(num);
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline NodeIdx Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::add_node(NodeIdx num)
+{
+    numNodes += num;
+    nodes.resize(numNodes);
+    strongRoots.resize(numNodes);
+    labelCount.resize(numNodes, 0);
+    termCap.resize(numNodes, 0);
+    return numNodes;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::add_edge(NodeIdx from, NodeIdx to, Cap capacity)
+{
+    arcs.emplace_back(from, to, capacity);
+    nodes[from].firstOutOfTree++;
+    nodes[to].firstOutOfTree++;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::add_tweights(
+    NodeIdx node, Excess capSource, Excess capSink)
+{
+    Excess delta = termCap[node];
+    if (delta > 0) {
+        capSource += delta;
+    } else {
+        capSink -= delta;
+    }
+    termFlow += std::min(capSource, capSink);
+    termCap[node] = capSource - capSink;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::mincut()
+{
+    init_mincut();
+
+    // pseudoflowPhase1
+    NodeIdx strongRoot;
+
+    while ((strongRoot = getNextStrongRoot()) != INVALID_NODE) {
+        processRoot(strongRoot);
+    }
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline typename Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::TermType
+Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::what_label(NodeIdx node) const
+{
+    return nodes[node].label >= gap() ? SOURCE : SINK;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline typename Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::Excess
+Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::compute_maxflow() const noexcept
+{
+    const NodeIdx g = gap();
+    Excess cut = termFlow;
+
+    // Compute value of minimum cut which is equal to the max. flow
+    for (const Arc& a : arcs) {
+        if (nodes[a.from].label >= g && nodes[a.to].label < g) {
+            cut += a.capacity;
+        }
+    }
+
+    // Implicit terminal arcs
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        if (termCap[i] > 0 && nodes[i].label < g) {
+            cut += termCap[i];
+        } else if (termCap[i] < 0 && nodes[i].label >= g) {
+            cut -= termCap[i];
+        }
+    }
+
+    return cut;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::recover_flow(unsigned int num_threads)
+{
+    ArcIdx iteration = 1;
+
+    for (ArcIdx j = 0; j < nodes[sink].numOutOfTree; ++j) {
+        Arc& a = arcs[outOfTreeBegin(sink)[j]];
+        Node& from = nodes[a.from];
+        if (from.excess < 0) {
+            if ((from.excess + a.flow) < 0) {
+                from.excess += a.flow;
+                a.flow = 0;
+            } else {
+                a.flow = static_cast<Cap>(from.excess + a.flow);
+                from.excess = 0;
+            }
+        }
+    }
+
+    // Implicit terminal arcs start saturated. Deficits are removed from the sink arcs and excesses
+    // are first returned along the node's own source arc, the rest is decomposed below.
+    termFlows = termCap;
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        Node& n = nodes[i];
+        if (n.excess < 0 && termFlows[i] < 0) {
+            Excess delta = std::max(n.excess, termFlows[i]);
+            n.excess -= delta;
+            termFlows[i] -= delta;
+        } else if (n.excess > 0 && termFlows[i] > 0) {
+            Excess delta = std::min(n.excess, termFlows[i]);
+            n.excess -= delta;
+            termFlows[i] -= delta;
+        }
+    }
+
+    for (ArcIdx j = 0; j < nodes[source].numOutOfTree; ++j) {
+        ArcIdx a = outOfTreeBegin(source)[j];
+        addOutOfTree(arcs[a].to, a);
+    }
+
+    nodes[source].excess = 0;
+    nodes[sink].excess = 0;
+
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        Node& n = nodes[i];
+
+        if (i == source || i == sink) {
+            continue;
+        }
+
+        if (n.label >= gap()) {
+            n.nextArc = 0;
+            if (n.parent != INVALID_NODE && arcs[n.arcToParent].flow) {
+                addOutOfTree(arcs[n.arcToParent].to, n.arcToParent);
+            }
+
+            ArcIdx *list = outOfTreeBegin(i);
+            for (ArcIdx j = 0; j < n.numOutOfTree; ++j) {
+                if (!arcs[list[j]].flow) {
+                    --n.numOutOfTree;
+                    list[j] = list[n.numOutOfTree];
+                    --j;
+                }
+            }
+
+            sort(i);
+        }
+    }
+
+    std::vector<ArcIdx> visited(numNodes, 0);
+
+    if (num_threads > 1) {
+        decomposeParallel(num_threads, visited);
+        return;
+    }
+
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        while (nodes[i].excess > 0) {
+            ++iteration;
+            decompose(i, visited, iteration);
+        }
+    }
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::decomposeParallel(
+    unsigned int num_threads, std::vector<ArcIdx>& visited)
+{
+    // Nodes which are not linked by out-of-tree arcs are decomposed independently, see Hpf
+    std::vector<NodeIdx> group(numNodes);
+    std::iota(group.begin(), group.end(), 0);
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        if (i == source || i == sink || nodes[i].label < gap()) {
+            continue;
+        }
+        const ArcIdx *list = outOfTreeBegin(i);
+        for (ArcIdx j = 0; j < nodes[i].numOutOfTree; ++j) {
+            const NodeIdx from = arcs[list[j]].from;
+            if (from != source && from != sink) {
+                union_groups(group, i, from);
+            }
+        }
+    }
+
+    decompose_groups<ArcIdx>(group, num_threads, [&](NodeIdx i) {
+        return nodes[i].excess > 0;
+    }, [&](NodeIdx i, ArcIdx& iteration) {
+        while (nodes[i].excess > 0) {
+            ++iteration;
+            decompose(i, visited, iteration);
+        }
+    });
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::init_mincut()
+{
+    // createOutOfTree
+    ArcIdx offset = 0;
+    for (Node& n : nodes) {
+        ArcIdx numAdjacent = n.firstOutOfTree;
+        n.firstOutOfTree = offset;
+        offset += numAdjacent;
+    }
+    outOfTree.resize(offset);
+
+    for (ArcIdx i = 0; i < static_cast<ArcIdx>(arcs.size()); ++i) {
+        Arc& a = arcs[i];
+        if (!(source == a.to || sink == a.from || a.from == a.to)) {
+            if (source == a.from && a.to == sink) {
+                a.flow = a.capacity;
+            } else if (a.from == source) {
+                addOutOfTree(a.from, i);
+            } else if (a.to == sink) {
+                addOutOfTree(a.to, i);
+            } else {
+                addOutOfTree(a.from, i);
+            }
+        }
+    }
+
+    // simpleInitialization
+    for (ArcIdx j = 0; j < nodes[source].numOutOfTree; ++j) {
+        Arc& a = arcs[outOfTreeBegin(source)[j]];
+        a.flow = a.capacity;
+        nodes[a.to].excess += a.capacity;
+    }
+
+    for (ArcIdx j = 0; j < nodes[sink].numOutOfTree; ++j) {
+        Arc& a = arcs[outOfTreeBegin(sink)[j]];
+        a.flow = a.capacity;
+        nodes[a.from].excess -= a.capacity;
+    }
+
+    nodes[source].excess = 0;
+    nodes[sink].excess = 0;
+
+    for (NodeIdx i = 0; i < numNodes; ++i) {
+        nodes[i].excess += termCap[i];
+        if (nodes[i].excess > 0) {
+            nodes[i].label = 1;
+            ++labelCount[1];
+
+            addToStrongBucket(i, strongRoots[1]);
+        }
+    }
+
+    nodes[source].label = numNodes;
+    nodes[sink].label = 0;
+    labelCount[0] = (numNodes - 2) - labelCount[1];
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline NodeIdx Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::gap() const noexcept
+{
+    return LABEL_ORDER == LabelOrder::LOWEST_FIRST ? lowestStrongLabel : numNodes;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline bool Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::reachedSource(NodeIdx current) const noexcept
+{
+    return current == source || termFlows[current] > 0;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::decompose(
+    NodeIdx excessNode, std::vector<ArcIdx>& visited, ArcIdx& iteration)
+{
+    NodeIdx current = excessNode;
+    ArcIdx tempArc;
+    Excess bottleneck = nodes[excessNode].excess;
+
+    for (; !reachedSource(current) && visited[current] < iteration; current = arcs[tempArc].from) {
+        visited[current] = iteration;
+        tempArc = currentArc(current);
+
+        if (arcs[tempArc].flow < bottleneck) {
+            bottleneck = arcs[tempArc].flow;
+        }
+    }
+
+    if (reachedSource(current)) {
+        const NodeIdx end = current;
+        if (end != source && termFlows[end] < bottleneck) {
+            bottleneck = termFlows[end];
+        }
+
+        nodes[excessNode].excess -= bottleneck;
+        current = excessNode;
+
+        while (current != end) {
+            tempArc = currentArc(current);
+            arcs[tempArc].flow -= bottleneck;
+
+            if (arcs[tempArc].flow) {
+                minisort(current);
+            } else {
+                ++nodes[current].nextArc;
+            }
+            current = arcs[tempArc].from;
+        }
+
+        if (end != source) {
+            termFlows[end] -= bottleneck;
+        }
+        return;
+    }
+
+    ++iteration;
+
+    bottleneck = arcs[currentArc(current)].flow;
+
+    while (visited[current] < iteration) {
+        visited[current] = iteration;
+        tempArc = currentArc(current);
+
+        if (arcs[tempArc].flow < bottleneck) {
+            bottleneck = arcs[tempArc].flow;
+        }
+        current = arcs[tempArc].from;
+    }
+
+    ++iteration;
+
+    while (visited[current] < iteration) {
+        visited[current] = iteration;
+
+        tempArc = currentArc(current);
+        arcs[tempArc].flow -= bottleneck;
+
+        if (arcs[tempArc].flow) {
+            minisort(current);
+        } else {
+            ++nodes[current].nextArc;
+        }
+        current = arcs[tempArc].from;
+    }
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::sort(NodeIdx current)
+{
+    // Out-of-tree arcs by decreasing flow
+    ArcIdx *list = outOfTreeBegin(current);
+    std::sort(list, list + nodes[current].numOutOfTree, [this](ArcIdx a, ArcIdx b) {
+        return arcs[a].flow > arcs[b].flow;
+    });
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::minisort(NodeIdx current)
+{
+    ArcIdx *list = outOfTreeBegin(current);
+    const Node& n = nodes[current];
+    ArcIdx temp = list[n.nextArc];
+    ArcIdx i, size = n.numOutOfTree;
+    Cap tempflow = arcs[temp].flow;
+
+    for (i = n.nextArc + 1; i < size && tempflow < arcs[list[i]].flow; ++i) {
+        list[i - 1] = list[i];
+    }
+    list[i - 1] = temp;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::addToStrongBucket(
+    NodeIdx newRoot, Root& rootBucket)
+{
+    if (ROOT_ORDER == RootOrder::FIFO) {
+        if (rootBucket.start != INVALID_NODE) {
+            nodes[rootBucket.end].next = newRoot;
+            rootBucket.end = newRoot;
+            nodes[newRoot].next = INVALID_NODE;
+        } else {
+            rootBucket.start = newRoot;
+            rootBucket.end = newRoot;
+            nodes[newRoot].next = INVALID_NODE;
+        }
+    } else {
+        nodes[newRoot].next = rootBucket.start;
+        rootBucket.start = newRoot;
+    }
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline NodeIdx Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::getHighestStrongRoot()
+{
+    NodeIdx i;
+    NodeIdx strongRoot;
+
+    for (i = highestStrongLabel; i > 0; --i) {
+        if (strongRoots[i].start != INVALID_NODE) {
+            highestStrongLabel = i;
+            if (labelCount[i - 1]) {
+                strongRoot = strongRoots[i].start;
+                strongRoots[i].start = nodes[strongRoot].next;
+                nodes[strongRoot].next = INVALID_NODE;
+                return strongRoot;
+            }
+
+            while (strongRoots[i].start != INVALID_NODE) {
+                strongRoot = strongRoots[i].start;
+                strongRoots[i].start = nodes[strongRoot].next;
+                liftAll(strongRoot);
+            }
+        }
+    }
+
+    if (strongRoots[0].start == INVALID_NODE) {
+        return INVALID_NODE;
+    }
+
+    while (strongRoots[0].start != INVALID_NODE) {
+        strongRoot = strongRoots[0].start;
+        strongRoots[0].start = nodes[strongRoot].next;
+        nodes[strongRoot].label = 1;
+        --labelCount[0];
+        ++labelCount[1];
+
+        addToStrongBucket(strongRoot, strongRoots[1]);
+    }
+
+    highestStrongLabel = 1;
+
+    strongRoot = strongRoots[1].start;
+    strongRoots[1].start = nodes[strongRoot].next;
+    nodes[strongRoot].next = INVALID_NODE;
+
+    return strongRoot;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline NodeIdx Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::getLowestStrongRoot()
+{
+    NodeIdx i;
+    NodeIdx strongRoot;
+
+    if (lowestStrongLabel == 0) {
+        while (strongRoots[0].start != INVALID_NODE) {
+            strongRoot = strongRoots[0].start;
+            strongRoots[0].start = nodes[strongRoot].next;
+            nodes[strongRoot].next = INVALID_NODE;
+
+            nodes[strongRoot].label = 1;
+
+            --labelCount[0];
+            ++labelCount[1];
+
+            addToStrongBucket(strongRoot, strongRoots[1]);
+        }
+        lowestStrongLabel = 1;
+    }
+
+    for (i = lowestStrongLabel; i < numNodes; ++i) {
+        if (strongRoots[i].start != INVALID_NODE) {
+            lowestStrongLabel = i;
+
+            if (labelCount[i - 1] == 0) {
+                return INVALID_NODE;
+            }
+
+            strongRoot = strongRoots[i].start;
+            strongRoots[i].start = nodes[strongRoot].next;
+            nodes[strongRoot].next = INVALID_NODE;
+            return strongRoot;
+        }
+    }
+
+    lowestStrongLabel = numNodes;
+    return INVALID_NODE;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline NodeIdx Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::getNextStrongRoot()
+{
+    if (LABEL_ORDER == LabelOrder::LOWEST_FIRST) {
+        return getLowestStrongRoot();
+    } else {
+        return getHighestStrongRoot();
+    }
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::processRoot(NodeIdx strongRoot)
+{
+    NodeIdx temp, strongNode = strongRoot, weakNode;
+    ArcIdx out;
+
+    nodes[strongRoot].nextScan = nodes[strongRoot].childList;
+
+    if ((out = findWeakNode(strongRoot, weakNode)) != INVALID_ARC) {
+        merge(weakNode, strongNode, out);
+        pushExcess(strongRoot);
+        return;
+    }
+
+    checkChildren(strongRoot);
+
+    while (strongNode != INVALID_NODE) {
+        while (nodes[strongNode].nextScan != INVALID_NODE) {
+            temp = nodes[strongNode].nextScan;
+            nodes[strongNode].nextScan = nodes[temp].next;
+            strongNode = temp;
+            nodes[strongNode].nextScan = nodes[strongNode].childList;
+
+            if ((out = findWeakNode(strongNode, weakNode)) != INVALID_ARC) {
+                merge(weakNode, strongNode, out);
+                pushExcess(strongRoot);
+                return;
+            }
+
+            checkChildren(strongNode);
+        }
+
+        if ((strongNode = nodes[strongNode].parent) != INVALID_NODE) {
+            checkChildren(strongNode);
+        }
+    }
+
+    addToStrongBucket(strongRoot, strongRoots[nodes[strongRoot].label]);
+
+    if (LABEL_ORDER == LabelOrder::HIGHEST_FIRST) {
+        ++highestStrongLabel;
+    }
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline ArcIdx Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::findWeakNode(
+    NodeIdx strongNode, NodeIdx& weakNode)
+{
+    Node& n = nodes[strongNode];
+    ArcIdx *list = outOfTreeBegin(strongNode);
+
+    const NodeIdx weakLabel = (LABEL_ORDER == LabelOrder::LOWEST_FIRST ?
+        lowestStrongLabel : highestStrongLabel) - 1;
+
+    for (ArcIdx i = n.nextArc; i < n.numOutOfTree; ++i) {
+        const ArcIdx out = list[i];
+        const Arc& a = arcs[out];
+        if (nodes[a.to].label == weakLabel) {
+            weakNode = a.to;
+        } else if (nodes[a.from].label == weakLabel) {
+            weakNode = a.from;
+        } else {
+            continue;
+        }
+        n.nextArc = i;
+        --n.numOutOfTree;
+        list[i] = list[n.numOutOfTree];
+        return out;
+    }
+
+    n.nextArc = n.numOutOfTree;
+
+    return INVALID_ARC;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::merge(NodeIdx parent, NodeIdx child, ArcIdx newArc)
+{
+    ArcIdx oldArc;
+    NodeIdx current = child, oldParent, newParent = parent;
+
+    while (nodes[current].parent != INVALID_NODE) {
+        oldArc = nodes[current].arcToParent;
+        nodes[current].arcToParent = newArc;
+        oldParent = nodes[current].parent;
+        breakRelationship(oldParent, current);
+        addRelationship(newParent, current);
+        newParent = current;
+        current = oldParent;
+        newArc = oldArc;
+        arcs[newArc].direction = !arcs[newArc].direction;
+    }
+
+    nodes[current].arcToParent = newArc;
+    addRelationship(newParent, current);
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::addRelationship(NodeIdx newParent, NodeIdx child)
+{
+    nodes[child].parent = newParent;
+    nodes[child].next = nodes[newParent].childList;
+    nodes[newParent].childList = child;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::breakRelationship(NodeIdx oldParent, NodeIdx child)
+{
+    NodeIdx current;
+
+    nodes[child].parent = INVALID_NODE;
+
+    if (nodes[oldParent].childList == child) {
+        nodes[oldParent].childList = nodes[child].next;
+        nodes[child].next = INVALID_NODE;
+        return;
+    }
+
+    for (current = nodes[oldParent].childList; nodes[current].next != child; current = nodes[current].next) {
+        // Do nothing
+    }
+
+    nodes[current].next = nodes[child].next;
+    nodes[child].next = INVALID_NODE;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::pushExcess(NodeIdx strongRoot)
+{
+    NodeIdx current, parent;
+    Excess prevEx = 1;
+
+    for (current = strongRoot; nodes[current].excess && nodes[current].parent != INVALID_NODE; current = parent) {
+        parent = nodes[current].parent;
+        prevEx = nodes[parent].excess;
+
+        const ArcIdx arcToParent = nodes[current].arcToParent;
+        const Arc& a = arcs[arcToParent];
+
+        if (a.direction) {
+            pushUpward(arcToParent, current, parent, (a.capacity - a.flow));
+        } else {
+            pushDownward(arcToParent, current, parent, a.flow);
+        }
+    }
+
+    if ((nodes[current].excess > 0) && (prevEx <= 0)) {
+        if (LABEL_ORDER == LabelOrder::LOWEST_FIRST) {
+            lowestStrongLabel = nodes[current].label;
+        }
+        addToStrongBucket(current, strongRoots[nodes[current].label]);
+    }
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::pushUpward(
+    ArcIdx currentArc, NodeIdx child, NodeIdx parent, Cap resCap)
+{
+    Arc& a = arcs[currentArc];
+    Node& c = nodes[child];
+    Node& p = nodes[parent];
+
+    if (resCap >= c.excess) {
+        p.excess += c.excess;
+        a.flow += c.excess;
+        c.excess = 0;
+        return;
+    }
+
+    a.direction = false;
+    p.excess += resCap;
+    c.excess -= resCap;
+    a.flow = a.capacity;
+    addOutOfTree(parent, currentArc);
+    breakRelationship(parent, child);
+
+    if (LABEL_ORDER == LabelOrder::LOWEST_FIRST) {
+        lowestStrongLabel = c.label;
+    }
+
+    addToStrongBucket(child, strongRoots[c.label]);
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::pushDownward(
+    ArcIdx currentArc, NodeIdx child, NodeIdx parent, Cap flow)
+{
+    Arc& a = arcs[currentArc];
+    Node& c = nodes[child];
+    Node& p = nodes[parent];
+
+    if (flow >= c.excess) {
+        p.excess += c.excess;
+        a.flow -= c.excess;
+        c.excess = 0;
+        return;
+    }
+
+    a.direction = true;
+    c.excess -= flow;
+    p.excess += flow;
+    a.flow = 0;
+    addOutOfTree(parent, currentArc);
+    breakRelationship(parent, child);
+
+    if (LABEL_ORDER == LabelOrder::LOWEST_FIRST) {
+        lowestStrongLabel = c.label;
+    }
+
+    addToStrongBucket(child, strongRoots[c.label]);
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::checkChildren(NodeIdx curNode)
+{
+    Node& n = nodes[curNode];
+
+    for (; n.nextScan != INVALID_NODE; n.nextScan = nodes[n.nextScan].next) {
+        if (nodes[n.nextScan].label == n.label) {
+            return;
+        }
+    }
+
+    --labelCount[n.label];
+    ++n.label;
+    ++labelCount[n.label];
+
+    n.nextArc = 0;
+}
+
+template <class Cap, class NodeIdx, class ArcIdx, LabelOrder LABEL_ORDER, RootOrder ROOT_ORDER>
+inline void Hpf2<Cap, NodeIdx, ArcIdx, LABEL_ORDER, ROOT_ORDER>::liftAll(NodeIdx rootNode)
+{
+    NodeIdx temp, current = rootNode;
+
+    nodes[current].nextScan = nodes[current].childList;
+
+    --labelCount[nodes[current].label];
+    nodes[current].label = numNodes;
+
+    for (; current != INVALID_NODE; current = nodes[current].parent) {
+        while (nodes[current].nextScan != INVALID_NODE) {
+            temp = nodes[current].nextScan;
+            nodes[current].nextScan = nodes[temp].next;
+            current = temp;
+            nodes[current].nextScan = nodes[current].childList;
+
+            --labelCount[nodes[current].label];
+            nodes[current].label = numNodes;
+        }
+    }
+}
+
+} // namespace reimpls
+
+#endif // REIMPLS_HPF_I_H__
@@ -1,19 +1,20 @@
 #ifndef REIMPLS_PARALLEL_GRAPH_H__
 #define REIMPLS_PARALLEL_GRAPH_H__
 
-#include <list>
 #include <unordered_map>
 #include <deque>
 #include <set>
 #include <thread>
 #include <atomic>
-#include <mutex>
+#include <chrono>
 #include <cinttypes>
 #include <cassert>
 #include <algorithm>
 #include <type_traits>
 
 #include "util.h"
+#include "alloc.h"
+#include "parallel_pr.h"
 
 namespace std {
 
@@ -63,6 +64,7 @@ class ParallelGraph {
     // Forward decls.
     struct Node;
     struct Arc;
+    struct BoundaryArc;
     struct BoundarySegment;
     struct GraphBlock;
 
@@ -71,7 +73,7 @@ public:
     static const ArcIdx INVALID_ARC = ~ArcIdx(0); // -1 for signed type, max. value for unsigned type
     static const ArcIdx TERMINAL_ARC = INVALID_ARC - 1;
     static const ArcIdx ORPHAN_ARC = INVALID_ARC - 2;
-    static const Cap INACTIVE_ARC = -1;
+    static constexpr Cap INACTIVE_ARC = -1;
 
     ParallelGraph(size_t expected_nodes, size_t expected_arcs, size_t expected_blocks);
 
@@ -81,6 +83,13 @@ public:
 
     void add_edge(NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap, bool merge_duplicates = true);
 
+    // Bulk versions of add_tweights and add_edge. term(k) must return a tuple (i, cap_source, cap_sink) and
+    // edge(k) a tuple (i, j, cap, rev_cap) for k = 0, ..., num - 1. The items are bucketed by block in
+    // parallel and each block is then written by the thread which solves it in phase 1. Duplicate edges
+    // are not merged.
+    template <class TermFunc> void bulk_add_tweights(size_t num_terms, TermFunc term);
+    template <class EdgeFunc> void bulk_add_edges(size_t num_edges, EdgeFunc edge);
+
     TermType what_segment(NodeIdx i, TermType default_segment = SOURCE) const;
 
     Flow maxflow();
@@ -92,41 +101,78 @@ public:
     inline unsigned int get_num_threads() const noexcept { return num_threads; }
     inline void set_num_threads(unsigned int num) noexcept { num_threads = num; }
 
+    inline ThreadPool& get_thread_pool() const noexcept { return *pool; }
+    inline void set_thread_pool(ThreadPool& p) noexcept { pool = &p; }
+
+    inline BlockPolicy get_block_policy() const noexcept { return block_policy; }
+    inline void set_block_policy(BlockPolicy policy) noexcept { block_policy = policy; }
+
+    // Once fewer than this many block pairs are left to merge, phase 2 stops merging and solves the residual
+    // graph of the remaining blocks with parallel push-relabel. 0 means always merge.
+    inline size_t get_tail_pairs() const noexcept { return tail_pairs; }
+    inline void set_tail_pairs(size_t num) noexcept { tail_pairs = num; }
+
     NodeArcSorting node_arc_sorting;
 
     std::chrono::duration<double> ph1_dur;
     std::chrono::duration<double> bs_dur;
     std::chrono::duration<double> ph2_dur;
+    std::chrono::duration<double> tail_dur; // Part of ph2_dur
+
+    // Work distribution of the last maxflow: seconds each thread was busy in phase 1 and 2, and seconds
+    // each block took to solve in phase 1
+    std::vector<double> ph1_busy;
+    std::vector<double> ph2_busy;
+    std::vector<double> block_work;
 
 private:
-    std::vector<Node> nodes;
-    std::vector<Arc> arcs;
+    PolicyVector<Node> nodes;
+    PolicyVector<Arc> arcs;
 
     std::vector<BlockIdx> node_blocks;
 
-    std::unordered_map<std::pair<BlockIdx, BlockIdx>, std::vector<std::pair<ArcIdx, Cap>>> boundary_arcs;
-    std::list<BoundarySegment> boundary_segments;
-    std::vector<BlockIdx> block_idxs;
+    // Flat table of boundary arcs. It is sorted by block pair before phase 2 so each boundary segment
+    // is a contiguous range.
+    std::vector<BoundaryArc> boundary_arcs;
+    // Phase 2 merge scheduler. Boundary segments are sorted by decreasing potential activations and
+    // claimed without a global lock: blocks are united in a union-find forest and a thread must own
+    // both roots before merging them. The per-root segment lists are only touched by the root's owner.
+    std::vector<BoundarySegment> boundary_segments;
+    std::vector<std::atomic<bool>> segment_done;
+    std::atomic<size_t> first_segment;
+    std::vector<std::atomic<BlockIdx>> block_parents;
+    std::vector<std::atomic<bool>> block_owned;
+    std::vector<std::vector<size_t>> block_segments;
 
     std::vector<GraphBlock> blocks;
 
     unsigned int num_threads;
+    ThreadPool *pool;
+    BlockPolicy block_policy;
+    size_t tail_pairs;
 
 
+    struct BoundaryArc {
+        BlockIdx i; // Block pair with i < j
+        BlockIdx j;
+        ArcIdx arc;
+        Cap cap; // Capacity given to the arc when it is activated
+    };
+
     struct BoundarySegment {
-        const std::vector<std::pair<ArcIdx, Cap>>& arcs;
+        size_t first; // Range of boundary_arcs
+        size_t last;
         BlockIdx i;
         BlockIdx j;
         int32_t potential_activations;
     };
 
     struct GraphBlock {
-        std::vector<Node>& nodes;
-        std::vector<Arc>& arcs;
+        PolicyVector<Node>& nodes;
+        PolicyVector<Arc>& arcs;
         std::vector<BlockIdx>& node_blocks;
 
         BlockIdx self;
-        bool locked;
         bool initialized;
 
         Flow flow;
@@ -136,13 +182,12 @@ private:
 
         Time time;
 
-        GraphBlock(std::vector<Node>& nodes, std::vector<Arc>& arcs, std::vector<BlockIdx>& node_blocks,
+        GraphBlock(PolicyVector<Node>& nodes, PolicyVector<Arc>& arcs, std::vector<BlockIdx>& node_blocks,
             BlockIdx self) :
             nodes(nodes),
             arcs(arcs),
             node_blocks(node_blocks),
             self(self),
-            locked(false),
             initialized(false),
             flow(0),
             first_active(INVALID_NODE),
@@ -229,7 +274,21 @@ private:
 
     inline std::pair<BlockIdx, BlockIdx> block_key(BlockIdx i, BlockIdx j) const noexcept;
 
-    std::pair<std::list<BoundarySegment>, BlockIdx> next_boundary_segment_set();
+    // Threads used for the bulk build and phase 1. Block b is owned by thread b % owner_threads().
+    inline unsigned int owner_threads() const noexcept
+    {
+        return static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(num_threads, blocks.size())));
+    }
+
+    template <class Idx, class BucketFunc>
+    void bucket_indices(size_t num, size_t num_buckets, BucketFunc bucket, std::vector<Idx>& order,
+        std::vector<size_t>& begin) const;
+
+    BlockIdx find_block_root(BlockIdx b);
+    bool try_claim_block(BlockIdx b);
+    inline void release_block(BlockIdx b) { block_owned[b].store(false, std::memory_order_release); }
+    bool claim_boundary_segment_set(std::vector<size_t>& out, BlockIdx& out_idx);
+    Flow solve_tail();
 
     inline ArcIdx sister_idx(ArcIdx a) const noexcept { return a ^ 1; }
     inline Arc &sister(ArcIdx a) { return arcs[sister_idx(a)]; }
@@ -250,13 +309,25 @@ ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::ParallelGraph(
     ph1_dur(),
     bs_dur(),
     ph2_dur(),
+    tail_dur(),
+    ph1_busy(),
+    ph2_busy(),
+    block_work(),
     nodes(),
     arcs(),
     node_blocks(),
     boundary_arcs(),
     boundary_segments(),
+    segment_done(),
+    first_segment(0),
+    block_parents(),
+    block_owned(),
+    block_segments(),
     blocks(),
     num_threads(std::thread::hardware_concurrency()),
+    pool(&default_thread_pool()),
+    block_policy(BLOCK_POLICY_FIXED),
+    tail_pairs(0),
     node_arc_sorting(LIFO)
 {
     nodes.reserve(expected_nodes);
@@ -285,7 +356,6 @@ inline NodeIdx ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::add_node(size_t
         // We assume that we always have blocks 0,1,2,...,N
         for (int b = blocks.size(); b <= block; ++b) {
             blocks.emplace_back(nodes, arcs, node_blocks, b);
-            block_idxs.push_back(b);
         }
     }
     return crnt;
@@ -337,11 +407,216 @@ inline void ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::add_edge(
         const ArcIdx a1 = add_half_edge(i, j, INACTIVE_ARC, merge_duplicates);
         const ArcIdx a2 = add_half_edge(j, i, INACTIVE_ARC, merge_duplicates);
         const auto key = block_key(bi, bj);
-        boundary_arcs[key].push_back(std::make_pair(a1, cap));
-        boundary_arcs[key].push_back(std::make_pair(a2, rev_cap));
+        boundary_arcs.push_back({ key.first, key.second, a1, cap });
+        boundary_arcs.push_back({ key.first, key.second, a2, rev_cap });
     }
 }
 
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
+template <class Idx, class BucketFunc>
+inline void ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::bucket_indices(
+    size_t num, size_t num_buckets, BucketFunc bucket, std::vector<Idx>& order, std::vector<size_t>& begin) const
+{
+    // Parallel stable counting sort of 0, ..., num - 1 by bucket. Every thread counts its own chunk so it
+    // also gets its own write offset in each bucket.
+    const unsigned int threads = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(num_threads, num)));
+    const size_t chunk = (num + threads - 1) / threads;
+    std::vector<std::vector<size_t>> offsets(threads, std::vector<size_t>(num_buckets, 0));
+
+    parallel_for_threads(*pool, threads, [&](unsigned int t) {
+        auto& counts = offsets[t];
+        const size_t end = std::min(num, (t + 1) * chunk);
+        for (size_t k = t * chunk; k < end; ++k) {
+            counts[bucket(k)]++;
+        }
+    });
+
+    begin.assign(num_buckets + 1, 0);
+    size_t sum = 0;
+    for (size_t b = 0; b < num_buckets; ++b) {
+        begin[b] = sum;
+        for (auto& counts : offsets) {
+            const size_t c = counts[b];
+            counts[b] = sum;
+            sum += c;
+        }
+    }
+    begin[num_buckets] = sum;
+
+    order.resize(num);
+    parallel_for_threads(*pool, threads, [&](unsigned int t) {
+        auto& offs = offsets[t];
+        const size_t end = std::min(num, (t + 1) * chunk);
+        for (size_t k = t * chunk; k < end; ++k) {
+            order[offs[bucket(k)]++] = static_cast<Idx>(k);
+        }
+    });
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
+template <class TermFunc>
+inline void ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::bulk_add_tweights(size_t num_terms, TermFunc term)
+{
+    const size_t num_blocks = blocks.size();
+    std::vector<size_t> order;
+    std::vector<size_t> begin;
+    bucket_indices(num_terms, num_blocks, [&](size_t k) {
+        return node_blocks[std::get<0>(term(k))];
+    }, order, begin);
+
+    // Terminal capacities only touch the node and the flow of its block, so owners don't interfere
+    const unsigned int owners = owner_threads();
+    parallel_for_threads(*pool, owners, [&](unsigned int t) {
+        for (size_t b = t; b < num_blocks; b += owners) {
+            for (size_t p = begin[b]; p < begin[b + 1]; ++p) {
+                const auto tw = term(order[p]);
+                add_tweights(std::get<0>(tw), std::get<1>(tw), std::get<2>(tw));
+            }
+        }
+    });
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
+template <class EdgeFunc>
+inline void ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::bulk_add_edges(size_t num_edges, EdgeFunc edge)
+{
+    struct BoundaryEdge {
+        BlockIdx i;
+        BlockIdx j;
+        ArcIdx edge;
+    };
+    const auto edge_less = [](const BoundaryEdge& a, const BoundaryEdge& b) {
+        return std::tie(a.i, a.j, a.edge) < std::tie(b.i, b.j, b.edge);
+    };
+
+    const size_t num_blocks = blocks.size();
+    const size_t arc_base = arcs.size();
+
+#ifndef REIMPLS_NO_OVERFLOW_CHECKS
+    if (num_edges > (std::numeric_limits<ArcIdx>::max() - 2 - arc_base) / 2) {
+        throw std::overflow_error("Arc count exceeds capacity of index type. "
+            "Please increase capacity of ArcIdx type.");
+    }
+#endif
+
+    // Bucket edges by block. Boundary edges go in an extra bucket at the end.
+    std::vector<ArcIdx> order;
+    std::vector<size_t> begin;
+    bucket_indices(num_edges, num_blocks + 1, [&](size_t k) {
+        const auto e = edge(k);
+        const BlockIdx bi = node_blocks[std::get<0>(e)];
+        const BlockIdx bj = node_blocks[std::get<1>(e)];
+        return bi == bj ? size_t(bi) : num_blocks;
+    }, order, begin);
+
+    // Sort boundary edges by block pair. Each thread sorts its own chunk and the chunks are merged pairwise.
+    const size_t bnd_offset = begin[num_blocks];
+    const size_t num_bnd = num_edges - bnd_offset;
+    std::vector<BoundaryEdge> bnd(num_bnd);
+    const unsigned int threads = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(num_threads, num_bnd)));
+    const size_t chunk = (num_bnd + threads - 1) / threads;
+    parallel_for_threads(*pool, threads, [&](unsigned int t) {
+        const size_t lo = std::min(num_bnd, t * chunk);
+        const size_t hi = std::min(num_bnd, lo + chunk);
+        for (size_t p = lo; p < hi; ++p) {
+            const ArcIdx k = order[bnd_offset + p];
+            const auto e = edge(k);
+            const auto key = block_key(node_blocks[std::get<0>(e)], node_blocks[std::get<1>(e)]);
+            bnd[p] = { key.first, key.second, k };
+        }
+        std::sort(bnd.begin() + lo, bnd.begin() + hi, edge_less);
+    });
+    for (size_t width = chunk; width > 0 && width < num_bnd; width *= 2) {
+        const size_t num_merges = (num_bnd + 2 * width - 1) / (2 * width);
+        parallel_for_blocks(*pool, num_merges, num_threads, [&](size_t lo, size_t hi) {
+            for (size_t m = lo; m < hi; ++m) {
+                const size_t first = 2 * width * m;
+                const size_t mid = std::min(num_bnd, first + width);
+                const size_t last = std::min(num_bnd, first + 2 * width);
+                std::inplace_merge(bnd.begin() + first, bnd.begin() + mid, bnd.begin() + last, edge_less);
+            }
+        });
+    }
+
+    // Block b gets its internal arc pairs followed by the boundary arc pairs whose first block is b.
+    // The k'th internal edge (in bucket order) of block b then starts at arc 2 * (k + bnd_begin[b]) and
+    // the k'th boundary edge at arc 2 * (begin[b + 1] + k), both relative to arc_base.
+    std::vector<size_t> bnd_begin(num_blocks + 1);
+    for (size_t b = 0; b <= num_blocks; ++b) {
+        bnd_begin[b] = std::partition_point(bnd.begin(), bnd.end(), [&](const BoundaryEdge& be) {
+            return be.i < b;
+        }) - bnd.begin();
+    }
+    // Boundary segments indexed by their second block, so its owner can link the remaining half arcs
+    std::vector<std::vector<size_t>> second_segments(num_blocks);
+    for (size_t p = 0; p < num_bnd; ++p) {
+        if (p == 0 || bnd[p].i != bnd[p - 1].i || bnd[p].j != bnd[p - 1].j) {
+            second_segments[bnd[p].j].push_back(p);
+        }
+    }
+
+    arcs.resize(arc_base + 2 * num_edges);
+    const size_t table_base = boundary_arcs.size();
+    boundary_arcs.resize(table_base + 2 * num_bnd);
+
+    const unsigned int owners = owner_threads();
+
+    // Write all arcs of the owned blocks and link the ones starting in them
+    parallel_for_threads(*pool, owners, [&](unsigned int t) {
+        for (size_t b = t; b < num_blocks; b += owners) {
+            for (size_t p = begin[b]; p < begin[b + 1]; ++p) {
+                const auto e = edge(order[p]);
+                const NodeIdx i = std::get<0>(e);
+                const NodeIdx j = std::get<1>(e);
+                assert(i != j);
+                assert(std::get<2>(e) >= 0);
+                assert(std::get<3>(e) >= 0);
+
+                const ArcIdx a = arc_base + 2 * (p + bnd_begin[b]);
+                arcs[a] = Arc(j, nodes[i].first, std::get<2>(e));
+                nodes[i].first = a;
+                arcs[a + 1] = Arc(i, nodes[j].first, std::get<3>(e));
+                nodes[j].first = a + 1;
+            }
+            for (size_t p = bnd_begin[b]; p < bnd_begin[b + 1]; ++p) {
+                const auto e = edge(bnd[p].edge);
+                const NodeIdx i = std::get<0>(e);
+                const NodeIdx j = std::get<1>(e);
+                assert(std::get<2>(e) >= 0);
+                assert(std::get<3>(e) >= 0);
+
+                const ArcIdx a = arc_base + 2 * (begin[b + 1] + p);
+                arcs[a] = Arc(j, INVALID_ARC, INACTIVE_ARC);
+                arcs[a + 1] = Arc(i, INVALID_ARC, INACTIVE_ARC);
+                const ArcIdx own = node_blocks[i] == b ? a : a + 1;
+                const NodeIdx tail = node_blocks[i] == b ? i : j;
+                arcs[own].next = nodes[tail].first;
+                nodes[tail].first = own;
+
+                boundary_arcs[table_base + 2 * p] = { bnd[p].i, bnd[p].j, a, static_cast<Cap>(std::get<2>(e)) };
+                boundary_arcs[table_base + 2 * p + 1] = {
+                    bnd[p].i, bnd[p].j, static_cast<ArcIdx>(a + 1), static_cast<Cap>(std::get<3>(e)) };
+            }
+        }
+    });
+
+    // Link the boundary arcs which start in the second block of their segment
+    parallel_for_threads(*pool, owners, [&](unsigned int t) {
+        for (size_t b = t; b < num_blocks; b += owners) {
+            for (size_t first : second_segments[b]) {
+                for (size_t p = first; p < num_bnd && bnd[p].i == bnd[first].i && bnd[p].j == b; ++p) {
+                    const ArcIdx a = arc_base + 2 * (begin[bnd[p].i + 1] + p);
+                    // The arc starting in b is the one whose sister points into b
+                    const ArcIdx own = node_blocks[arcs[a + 1].head] == b ? a : a + 1;
+                    const NodeIdx tail = arcs[sister_idx(own)].head;
+                    arcs[own].next = nodes[tail].first;
+                    nodes[tail].first = own;
+                }
+            }
+        }
+    });
+}
+
 template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
 inline ArcIdx ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::add_half_edge(
     NodeIdx from, NodeIdx to, Cap cap, bool merge_duplicates)
@@ -433,44 +708,87 @@ inline Flow ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::maxflow()
 
     Flow flow = 0;
 
-    std::atomic<BlockIdx> processed_blocks = 0;
-    std::vector<std::thread> threads;
-
     init_maxflow();
 
-    // Solve all base blocks.
-    for (unsigned int i = 0; i < num_threads; ++i) {
-        threads.emplace_back([&]() {
-            const BlockIdx num_blocks = blocks.size();
-            BlockIdx crnt = processed_blocks.fetch_add(1);
-            while (crnt < num_blocks) {
-                blocks[crnt].maxflow();
-                crnt = processed_blocks.fetch_add(1);
+    const size_t num_blocks = blocks.size();
+    const unsigned int owners = owner_threads();
+    ph1_busy.assign(owners, 0);
+    block_work.assign(num_blocks, 0);
+    const auto solve_block = [&](size_t b, unsigned int t) {
+        auto solve_begin = std::chrono::steady_clock::now();
+        blocks[b].maxflow();
+        block_work[b] = std::chrono::duration<double>(std::chrono::steady_clock::now() - solve_begin).count();
+        ph1_busy[t] += block_work[b];
+    };
+
+    if (block_policy == BLOCK_POLICY_ADAPTIVE) {
+        // Estimate the work of each block by its number of nodes. Blocks are solved heaviest first so a
+        // large block does not start last, and light blocks are batched so they don't cost a task each.
+        std::vector<std::vector<double>> counts(owners, std::vector<double>(num_blocks, 0));
+        parallel_for_threads(*pool, owners, [&](unsigned int t) {
+            const size_t end = node_blocks.size() * (t + 1) / owners;
+            for (size_t i = node_blocks.size() * t / owners; i < end; ++i) {
+                counts[t][node_blocks[i]] += 1;
             }
         });
-    }
-    for (auto &th : threads) {
-        if (th.joinable()) {
-            th.join();
+        for (unsigned int t = 1; t < owners; ++t) {
+            for (size_t b = 0; b < num_blocks; ++b) {
+                counts[0][b] += counts[t][b];
+            }
         }
+
+        std::vector<size_t> order;
+        std::vector<size_t> task_begin;
+        plan_work_tasks(counts[0], double(nodes.size()) / (8 * owners), order, task_begin);
+        parallel_for_queue(*pool, task_begin.size() - 1, owners, [&](size_t k, unsigned int t) {
+            for (size_t p = task_begin[k]; p < task_begin[k + 1]; ++p) {
+                solve_block(order[p], t);
+            }
+        });
+    } else {
+        // Solve all base blocks. Every thread first solves the blocks it owns, which are the ones it wrote
+        // in the bulk build, and then helps the other threads with theirs.
+        std::vector<std::atomic<size_t>> next_owned(owners);
+        for (auto& next : next_owned) {
+            next.store(0, std::memory_order_relaxed);
+        }
+        parallel_for_threads(*pool, owners, [&](unsigned int t) {
+            for (unsigned int k = 0; k < owners; ++k) {
+                const unsigned int owner = (t + k) % owners;
+                size_t crnt = owner + owners * next_owned[owner].fetch_add(1);
+                while (crnt < num_blocks) {
+                    solve_block(crnt, t);
+                    crnt = owner + owners * next_owned[owner].fetch_add(1);
+                }
+            }
+        });
     }
 
     ph1_dur = std::chrono::system_clock::now() - ph1_begin;
     auto bs_begin = std::chrono::system_clock::now();
 
-    // Build list of boundary segments
-    for (const auto& ba : boundary_arcs) {
-        BlockIdx i, j;
-        std::tie(i, j) = ba.first;
-        boundary_segments.push_back({ ba.second, i, j, 0 });
+    // Sort boundary arcs by block pair and build list of boundary segments
+    const auto key_less = [](const BoundaryArc& a, const BoundaryArc& b) {
+        return std::tie(a.i, a.j) < std::tie(b.i, b.j);
+    };
+    if (!std::is_sorted(boundary_arcs.begin(), boundary_arcs.end(), key_less)) {
+        std::stable_sort(boundary_arcs.begin(), boundary_arcs.end(), key_less);
+    }
+    boundary_segments.clear();
+    for (size_t first = 0, last; first < boundary_arcs.size(); first = last) {
+        const BlockIdx i = boundary_arcs[first].i;
+        const BlockIdx j = boundary_arcs[first].j;
+        for (last = first + 1; last < boundary_arcs.size() &&
+            boundary_arcs[last].i == i && boundary_arcs[last].j == j; ++last) {}
+        boundary_segments.push_back({ first, last, i, j, 0 });
     }
 
     // Count number of potential activations for each boundary segment and sort
     for (auto &bs : boundary_segments) {
         int32_t potential_activations = 0;
-        for (const auto &a : bs.arcs) {
-            Arc& arc = arcs[a.first];
-            Arc& sister_arc = sister(a.first);
+        for (size_t a = bs.first; a < bs.last; ++a) {
+            Arc& arc = arcs[boundary_arcs[a].arc];
+            Arc& sister_arc = sister(boundary_arcs[a].arc);
             if (should_activate(arc.head, sister_arc.head)) {
                 potential_activations++;
             }
@@ -478,79 +796,110 @@ inline Flow ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::maxflow()
         bs.potential_activations = potential_activations;
     }
 
-    boundary_segments.sort([](const auto& bs1, const auto& bs2) {
+    std::stable_sort(boundary_segments.begin(), boundary_segments.end(), [](const auto& bs1, const auto& bs2) {
         return bs1.potential_activations > bs2.potential_activations;
     });
+    if (block_policy == BLOCK_POLICY_ADAPTIVE) {
+        // Merge the block pairs that were cheapest to solve first. Heavy blocks then join few, late merges
+        // instead of growing through a long chain of merges that other threads have to wait for.
+        std::stable_sort(boundary_segments.begin(), boundary_segments.end(), [&](const auto& bs1, const auto& bs2) {
+            return block_work[bs1.i] + block_work[bs1.j] < block_work[bs2.i] + block_work[bs2.j];
+        });
+    }
+
+    // Set up the merge scheduler: every block is its own root and lists the segments touching it
+    const size_t num_segments = boundary_segments.size();
+    segment_done = std::vector<std::atomic<bool>>(num_segments);
+    first_segment.store(0, std::memory_order_relaxed);
+    block_parents = std::vector<std::atomic<BlockIdx>>(blocks.size());
+    block_owned = std::vector<std::atomic<bool>>(blocks.size());
+    block_segments.assign(blocks.size(), std::vector<size_t>());
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        block_parents[b].store(b, std::memory_order_relaxed);
+        block_owned[b].store(false, std::memory_order_relaxed);
+    }
+    for (size_t s = 0; s < num_segments; ++s) {
+        segment_done[s].store(false, std::memory_order_relaxed);
+        block_segments[boundary_segments[s].i].push_back(s);
+        block_segments[boundary_segments[s].j].push_back(s);
+    }
 
     bs_dur = std::chrono::system_clock::now() - bs_begin;
     auto ph2_begin = std::chrono::system_clock::now();
 
     // Merge blocks
-    threads.clear();
-    std::mutex lock;
-    
-    for (unsigned int i = 0; i < num_threads; ++i) {
-        threads.emplace_back([&]() {
+    std::atomic<size_t> remaining_segments(num_segments);
+    std::atomic<unsigned int> live_threads(num_threads);
+    ph2_busy.assign(num_threads, 0);
+
+    parallel_for_threads(*pool, num_threads, [&](unsigned int t) {
 
-            BlockIdx crnt;
-            std::list<BoundarySegment> boundary_set;
+        BlockIdx crnt;
+        std::vector<size_t> boundary_set;
 
-            while (true) {
+        while (true) {
 
-                lock.lock();
+            if (remaining_segments.load(std::memory_order_acquire) < tail_pairs) {
+                // Leave the remaining blocks to the tail solve
+                break;
+            }
 
-                std::tie(boundary_set, crnt) = next_boundary_segment_set();
-                if (boundary_set.empty()) {
-                    lock.unlock();
+            if (!claim_boundary_segment_set(boundary_set, crnt)) {
+                if (remaining_segments.load(std::memory_order_acquire) == 0) {
                     break;
                 }
+                // Every pending segment touches a block owned by another thread. That thread will
+                // look at the segment again when it is done, so we can leave unless we are the last one.
+                if (live_threads.fetch_sub(1, std::memory_order_acq_rel) > 1) {
+                    break;
+                }
+                live_threads.fetch_add(1, std::memory_order_acq_rel);
+                std::this_thread::yield();
+                continue;
+            }
 
-                // Lock block
-                auto& block = blocks[crnt];
-                block.locked = true;
-
-                lock.unlock();
+            auto& block = blocks[crnt];
+            auto merge_begin = std::chrono::steady_clock::now();
 
-                // Activate boundary arcs
-                for (const auto& bs : boundary_set) {
-                    for (const auto& a : bs.arcs) {
-                        Arc& arc = arcs[a.first];
-                        Arc& sister_arc = sister(a.first);
+            // Activate boundary arcs
+            for (size_t s : boundary_set) {
+                const auto& bs = boundary_segments[s];
+                for (size_t a = bs.first; a < bs.last; ++a) {
+                    const BoundaryArc& ba = boundary_arcs[a];
+                    Arc& arc = arcs[ba.arc];
+                    Arc& sister_arc = sister(ba.arc);
 
-                        arc.r_cap = a.second;
+                    arc.r_cap = ba.cap;
 
-                        if (should_activate(arc.head, sister_arc.head)) {
-                            block.make_active(arc.head);
-                        }
+                    if (should_activate(arc.head, sister_arc.head)) {
+                        block.make_active(arc.head);
                     }
                 }
+            }
 
-                // Compute maxflow
-                auto solve_begin = std::chrono::system_clock::now();
-
-                block.maxflow();
+            // Compute maxflow
+            block.maxflow();
+            ph2_busy[t] += std::chrono::duration<double>(std::chrono::steady_clock::now() - merge_begin).count();
 
-                std::chrono::duration<double> solve_dur = std::chrono::system_clock::now() - solve_begin;
-                
-                lock.lock();
-                block.locked = false;
-                lock.unlock();
-            }
-        });
-    }
-    for (auto& th : threads) {
-        if (th.joinable()) {
-            th.join();
+            remaining_segments.fetch_sub(boundary_set.size(), std::memory_order_acq_rel);
+            release_block(crnt);
         }
+    });
+
+    tail_dur = tail_dur.zero();
+    if (remaining_segments.load(std::memory_order_acquire) > 0) {
+        auto tail_begin = std::chrono::system_clock::now();
+        flow += solve_tail();
+        tail_dur = std::chrono::system_clock::now() - tail_begin;
     }
 
     ph2_dur = std::chrono::system_clock::now() - ph2_begin;
 
     // Sum up all subgraph flows
-    std::sort(block_idxs.begin(), block_idxs.end());
-    auto last = std::unique(block_idxs.begin(), block_idxs.end());
-    for (auto iter = block_idxs.begin(); iter != last; ++iter) {
-        flow += blocks[*iter].flow;
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (block_parents[b].load(std::memory_order_relaxed) == b) {
+            flow += blocks[b].flow;
+        }
     }
     return flow;
 }
@@ -563,43 +912,171 @@ inline std::pair<BlockIdx, BlockIdx> ParallelGraph<Cap, Term, Flow, ArcIdx, Node
 }
 
 template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline std::pair<
-    std::list<typename ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::BoundarySegment>, BlockIdx>
-ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::next_boundary_segment_set()
+inline BlockIdx ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::find_block_root(BlockIdx b)
 {
-    // NOTE: We assume the global lock is grabbed at this point so no other threads are scanning
-    std::list<BoundarySegment> out;
-    BlockIdx out_idx = 0;
-
-    // Scan until we find a boundary segment with unlocked blocks
-    auto iter = boundary_segments.begin();
-    for (; iter != boundary_segments.end(); ++iter) {
-        const auto& bs = *iter;
-        if (!blocks[block_idxs[bs.i]].locked && !blocks[block_idxs[bs.j]].locked) {
-            // Found boundary between two unlocked blocks
-            out_idx = block_idxs[bs.i];
-            BlockIdx j = block_idxs[bs.j];
-            // Unite blocks
-            std::replace(block_idxs.begin(), block_idxs.end(), j, out_idx);
-            blocks[out_idx].time = std::max(blocks[out_idx].time, blocks[j].time);
-            blocks[out_idx].flow += blocks[j].flow;
-            break;
+    // Path halving. Only the owner of a root may give it a parent, but any thread may shortcut
+    // non-root blocks since every ancestor of a block stays in the same set.
+    while (true) {
+        BlockIdx p = block_parents[b].load(std::memory_order_acquire);
+        if (p == b) {
+            return b;
+        }
+        BlockIdx gp = block_parents[p].load(std::memory_order_acquire);
+        if (gp != p) {
+            block_parents[b].compare_exchange_weak(p, gp, std::memory_order_release, std::memory_order_relaxed);
         }
+        b = gp;
+    }
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
+inline bool ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::try_claim_block(BlockIdx b)
+{
+    if (block_owned[b].load(std::memory_order_relaxed) || block_owned[b].exchange(true, std::memory_order_acquire)) {
+        return false;
+    }
+    // The block may have been merged into another one after we looked it up
+    if (block_parents[b].load(std::memory_order_acquire) != b) {
+        release_block(b);
+        return false;
+    }
+    return true;
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
+inline bool ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::claim_boundary_segment_set(
+    std::vector<size_t>& out, BlockIdx& out_idx)
+{
+    const size_t num_segments = boundary_segments.size();
+    out.clear();
+
+    // Skip the prefix of finished segments and let other threads skip it too
+    size_t first = first_segment.load(std::memory_order_relaxed);
+    while (first < num_segments && segment_done[first].load(std::memory_order_acquire)) {
+        ++first;
     }
-    // If we are not at the end, move all relevant boundary segments to output
-    // Note that iter starts at the found boundary segment or at the end
-    while (iter != boundary_segments.end()) {
-        const auto &bs = *iter;
-        if (block_idxs[bs.i] == out_idx && block_idxs[bs.j] == out_idx) {
-            out.push_back(bs);
-            auto to_erase = iter;
-            ++iter;
-            boundary_segments.erase(to_erase);
+    size_t seen = first_segment.load(std::memory_order_relaxed);
+    while (seen < first && !first_segment.compare_exchange_weak(seen, first, std::memory_order_relaxed)) {}
+
+    // Scan until we find a boundary segment between two unowned blocks
+    for (size_t s = first; s < num_segments; ++s) {
+        if (segment_done[s].load(std::memory_order_acquire)) {
+            continue;
+        }
+        const auto& bs = boundary_segments[s];
+        BlockIdx i = find_block_root(bs.i);
+        BlockIdx j = find_block_root(bs.j);
+        if (i == j) {
+            // Blocks were just united and the owner is collecting this segment
+            continue;
+        }
+        if (!try_claim_block(i)) {
+            continue;
+        }
+        if (!try_claim_block(j)) {
+            release_block(i);
+            continue;
+        }
+
+        // We own both roots now so nobody else can change them. Unite blocks.
+        out_idx = i;
+        blocks[i].time = std::max(blocks[i].time, blocks[j].time);
+        blocks[i].flow += blocks[j].flow;
+        block_parents[j].store(i, std::memory_order_release);
+        release_block(j);
+
+        // Move all segments that are now internal to the output and keep the rest for later merges
+        auto& segments = block_segments[i];
+        segments.insert(segments.end(), block_segments[j].begin(), block_segments[j].end());
+        block_segments[j] = std::vector<size_t>();
+        auto last = std::remove_if(segments.begin(), segments.end(), [&](size_t t) {
+            if (segment_done[t].load(std::memory_order_relaxed)) {
+                return true;
+            }
+            const auto& ts = boundary_segments[t];
+            if (find_block_root(ts.i) == i && find_block_root(ts.j) == i) {
+                segment_done[t].store(true, std::memory_order_release);
+                out.push_back(t);
+                return true;
+            }
+            return false;
+        });
+        segments.erase(last, segments.end());
+        return true;
+    }
+    return false;
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
+inline Flow ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::solve_tail()
+{
+    // Find the blocks which are still waiting for a merge and activate the boundary arcs between them
+    std::vector<BlockIdx> roots(blocks.size());
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        roots[b] = find_block_root(b);
+    }
+    std::vector<bool> in_tail(blocks.size(), false);
+    for (size_t s = 0; s < boundary_segments.size(); ++s) {
+        if (segment_done[s].load(std::memory_order_relaxed)) {
+            continue;
+        }
+        const auto& bs = boundary_segments[s];
+        in_tail[roots[bs.i]] = true;
+        in_tail[roots[bs.j]] = true;
+        for (size_t a = bs.first; a < bs.last; ++a) {
+            arcs[boundary_arcs[a].arc].r_cap = boundary_arcs[a].cap;
+        }
+    }
+
+    // Number the nodes of these blocks
+    std::vector<NodeIdx> tail_idx(nodes.size(), INVALID_NODE);
+    NodeIdx num_tail = 0;
+    for (NodeIdx i = 0; i < nodes.size(); ++i) {
+        if (in_tail[roots[node_blocks[i]]]) {
+            tail_idx[i] = num_tail++;
+        }
+    }
+
+    // The residual graph of the blocks continues from the flow they have found so far. Arcs between tail
+    // blocks and finished blocks don't exist, as those would have been merged.
+    using PushRelabel = ParallelPushRelabel<Term, Flow, ArcIdx, NodeIdx>;
+    PushRelabel tail(num_tail, arcs.size() / 2);
+    tail.set_num_threads(num_threads);
+    tail.set_thread_pool(*pool);
+    for (NodeIdx i = 0; i < nodes.size(); ++i) {
+        const Term tr_cap = nodes[i].tr_cap;
+        if (tail_idx[i] == INVALID_NODE || tr_cap == 0) {
+            continue;
+        }
+        if (tr_cap > 0) {
+            tail.add_tweights(tail_idx[i], tr_cap, 0);
         } else {
-            ++iter;
+            tail.add_tweights(tail_idx[i], 0, -tr_cap);
         }
     }
-    return std::make_pair(out, out_idx);
+    for (ArcIdx a = 0; a < arcs.size(); a += 2) {
+        const NodeIdx i = tail_idx[arcs[a + 1].head];
+        const NodeIdx j = tail_idx[arcs[a].head];
+        if (i == INVALID_NODE || (arcs[a].r_cap == 0 && arcs[a + 1].r_cap == 0)) {
+            continue;
+        }
+        assert(j != INVALID_NODE);
+        tail.add_edge(i, j, arcs[a].r_cap, arcs[a + 1].r_cap);
+    }
+
+    tail.mincut();
+
+    // Record the cut in the tree fields that what_segment reads
+    parallel_for_blocks(*pool, nodes.size(), num_threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            if (tail_idx[i] != INVALID_NODE) {
+                nodes[i].parent = TERMINAL_ARC;
+                nodes[i].is_sink = tail.what_segment(tail_idx[i]) == PushRelabel::SINK;
+            }
+        }
+    });
+
+    return tail.get_flow();
 }
 
 template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
@@ -693,7 +1170,7 @@ inline void ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::init_maxflow()
         Node &n = nodes[i];
         n.next_active = INVALID_NODE;
         n.timestamp = 0;
-        if (n.tr_cap != 0) {
+        if (!is_zero_term(n.tr_cap)) {
             // Node n is connected to the source or sink
             n.is_sink = n.tr_cap < 0; // Negative capacity goes to sink
             n.parent = TERMINAL_ARC;
@@ -729,7 +1206,7 @@ inline void ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::GraphBlock::init_ma
             Node& n = nodes[i];
             n.next_active = INVALID_NODE;
             n.timestamp = 0;
-            if (n.tr_cap != 0) {
+            if (!is_zero_term(n.tr_cap)) {
                 // Node n is connected to the source or sink
                 n.is_sink = n.tr_cap < 0; // Negative capacity goes to sink
                 n.parent = TERMINAL_ARC;
@@ -851,13 +1328,13 @@ inline void ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::GraphBlock::augment
         Arc &b = source_tree ? sister(ai) : arcs[ai];
         a.r_cap += bottleneck;
         b.r_cap -= bottleneck;
-        if (b.r_cap == 0) {
+        if (!has_residual(b.r_cap)) {
             make_front_orphan(i);
         }
         i = arcs[ai].head;
     }
     nodes[i].tr_cap += source_tree ? -bottleneck : bottleneck;
-    if (nodes[i].tr_cap == 0) {
+    if (is_zero_term(nodes[i].tr_cap)) {
         make_front_orphan(i);
     }
 }
@@ -877,7 +1354,7 @@ inline ArcIdx ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::GraphBlock::grow_
     ArcIdx ai;
     // Add neighbor nodes search tree until we find a node from the other search tree or run out of neighbors
     for (ai = start.first; ai != INVALID_ARC; ai = arcs[ai].next) {
-        if (sister_or_arc(ai, !source).r_cap > 0) {
+        if (has_residual(sister_or_arc(ai, !source).r_cap)) {
             Node& n = head_node(ai);
             if (n.parent == INVALID_ARC) {
                 // This node is not yet in a tree so claim it for this one
@@ -924,7 +1401,7 @@ inline void ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::GraphBlock::process
     ArcIdx min_a0 = INVALID_ARC;
     // Try to find a new parent
     for (ArcIdx a0 = n.first; a0 != INVALID_ARC; a0 = arcs[a0].next) {
-        if (sister_or_arc(a0, source).r_cap > 0) {
+        if (has_residual(sister_or_arc(a0, source).r_cap)) {
             NodeIdx j = arcs[a0].head;
             ArcIdx a = nodes[j].parent;
             if (nodes[j].is_sink != source && a != INVALID_ARC) {
@@ -978,7 +1455,7 @@ inline void ParallelGraph<Cap, Term, Flow, ArcIdx, NodeIdx>::GraphBlock::process
                 NodeIdx j = arcs[a0].head;
                 Node &m = nodes[j];
                 if (m.is_sink != source && m.parent != INVALID_ARC) {
-                    if (sister_or_arc(a0, source).r_cap > 0) {
+                    if (has_residual(sister_or_arc(a0, source).r_cap)) {
                         make_active(j);
                     }
                     ArcIdx pa = m.parent;
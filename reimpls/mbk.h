@@ -7,15 +7,17 @@
 #include <cassert>
 #include <algorithm>
 #include <type_traits>
+#include <stdexcept>
 
 #include "util.h"
+#include "alloc.h"
 
 namespace reimpls {
 
 using Time = uint32_t;
 using Dist = uint16_t;
 
-template <class Cap, class Term, class Flow, class ArcIdx = int32_t, class NodeIdx = int32_t>
+template <class Cap, class Term, class Flow, class ArcIdx = int32_t, class NodeIdx = int32_t, bool Prefetch = false>
 class Graph {
     static_assert(std::is_integral<ArcIdx>::value, "ArcIdx must be an integer type");
     static_assert(std::is_integral<NodeIdx>::value, "NodeIdx must be an integer type");
@@ -59,9 +61,20 @@ public:
 
     void mark_node(NodeIdx i);
 
+    // Residual capacity of the terminal arcs, positive for the source and negative for the sink (as in BK)
+    inline Term get_trcap(NodeIdx i) const { return nodes[i].tr_cap; }
+
+    // Calls func(i, j, r_cap, rev_r_cap) once for every pair of sister arcs (i, j) and (j, i)
+    template <class Func>
+    void for_each_residual_edge(Func func) const;
+
+    // Changes capacities of the existing edge (i, j) after maxflow. Both nodes must then be marked
+    // with mark_node before re-solving with reuse_trees.
+    void update_edge(NodeIdx i, NodeIdx j, Cap cap_delta, Cap rev_cap_delta);
+
 private:
-    std::vector<Node> nodes;
-    std::vector<Arc> arcs;
+    PolicyVector<Node> nodes;
+    PolicyVector<Arc> arcs;
 
     Flow flow;
     int32_t maxflow_iteration;
@@ -132,6 +145,11 @@ private:
     ArcIdx grow_search_tree(NodeIdx start);
     template <bool source> ArcIdx grow_search_tree_impl(NodeIdx start);
 
+    // Arcs are scanned in batches so the head nodes of a batch can be prefetched before they are tested.
+    // Without prefetching a batch is a single arc which gives the plain linked list traversal.
+    static constexpr int ARC_BATCH = Prefetch ? 16 : 1;
+    int gather_arcs(ArcIdx& ai, ArcIdx *batch) const;
+
     void process_orphan(NodeIdx i);
     template <bool source> void process_orphan_impl(NodeIdx i);
 
@@ -150,8 +168,8 @@ private:
 };
 
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::Graph() :
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::Graph() :
     nodes(),
     arcs(),
     flow(0),
@@ -162,28 +180,28 @@ Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::Graph() :
     time(0)
 {}
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::Graph(size_t expected_nodes, size_t expected_arcs) :
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::Graph(size_t expected_nodes, size_t expected_arcs) :
     Graph()
 {
     reserve_nodes(expected_nodes);
     reserve_edges(expected_arcs);
 }
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::reserve_nodes(size_t num)
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::reserve_nodes(size_t num)
 {
     nodes.reserve(num);
 }
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::reserve_edges(size_t num)
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::reserve_edges(size_t num)
 {
     arcs.reserve(2 * num);
 }
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline NodeIdx Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::add_node(size_t num)
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline NodeIdx Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::add_node(size_t num)
 {
     NodeIdx crnt = nodes.size();
 
@@ -198,8 +216,8 @@ inline NodeIdx Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::add_node(size_t num)
     return crnt;
 }
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::add_tweights(NodeIdx i, Term cap_source, Term cap_sink)
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::add_tweights(NodeIdx i, Term cap_source, Term cap_sink)
 {
     assert(i >= 0 && i < nodes.size());
     Term delta = nodes[i].tr_cap;
@@ -212,8 +230,8 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::add_tweights(NodeIdx i, Ter
     nodes[i].tr_cap = cap_source - cap_sink;
 }
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::add_edge(
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::add_edge(
     NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap, bool merge_duplicates)
 {
     assert(i >= 0 && i < nodes.size());
@@ -237,8 +255,8 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::add_edge(
     add_half_edge(j, i, rev_cap, merge_duplicates);
 }
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::add_half_edge(
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::add_half_edge(
     NodeIdx from, NodeIdx to, Cap cap, bool merge_duplicates)
 {
     ArcIdx ai;
@@ -263,9 +281,9 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::add_half_edge(
     nodes[from].first = ai;
 }
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline typename Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::TermType
-Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::what_segment(NodeIdx i, TermType default_segment) const
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline typename Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::TermType
+Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::what_segment(NodeIdx i, TermType default_segment) const
 {
     if (nodes[i].parent != INVALID_ARC) {
         return (nodes[i].is_sink) ? SINK : SOURCE;
@@ -274,15 +292,65 @@ Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::what_segment(NodeIdx i, TermType defaul
     }
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::mark_node(NodeIdx i)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::mark_node(NodeIdx i)
 {
     make_active(i);
     nodes[i].is_marked = true;
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline Flow Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::maxflow(bool reuse_trees)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+template <class Func>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::for_each_residual_edge(Func func) const
+{
+    // Sister arcs are always added together, so they are at a and a + 1
+    for (size_t a = 0; a < arcs.size(); a += 2) {
+        func(arcs[a + 1].head, arcs[a].head, arcs[a].r_cap, arcs[a + 1].r_cap);
+    }
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::update_edge(
+    NodeIdx i, NodeIdx j, Cap cap_delta, Cap rev_cap_delta)
+{
+    assert(i >= 0 && i < nodes.size());
+    assert(j >= 0 && j < nodes.size());
+
+    ArcIdx ai = nodes[i].first;
+    while (ai != INVALID_ARC && arcs[ai].head != j) {
+        ai = arcs[ai].next;
+    }
+    if (ai == INVALID_ARC) {
+        throw std::invalid_argument("Edge to update does not exist.");
+    }
+
+    Arc& a = arcs[ai];
+    Arc& b = sister(ai);
+    a.r_cap += cap_delta;
+    b.r_cap += rev_cap_delta;
+
+    // If a capacity is now below the flow through the arc, cancel the excess flow (see Graph2::update_edge).
+    if (a.r_cap < 0) {
+        Cap excess = -a.r_cap;
+        a.r_cap = 0;
+        b.r_cap -= excess;
+        add_tweights(i, excess, 0);
+        add_tweights(j, 0, excess);
+        flow -= excess;
+    }
+    if (b.r_cap < 0) {
+        Cap excess = -b.r_cap;
+        b.r_cap = 0;
+        a.r_cap -= excess;
+        add_tweights(j, excess, 0);
+        add_tweights(i, 0, excess);
+        flow -= excess;
+    }
+    assert(a.r_cap >= 0 && b.r_cap >= 0);
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline Flow Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::maxflow(bool reuse_trees)
 {
     if (reuse_trees) {
         init_maxflow_reuse_trees();
@@ -354,8 +422,8 @@ inline Flow Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::maxflow(bool reuse_trees)
     return flow;
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::init_maxflow()
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::init_maxflow()
 {
     first_active = INVALID_NODE;
     last_active = INVALID_NODE;
@@ -367,7 +435,7 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::init_maxflow()
         n.next_active = INVALID_NODE;
         n.is_marked = false;
         n.timestamp = time;
-        if (n.tr_cap != 0) {
+        if (!is_zero_term(n.tr_cap)) {
             // n is connected to the source or sink
             n.is_sink = n.tr_cap < 0; // negative capacity goes to sink
             n.parent = TERMINAL_ARC;
@@ -379,8 +447,8 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::init_maxflow()
     }
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::init_maxflow_reuse_trees()
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::init_maxflow_reuse_trees()
 {
     NodeIdx i = first_active;
 
@@ -404,7 +472,7 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::init_maxflow_reuse_trees()
         n.is_marked = false;
         make_active(i);
 
-        if (n.tr_cap == 0) {
+        if (is_zero_term(n.tr_cap)) {
             if (n.parent != INVALID_ARC) {
                 make_back_orphan(i);
             }
@@ -420,7 +488,7 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::init_maxflow_reuse_trees()
                         if (m.parent == sister_idx(ai)) {
                             make_back_orphan(j);
                         }
-                        if (m.parent != INVALID_ARC && m.is_sink && arcs[ai].r_cap > 0) {
+                        if (m.parent != INVALID_ARC && m.is_sink && has_residual(arcs[ai].r_cap)) {
                             make_active(j);
                         }
                     }
@@ -437,7 +505,7 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::init_maxflow_reuse_trees()
                         if (m.parent == sister_idx(ai)) {
                             make_back_orphan(j);
                         }
-                        if (m.parent != INVALID_ARC && !m.is_sink && sister(ai).r_cap > 0) {
+                        if (m.parent != INVALID_ARC && !m.is_sink && has_residual(sister(ai).r_cap)) {
                             make_active(j);
                         }
                     }
@@ -457,8 +525,8 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::init_maxflow_reuse_trees()
     }
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::make_active(NodeIdx i)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::make_active(NodeIdx i)
 {
     if (nodes[i].next_active == INVALID_NODE) {
         // It's not in the active list yet
@@ -473,22 +541,22 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::make_active(NodeIdx i)
     }
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::make_front_orphan(NodeIdx i)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::make_front_orphan(NodeIdx i)
 {
     nodes[i].parent = ORPHAN_ARC;
     orphan_nodes.push_front(i);
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::make_back_orphan(NodeIdx i)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::make_back_orphan(NodeIdx i)
 {
     nodes[i].parent = ORPHAN_ARC;
     orphan_nodes.push_back(i);
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline NodeIdx Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::next_active()
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline NodeIdx Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::next_active()
 {
     NodeIdx i;
     // Pop nodes from the active list until we find a valid one or run out of nodes
@@ -512,8 +580,8 @@ inline NodeIdx Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::next_active()
     return i;
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::augment(ArcIdx middle_idx)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::augment(ArcIdx middle_idx)
 {
     Arc& middle = arcs[middle_idx];
     Arc& middle_sister = sister(middle_idx);
@@ -532,8 +600,8 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::augment(ArcIdx middle_idx)
     flow += bottleneck;
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline Term Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::tree_bottleneck(NodeIdx start, bool source_tree) const
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline Term Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::tree_bottleneck(NodeIdx start, bool source_tree) const
 {
     NodeIdx i = start;
     Term bottleneck = std::numeric_limits<Term>::max();
@@ -550,8 +618,8 @@ inline Term Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::tree_bottleneck(NodeIdx sta
     return std::min<Term>(bottleneck, source_tree ? tr_cap : -tr_cap);
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::augment_tree(
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::augment_tree(
     NodeIdx start, Term bottleneck, bool source_tree)
 {
     NodeIdx i = start;
@@ -564,60 +632,74 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::augment_tree(
         Arc& b = source_tree ? sister(ai) : arcs[ai];
         a.r_cap += bottleneck;
         b.r_cap -= bottleneck;
-        if (b.r_cap == 0) {
+        if (!has_residual(b.r_cap)) {
             make_front_orphan(i);
         }
         i = arcs[ai].head;
     }
     nodes[i].tr_cap += source_tree ? -bottleneck : bottleneck;
-    if (nodes[i].tr_cap == 0) {
+    if (is_zero_term(nodes[i].tr_cap)) {
         make_front_orphan(i);
     }
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline ArcIdx Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::grow_search_tree(NodeIdx start)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline ArcIdx Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::grow_search_tree(NodeIdx start)
 {
     return nodes[start].is_sink ? grow_search_tree_impl<false>(start) : grow_search_tree_impl<true>(start);
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
 template<bool source>
-inline ArcIdx Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::grow_search_tree_impl(NodeIdx start_idx)
+inline ArcIdx Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::grow_search_tree_impl(NodeIdx start_idx)
 {
     const Node& start = nodes[start_idx];
-    ArcIdx ai;
+    ArcIdx batch[ARC_BATCH];
     // Add neighbor nodes search tree until we find a node from the other search tree or run out of neighbors
-    for (ai = start.first; ai != INVALID_ARC; ai = arcs[ai].next) {
-        if (sister_or_arc(ai, !source).r_cap > 0) {
-            Node& n = head_node(ai);
-            if (n.parent == INVALID_ARC) {
-                // This node is not yet in a tree so claim it for this one
-                n.is_sink = !source;
-                n.parent = sister_idx(ai);
-                n.timestamp = start.timestamp;
-                n.dist = start.dist + 1;
-                make_active(arcs[ai].head);
-            } else if (n.is_sink == source) {
-                // Found a node from the other search tree so abort
-                if (!source) {
+    for (ArcIdx next = start.first; next != INVALID_ARC;) {
+        int num = gather_arcs(next, batch);
+        for (int k = 0; k < num; ++k) {
+            ArcIdx ai = batch[k];
+            if (has_residual(sister_or_arc(ai, !source).r_cap)) {
+                Node& n = head_node(ai);
+                if (n.parent == INVALID_ARC) {
+                    // This node is not yet in a tree so claim it for this one
+                    n.is_sink = !source;
+                    n.parent = sister_idx(ai);
+                    n.timestamp = start.timestamp;
+                    n.dist = start.dist + 1;
+                    make_active(arcs[ai].head);
+                } else if (n.is_sink == source) {
+                    // Found a node from the other search tree so abort
                     // If we are growing the sink tree we instead return the sister arc
-                    ai = sister_idx(ai);
+                    return source ? ai : sister_idx(ai);
+                } else if (n.timestamp <= start.timestamp && n.dist > start.dist) {
+                    // Heuristic: trying to make the distance from j to the source/sink shorter
+                    n.parent = sister_idx(ai);
+                    n.timestamp = n.timestamp;
+                    n.dist = start.dist + 1;
                 }
-                break;
-            } else if (n.timestamp <= start.timestamp && n.dist > start.dist) {
-                // Heuristic: trying to make the distance from j to the source/sink shorter
-                n.parent = sister_idx(ai);
-                n.timestamp = n.timestamp;
-                n.dist = start.dist + 1;
             }
         }
     }
-    return ai;
+    return INVALID_ARC;
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline int Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::gather_arcs(ArcIdx& ai, ArcIdx *batch) const
+{
+    int num = 0;
+    for (; ai != INVALID_ARC && num < ARC_BATCH; ai = arcs[ai].next) {
+        if (Prefetch) {
+            REIMPLS_PREFETCH(&nodes[arcs[ai].head]);
+        }
+        batch[num++] = ai;
+    }
+    return num;
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::process_orphan(NodeIdx i)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::process_orphan(NodeIdx i)
 {
     if (nodes[i].is_sink) {
         process_orphan_impl<false>(i);
@@ -626,54 +708,59 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::process_orphan(NodeIdx i)
     }
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
 template<bool source>
-inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::process_orphan_impl(NodeIdx i)
+inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::process_orphan_impl(NodeIdx i)
 {
     Node &n = nodes[i];
     static const int32_t INF_DIST = std::numeric_limits<int32_t>::max();
     int32_t min_d = INF_DIST;
     ArcIdx min_a0 = INVALID_ARC;
+    ArcIdx batch[ARC_BATCH];
     // Try to find a new parent
-    for (ArcIdx a0 = n.first; a0 != INVALID_ARC; a0 = arcs[a0].next) {
-        if (sister_or_arc(a0, source).r_cap > 0) {
-            NodeIdx j = arcs[a0].head;
-            ArcIdx a = nodes[j].parent;
-            if (nodes[j].is_sink != source && a != INVALID_ARC) {
-                // Check origin of m
-                int32_t d = 0;
-                while (true) {
-                    Node &m = nodes[j];
-                    if (m.timestamp == time) {
-                        d += m.dist;
-                        break;
-                    }
-                    a = m.parent;
-                    d++;
-                    if (a == TERMINAL_ARC) {
-                        m.timestamp = time;
-                        m.dist = 1;
-                        break;
-                    }
-                    if (a == ORPHAN_ARC) {
-                        d = INF_DIST; // infinite distance
-                        break;
-                    }
-                    j = arcs[a].head;
-                }
-                if (d < INF_DIST) {
-                    // m originates from the source
-                    if (d < min_d) {
-                        min_a0 = a0;
-                        min_d = d;
-                    }
-                    // Set marks along the path
-                    j = arcs[a0].head;
-                    while (nodes[j].timestamp != time) {
+    for (ArcIdx next = n.first; next != INVALID_ARC;) {
+        int num = gather_arcs(next, batch);
+        for (int k = 0; k < num; ++k) {
+            ArcIdx a0 = batch[k];
+            if (has_residual(sister_or_arc(a0, source).r_cap)) {
+                NodeIdx j = arcs[a0].head;
+                ArcIdx a = nodes[j].parent;
+                if (nodes[j].is_sink != source && a != INVALID_ARC) {
+                    // Check origin of m
+                    int32_t d = 0;
+                    while (true) {
                         Node &m = nodes[j];
-                        m.timestamp = time;
-                        m.dist = d--;
-                        j = arcs[m.parent].head;
+                        if (m.timestamp == time) {
+                            d += m.dist;
+                            break;
+                        }
+                        a = m.parent;
+                        d++;
+                        if (a == TERMINAL_ARC) {
+                            m.timestamp = time;
+                            m.dist = 1;
+                            break;
+                        }
+                        if (a == ORPHAN_ARC) {
+                            d = INF_DIST; // infinite distance
+                            break;
+                        }
+                        j = arcs[a].head;
+                    }
+                    if (d < INF_DIST) {
+                        // m originates from the source
+                        if (d < min_d) {
+                            min_a0 = a0;
+                            min_d = d;
+                        }
+                        // Set marks along the path
+                        j = arcs[a0].head;
+                        while (nodes[j].timestamp != time) {
+                            Node &m = nodes[j];
+                            m.timestamp = time;
+                            m.dist = d--;
+                            j = arcs[m.parent].head;
+                        }
                     }
                 }
             }
@@ -685,16 +772,20 @@ inline void Graph<Cap, Term, Flow, ArcIdx, NodeIdx>::process_orphan_impl(NodeIdx
         n.dist = min_d + 1;
     } else {
         // No parent was found so process neighbors
-        for (ArcIdx a0 = n.first; a0 != INVALID_ARC; a0 = arcs[a0].next) {
-            NodeIdx j = arcs[a0].head;
-            Node &m = nodes[j];
-            if (m.is_sink != source && m.parent != INVALID_ARC) {
-                if (sister_or_arc(a0, source).r_cap > 0) {
-                    make_active(j);
-                }
-                ArcIdx pa = m.parent;
-                if (pa != TERMINAL_ARC && pa != ORPHAN_ARC && arcs[pa].head == i) {
-                    make_back_orphan(j);
+        for (ArcIdx next = n.first; next != INVALID_ARC;) {
+            int num = gather_arcs(next, batch);
+            for (int k = 0; k < num; ++k) {
+                ArcIdx a0 = batch[k];
+                NodeIdx j = arcs[a0].head;
+                Node &m = nodes[j];
+                if (m.is_sink != source && m.parent != INVALID_ARC) {
+                    if (has_residual(sister_or_arc(a0, source).r_cap)) {
+                        make_active(j);
+                    }
+                    ArcIdx pa = m.parent;
+                    if (pa != TERMINAL_ARC && pa != ORPHAN_ARC && arcs[pa].head == i) {
+                        make_back_orphan(j);
+                    }
                 }
             }
         }
@@ -3,17 +3,25 @@
 
 #include <vector>
 #include <deque>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
 #include <cinttypes>
+#include <cstddef>
 #include <cassert>
 #include <algorithm>
 #include <type_traits>
 
+#include "util.h"
+#include "alloc.h"
+#include "arc_scan.h"
+
 namespace reimpls {
 
 using Time = uint32_t;
 using Dist = uint16_t;
 
-template <class Cap, class Term, class Flow, class ArcIdx = int32_t, class NodeIdx = int32_t>
+template <class Cap, class Term, class Flow, class ArcIdx = int32_t, class NodeIdx = int32_t, bool Prefetch = false>
 class Graph2 {
     static_assert(std::is_integral<ArcIdx>::value, "ArcIdx must be an integer type");
     static_assert(std::is_integral<NodeIdx>::value, "NodeIdx must be an integer type");
@@ -42,27 +50,51 @@ public:
 
     void add_edge(NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap, bool merge_duplicates = true);
 
-    void init_maxflow();
-    Flow maxflow();
+    void init_maxflow(unsigned int num_threads = 1);
+    Flow maxflow(bool reuse_trees = false);
+
+    Flow get_maxflow() const noexcept { return flow; }
 
     TermType what_segment(NodeIdx i, TermType default_segment = SOURCE) const;
 
     inline size_t get_node_num() const noexcept { return nodes.size() - 1; }
     inline size_t get_arc_num() const noexcept { return arcs.size(); }
 
+    void mark_node(NodeIdx i);
+
+    // Residual capacity of the terminal arcs, positive for the source and negative for the sink (as in BK)
+    inline Term get_trcap(NodeIdx i) const { return nodes[i].tr_cap; }
+
+    // Calls func(i, j, r_cap, rev_r_cap) once for every pair of sister arcs (i, j) and (j, i). Only valid
+    // after init_maxflow.
+    template <class Func>
+    void for_each_residual_edge(Func func) const;
+
+    // Changes capacities of the existing edge (i, j) after init_maxflow. Both nodes must then be marked
+    // with mark_node before re-solving with reuse_trees.
+    void update_edge(NodeIdx i, NodeIdx j, Cap cap_delta, Cap rev_cap_delta);
+
 private:
-    std::vector<Node> nodes;
-    std::vector<Arc> arcs;
-    std::vector<Arc> arc_buffer;
+    PolicyVector<Node> nodes;
+    PolicyVector<Arc> arcs;
 
     Flow flow;
     int32_t maxflow_iteration;
 
+    bool arcs_reordered; // Arcs are stored consecutively for each node (after the first init_maxflow)
+    bool trees_initialized; // Search trees were initialized by init_maxflow and not yet used by maxflow
+
     NodeIdx first_active, last_active;
     std::deque<NodeIdx> orphan_nodes;
 
     Time time;
 
+    // Vector kernel for skipping saturated arcs during growth. Only used for integer capacities.
+    static constexpr bool ARC_SCAN = std::is_integral<Cap>::value && sizeof(ArcIdx) + sizeof(NodeIdx) >= 4;
+    ArcScanFunc arc_scan;
+    ArcScanLayout r_cap_scan, sister_sat_scan;
+    static ArcScanLayout arc_scan_layout(bool use_r_cap);
+
 #pragma pack (1)
     struct REIMPLS_PACKED Node {
         ArcIdx first; // First out-going arc.
@@ -76,6 +108,7 @@ private:
                      // Otherwise         -tr_cap is residual capacity of the arc node->SINK.
 
         bool is_sink : 1;	// flag showing if the node is in the source or sink tree (if parent!=NULL)
+        bool is_marked : 1; // flag showing if the node has been marked by mark_node
 
         Node() :
             first(INVALID_ARC),
@@ -84,7 +117,8 @@ private:
             timestamp(0),
             dist(0),
             tr_cap(0),
-            is_sink(false) {}
+            is_sink(false),
+            is_marked(false) {}
     };
 
     struct REIMPLS_PACKED Arc {
@@ -108,6 +142,13 @@ private:
     void add_half_edge(NodeIdx from, NodeIdx to, Cap cap, Cap rev_cap, 
         bool merge_duplicates = true);
 
+    void init_trees();
+    void init_maxflow_reuse_trees();
+
+    void reorder_arcs(unsigned int num_threads);
+    void move_arcs(unsigned int num_threads);
+    void move_arcs_serial();
+
     void make_active(NodeIdx i);
     void make_front_orphan(NodeIdx i);
     void make_back_orphan(NodeIdx i);
@@ -121,6 +162,11 @@ private:
     ArcIdx grow_search_tree(NodeIdx start);
     template <bool source> ArcIdx grow_search_tree_impl(NodeIdx start);
 
+    // Arcs of a node are consecutive, so head nodes can be prefetched a fixed distance ahead of the scan
+    static constexpr ArcIdx PREFETCH_DIST = 8;
+    void prefetch_first_heads(ArcIdx begin, ArcIdx end) const;
+    void prefetch_ahead(ArcIdx ai, ArcIdx end) const;
+
     void process_orphan(NodeIdx i);
     template <bool source> void process_orphan_impl(NodeIdx i);
 
@@ -139,27 +185,30 @@ private:
 };
 
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::Graph2(size_t expected_nodes, size_t expected_arcs) :
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::Graph2(size_t expected_nodes, size_t expected_arcs) :
     nodes(),
     arcs(),
-    arc_buffer(),
     flow(0),
     maxflow_iteration(0),
+    arcs_reordered(false),
+    trees_initialized(false),
     first_active(INVALID_NODE),
     last_active(INVALID_NODE),
     orphan_nodes(),
-    time(0)
+    time(0),
+    arc_scan(ARC_SCAN ? arc_scan_func() : nullptr),
+    r_cap_scan(arc_scan_layout(true)),
+    sister_sat_scan(arc_scan_layout(false))
 {
     nodes.reserve(expected_nodes + 1);
     nodes.resize(1); // Make room for sentinel node now
     arcs.reserve(2 * expected_arcs);
-    arc_buffer.reserve(2 * expected_arcs);
 }
 
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline NodeIdx Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::add_node(size_t num)
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline NodeIdx Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::add_node(size_t num)
 {
     NodeIdx crnt = nodes.size();
 
@@ -174,8 +223,8 @@ inline NodeIdx Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::add_node(size_t num)
     return crnt;
 }
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::add_tweights(NodeIdx i, Term cap_source, Term cap_sink)
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::add_tweights(NodeIdx i, Term cap_source, Term cap_sink)
 {
     assert(i >= 0 && i < nodes.size());
     Term delta = nodes[i].tr_cap;
@@ -188,8 +237,8 @@ inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::add_tweights(NodeIdx i, Te
     nodes[i].tr_cap = cap_source - cap_sink;
 }
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::add_edge(
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::add_edge(
     NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap, bool merge_duplicates)
 {
     assert(i >= 0 && i < nodes.size());
@@ -213,8 +262,8 @@ inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::add_edge(
     add_half_edge(j, i, rev_cap, cap, merge_duplicates);
 }
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::add_half_edge(
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::add_half_edge(
     NodeIdx from, NodeIdx to, Cap cap, Cap rev_cap, bool merge_duplicates)
 {
     ArcIdx ai;
@@ -235,13 +284,13 @@ inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::add_half_edge(
 
     // Create new arc.
     ai = arcs.size();
-    arcs.emplace_back(to, nodes[from].first, cap, rev_cap == 0);
+    arcs.emplace_back(to, nodes[from].first, cap, !has_residual(rev_cap));
     nodes[from].first = ai;
 }
 
-template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline typename Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::TermType 
-Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::what_segment(NodeIdx i, TermType default_segment) const
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline typename Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::TermType 
+Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::what_segment(NodeIdx i, TermType default_segment) const
 {
     if (nodes[i].parent != INVALID_ARC) {
         return (nodes[i].is_sink) ? SINK : SOURCE;
@@ -250,10 +299,84 @@ Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::what_segment(NodeIdx i, TermType defau
     }
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline Flow Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::maxflow()
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::mark_node(NodeIdx i)
+{
+    make_active(i);
+    nodes[i].is_marked = true;
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+template <class Func>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::for_each_residual_edge(Func func) const
 {
-    // init_maxflow();
+    assert(arcs_reordered);
+    const size_t num_nodes = get_node_num();
+    for (size_t i = 0; i < num_nodes; ++i) {
+        for (ArcIdx a = nodes[i].first; a < nodes[i + 1].first; ++a) {
+            const Arc& arc = arcs[a];
+            if (a < arc.sister) {
+                func(static_cast<NodeIdx>(i), arc.head, arc.r_cap, arcs[arc.sister].r_cap);
+            }
+        }
+    }
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::update_edge(
+    NodeIdx i, NodeIdx j, Cap cap_delta, Cap rev_cap_delta)
+{
+    assert(arcs_reordered);
+    assert(i >= 0 && i < get_node_num());
+    assert(j >= 0 && j < get_node_num());
+
+    ArcIdx ai = nodes[i].first;
+    while (ai != nodes[i + 1].first && arcs[ai].head != j) {
+        ++ai;
+    }
+    if (ai == nodes[i + 1].first) {
+        throw std::invalid_argument("Edge to update does not exist.");
+    }
+
+    Arc& a = arcs[ai];
+    Arc& b = arcs[a.sister];
+    a.r_cap += cap_delta;
+    b.r_cap += rev_cap_delta;
+
+    // If a capacity is now below the flow through the arc, cancel the excess flow. The tail sends the
+    // excess to the sink and the head gets it from the source. Both nodes also get the same capacity on
+    // their other terminal arc, which shifts all cuts by a constant that is subtracted from the flow.
+    if (a.r_cap < 0) {
+        Cap excess = -a.r_cap;
+        a.r_cap = 0;
+        b.r_cap -= excess;
+        add_tweights(i, excess, 0);
+        add_tweights(j, 0, excess);
+        flow -= excess;
+    }
+    if (b.r_cap < 0) {
+        Cap excess = -b.r_cap;
+        b.r_cap = 0;
+        a.r_cap -= excess;
+        add_tweights(j, excess, 0);
+        add_tweights(i, 0, excess);
+        flow -= excess;
+    }
+    assert(a.r_cap >= 0 && b.r_cap >= 0);
+
+    a.sister_sat = !has_residual(b.r_cap);
+    b.sister_sat = !has_residual(a.r_cap);
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline Flow Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::maxflow(bool reuse_trees)
+{
+    if (reuse_trees && arcs_reordered) {
+        init_maxflow_reuse_trees();
+    } else if (!trees_initialized) {
+        init_maxflow();
+    }
+    trees_initialized = false;
 
     NodeIdx crnt_node = INVALID_NODE;
 
@@ -319,49 +442,33 @@ inline Flow Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::maxflow()
     return flow;
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::init_maxflow()
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::init_maxflow(unsigned int num_threads)
+{
+    // Arcs are only reordered once, so the graph can be solved again after an update
+    if (!arcs_reordered) {
+        reorder_arcs(num_threads);
+        arcs_reordered = true;
+    }
+    init_trees();
+    trees_initialized = true;
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::init_trees()
 {
     first_active = INVALID_NODE;
     last_active = INVALID_NODE;
     orphan_nodes.clear();
     time = 0;
 
-    // Reorder arcs so outgoing arcs for a node are consecutive
-    ArcIdx crnt = 0;
-    arc_buffer.resize(arcs.size());
-    for (size_t i = 0; i < nodes.size() - 1; ++i) {
-        ArcIdx new_first = crnt;
-        ArcIdx next;
-        for (ArcIdx a = nodes[i].first; a != INVALID_ARC; a = next) {
-            next = arcs[a].sister;
-            arcs[a].sister = crnt;
-            arc_buffer[crnt].head = arcs[a].head;
-            arc_buffer[crnt].sister = a;
-            arc_buffer[crnt].r_cap = arcs[a].r_cap;
-            arc_buffer[crnt].sister_sat = arcs[a].sister_sat;
-            ++crnt;
-        }
-        nodes[i].first = new_first;
-    }
-
-    // Set sentinel node
-    nodes[nodes.size() - 1].first = crnt;
-    
-    // Adjust sister indices
-    for (auto& arc : arc_buffer) {
-        arc.sister = arcs[arc.sister ^ 1].sister;
-    }
-    
-    // Swap buffer
-    std::swap(arcs, arc_buffer);
-
     // Init nodes and make relevant ones active
     for (size_t i = 0; i < nodes.size() - 1; ++i) {
         Node& n = nodes[i];
         n.next_active = INVALID_NODE;
+        n.is_marked = false;
         n.timestamp = time;
-        if (n.tr_cap != 0) {
+        if (!is_zero_term(n.tr_cap)) {
             // n is connected to the source or sink
             n.is_sink = n.tr_cap < 0; // negative capacity goes to sink
             n.parent = TERMINAL_ARC;
@@ -373,8 +480,239 @@ inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::init_maxflow()
     }
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::make_active(NodeIdx i)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::init_maxflow_reuse_trees()
+{
+    NodeIdx i = first_active;
+
+    // Reset queues as we are going to re-add to them during initialization
+    first_active = INVALID_NODE;
+    last_active = INVALID_NODE;
+    orphan_nodes.clear();
+
+    time++;
+
+    NodeIdx next = i;
+    while (next != INVALID_NODE) {
+        i = next;
+        Node& n = nodes[i];
+        next = n.next_active;
+        if (next == i) {
+            // Node i is the last one so prepare to terminate
+            next = INVALID_NODE;
+        }
+        n.next_active = INVALID_NODE;
+        n.is_marked = false;
+        make_active(i);
+
+        if (is_zero_term(n.tr_cap)) {
+            if (n.parent != INVALID_ARC) {
+                make_back_orphan(i);
+            }
+            continue;
+        }
+        const bool is_sink = n.tr_cap < 0;
+        if (n.parent == INVALID_ARC || n.is_sink != is_sink) {
+            n.is_sink = is_sink;
+            for (ArcIdx ai = n.first; ai != nodes[i + 1].first; ++ai) {
+                NodeIdx j = arcs[ai].head;
+                const Node& m = nodes[j];
+                if (!m.is_marked) {
+                    if (m.parent == arcs[ai].sister) {
+                        make_back_orphan(j);
+                    }
+                    // Neighbors in the other tree which can reach this node must be explored again
+                    bool has_cap = is_sink ? !arcs[ai].sister_sat : has_residual(arcs[ai].r_cap);
+                    if (m.parent != INVALID_ARC && m.is_sink != is_sink && has_cap) {
+                        make_active(j);
+                    }
+                }
+            }
+        }
+        n.parent = TERMINAL_ARC;
+        n.timestamp = time;
+        n.dist = 1;
+    }
+
+    // Adoption
+    while (!orphan_nodes.empty()) {
+        NodeIdx o = orphan_nodes.front();
+        orphan_nodes.pop_front();
+        process_orphan(o);
+    }
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::reorder_arcs(unsigned int num_threads)
+{
+    // Reorder arcs so outgoing arcs for a node are consecutive. This is done in place to avoid
+    // doubling the arc memory at peak.
+    const size_t num_nodes = nodes.size() - 1;
+    const size_t num_arcs = arcs.size();
+
+    // Count out-degrees. Each arc is in exactly one list, so nodes can be processed in parallel.
+    std::vector<ArcIdx> new_first(num_nodes + 1, 0);
+    parallel_for_blocks(num_nodes, num_threads, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i) {
+            ArcIdx deg = 0;
+            for (ArcIdx a = nodes[i].first; a != INVALID_ARC; a = arcs[a].sister) {
+                ++deg;
+            }
+            new_first[i + 1] = deg;
+        }
+    });
+    for (size_t i = 0; i < num_nodes; ++i) {
+        new_first[i + 1] += new_first[i];
+    }
+
+    // Replace the next pointers with the new arc positions
+    parallel_for_blocks(num_nodes, num_threads, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i) {
+            ArcIdx crnt = new_first[i];
+            ArcIdx next;
+            for (ArcIdx a = nodes[i].first; a != INVALID_ARC; a = next) {
+                next = arcs[a].sister;
+                arcs[a].sister = crnt++;
+            }
+            nodes[i].first = new_first[i];
+        }
+    });
+
+    // Set sentinel node
+    nodes[num_nodes].first = new_first[num_nodes];
+
+    if (num_arcs <= static_cast<size_t>(std::numeric_limits<NodeIdx>::max())) {
+        move_arcs(num_threads);
+    } else {
+        move_arcs_serial();
+    }
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::move_arcs(unsigned int num_threads)
+{
+    // Assumes the sister field of each arc holds its new position
+    const size_t num_nodes = nodes.size() - 1;
+    const size_t num_arcs = arcs.size();
+
+    // Temporarily store the new sister in the head field, so arcs can be moved without looking at their
+    // sisters. The heads are restored afterwards from the node each sister leaves.
+    parallel_for_blocks(num_arcs / 2, num_threads, [&](size_t begin, size_t end)
+    {
+        for (size_t k = begin; k < end; ++k) {
+            Arc& a0 = arcs[2 * k];
+            Arc& a1 = arcs[2 * k + 1];
+            a0.head = static_cast<NodeIdx>(a1.sister);
+            a1.head = static_cast<NodeIdx>(a0.sister);
+        }
+    });
+
+    // Move arcs by following the cycles of the permutation. A chain starts by picking up an arc, leaving a
+    // hole, and ends when it reaches a hole. This way, several chains can run on the same cycle, so each
+    // thread can advance several chains in turn to overlap their cache misses.
+    enum : uint8_t { UNTOUCHED = 0, PICKING = 1, HOLE = 2, FILLED = 3 };
+    std::vector<std::atomic<uint8_t>> state(num_arcs);
+    parallel_for_blocks(num_arcs, num_threads, [&](size_t begin, size_t end)
+    {
+        constexpr int NUM_CHAINS = 16;
+        Arc carry[NUM_CHAINS];
+        int num_active = 0;
+        size_t s = begin;
+        while (true) {
+            // Start new chains
+            while (num_active < NUM_CHAINS && s < end) {
+                uint8_t expected = UNTOUCHED;
+                if (state[s].load(std::memory_order_relaxed) == UNTOUCHED &&
+                    state[s].compare_exchange_strong(expected, PICKING, std::memory_order_acquire)) {
+                    Arc a = arcs[s];
+                    state[s].store(HOLE, std::memory_order_release);
+                    REIMPLS_PREFETCH(&arcs[a.sister]);
+                    REIMPLS_PREFETCH(&state[a.sister]);
+                    carry[num_active++] = a;
+                }
+                ++s;
+            }
+            if (num_active == 0) {
+                break;
+            }
+
+            // Advance all chains one step
+            for (int c = 0; c < num_active;) {
+                Arc& a = carry[c];
+                ArcIdx dest = a.sister;
+                a.sister = static_cast<ArcIdx>(a.head);
+                uint8_t expected = UNTOUCHED;
+                if (state[dest].compare_exchange_strong(expected, FILLED, std::memory_order_acquire)) {
+                    std::swap(a, arcs[dest]);
+                    REIMPLS_PREFETCH(&arcs[a.sister]);
+                    REIMPLS_PREFETCH(&state[a.sister]);
+                    ++c;
+                } else {
+                    // Reached a hole so this chain is done
+                    while (state[dest].load(std::memory_order_acquire) != HOLE) {
+                        // The arc at dest is being picked up by another thread
+                    }
+                    arcs[dest] = a;
+                    a = carry[--num_active];
+                }
+            }
+        }
+    });
+
+    // Restore heads
+    parallel_for_blocks(num_nodes, num_threads, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i) {
+            for (ArcIdx a = nodes[i].first; a < nodes[i + 1].first; ++a) {
+                arcs[arcs[a].sister].head = i;
+            }
+        }
+    });
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::move_arcs_serial()
+{
+    // Assumes the sister field of each arc holds its new position
+    const size_t num_arcs = arcs.size();
+
+    // Used when the head field can not hold arc indices. The new sister of an arc is the new position of
+    // its old sister, so the first arc of a pair to be moved takes its sister's new position and leaves its
+    // own new position in its sister's field. When the sister is moved later, it can then find its new
+    // position through the arc that was moved first.
+    std::vector<bool> moved(num_arcs, false);
+    for (size_t s = 0; s < num_arcs; ++s) {
+        if (moved[s]) {
+            continue;
+        }
+        Arc carry = arcs[s];
+        ArcIdx a = s;
+        while (true) {
+            ArcIdx dest, new_sister;
+            if (!moved[a ^ 1]) {
+                dest = carry.sister;
+                new_sister = arcs[a ^ 1].sister;
+                arcs[a ^ 1].sister = dest;
+            } else {
+                new_sister = carry.sister;
+                dest = arcs[new_sister].sister;
+            }
+            moved[a] = true;
+            carry.sister = new_sister;
+            if (dest == s) {
+                arcs[s] = carry;
+                break;
+            }
+            std::swap(carry, arcs[dest]);
+            a = dest;
+        }
+    }
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::make_active(NodeIdx i)
 {
     if (nodes[i].next_active == INVALID_NODE) {
         // It's not in the active list yet
@@ -389,22 +727,22 @@ inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::make_active(NodeIdx i)
     }
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::make_front_orphan(NodeIdx i)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::make_front_orphan(NodeIdx i)
 {
     nodes[i].parent = ORPHAN_ARC;
     orphan_nodes.push_front(i);
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::make_back_orphan(NodeIdx i)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::make_back_orphan(NodeIdx i)
 {
     nodes[i].parent = ORPHAN_ARC;
     orphan_nodes.push_back(i);
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline NodeIdx Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::next_active()
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline NodeIdx Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::next_active()
 {
     NodeIdx i;
     // Pop nodes from the active list until we find a valid one or run out of nodes
@@ -428,8 +766,8 @@ inline NodeIdx Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::next_active()
     return i;
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::augment(ArcIdx middle_idx)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::augment(ArcIdx middle_idx)
 {
     Arc& middle = arcs[middle_idx];
     Arc& middle_sister = arcs[middle.sister];
@@ -441,8 +779,8 @@ inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::augment(ArcIdx middle_idx)
     // Step  2: Augment along source and sink tree
     middle_sister.r_cap += bottleneck;
     middle.r_cap -= bottleneck;
-    middle_sister.sister_sat = middle.r_cap == 0;
-    middle.sister_sat = middle_sister.r_cap == 0;
+    middle_sister.sister_sat = !has_residual(middle.r_cap);
+    middle.sister_sat = !has_residual(middle_sister.r_cap);
     augment_tree(middle_sister.head, bottleneck, true);
     augment_tree(middle.head, bottleneck, false);
 
@@ -450,8 +788,8 @@ inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::augment(ArcIdx middle_idx)
     flow += bottleneck;
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline Term Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::tree_bottleneck(NodeIdx start, bool source_tree) const
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline Term Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::tree_bottleneck(NodeIdx start, bool source_tree) const
 {
     NodeIdx i = start;
     Term bottleneck = std::numeric_limits<Term>::max();
@@ -468,8 +806,8 @@ inline Term Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::tree_bottleneck(NodeIdx st
     return std::min<Term>(bottleneck, source_tree ? tr_cap : -tr_cap);
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::augment_tree(
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::augment_tree(
     NodeIdx start, Term bottleneck, bool source_tree)
 {
     NodeIdx i = start;
@@ -482,34 +820,61 @@ inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::augment_tree(
         Arc& b = source_tree ? arcs[arcs[ai].sister] : arcs[ai];
         a.r_cap += bottleneck;
         b.r_cap -= bottleneck;
-        a.sister_sat = b.r_cap == 0;
-        b.sister_sat = a.r_cap == 0;
-        if (b.r_cap == 0) {
+        a.sister_sat = !has_residual(b.r_cap);
+        b.sister_sat = !has_residual(a.r_cap);
+        if (!has_residual(b.r_cap)) {
             make_front_orphan(i);
         }
         i = arcs[ai].head;
     }
     nodes[i].tr_cap += source_tree ? -bottleneck : bottleneck;
-    if (nodes[i].tr_cap == 0) {
+    if (is_zero_term(nodes[i].tr_cap)) {
         make_front_orphan(i);
     }
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline ArcIdx Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::grow_search_tree(NodeIdx start)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline ArcScanLayout Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::arc_scan_layout(bool use_r_cap)
+{
+    // Only the residual field is scanned since growth may also update nodes from its own tree
+    ArcScanLayout layout = {};
+    layout.arc_size = sizeof(Arc);
+    if (use_r_cap) {
+        layout.res_offset = offsetof(Arc, r_cap);
+        layout.res_size = sizeof(Cap);
+        layout.res_test = std::is_signed<Cap>::value ? RESIDUAL_POSITIVE : RESIDUAL_NONZERO;
+    } else {
+        layout.res_offset = offsetof(Arc, sister_sat);
+        layout.res_size = sizeof(bool);
+        layout.res_test = RESIDUAL_ZERO;
+    }
+    layout.head_offset = offsetof(Arc, head);
+    return layout;
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline ArcIdx Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::grow_search_tree(NodeIdx start)
 {
     return nodes[start].is_sink ? grow_search_tree_impl<false>(start) : grow_search_tree_impl<true>(start);
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
 template<bool source>
-inline ArcIdx Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::grow_search_tree_impl(NodeIdx start_idx)
+inline ArcIdx Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::grow_search_tree_impl(NodeIdx start_idx)
 {
     const Node& start = nodes[start_idx];
     const Node& next = nodes[start_idx + 1];
     // Add neighbor nodes search tree until we find a node from the other search tree or run out of neighbors
+    prefetch_first_heads(start.first, next.first);
     for (ArcIdx ai = start.first; ai != next.first; ++ai) {
-        if (source ? arcs[ai].r_cap : !arcs[ai].sister_sat) {
+        if (ARC_SCAN) {
+            ai = skip_arcs(arc_scan, source ? r_cap_scan : sister_sat_scan, arcs.data(), ai, next.first);
+            if (ai == next.first) {
+                break;
+            }
+        }
+        prefetch_ahead(ai, next.first);
+        if (source ? has_residual(arcs[ai].r_cap) : !arcs[ai].sister_sat) {
             Node& n = head_node(ai);
             if (n.parent == INVALID_ARC) {
                 // This node is not yet in a tree so claim it for this one
@@ -536,8 +901,27 @@ inline ArcIdx Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::grow_search_tree_impl(No
     return INVALID_ARC;
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
-inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::process_orphan(NodeIdx i)
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::prefetch_first_heads(ArcIdx begin, ArcIdx end) const
+{
+    if (Prefetch) {
+        end = std::min(end, begin + PREFETCH_DIST);
+        for (ArcIdx ai = begin; ai < end; ++ai) {
+            REIMPLS_PREFETCH(&nodes[arcs[ai].head]);
+        }
+    }
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::prefetch_ahead(ArcIdx ai, ArcIdx end) const
+{
+    if (Prefetch && end - ai > PREFETCH_DIST) {
+        REIMPLS_PREFETCH(&nodes[arcs[ai + PREFETCH_DIST].head]);
+    }
+}
+
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::process_orphan(NodeIdx i)
 {
     if (nodes[i].is_sink) {
         process_orphan_impl<false>(i);
@@ -546,9 +930,9 @@ inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::process_orphan(NodeIdx i)
     }
 }
 
-template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx>
+template<class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, bool Prefetch>
 template<bool source>
-inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::process_orphan_impl(NodeIdx i)
+inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx, Prefetch>::process_orphan_impl(NodeIdx i)
 {
     Node& n = nodes[i];
     Node& next = nodes[i + 1];
@@ -556,8 +940,10 @@ inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::process_orphan_impl(NodeId
     int32_t min_d = INF_DIST;
     ArcIdx min_a0 = INVALID_ARC;
     // Try to find a new parent
+    prefetch_first_heads(n.first, next.first);
     for (ArcIdx a0 = n.first; a0 != next.first; ++a0) {
-        if (source ? !arcs[a0].sister_sat : arcs[a0].r_cap) {
+        prefetch_ahead(a0, next.first);
+        if (source ? !arcs[a0].sister_sat : has_residual(arcs[a0].r_cap)) {
             NodeIdx j = arcs[a0].head;
             ArcIdx a = nodes[j].parent;
             if (nodes[j].is_sink != source && a != INVALID_ARC) {
@@ -606,11 +992,13 @@ inline void Graph2<Cap, Term, Flow, ArcIdx, NodeIdx>::process_orphan_impl(NodeId
         n.dist = min_d + 1;
     } else {
         // No parent was found so process neighbors
+        prefetch_first_heads(n.first, next.first);
         for (ArcIdx a0 = n.first; a0 != next.first; ++a0) {
+            prefetch_ahead(a0, next.first);
             NodeIdx j = arcs[a0].head;
             Node &m = nodes[j];
             if (m.is_sink != source && m.parent != INVALID_ARC) {
-                if (source ? !arcs[a0].sister_sat : arcs[a0].r_cap) {
+                if (source ? !arcs[a0].sister_sat : has_residual(arcs[a0].r_cap)) {
                     make_active(j);
                 }
                 ArcIdx pa = m.parent;
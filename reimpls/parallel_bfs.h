@@ -0,0 +1,263 @@
+#ifndef REIMPLS_PARALLEL_BFS_H__
+#define REIMPLS_PARALLEL_BFS_H__
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cinttypes>
+#include <cassert>
+
+#include "util.h"
+
+namespace reimpls {
+
+/**
+ * Parallel breadth-first search backwards along residual arcs, e.g. from the sink for the global relabeling of
+ * push-relabel. Each level is found with one of two kinds of steps, as in the direction-optimizing search of:
+ *     Direction-Optimizing Breadth-First Search
+ *     Beamer, S., Asanovic, K., Patterson, D., 2012, SC
+ *
+ * - Top-down: the nodes of the current level scan their arcs and claim the unvisited nodes with a residual arc
+ *   into the level.
+ * - Bottom-up: the unvisited nodes scan their arcs until they find a residual arc into the current level, which
+ *   is marked in a bitmap. Nodes are not claimed by several threads, so this needs no atomics on labels.
+ *
+ * Bottom-up steps are used while the arcs of the level outnumber the arcs of the unvisited nodes by a factor,
+ * which happens in the middle levels of low-diameter graphs, where top-down steps would scan most arcs many
+ * times. The search can start from any level, so labels which are known to be exact can be kept.
+ *
+ * The graph is given by an adapter with these members:
+ *     NodeState init_node(NodeIdx i); // Called once per node before the search, see NodeState
+ *     ArcIdx first_arc(NodeIdx i); // The arcs of node i are first_arc(i), ..., last_arc(i) - 1
+ *     ArcIdx last_arc(NodeIdx i);
+ *     NodeIdx head(ArcIdx a);
+ *     bool has_residual(ArcIdx a); // Arc a has residual capacity
+ *     bool has_rev_residual(ArcIdx a); // The reverse arc of a has residual capacity
+ *     void set_label(NodeIdx i, Label label); // Called once for every node the search reaches
+ */
+template <class NodeIdx, class ArcIdx, class Label = NodeIdx>
+class ParallelReverseBfs {
+    struct ThreadData;
+
+    // Ranges with fewer nodes per thread than this are split over fewer threads
+    static constexpr size_t MIN_NODES_PER_THREAD = 256;
+
+    // Direction switching parameters from Beamer et al.
+    static constexpr size_t ALPHA = 14; // Go bottom-up when the level has more than 1/ALPHA of the unvisited arcs
+    static constexpr size_t BETA = 24; // Go top-down when the level has less than 1/BETA of the nodes
+
+public:
+    enum NodeState : int {
+        OPEN, // Not labeled yet. init_node should give it the label for unreachable nodes.
+        DONE, // Keeps its label and is not searched from, e.g. the source or nodes below the first level
+        FIRST_LEVEL // Keeps its label and the search starts from it
+    };
+
+    explicit ParallelReverseBfs(size_t num_nodes);
+
+    // Label the nodes reached from the first level with first_label + 1, first_label + 2, ...
+    template <class Graph>
+    void run(Graph& graph, Label first_label);
+
+    inline unsigned int get_num_threads() const noexcept { return num_threads; }
+    inline void set_num_threads(unsigned int num) noexcept { num_threads = std::max(1u, num); }
+
+    inline ThreadPool& get_thread_pool() const noexcept { return *pool; }
+    inline void set_thread_pool(ThreadPool& p) noexcept { pool = &p; }
+
+    // Stats of the last search
+    size_t levels;
+    size_t bottom_up_levels;
+    size_t scanned_arcs;
+
+private:
+    size_t num_nodes;
+
+    AtomicBitset visited;
+    AtomicBitset in_level; // Nodes of the current level, only set for bottom-up steps
+
+    std::vector<NodeIdx> level;
+    std::vector<NodeIdx> next_level;
+
+    std::vector<ThreadData> thread_data;
+
+    unsigned int num_threads;
+    ThreadPool *pool;
+
+    size_t gather(unsigned int threads, std::vector<NodeIdx>& out);
+
+    struct alignas(64) ThreadData {
+        std::vector<NodeIdx> nodes; // Nodes added to the next level by this thread
+        size_t offset; // Position of the nodes in the next level
+        size_t level_arcs; // Arcs of these nodes
+        size_t open_arcs;
+        size_t scanned_arcs;
+    };
+};
+
+template <class NodeIdx, class ArcIdx, class Label>
+inline ParallelReverseBfs<NodeIdx, ArcIdx, Label>::ParallelReverseBfs(size_t num_nodes) :
+    levels(0),
+    bottom_up_levels(0),
+    scanned_arcs(0),
+    num_nodes(num_nodes),
+    visited(num_nodes),
+    in_level(num_nodes),
+    level(),
+    next_level(),
+    thread_data(),
+    num_threads(std::max(1u, std::thread::hardware_concurrency())),
+    pool(&default_thread_pool()) {}
+
+template <class NodeIdx, class ArcIdx, class Label>
+template <class Graph>
+inline void ParallelReverseBfs<NodeIdx, ArcIdx, Label>::run(Graph& graph, Label first_label)
+{
+    levels = 0;
+    bottom_up_levels = 0;
+    scanned_arcs = 0;
+    if (level.size() < num_nodes) {
+        level.resize(num_nodes);
+        next_level.resize(num_nodes);
+    }
+    if (thread_data.size() < num_threads) {
+        thread_data.resize(num_threads);
+    }
+    visited.clear();
+
+    unsigned int threads = parallel_for_chunks(*pool, num_nodes, num_threads, MIN_NODES_PER_THREAD,
+        [&](unsigned int t, size_t begin, size_t end) {
+        ThreadData& td = thread_data[t];
+        td.nodes.clear();
+        td.level_arcs = 0;
+        td.open_arcs = 0;
+        for (size_t i = begin; i < end; ++i) {
+            const size_t degree = graph.last_arc(i) - graph.first_arc(i);
+            switch (graph.init_node(i)) {
+            case OPEN:
+                td.open_arcs += degree;
+                break;
+            case FIRST_LEVEL:
+                td.nodes.push_back(i);
+                td.level_arcs += degree;
+                // Fall through
+            case DONE:
+                visited.test_and_set(i);
+                break;
+            }
+        }
+    });
+    size_t level_size = gather(threads, level);
+    size_t level_arcs = 0;
+    size_t open_arcs = 0;
+    for (unsigned int t = 0; t < threads; ++t) {
+        level_arcs += thread_data[t].level_arcs;
+        open_arcs += thread_data[t].open_arcs;
+    }
+
+    bool bottom_up = false;
+    Label label = first_label;
+    while (level_size > 0) {
+        label++;
+        if (!bottom_up) {
+            bottom_up = level_arcs > open_arcs / ALPHA;
+        } else {
+            bottom_up = level_size >= num_nodes / BETA;
+        }
+
+        if (bottom_up) {
+            parallel_for_chunks(*pool, level_size, num_threads, MIN_NODES_PER_THREAD,
+                [&](unsigned int, size_t begin, size_t end) {
+                for (size_t k = begin; k < end; ++k) {
+                    in_level.test_and_set(level[k]);
+                }
+            });
+            threads = parallel_for_chunks(*pool, num_nodes, num_threads, MIN_NODES_PER_THREAD,
+                [&](unsigned int t, size_t begin, size_t end) {
+                ThreadData& td = thread_data[t];
+                td.nodes.clear();
+                td.level_arcs = 0;
+                td.scanned_arcs = 0;
+                for (size_t i = begin; i < end; ++i) {
+                    if (visited.test(i)) {
+                        continue;
+                    }
+                    const ArcIdx first = graph.first_arc(i);
+                    const ArcIdx last = graph.last_arc(i);
+                    for (ArcIdx a = first; a != last; ++a) {
+                        td.scanned_arcs++;
+                        if (graph.has_residual(a) && in_level.test(graph.head(a))) {
+                            visited.test_and_set(i);
+                            graph.set_label(i, label);
+                            td.nodes.push_back(i);
+                            td.level_arcs += last - first;
+                            break;
+                        }
+                    }
+                }
+            });
+            parallel_for_chunks(*pool, level_size, num_threads, MIN_NODES_PER_THREAD,
+                [&](unsigned int, size_t begin, size_t end) {
+                for (size_t k = begin; k < end; ++k) {
+                    in_level.reset(level[k]);
+                }
+            });
+            bottom_up_levels++;
+        } else {
+            threads = parallel_for_chunks(*pool, level_size, num_threads, MIN_NODES_PER_THREAD,
+                [&](unsigned int t, size_t begin, size_t end) {
+                ThreadData& td = thread_data[t];
+                td.nodes.clear();
+                td.level_arcs = 0;
+                td.scanned_arcs = 0;
+                for (size_t k = begin; k < end; ++k) {
+                    const NodeIdx i = level[k];
+                    for (ArcIdx a = graph.first_arc(i); a != graph.last_arc(i); ++a) {
+                        td.scanned_arcs++;
+                        const NodeIdx j = graph.head(a);
+                        if (graph.has_rev_residual(a) && !visited.test(j) && !visited.test_and_set(j)) {
+                            graph.set_label(j, label);
+                            td.nodes.push_back(j);
+                            td.level_arcs += graph.last_arc(j) - graph.first_arc(j);
+                        }
+                    }
+                }
+            });
+        }
+
+        level_size = gather(threads, next_level);
+        std::swap(level, next_level);
+        level_arcs = 0;
+        for (unsigned int t = 0; t < threads; ++t) {
+            level_arcs += thread_data[t].level_arcs;
+            scanned_arcs += thread_data[t].scanned_arcs;
+        }
+        assert(level_arcs <= open_arcs);
+        open_arcs -= level_arcs;
+        levels++;
+    }
+}
+
+template <class NodeIdx, class ArcIdx, class Label>
+inline size_t ParallelReverseBfs<NodeIdx, ArcIdx, Label>::gather(unsigned int threads, std::vector<NodeIdx>& out)
+{
+    // Concatenate the nodes found by the threads. Each node is visited once, so out has room for all.
+    size_t total = 0;
+    for (unsigned int t = 0; t < threads; ++t) {
+        thread_data[t].offset = total;
+        total += thread_data[t].nodes.size();
+    }
+    assert(total <= out.size());
+    const unsigned int copy_threads = total >= MIN_NODES_PER_THREAD ? threads : 1;
+    parallel_for_threads(*pool, copy_threads, [&](unsigned int t) {
+        for (unsigned int u = t; u < threads; u += copy_threads) {
+            const auto& found = thread_data[u].nodes;
+            std::copy(found.begin(), found.end(), out.begin() + thread_data[u].offset);
+        }
+    });
+    return total;
+}
+
+} // namespace reimpls
+
+#endif // REIMPLS_PARALLEL_BFS_H__
@@ -8,14 +8,18 @@
 #include <type_traits>
 #include <cassert>
 #include <vector>
-#include <unordered_map>
+#include <list>
 #include <utility>
 #include <algorithm>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <memory>
+#include <chrono>
 
 #include "util.h"
+#include "alloc.h"
+#include "parallel_pr.h"
 
 namespace reimpls {
 
@@ -27,11 +31,8 @@ class ParallelIbfs {
     static constexpr ArcIdx INVALID_ARC = ~ArcIdx(0); // -1 for signed type, max. value for unsigned type
 
     using BlockIdx = uint16_t; // We assume 65536 is enough blocks
-    using BoundaryKey = uint32_t; // Must be 2 x sizeof(BlockIdx)
     using Dist = std::make_signed_t<NodeIdx>;
 
-    static_assert(sizeof(BoundaryKey) == 2 * sizeof(BlockIdx),
-        "BoundaryKey must be double the size of BlockIdx");
     static_assert(std::is_integral<ArcIdx>::value, "ArcIdx must be an integer type");
     static_assert(std::is_integral<NodeIdx>::value, "NodeIdx must be an integer type");
     static_assert(std::is_signed<Cap>::value, "Cap must be a signed type");
@@ -39,6 +40,7 @@ class ParallelIbfs {
     // Forward decls.
     struct Node;
     struct Arc;
+    struct BoundaryArc;
     struct BoundarySegment;
     struct IbfsBlock;
     struct TmpEdge;
@@ -68,6 +70,29 @@ public:
     unsigned int getNumThreads() const noexcept { return num_threads; }
     void setNumThreads(unsigned int threads) { num_threads = threads; }
 
+    ThreadPool& getThreadPool() const noexcept { return *pool; }
+    void setThreadPool(ThreadPool& p) noexcept { pool = &p; }
+
+    BlockPolicy getBlockPolicy() const noexcept { return block_policy; }
+    void setBlockPolicy(BlockPolicy policy) noexcept { block_policy = policy; }
+
+    // Once fewer than this many block pairs are left to merge, phase 2 stops merging and solves the residual
+    // graph of the remaining blocks with parallel push-relabel. 0 means always merge.
+    size_t getTailPairs() const noexcept { return tail_pairs; }
+    void setTailPairs(size_t num) noexcept { tail_pairs = num; }
+
+    std::chrono::duration<double> init_dur;
+    std::chrono::duration<double> ph1_dur;
+    std::chrono::duration<double> bs_dur;
+    std::chrono::duration<double> ph2_dur;
+    std::chrono::duration<double> tail_dur; // Part of ph2_dur
+
+    // Work distribution of the last computeMaxFlow: seconds each thread was busy in phase 1 and 2, and
+    // seconds each block took to solve in phase 1
+    std::vector<double> ph1_busy;
+    std::vector<double> ph2_busy;
+    std::vector<double> block_work;
+
 private:
 #pragma pack (1)
     struct REIMPLS_PACKED Arc {
@@ -94,9 +119,9 @@ private:
     int64_t init_n_edges;
     Arc* arcIter;
 
-    std::vector<Node> nodes;
-    std::vector<Arc> arcs;
-    std::vector<NodeIdx> ptrs;
+    PolicyVector<Node> nodes;
+    PolicyVector<Arc> arcs;
+    PolicyVector<NodeIdx> ptrs;
     //Node *nodes, *nodeEnd;
     //Arc *arcs, *arcEnd;
     //NodeIdx* ptrs;
@@ -111,16 +136,30 @@ private:
     std::vector<IbfsBlock> blocks;
     std::vector<BlockIdx> node_blocks;
 
-    std::unordered_map<BoundaryKey, std::vector<std::pair<ArcIdx, Cap>>> boundary_arcs;
+    // Flat table of boundary arcs, sorted by block pair so each boundary segment is a contiguous range
+    std::vector<BoundaryArc> boundary_arcs;
     std::list<BoundarySegment> boundary_segments;
     std::vector<BlockIdx> block_idxs;
+    // Nodes plus edges of each block, used to estimate the phase 1 work
+    std::vector<double> block_sizes;
 
     unsigned int num_threads;
+    ThreadPool *pool;
+    BlockPolicy block_policy;
+    size_t tail_pairs;
 
     void print_graph(std::FILE* file = stdout) const;
 
+    struct BoundaryArc {
+        BlockIdx i; // i < j
+        BlockIdx j;
+        ArcIdx arc;
+        Cap cap;
+    };
+
     struct BoundarySegment {
-        const std::vector<std::pair<ArcIdx, Cap>>& arcs;
+        size_t first; // Range of boundary_arcs
+        size_t last;
         BlockIdx i;
         BlockIdx j;
         int32_t broken_invariants;
@@ -132,9 +171,9 @@ private:
         ArcIdx numArcs; // TODO: Remove when we change to std::vector
         bool locked;
 
-        std::vector<Node>& nodes;
-        std::vector<Arc>& arcs;
-        std::vector<NodeIdx>& ptrs;
+        PolicyVector<Node>& nodes;
+        PolicyVector<Arc>& arcs;
+        PolicyVector<NodeIdx>& ptrs;
 
         Flow flow;
         int64_t augTimestamp;
@@ -145,8 +184,8 @@ private:
         ExcessBuckets excessBuckets;
         int64_t uniqOrphansS, uniqOrphansT;
 
-        IbfsBlock(NodeIdx numNodes, ArcIdx numArcs, std::vector<Node>& nodes, std::vector<Arc>& arcs, 
-            std::vector<NodeIdx>& ptrs, BlockIdx block) :
+        IbfsBlock(NodeIdx numNodes, ArcIdx numArcs, PolicyVector<Node>& nodes, PolicyVector<Arc>& arcs, 
+            PolicyVector<NodeIdx>& ptrs, BlockIdx block) :
             self(block),
             numNodes(numNodes),
             numArcs(numArcs),
@@ -171,9 +210,15 @@ private:
             active0.init(bufBegin);
             activeS1.init(bufBegin + numNodes);
             activeT1.init(bufBegin + 2 * numNodes);
-            excessBuckets.init(nodes.data(), bufBegin + 3 * numNodes, numNodes);
-            orphan3PassBuckets.init(nodes.data(), numNodes);
-            orphanBuckets.init(nodes.data(), numNodes);
+        }
+
+        // Buckets are sized by the nodes in the block, not the graph, and grow when blocks are merged
+        inline void initBuckets(NodeIdx numBlockNodes)
+        {
+            NodeIdx *bufBegin = ptrs.data();
+            excessBuckets.init(nodes.data(), bufBegin + 3 * numNodes, numBlockNodes);
+            orphan3PassBuckets.init(nodes.data(), numBlockNodes);
+            orphanBuckets.init(nodes.data(), numBlockNodes);
         }
 
         void incNode(NodeIdx node, Term deltaCapSource, Term deltaCapSink);
@@ -326,8 +371,8 @@ private:
         inline void allocate(int64_t numLevels)
         {
             if (numLevels > allocLevels) {
-                // TODO: What if numLevels > 2 * allocLevels? Can this not happen?
-                allocLevels *= 2;
+                // Merged blocks may jump more than one level
+                allocLevels = std::max<size_t>(2 * allocLevels, numLevels);
                 buckets.resize(allocLevels + 1, INVALID_NODE);
             }
         }
@@ -400,8 +445,8 @@ private:
         inline void allocate(int64_t numLevels)
         {
             if (numLevels > allocLevels) {
-                // TODO: What if numLevels > 2 * allocLevels? Can this not happen?
-                allocLevels *= 2;
+                // Merged blocks may jump more than one level
+                allocLevels = std::max<size_t>(2 * allocLevels, numLevels);
                 buckets.resize(allocLevels + 1, INVALID_NODE);
             }
         }
@@ -510,8 +555,8 @@ private:
         inline void allocate(int64_t numLevels)
         {
             if (numLevels > allocLevels) {
-                // TODO: What if numLevels > 2 * allocLevels? Can this not happen?
-                allocLevels *= 2;
+                // Merged blocks may jump more than one level
+                allocLevels = std::max<size_t>(2 * allocLevels, numLevels);
                 buckets.resize(allocLevels + 1, INVALID_NODE);
             }
         }
@@ -588,10 +633,8 @@ private:
     
     static bool invalidates_invariants(const Node& x, const Node& y);
 
-    inline BoundaryKey block_key(BlockIdx i, BlockIdx j) const noexcept;
-    inline std::pair<BlockIdx, BlockIdx> blocks_from_key(BoundaryKey key) const noexcept;
-
     std::pair<std::list<BoundarySegment>, BlockIdx> next_boundary_segment_set();
+    Flow solve_tail();
 
     void unite_blocks(BlockIdx i, BlockIdx j);
 
@@ -599,9 +642,7 @@ private:
 
     inline bool isInitializedGraph() const noexcept { return arcs.size() > 0; }
     void initGraphFast();
-    void initNodes();
-
-    ArcIdx build_arc(NodeIdx from, NodeIdx to, Cap cap, Cap revCap);
+    void initNodes(BlockIdx block, const NodeIdx *blockNodes, size_t numBlockNodes);
 };
 
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
@@ -625,7 +666,19 @@ inline ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::ParallelIbfs() :
     boundary_arcs(),
     boundary_segments(),
     block_idxs(),
-    num_threads(std::thread::hardware_concurrency()) {}
+    block_sizes(),
+    init_dur(),
+    ph1_dur(),
+    bs_dur(),
+    ph2_dur(),
+    tail_dur(),
+    ph1_busy(),
+    ph2_busy(),
+    block_work(),
+    num_threads(std::thread::hardware_concurrency()),
+    pool(&default_thread_pool()),
+    block_policy(BLOCK_POLICY_FIXED),
+    tail_pairs(0) {}
 
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
 inline ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::ParallelIbfs(int64_t numNodes, int64_t numEdges) :
@@ -909,7 +962,9 @@ inline int ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::isNodeOnSrcSide(NodeI
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
 inline void ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::initGraph()
 {
+    auto init_begin = std::chrono::system_clock::now();
     initGraphFast();
+    init_dur = std::chrono::system_clock::now() - init_begin;
 }
 
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
@@ -1003,15 +1058,23 @@ inline void ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::registerNodes(
     std::fill(node_blocks.begin() + begin, node_blocks.begin() + end, block);
 }
 
+// @pre: blockNodes are the nodes of the block in increasing order
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
-inline void ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::initNodes()
+inline void ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::initNodes(
+    BlockIdx block, const NodeIdx *blockNodes, size_t numBlockNodes)
 {
-    // Init active lists first
-    std::fill_n(ptrs.begin(), 3 * numNodes, INVALID_NODE);
+    IbfsBlock& b = blocks[block];
+    b.initBuckets(numBlockNodes);
+
+    for (size_t k = 0; k < numBlockNodes; ++k) {
+        const NodeIdx i = blockNodes[k];
+        Node& x = nodes[i];
+
+        // Init active lists first
+        ptrs[i] = INVALID_NODE;
+        ptrs[numNodes + i] = INVALID_NODE;
+        ptrs[2 * numNodes + i] = INVALID_NODE;
 
-    NodeIdx i = 0;
-    //for (Node* x = nodes; x <= nodeEnd; ++x, ++i) {
-    for (auto& x : nodes) {
         x.firstArc = x.label;
         x.parent = INVALID_ARC;
         x.firstSon = INVALID_NODE;
@@ -1020,29 +1083,14 @@ inline void ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::initNodes()
             x.label = 0;
         } else if (x.excess > 0) {
             x.label = 1;
-            blocks[node_blocks[i]].activeS1.add(i);
-            //blocks[0].activeS1.add(i);
+            b.activeS1.add(i);
         } else {
             x.label = -1;
-            blocks[node_blocks[i]].activeT1.add(i);
-            //blocks[0].activeT1.add(i);
+            b.activeT1.add(i);
         }
-        ++i;
     }
 }
 
-template<class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
-inline ArcIdx ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::build_arc(
-    NodeIdx from, NodeIdx to, Cap cap, Cap revCap)
-{
-    ArcIdx ai = nodes[from].firstArc;
-    arcs[ai].rev = nodes[to].firstArc;
-    arcs[ai].head = to;
-    arcs[ai].rCap = cap;
-    arcs[ai].isRevResidual = revCap != 0;
-    return ai;
-}
-
 template<class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
 inline bool ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::invalidates_invariants(const Node & x, const Node & y)
 {
@@ -1052,28 +1100,6 @@ inline bool ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::invalidates_invarian
         || (x.label < (y.label - 1) && y.label < 0);
 }
 
-template<class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
-inline typename ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::BoundaryKey
-ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::block_key(BlockIdx i, BlockIdx j) const noexcept
-{
-    constexpr BoundaryKey shift = sizeof(BlockIdx) * 8;
-    if (i < j) {
-        return static_cast<BoundaryKey>(i) | (static_cast<BoundaryKey>(j) << shift);
-    } else {
-        return static_cast<BoundaryKey>(j) | (static_cast<BoundaryKey>(i) << shift);
-    }
-}
-
-template<class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
-inline std::pair<BlockIdx, BlockIdx> ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::blocks_from_key(
-    BoundaryKey key) const noexcept
-{
-    static_assert(sizeof(std::pair<BlockIdx, BlockIdx>) == sizeof(BoundaryKey),
-        "Pair of BlockIdx does not match size of BoundaryKey");
-    // Since std::pair just stores two BlockIdx fields adjacent in memory, we can just reinterpret the key
-    return *reinterpret_cast<std::pair<BlockIdx, BlockIdx> *>(&key);
-}
-
 template<class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
 inline std::pair<std::list<
     typename ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::BoundarySegment>, BlockIdx>
@@ -1111,6 +1137,70 @@ ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::next_boundary_segment_set()
     return std::make_pair(out, out_idx);
 }
 
+template<class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
+inline Flow ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::solve_tail()
+{
+    // Find the blocks which are still waiting for a merge and add the boundary arcs between them
+    std::vector<bool> inTail(blocks.size(), false);
+    for (const auto& bs : boundary_segments) {
+        inTail[block_idxs[bs.i]] = true;
+        inTail[block_idxs[bs.j]] = true;
+        for (size_t a = bs.first; a < bs.last; ++a) {
+            arcs[boundary_arcs[a].arc].rCap += boundary_arcs[a].cap;
+        }
+    }
+    boundary_segments.clear();
+
+    // Number the nodes of these blocks
+    const NodeIdx numGraphNodes = nodes.size() - 1;
+    std::vector<NodeIdx> tailIdx(numGraphNodes, INVALID_NODE);
+    NodeIdx numTail = 0;
+    for (NodeIdx i = 0; i < numGraphNodes; ++i) {
+        if (inTail[block_idxs[node_blocks[i]]]) {
+            tailIdx[i] = numTail++;
+        }
+    }
+
+    // The residual graph of the blocks continues from the flow they have found so far. The labels are not
+    // reused since the added boundary arcs break the invariants push-relabel needs.
+    using PushRelabel = ParallelPushRelabel<Term, Flow, ArcIdx, NodeIdx>;
+    PushRelabel tail(numTail, arcs.size() / 2);
+    tail.set_num_threads(num_threads);
+    tail.set_thread_pool(*pool);
+    for (NodeIdx i = 0; i < numGraphNodes; ++i) {
+        if (tailIdx[i] == INVALID_NODE) {
+            continue;
+        }
+        const Term excess = nodes[i].excess;
+        if (excess > 0) {
+            tail.add_tweights(tailIdx[i], excess, 0);
+        } else if (excess < 0) {
+            tail.add_tweights(tailIdx[i], 0, -excess);
+        }
+        for (ArcIdx a = nodes[i].firstArc; a != nodes[i + 1].firstArc; ++a) {
+            const Arc& arc = arcs[a];
+            if (arc.rev < a || (arc.rCap == 0 && arcs[arc.rev].rCap == 0)) {
+                continue;
+            }
+            assert(tailIdx[arc.head] != INVALID_NODE);
+            tail.add_edge(tailIdx[i], tailIdx[arc.head], arc.rCap, arcs[arc.rev].rCap);
+        }
+    }
+
+    tail.mincut();
+
+    // Record the cut in the labels that isNodeOnSrcSide reads
+    parallel_for_blocks(*pool, numGraphNodes, num_threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            if (tailIdx[i] != INVALID_NODE) {
+                nodes[i].label = tail.what_segment(tailIdx[i]) == PushRelabel::SINK ? -1 : 1;
+            }
+        }
+    });
+
+    return tail.get_flow();
+}
+
 template<class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
 inline void ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::unite_blocks(BlockIdx i, BlockIdx j)
 {
@@ -1123,46 +1213,181 @@ inline void ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::unite_blocks(BlockId
     bi.flow += bj.flow;
     bi.uniqOrphansS += bj.uniqOrphansS;
     bi.uniqOrphansT += bj.uniqOrphansT;
+
+    // Nodes from block j may be on levels beyond what the buckets of block i have room for
+    const int64_t topLevel = std::max(bi.topLevelS, bi.topLevelT) + 1;
+    bi.orphanBuckets.allocate(topLevel);
+    bi.orphan3PassBuckets.allocate(topLevel);
+    bi.excessBuckets.allocate(topLevel);
 }
 
 template <class Cap, class Term, class Flow, class NodeIdx, class ArcIdx>
 inline void ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::initGraphFast()
 {
-    Node* x;
-    TmpEdge* te;
+    const size_t numBlocks = blocks.size();
+    const size_t numEdges = tmpEdgeLast - tmpEdges.data();
+    const NodeIdx numGraphNodes = nodes.size() - 1;
+    const unsigned int threads = std::max(1u, num_threads);
+
+    // Nodes and edges are split into the same chunks in every pass below
+    const size_t numChunks = threads;
+    auto nodeBegin = [&](size_t c) { return static_cast<NodeIdx>(numGraphNodes * c / numChunks); };
+    auto edgeBegin = [&](size_t c) { return numEdges * c / numChunks; };
+
+    // Sum the degrees (stored in label by addEdge) of each chunk of nodes and count the nodes and edges
+    // of each block in each chunk. Boundary edges count for both of their blocks.
+    std::vector<ArcIdx> chunkFirstArc(numChunks + 1, 0);
+    std::vector<size_t> nodeOffsets(numChunks * numBlocks, 0);
+    std::vector<size_t> edgeOffsets(numChunks * numBlocks, 0);
+    parallel_for_each(*pool, numChunks, threads, [&](size_t c) {
+        ArcIdx sum = 0;
+        size_t *nodeCounts = &nodeOffsets[c * numBlocks];
+        for (NodeIdx i = nodeBegin(c); i != nodeBegin(c + 1); ++i) {
+            sum += nodes[i].label;
+            nodeCounts[node_blocks[i]]++;
+        }
+        chunkFirstArc[c + 1] = sum;
+
+        size_t *edgeCounts = &edgeOffsets[c * numBlocks];
+        for (size_t e = edgeBegin(c); e != edgeBegin(c + 1); ++e) {
+            const BlockIdx bi = node_blocks[tmpEdges[e].tail];
+            const BlockIdx bj = node_blocks[tmpEdges[e].head];
+            edgeCounts[bi]++;
+            if (bj != bi) {
+                edgeCounts[bj]++;
+            }
+        }
+    });
+    for (size_t c = 0; c < numChunks; ++c) {
+        chunkFirstArc[c + 1] += chunkFirstArc[c];
+    }
 
-    // calculate start arc offsets and labels for every node
-    nodes[0].firstArc = 0;
-    //for (x = nodes; x != nodeEnd; x++) {
-    for (NodeIdx i = 0; i < nodes.size() - 1; ++i) {
-        nodes[i + 1].firstArc = nodes[i].firstArc + nodes[i].label;
-        nodes[i].label = nodes[i].firstArc;
+    // Turn counts into offsets in the node and edge lists of the blocks. The lists are in index order
+    // since the chunks are in index order.
+    std::vector<size_t> blockFirstNode(numBlocks + 1, 0);
+    std::vector<size_t> blockFirstEdge(numBlocks + 1, 0);
+    size_t nodePos = 0;
+    size_t edgePos = 0;
+    for (size_t b = 0; b < numBlocks; ++b) {
+        blockFirstNode[b] = nodePos;
+        blockFirstEdge[b] = edgePos;
+        for (size_t c = 0; c < numChunks; ++c) {
+            size_t& nodeOffset = nodeOffsets[c * numBlocks + b];
+            size_t& edgeOffset = edgeOffsets[c * numBlocks + b];
+            std::swap(nodePos, nodeOffset);
+            nodePos += nodeOffset;
+            std::swap(edgePos, edgeOffset);
+            edgePos += edgeOffset;
+        }
     }
-    nodes.back().label = arcs.size();
-
-    // copy arcs
-    //for (te = tmpEdges; te != tmpEdgeLast; te++) {
-    for (const auto& te : tmpEdges) {
-        NodeIdx from = te.tail;
-        NodeIdx to = te.head;
-        Cap cap = te.cap;
-        Cap revCap = te.revCap;
-       
-        if (node_blocks[from] != node_blocks[to]) {
-            auto key = block_key(node_blocks[from], node_blocks[to]);
-            ArcIdx a1 = build_arc(from, to, 0, 0);            
-            ArcIdx a2 = build_arc(to, from, 0, 0);
-            boundary_arcs[key].emplace_back(a1, cap);
-            boundary_arcs[key].emplace_back(a2, revCap);
-        } else {
-            build_arc(from, to, cap, revCap);
-            build_arc(to, from, revCap, cap);
+    blockFirstNode[numBlocks] = nodePos;
+    blockFirstEdge[numBlocks] = edgePos;
+
+    block_sizes.resize(numBlocks);
+    for (size_t b = 0; b < numBlocks; ++b) {
+        block_sizes[b] = (blockFirstNode[b + 1] - blockFirstNode[b]) + (blockFirstEdge[b + 1] - blockFirstEdge[b]);
+    }
+
+    // Calculate start arc offsets and labels for every node and fill the lists
+    std::unique_ptr<NodeIdx[]> blockNodes(new NodeIdx[nodePos]);
+    std::unique_ptr<ArcIdx[]> blockEdges(new ArcIdx[edgePos]);
+    parallel_for_each(*pool, numChunks, threads, [&](size_t c) {
+        ArcIdx pos = chunkFirstArc[c];
+        size_t *nodeNext = &nodeOffsets[c * numBlocks];
+        for (NodeIdx i = nodeBegin(c); i != nodeBegin(c + 1); ++i) {
+            const ArcIdx degree = nodes[i].label;
+            nodes[i].firstArc = pos;
+            nodes[i].label = pos;
+            pos += degree;
+            blockNodes[nodeNext[node_blocks[i]]++] = i;
+        }
+
+        size_t *edgeNext = &edgeOffsets[c * numBlocks];
+        for (size_t e = edgeBegin(c); e != edgeBegin(c + 1); ++e) {
+            const BlockIdx bi = node_blocks[tmpEdges[e].tail];
+            const BlockIdx bj = node_blocks[tmpEdges[e].head];
+            blockEdges[edgeNext[bi]++] = e;
+            if (bj != bi) {
+                blockEdges[edgeNext[bj]++] = e;
+            }
+        }
+    });
+
+    // Each block hands out the arcs of its own nodes to its edges in index order. This gives the same
+    // arcs as handing them out while going through all edges in order.
+    std::unique_ptr<ArcIdx[]> tailArcs(new ArcIdx[numEdges]);
+    std::unique_ptr<ArcIdx[]> headArcs(new ArcIdx[numEdges]);
+    parallel_for_each(*pool, numBlocks, threads, [&](size_t b) {
+        for (size_t k = blockFirstEdge[b]; k < blockFirstEdge[b + 1]; ++k) {
+            const ArcIdx e = blockEdges[k];
+            const TmpEdge& te = tmpEdges[e];
+            if (node_blocks[te.tail] == b) {
+                tailArcs[e] = nodes[te.tail].firstArc++;
+            }
+            if (node_blocks[te.head] == b) {
+                headArcs[e] = nodes[te.head].firstArc++;
+            }
+        }
+    });
+
+    // Copy arcs and init. nodes. Boundary arcs start with zero capacity and are added when their blocks merge.
+    std::vector<std::vector<BoundaryArc>> blockBoundaryArcs(numBlocks);
+    parallel_for_each(*pool, numBlocks, threads, [&](size_t b) {
+        auto& boundary = blockBoundaryArcs[b];
+        for (size_t k = blockFirstEdge[b]; k < blockFirstEdge[b + 1]; ++k) {
+            const ArcIdx e = blockEdges[k];
+            const TmpEdge& te = tmpEdges[e];
+            const NodeIdx from = te.tail;
+            const NodeIdx to = te.head;
+            const BlockIdx bf = node_blocks[from];
+            const BlockIdx bt = node_blocks[to];
+            const bool isBoundary = bf != bt;
+
+            if (bf == b) {
+                Arc& a = arcs[tailArcs[e]];
+                a.head = to;
+                a.rev = headArcs[e];
+                a.rCap = isBoundary ? 0 : te.cap;
+                a.isRevResidual = !isBoundary && te.revCap != 0;
+                if (isBoundary) {
+                    boundary.push_back({ std::min(bf, bt), std::max(bf, bt), tailArcs[e], te.cap });
+                }
+            }
+            if (bt == b) {
+                Arc& a = arcs[headArcs[e]];
+                a.head = from;
+                a.rev = tailArcs[e];
+                a.rCap = isBoundary ? 0 : te.revCap;
+                a.isRevResidual = !isBoundary && te.cap != 0;
+                if (isBoundary) {
+                    boundary.push_back({ std::min(bf, bt), std::max(bf, bt), headArcs[e], te.revCap });
+                }
+            }
         }
-        ++nodes[to].firstArc;
-        ++nodes[from].firstArc;
+
+        initNodes(b, &blockNodes[blockFirstNode[b]], blockFirstNode[b + 1] - blockFirstNode[b]);
+    });
+
+    Node& last = nodes.back();
+    last.firstArc = arcs.size();
+    last.parent = INVALID_ARC;
+    last.firstSon = INVALID_NODE;
+    last.nextNode = INVALID_NODE;
+    last.label = 0;
+
+    // Collect boundary arcs into one table sorted by block pair
+    boundary_arcs.clear();
+    for (auto& boundary : blockBoundaryArcs) {
+        boundary_arcs.insert(boundary_arcs.end(), boundary.begin(), boundary.end());
+        boundary = std::vector<BoundaryArc>();
     }
+    std::stable_sort(boundary_arcs.begin(), boundary_arcs.end(), [](const BoundaryArc& a, const BoundaryArc& b) {
+        return std::tie(a.i, a.j) < std::tie(b.i, b.j);
+    });
 
-    initNodes();
+    // Edges are all stored in the arcs now
+    tmpEdges = std::vector<TmpEdge>();
+    tmpEdgeLast = nullptr;
 }
 
 // @ret: minimum orphan level
@@ -1790,39 +2015,60 @@ inline Flow ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::computeMaxFlow()
 {
     flow = 0;
 
-    std::atomic<BlockIdx> processed_blocks = 0;
-    std::vector<std::thread> threads;
+    auto ph1_begin = std::chrono::system_clock::now();
 
-    // Phase 1: solve all base blocks
-    for (unsigned int i = 0; i < num_threads; ++i) {
-        threads.emplace_back([&]() {
-            const BlockIdx num_blocks = blocks.size();
-            BlockIdx crnt = processed_blocks.fetch_add(1);
-            while (crnt < num_blocks) {
-                blocks[crnt].computeMaxFlow(true, true);
-                crnt = processed_blocks.fetch_add(1);
-            }
-        });
-    }
-    for (auto& th : threads) {
-        if (th.joinable()) {
-            th.join();
+    // Phase 1: solve all base blocks. With the adaptive policy the heaviest blocks go first and light blocks
+    // are batched into tasks, otherwise blocks are taken in index order.
+    std::vector<size_t> order;
+    std::vector<size_t> task_begin;
+    if (block_policy == BLOCK_POLICY_ADAPTIVE) {
+        double total = 0;
+        for (double size : block_sizes) {
+            total += size;
         }
+        plan_work_tasks(block_sizes, total / (8 * std::max(1u, num_threads)), order, task_begin);
+    } else {
+        order.resize(blocks.size());
+        task_begin.resize(blocks.size() + 1);
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            order[b] = b;
+            task_begin[b] = b;
+        }
+        task_begin[blocks.size()] = blocks.size();
     }
 
+    ph1_busy.assign(std::max(1u, num_threads), 0);
+    block_work.assign(blocks.size(), 0);
+    parallel_for_queue(*pool, task_begin.size() - 1, num_threads, [&](size_t k, unsigned int t) {
+        for (size_t p = task_begin[k]; p < task_begin[k + 1]; ++p) {
+            const size_t b = order[p];
+            auto solve_begin = std::chrono::steady_clock::now();
+            blocks[b].computeMaxFlow(true, true);
+            block_work[b] = std::chrono::duration<double>(std::chrono::steady_clock::now() - solve_begin).count();
+            ph1_busy[t] += block_work[b];
+        }
+    });
+
+    ph1_dur = std::chrono::system_clock::now() - ph1_begin;
+    auto bs_begin = std::chrono::system_clock::now();
+
     // Build list of boundary segments
-    for (const auto& ba : boundary_arcs) {
-        BlockIdx i, j;
-        std::tie(i, j) = blocks_from_key(ba.first);
-        boundary_segments.push_back({ ba.second, i, j, 0 });
+    boundary_segments.clear();
+    for (size_t first = 0, last; first < boundary_arcs.size(); first = last) {
+        const BlockIdx i = boundary_arcs[first].i;
+        const BlockIdx j = boundary_arcs[first].j;
+        for (last = first + 1; last < boundary_arcs.size() &&
+            boundary_arcs[last].i == i && boundary_arcs[last].j == j; ++last) {}
+        boundary_segments.push_back({ first, last, i, j, 0 });
     }
 
     // Compute merge order heuristic
     for (auto& bs : boundary_segments) {
         int32_t broken_invariants = 0;
-        for (const auto& a : bs.arcs) {
-            Node& y = nodes[arcs[a.first].head];
-            Node& x = nodes[arcs[arcs[a.first].rev].head];
+        for (size_t a = bs.first; a < bs.last; ++a) {
+            const ArcIdx ai = boundary_arcs[a].arc;
+            Node& y = nodes[arcs[ai].head];
+            Node& x = nodes[arcs[arcs[ai].rev].head];
             if (invalidates_invariants(x, y)) {
                 broken_invariants++;
             }
@@ -1833,57 +2079,75 @@ inline Flow ParallelIbfs<Cap, Term, Flow, NodeIdx, ArcIdx>::computeMaxFlow()
     boundary_segments.sort([](const auto& bs1, const auto& bs2) {
         return bs1.broken_invariants > bs2.broken_invariants;
     });
+    if (block_policy == BLOCK_POLICY_ADAPTIVE) {
+        // Merge the block pairs that were cheapest to solve first, so heavy blocks join few, late merges
+        boundary_segments.sort([&](const auto& bs1, const auto& bs2) {
+            return block_work[bs1.i] + block_work[bs1.j] < block_work[bs2.i] + block_work[bs2.j];
+        });
+    }
+
+    bs_dur = std::chrono::system_clock::now() - bs_begin;
+    auto ph2_begin = std::chrono::system_clock::now();
 
     // Phase 2: merge blocks
-    threads.clear();
     std::mutex lock;
+    ph2_busy.assign(num_threads, 0);
 
+    parallel_for_threads(*pool, num_threads, [&](unsigned int t) {
 
-    for (unsigned int i = 0; i < num_threads; ++i) {
-        threads.emplace_back([&]() {
+        BlockIdx crnt;
+        std::list<BoundarySegment> boundary_set;
+        while (true) {
+            lock.lock();
 
-            BlockIdx crnt;
-            std::list<BoundarySegment> boundary_set;
-            while (true) {
-                lock.lock();
+            if (boundary_segments.size() < tail_pairs) {
+                // Leave the remaining blocks to the tail solve
+                lock.unlock();
+                break;
+            }
 
-                std::tie(boundary_set, crnt) = next_boundary_segment_set();
-                if (boundary_set.empty()) {
-                    lock.unlock();
-                    break;
-                }
+            std::tie(boundary_set, crnt) = next_boundary_segment_set();
+            if (boundary_set.empty()) {
+                lock.unlock();
+                break;
+            }
 
-                // Lock block
-                auto& block = blocks[crnt];
-                block.locked = true;
+            // Lock block
+            auto& block = blocks[crnt];
+            block.locked = true;
 
-                lock.unlock();
+            lock.unlock();
+            auto merge_begin = std::chrono::steady_clock::now();
 
-                // Re-add boundary arcs
-                for (const auto& segment : boundary_set) {
-                    for (const auto& a : segment.arcs) {
-                        block.incArc(a.first, a.second);
-                    }
+            // Re-add boundary arcs
+            for (const auto& segment : boundary_set) {
+                for (size_t a = segment.first; a < segment.last; ++a) {
+                    block.incArc(boundary_arcs[a].arc, boundary_arcs[a].cap);
                 }
+            }
 
-                // Compute maxflow for merged block
-                block.template augmentIncrements<true>();
-                block.template augmentIncrements<false>();
-                assert(block.active0.empty());
-                block.computeMaxFlow(true, true);
+            // Compute maxflow for merged block
+            block.template augmentIncrements<true>();
+            block.template augmentIncrements<false>();
+            assert(block.active0.empty());
+            block.computeMaxFlow(true, true);
+            ph2_busy[t] += std::chrono::duration<double>(std::chrono::steady_clock::now() - merge_begin).count();
 
-                lock.lock();
-                block.locked = false;
-                lock.unlock();
-            }
-        });
-    }
-    for (auto& th : threads) {
-        if (th.joinable()) {
-            th.join();
+            lock.lock();
+            block.locked = false;
+            lock.unlock();
         }
+    });
+
+    tail_dur = tail_dur.zero();
+    if (!boundary_segments.empty()) {
+        auto tail_begin = std::chrono::system_clock::now();
+        flow += solve_tail();
+        tail_dur = std::chrono::system_clock::now() - tail_begin;
     }
 
+    ph2_dur = std::chrono::system_clock::now() - ph2_begin;
+
     // Sum up all subgraph flows
     std::sort(block_idxs.begin(), block_idxs.end());
     auto last = std::unique(block_idxs.begin(), block_idxs.end());
@@ -10,13 +10,8 @@
 #include <cinttypes>
 #include <cassert>
 
-#include "tbb/concurrent_vector.h"
-
-#ifdef _OPENMP
-#include <omp.h>
-#endif
-
 #include "util.h"
+#include "parallel_bfs.h"
 
 namespace reimpls {
 
@@ -25,7 +20,17 @@ namespace reimpls {
  *     Efficient Implementation of a Synchronous Parallel Push-Relabel Algorithm
  *     Baumstark, N., Blelloch, G., Shun, J., 2015, ESA
  *
- * NOTE: This implementation relies on OpenMP for parallelism.
+ * The source and sink are implicit: a node's source capacity is its initial excess and its sink capacity is
+ * kept on the node. The arcs are stored grouped by node and are built from the added edges when mincut is
+ * called, so the graph can not be changed afterwards. In each round, every thread collects the nodes it
+ * discovers in its own buffer and the buffers are concatenated into the next working set at offsets given by
+ * a prefix sum over the buffer sizes.
+ *
+ * Global relabels use ParallelReverseBfs and only relabel the nodes above the lowest label that may have
+ * changed since the last global relabel: the label of a node that relabeled or saturated an arc, minus one.
+ * Nodes at or below that label can only reach the sink through each other and their paths are unchanged.
+ *
+ * NOTE: This implementation runs on a ThreadPool, see set_thread_pool.
  */
 template <class Cap, class Flow, class ArcIdx = uint32_t, class NodeIdx = uint32_t>
 class ParallelPushRelabel {
@@ -35,12 +40,20 @@ class ParallelPushRelabel {
 
     using Label = NodeIdx;
 
+    // Excesses are sums of many arc capacities so small integer types are promoted
+    using Excess = PromotedCap<Cap>;
+
     // Forward decls.
     struct Node;
     struct Arc;
+    struct Edge;
+    struct ThreadData;
+    struct RelabelGraph;
 
-    static constexpr NodeIdx INVALID_NODE = ~NodeIdx(0); // -1 for signed type, max. value for unsigned type
-    static constexpr ArcIdx INVALID_ARC = ~ArcIdx(0); // -1 for signed type, max. value for unsigned type
+    using Bfs = ParallelReverseBfs<NodeIdx, ArcIdx, Label>;
+
+    // Ranges with fewer nodes per thread than this are split over fewer threads
+    static constexpr size_t MIN_NODES_PER_THREAD = 256;
 
 public:
     enum TermType : int32_t {
@@ -48,108 +61,173 @@ public:
         SINK = 1
     };
 
-    ParallelPushRelabel(size_t expected_nodes, size_t expected_arcs);
-
-    inline void set_source(NodeIdx s) noexcept { source = s; }
-    inline void set_sink(NodeIdx t) noexcept { sink = t; };
+    ParallelPushRelabel(size_t num_nodes, size_t expected_arcs);
 
+    void add_tweights(NodeIdx i, Cap cap_source, Cap cap_sink);
     void add_edge(NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap);
 
-    TermType what_segment(NodeIdx i);
+    TermType what_segment(NodeIdx i) const;
 
     void mincut();
+
+    // Relabel the nodes whose distance to the sink may have changed since the last global relabel
     void global_relabel();
 
-    Flow get_flow();
+    inline Flow get_flow() const noexcept { return flow; }
 
     inline unsigned int get_num_threads() const noexcept { return num_threads; }
-    inline void set_num_threads(unsigned int num) noexcept { num_threads = num; }
+    inline void set_num_threads(unsigned int num) noexcept { num_threads = std::max(1u, num); }
+
+    inline ThreadPool& get_thread_pool() const noexcept { return *pool; }
+    inline void set_thread_pool(ThreadPool& p) noexcept { pool = &p; }
 
 private:
     std::vector<Node> nodes;
+    std::vector<ArcIdx> first_arc; // The arcs of node i are first_arc[i], ..., first_arc[i + 1] - 1
     std::vector<Arc> arcs;
+    std::vector<Edge> edges; // Added edges which have not been turned into arcs yet
+
+    std::vector<std::atomic<Excess>> added_excess; // Excess pushed to each node in the current round
+    AtomicBitset discovered; // Nodes which are in the buffer of some thread
 
-    // TODO: Replace this with an inline linked list similar to active nodes in BK
-    tbb::concurrent_vector<NodeIdx> working_set;
-    tbb::concurrent_vector<NodeIdx> new_working_set;
-    tbb::concurrent_vector<NodeIdx> q;
-    tbb::concurrent_vector<NodeIdx> new_q;
+    // Node lists are allocated for all nodes once and have a separate size
+    std::vector<NodeIdx> working_set;
+    std::vector<NodeIdx> next_set;
+    size_t working_size;
 
-    NodeIdx source;
-    NodeIdx sink;
+    std::vector<ThreadData> thread_data;
+
+    Bfs bfs;
+    Label lowest_changed; // Labels up to this one are exact distances to the sink
+
+    Flow flow;
 
     unsigned int num_threads;
+    ThreadPool *pool;
 
-    void init_mincut();
+    void init_buffers();
+    void build_arcs();
 
-    void add_half_edge(NodeIdx from, NodeIdx to, Cap cap);
+    void discharge(NodeIdx i, ThreadData& td);
 
-    bool owns_arc(NodeIdx n, NodeIdx other) const;
+    size_t gather(unsigned int threads, std::vector<NodeIdx>& out);
 
-    inline ArcIdx sister_idx(ArcIdx a) const noexcept { return a ^ 1; }
-    inline Arc& sister(ArcIdx a) { return arcs[sister_idx(a)]; }
-    inline const Arc& sister(ArcIdx a) const { return arcs[sister_idx(a)]; }
+    bool owns_arc(NodeIdx n, NodeIdx other) const;
 
-#pragma pack (1)
-    struct REIMPLS_PACKED Node {
-        ArcIdx first; // First out-going arc
-        ArcIdx degree; // Number of out-going arcs
-        
-        Cap excess;
-        std::atomic<Cap> added_excess;
-        std::atomic<Label> label;
-        Label label_copy;
+    inline size_t num_nodes() const noexcept { return nodes.size(); }
 
-        Label work;
+    // Label of nodes which can not reach the sink. Distances to the sink are at most the number of nodes.
+    inline Label max_label() const noexcept { return static_cast<Label>(nodes.size() + 1); }
 
-        std::atomic_flag is_discovered;
-        std::vector<NodeIdx> discovered_nodes; // TODO: Do this without a vector
+    struct Node {
+        Label label;
+        Label new_label; // Label at the end of the current round
+        Excess excess;
+        Excess sink_cap; // Residual capacity of the implicit arc to the sink
 
         Node() :
-            first(INVALID_ARC),
-            degree(0),
-            excess(0),
-            added_excess(),
             label(0),
-            label_copy(0),
-            work(0),
-            is_discovered(),
-            discovered_nodes() {}
+            new_label(0),
+            excess(0),
+            sink_cap(0) {}
     };
 
-    struct REIMPLS_PACKED Arc {
-        ArcIdx next; // Next arc with the same originating node
-        NodeIdx head; // Node this arc points to.
+    struct Arc {
+        NodeIdx head;
+        ArcIdx sister;
 
-        Cap cap; // Capacity
-        Cap flow; // Current flow
+        // A push also adds to the sister arc, which the thread of the head node may read during the same round
+        std::atomic<Cap> r_cap;
+    };
 
-        Arc(NodeIdx head, ArcIdx next, Cap cap) :
-            next(next),
-            head(head),
-            cap(cap),
-            flow(0) {}
+    struct Edge {
+        NodeIdx i;
+        NodeIdx j;
+        Cap cap;
+        Cap rev_cap;
+    };
 
-        inline Cap r_cap() const noexcept { return cap - flow; }
+    struct alignas(64) ThreadData {
+        std::vector<NodeIdx> nodes; // Nodes discovered by this thread
+        size_t offset; // Position of the nodes in the merged list
+        size_t work;
+        Flow flow; // Flow pushed to the sink
+        Label lowest_changed;
+    };
+
+    // Adapter for the reverse search from the sink
+    struct RelabelGraph {
+        ParallelPushRelabel& g;
+        Label first_label; // Zero to start from the sink
+
+        typename Bfs::NodeState init_node(NodeIdx i)
+        {
+            Node& n = g.nodes[i];
+            if (first_label == 0) {
+                if (n.sink_cap > 0) {
+                    n.label = 1;
+                    return Bfs::FIRST_LEVEL;
+                }
+            } else if (n.label <= first_label) {
+                return n.label == first_label ? Bfs::FIRST_LEVEL : Bfs::DONE;
+            }
+            n.label = g.max_label();
+            return Bfs::OPEN;
+        }
+
+        inline ArcIdx first_arc(NodeIdx i) const noexcept { return g.first_arc[i]; }
+        inline ArcIdx last_arc(NodeIdx i) const noexcept { return g.first_arc[i + 1]; }
+        inline NodeIdx head(ArcIdx a) const noexcept { return g.arcs[a].head; }
+        inline bool has_residual(ArcIdx a) const noexcept
+        {
+            return g.arcs[a].r_cap.load(std::memory_order_relaxed) > 0;
+        }
+        inline bool has_rev_residual(ArcIdx a) const noexcept { return has_residual(g.arcs[a].sister); }
+        inline void set_label(NodeIdx i, Label label) noexcept { g.nodes[i].label = label; }
     };
-#pragma pack ()
 };
 
 template<class Cap, class Flow, class ArcIdx, class NodeIdx>
 inline ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::ParallelPushRelabel(
     size_t num_nodes, size_t expected_arcs) :
     nodes(num_nodes),
+    first_arc(num_nodes + 1, 0),
     arcs(),
+    edges(),
+    added_excess(num_nodes),
+    discovered(num_nodes),
     working_set(),
-    source(INVALID_NODE),
-    sink(INVALID_NODE),
-    num_threads(std::thread::hardware_concurrency())
+    next_set(),
+    working_size(0),
+    thread_data(),
+    bfs(num_nodes),
+    lowest_changed(0),
+    flow(0),
+    num_threads(std::max(1u, std::thread::hardware_concurrency())),
+    pool(&default_thread_pool())
+{
+#ifndef REIMPLS_NO_OVERFLOW_CHECKS
+    if (num_nodes >= static_cast<size_t>(std::numeric_limits<NodeIdx>::max())) {
+        throw std::overflow_error("Node count exceeds capacity of index type. "
+            "Please increase capacity of NodeIdx type.");
+    }
+#endif
+    edges.reserve(expected_arcs);
+}
+
+template<class Cap, class Flow, class ArcIdx, class NodeIdx>
+inline void ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::add_tweights(NodeIdx i, Cap cap_source, Cap cap_sink)
 {
-    arcs.reserve(2 * expected_arcs);
-    working_set.reserve(num_nodes);
-    new_working_set.reserve(num_nodes);
-    q.reserve(num_nodes);
-    new_q.reserve(num_nodes);
+    assert(i >= 0 && i < nodes.size());
+    assert(cap_source >= 0);
+    assert(cap_sink >= 0);
+    Node& n = nodes[i];
+    n.excess += cap_source;
+    n.sink_cap += cap_sink;
+    const Excess common = std::min(n.excess, n.sink_cap);
+    n.excess -= common;
+    n.sink_cap -= common;
+    flow += common;
 }
 
 template<class Cap, class Flow, class ArcIdx, class NodeIdx>
@@ -160,244 +238,282 @@ inline void ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::add_edge(NodeIdx i,
     assert(i != j);
     assert(cap >= 0);
     assert(rev_cap >= 0);
+    assert(arcs.empty());
 
 #ifndef REIMPLS_NO_OVERFLOW_CHECKS
-    if (arcs.size() > std::numeric_limits<ArcIdx>::max() - 2) {
+    if (2 * edges.size() > static_cast<size_t>(std::numeric_limits<ArcIdx>::max()) - 2) {
         throw std::overflow_error("Arc count exceeds capacity of index type. "
             "Please increase capacity of ArcIdx type.");
     }
 #endif
 
-    add_half_edge(i, j, cap);
-    add_half_edge(j, i, rev_cap);
+    edges.push_back({ i, j, cap, rev_cap });
+    first_arc[i]++;
+    first_arc[j]++;
 }
 
 template<class Cap, class Flow, class ArcIdx, class NodeIdx>
-inline typename ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::TermType 
-ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::what_segment(NodeIdx i)
+inline typename ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::TermType
+ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::what_segment(NodeIdx i) const
 {
     assert(0 <= i && i < nodes.size());
-    return nodes[i].label >= nodes.size() - 2 ? SOURCE : SINK;
+    // After mincut the label is the exact distance to the sink, or max_label if there is no path
+    return nodes[i].label >= max_label() ? SOURCE : SINK;
 }
 
 template<class Cap, class Flow, class ArcIdx, class NodeIdx>
 inline void ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::mincut()
 {
-    if (source == INVALID_NODE || sink == INVALID_NODE) {
-        throw std::runtime_error("Must set source and sink before calling mincut");
-    }
-
-    init_mincut();
+    init_buffers();
 
     size_t work_since_last_global_relabel = std::numeric_limits<size_t>::max();
+    bool exact_labels = false;
 
     while (true) {
         // Check if it's time for a global relabel
         constexpr size_t div_freq = 2; // From hi_pr: freq = 0.5
         constexpr size_t alpha = 6; // From hi_pr: alpha = 6
-        if (work_since_last_global_relabel / div_freq > alpha * nodes.size() + arcs.size() / 2) {
+        if (work_since_last_global_relabel / div_freq > alpha * num_nodes() + arcs.size() / 2) {
             work_since_last_global_relabel = 0;
             global_relabel();
-            // Update working set
-            #pragma omp parallel for
-            for (int i = 0; i < working_set.size(); ++i) {
-                NodeIdx ni = working_set[i];
-                if (nodes[ni].label < nodes.size()) {
-                    new_working_set.push_back(ni);
+            exact_labels = true;
+            // Rebuild the working set from all nodes. Labels from the parallel relabels may overshoot, so nodes
+            // which were dropped when their label reached max_label can get a lower label again.
+            unsigned int threads = parallel_for_chunks(*pool, num_nodes(), num_threads, MIN_NODES_PER_THREAD,
+                [&](unsigned int t, size_t begin, size_t end) {
+                auto& found = thread_data[t].nodes;
+                found.clear();
+                for (size_t i = begin; i < end; ++i) {
+                    if (nodes[i].excess > 0 && nodes[i].label < max_label()) {
+                        found.push_back(i);
+                    }
                 }
-            }
-            std::swap(new_working_set, working_set);
-            new_working_set.clear();
+            });
+            working_size = gather(threads, working_set);
         }
 
-        if (working_set.empty()) {
-            // We're done!
-            break;
+        if (working_size == 0) {
+            if (exact_labels) {
+                // We're done! The labels are the exact distances to the sink, so what_segment can tell
+                // which nodes can still reach it.
+                break;
+            }
+            // Make sure no node with excess was dropped because of an overshooting label
+            work_since_last_global_relabel = std::numeric_limits<size_t>::max();
+            continue;
+        }
+        exact_labels = false;
+
+        unsigned int threads = parallel_for_chunks(*pool, working_size, num_threads, MIN_NODES_PER_THREAD,
+            [&](unsigned int t, size_t begin, size_t end) {
+            ThreadData& td = thread_data[t];
+            td.nodes.clear();
+            td.work = 0;
+            td.flow = 0;
+            td.lowest_changed = max_label();
+            for (size_t k = begin; k < end; ++k) {
+                discharge(working_set[k], td);
+            }
+        });
+        for (unsigned int t = 0; t < threads; ++t) {
+            work_since_last_global_relabel += thread_data[t].work;
+            flow += thread_data[t].flow;
+            lowest_changed = std::min(lowest_changed, thread_data[t].lowest_changed);
         }
 
-        #pragma omp parallel for
-        for (int i = 0; i < working_set.size(); ++i) {
-            NodeIdx ni = working_set[i];
-            Node& n = nodes[ni];
-            n.discovered_nodes.clear();
-            n.label_copy = n.label;
-            Cap excess = n.excess;
-            n.work = 0;
-            
-            while (excess > 0) {
-                Label new_label = nodes.size();
-                bool skipped = false;
-                int scanned_arcs = 0;
-
-                // Loop over outgoing residual arcs
-                for (ArcIdx ai = n.first; ai != INVALID_ARC && excess != 0; ai = arcs[ai].next) {
-                    Arc& a = arcs[ai];
-                    if (!a.r_cap()) {
-                        continue;
-                    }
-                    scanned_arcs++;
-                    NodeIdx mi = a.head;
-                    Node& m = nodes[mi];
-                    bool admissible = n.label_copy == m.label + 1;
-
-                    // Is this an arc between two active nodes?
-                    if (m.excess != 0) {
-                        if (admissible && !owns_arc(ni, mi)) {
-                            skipped = true;
-                            continue; // Skip to next redidual arc
-                        }
-                    }
-
-                    if (admissible && a.r_cap()) {
-                        Cap delta = std::min<Cap>(a.r_cap(), excess);
-                        a.flow += delta;
-                        sister(ai).flow -= delta;
-                        excess -= delta;
-
-                        m.added_excess.fetch_add(delta);
+        // Apply the new labels and the excess pushed by the working set. Other threads read the labels while
+        // pushing, so this has to wait for the end of the round.
+        parallel_for_chunks(*pool, working_size, num_threads, MIN_NODES_PER_THREAD,
+            [&](unsigned int, size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                const NodeIdx i = working_set[k];
+                Node& n = nodes[i];
+                n.label = n.new_label;
+                n.excess += added_excess[i].load(std::memory_order_relaxed);
+                added_excess[i].store(0, std::memory_order_relaxed);
+            }
+        });
+
+        // Every node which got excess is in exactly one buffer. Each thread applies the excess of its nodes
+        // and keeps those which can still reach the sink, then the buffers become the next working set.
+        parallel_for_threads(*pool, threads, [&](unsigned int t) {
+            auto& found = thread_data[t].nodes;
+            size_t kept = 0;
+            for (NodeIdx i : found) {
+                Node& n = nodes[i];
+                discovered.reset(i);
+                n.excess += added_excess[i].load(std::memory_order_relaxed);
+                added_excess[i].store(0, std::memory_order_relaxed);
+                if (n.label < max_label()) {
+                    found[kept++] = i;
+                }
+            }
+            found.resize(kept);
+        });
+        working_size = gather(threads, working_set);
+    }
+}
 
-                        if (mi != sink && !m.is_discovered.test_and_set()) {
-                            n.discovered_nodes.push_back(mi);
-                        }
-                    }
+template<class Cap, class Flow, class ArcIdx, class NodeIdx>
+inline void ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::discharge(NodeIdx ni, ThreadData& td)
+{
+    Node& n = nodes[ni];
+    n.new_label = n.label;
+    Excess excess = n.excess;
+
+    while (excess > 0) {
+        Label new_label = max_label();
+        bool skipped = false;
+        size_t scanned_arcs = 0;
+
+        // The implicit arc to the sink, which has label 0
+        if (n.sink_cap > 0) {
+            scanned_arcs++;
+            if (n.new_label == 1) {
+                Excess delta = std::min(n.sink_cap, excess);
+                n.sink_cap -= delta;
+                excess -= delta;
+                td.flow += delta;
+                if (n.sink_cap == 0) {
+                    td.lowest_changed = 0;
+                }
+            }
+            if (n.sink_cap > 0) {
+                new_label = 1;
+            }
+        }
 
-                    if (a.r_cap() && m.label >= n.label_copy) {
-                        new_label = std::min<Cap>(new_label, m.label + 1);
-                    }
+        // Loop over outgoing residual arcs
+        for (ArcIdx ai = first_arc[ni]; ai != first_arc[ni + 1] && excess != 0; ++ai) {
+            Arc& a = arcs[ai];
+            Excess r_cap = a.r_cap.load(std::memory_order_relaxed);
+            if (r_cap <= 0) {
+                continue;
+            }
+            scanned_arcs++;
+            NodeIdx mi = a.head;
+            const Node& m = nodes[mi];
+
+            if (n.new_label == m.label + 1) {
+                // Is this an arc between two active nodes?
+                if (m.excess != 0 && !owns_arc(ni, mi)) {
+                    skipped = true;
+                    continue; // Skip to next redidual arc
                 }
 
-                if (excess == 0 || skipped) {
-                    break;
+                Excess delta = std::min(r_cap, excess);
+                r_cap -= delta;
+                a.r_cap.store(static_cast<Cap>(r_cap), std::memory_order_relaxed);
+                Arc& s = arcs[a.sister];
+                s.r_cap.store(static_cast<Cap>(s.r_cap.load(std::memory_order_relaxed) + delta),
+                    std::memory_order_relaxed);
+                excess -= delta;
+
+                atomic_add(added_excess[mi], delta);
+                if (!discovered.test_and_set(mi)) {
+                    td.nodes.push_back(mi);
                 }
-                n.label_copy = new_label;
-                constexpr size_t beta = 12; // from hi_pr: beta = 12
-                n.work += scanned_arcs + beta;
-                
-                if (n.label_copy == nodes.size()) {
-                    break;
+                if (r_cap <= 0) {
+                    td.lowest_changed = std::min(td.lowest_changed, m.label);
                 }
             }
 
-            n.added_excess += excess - n.excess;
-            if (excess && !n.is_discovered.test_and_set()) {
-                n.discovered_nodes.push_back(ni);
+            if (r_cap > 0 && m.label >= n.new_label) {
+                new_label = std::min<Label>(new_label, m.label + 1);
             }
         }
 
-        #pragma omp parallel for reduction(+: work_since_last_global_relabel)
-        for (int i = 0; i < working_set.size(); ++i) {
-            Node& n = nodes[working_set[i]];
-            n.label = n.label_copy;
-            n.excess += n.added_excess;
-            n.added_excess = 0;
-            n.is_discovered.clear();
-
-            work_since_last_global_relabel += n.work;
-            
-            for (auto ni : n.discovered_nodes) {
-                if (nodes[ni].label < nodes.size()) {
-                    new_working_set.push_back(ni);
-                }
-            }
+        if (excess == 0 || skipped) {
+            break;
         }
-        std::swap(working_set, new_working_set);
-        new_working_set.clear();
-
+        td.lowest_changed = std::min<Label>(td.lowest_changed, n.new_label - 1);
+        n.new_label = new_label;
+        constexpr size_t beta = 12; // from hi_pr: beta = 12
+        td.work += scanned_arcs + beta;
 
-        #pragma omp parallel for
-        for (int i = 0; i < working_set.size(); ++i) {
-            Node& n = nodes[working_set[i]];
-            n.excess += n.added_excess;
-            n.added_excess = 0;
-            n.is_discovered.clear();
+        if (n.new_label >= max_label()) {
+            break;
         }
     }
+
+    atomic_add(added_excess[ni], excess - n.excess);
+    if (excess > 0 && !discovered.test_and_set(ni)) {
+        td.nodes.push_back(ni);
+    }
 }
 
 template<class Cap, class Flow, class ArcIdx, class NodeIdx>
 inline void ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::global_relabel()
 {
-    for (size_t i = 0; i < nodes.size(); ++i) {
-        nodes[i].label = nodes.size();
+    init_buffers();
+    if (lowest_changed >= max_label()) {
+        return; // Nothing has changed
     }
 
-    nodes[sink].label = 0;
-    q.push_back(sink);
-    while (!q.empty()) {
-        #pragma omp parallel for
-        for (int i = 0; i < q.size(); ++i) {
-            Node& n = nodes[q[i]];
-            n.discovered_nodes.clear();
-            for (ArcIdx ai = n.first; ai != INVALID_ARC; ai = arcs[ai].next) {
-                NodeIdx mi = arcs[ai].head;
-                if (mi != sink && mi != source && sister(ai).r_cap() > 0) {
-                    Node& m = nodes[mi];
-                    Label num_nodes = nodes.size();
-                    if (m.label.compare_exchange_strong(num_nodes, n.label + 1)) {
-                        new_q.push_back(mi);
-                    }
-                }
-            }
-        }
-        std::swap(q, new_q);
-        new_q.clear();
-    }
+    // With lowest_changed > 0 the search starts from the nodes with that label, otherwise from the nodes with
+    // a residual arc to the sink.
+    RelabelGraph graph{ *this, lowest_changed };
+    bfs.set_num_threads(num_threads);
+    bfs.set_thread_pool(*pool);
+    bfs.run(graph, std::max<Label>(lowest_changed, 1));
+    lowest_changed = max_label();
 }
 
 template<class Cap, class Flow, class ArcIdx, class NodeIdx>
-inline Flow ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::get_flow()
+inline void ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::init_buffers()
 {
-    Flow flow = 0;
-    for (ArcIdx ai = nodes[sink].first; ai != INVALID_ARC; ai = arcs[ai].next) {
-        flow += sister(ai).flow;
+    if (!edges.empty()) {
+        build_arcs();
+    }
+    if (working_set.size() < num_nodes()) {
+        working_set.resize(num_nodes());
+        next_set.resize(num_nodes());
+    }
+    if (thread_data.size() < num_threads) {
+        thread_data.resize(num_threads);
     }
-    return flow;
 }
 
 template<class Cap, class Flow, class ArcIdx, class NodeIdx>
-inline void ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::init_mincut()
+inline void ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::build_arcs()
 {
-#ifdef _OPENMP
-    omp_set_num_threads(num_threads);
-#endif
-
-    #pragma omp parallel for
-    for (int i = 0; i < nodes.size(); ++i) {
-        Node& n = nodes[i];
-        n.excess = 0;
-        n.added_excess = 0;
-        n.label = 0;
-        n.work = 0;
-        n.is_discovered.clear();
-        n.discovered_nodes.clear();
-        n.discovered_nodes.reserve(n.degree);
-    }
-    nodes[source].label = nodes.size();
-
-    // Saturate all source adjacent arcs
-    for (ArcIdx ai = nodes[source].first; ai != INVALID_ARC; ai = arcs[ai].next) {
-        Arc& a = arcs[ai];
-        a.flow = a.cap;
-        sister(ai).flow = -a.cap;
-        nodes[a.head].excess = a.cap;
-    }
-
-    // Add all vertices with excess to working set except the source
-    #pragma omp parallel for
-    for (int i = 0; i < nodes.size(); ++i) {
-        if (i != source && nodes[i].excess) {
-            working_set.push_back(i);
-        }
+    // first_arc holds the degree of each node and the extra entry is zero, so the prefix sums are the offsets
+    const size_t num_arcs = parallel_exclusive_scan(*pool, first_arc.data(), first_arc.size(), num_threads);
+    assert(num_arcs == 2 * edges.size());
+
+    arcs = std::vector<Arc>(num_arcs);
+    std::vector<ArcIdx> next_arc(first_arc.begin(), first_arc.end() - 1);
+    for (const Edge& e : edges) {
+        const ArcIdx a = next_arc[e.i]++;
+        const ArcIdx b = next_arc[e.j]++;
+        arcs[a].head = e.j;
+        arcs[a].sister = b;
+        arcs[a].r_cap.store(e.cap, std::memory_order_relaxed);
+        arcs[b].head = e.i;
+        arcs[b].sister = a;
+        arcs[b].r_cap.store(e.rev_cap, std::memory_order_relaxed);
     }
+    std::vector<Edge>().swap(edges);
 }
 
 template<class Cap, class Flow, class ArcIdx, class NodeIdx>
-inline void ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::add_half_edge(NodeIdx from, NodeIdx to, Cap cap)
+inline size_t ParallelPushRelabel<Cap, Flow, ArcIdx, NodeIdx>::gather(unsigned int threads, std::vector<NodeIdx>& out)
 {
-    ArcIdx ai = arcs.size();
-    arcs.emplace_back(to, nodes[from].first, cap);
-    nodes[from].first = ai;
-    nodes[from].degree++;
+    // Concatenate the buffers of the threads. Each node is in at most one buffer, so out has room for all.
+    size_t total = 0;
+    for (unsigned int t = 0; t < threads; ++t) {
+        thread_data[t].offset = total;
+        total += thread_data[t].nodes.size();
+    }
+    assert(total <= out.size());
+    const unsigned int copy_threads = total >= MIN_NODES_PER_THREAD ? threads : 1;
+    parallel_for_threads(*pool, copy_threads, [&](unsigned int t) {
+        for (unsigned int u = t; u < threads; u += copy_threads) {
+            const auto& found = thread_data[u].nodes;
+            std::copy(found.begin(), found.end(), out.begin() + thread_data[u].offset);
+        }
+    });
+    return total;
 }
 
 template<class Cap, class Flow, class ArcIdx, class NodeIdx>
@@ -0,0 +1,403 @@
+#ifndef REIMPLS_PARAMETRIC_H__
+#define REIMPLS_PARAMETRIC_H__
+
+#include <vector>
+#include <cinttypes>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include <stdexcept>
+
+#include "mbk.h"
+
+namespace reimpls {
+
+// Parametric min-cut on top of Graph (mbk). Terminal capacities are affine in a parameter lambda:
+//   source_cap(lambda) = source_cap + lambda * source_slope, with source_slope >= 0
+//   sink_cap(lambda)   = sink_cap   + lambda * sink_slope,   with sink_slope   <= 0
+// For an increasing list of lambdas the minimal source sets are then nested, so the whole family of cuts
+// is described by a single breakpoint per node: the index of the first lambda for which the node is on
+// the source side (or the number of lambdas if it never is).
+template <class Cap, class Term, class Flow, class ArcIdx = int32_t, class NodeIdx = int32_t, class Lambda = double>
+class ParametricGraph {
+    static_assert(std::is_integral<NodeIdx>::value, "NodeIdx must be an integer type");
+    static_assert(std::is_signed<Term>::value, "Term must be a signed type");
+
+    // Forward decls.
+    struct TermCaps;
+    struct Edge;
+
+public:
+    using Solver = Graph<Cap, Term, Flow, ArcIdx, NodeIdx>;
+    using TermType = typename Solver::TermType;
+    using LambdaIdx = uint32_t;
+
+    static constexpr NodeIdx INVALID_NODE = ~NodeIdx(0); // -1 for signed type, max. value for unsigned type
+
+    explicit ParametricGraph();
+    explicit ParametricGraph(size_t expected_nodes, size_t expected_arcs);
+
+    void reserve_nodes(size_t num);
+    void reserve_edges(size_t num);
+
+    NodeIdx add_node(size_t num = 1);
+
+    void add_tweights(NodeIdx i, Term cap_source, Term cap_sink, Term slope_source = 0, Term slope_sink = 0);
+
+    void add_edge(NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap);
+
+    std::vector<Flow> sweep(const std::vector<Lambda>& lambdas);
+    void find_breakpoints(const std::vector<Lambda>& lambdas);
+
+    inline LambdaIdx breakpoint(NodeIdx i) const { return breakpoints[i]; }
+    inline const std::vector<LambdaIdx>& get_breakpoints() const noexcept { return breakpoints; }
+
+    TermType what_segment(NodeIdx i, LambdaIdx k) const;
+
+    inline size_t get_node_num() const noexcept { return term_caps.size(); }
+    inline size_t get_edge_num() const noexcept { return edges.size(); }
+
+private:
+    std::vector<TermCaps> term_caps;
+    std::vector<Edge> edges;
+
+    std::vector<LambdaIdx> breakpoints;
+
+    // Used by find_breakpoints
+    std::vector<size_t> node_edges_start;
+    std::vector<size_t> node_edges;
+    std::vector<LambdaIdx> bp_lo, bp_hi;
+    std::vector<NodeIdx> local_idx;
+
+    struct TermCaps {
+        Term source;
+        Term sink;
+        Term source_slope;
+        Term sink_slope;
+
+        TermCaps() :
+            source(0),
+            sink(0),
+            source_slope(0),
+            sink_slope(0) {}
+
+        inline bool is_parametric() const noexcept { return source_slope != 0 || sink_slope != 0; }
+    };
+
+    struct Edge {
+        NodeIdx i;
+        NodeIdx j;
+        Cap cap;
+        Cap rev_cap;
+
+        Edge(NodeIdx _i, NodeIdx _j, Cap _cap, Cap _rev_cap) :
+            i(_i),
+            j(_j),
+            cap(_cap),
+            rev_cap(_rev_cap) {}
+    };
+
+    static Term eval(Term c, Term slope, Lambda lambda);
+
+    void build_node_edges();
+    void solve_interval(LambdaIdx lo, LambdaIdx hi, std::vector<NodeIdx>& subset, const std::vector<Lambda>& lambdas);
+};
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::ParametricGraph() :
+    term_caps(),
+    edges(),
+    breakpoints(),
+    node_edges_start(),
+    node_edges(),
+    bp_lo(),
+    bp_hi(),
+    local_idx()
+{}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::ParametricGraph(
+    size_t expected_nodes, size_t expected_arcs) :
+    ParametricGraph()
+{
+    reserve_nodes(expected_nodes);
+    reserve_edges(expected_arcs);
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+inline void ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::reserve_nodes(size_t num)
+{
+    term_caps.reserve(num);
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+inline void ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::reserve_edges(size_t num)
+{
+    edges.reserve(num);
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+inline NodeIdx ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::add_node(size_t num)
+{
+    NodeIdx crnt = term_caps.size();
+
+#ifndef REIMPLS_NO_OVERFLOW_CHECKS
+    if (crnt > std::numeric_limits<NodeIdx>::max() - num) {
+        throw std::overflow_error("Node count exceeds capacity of index type. "
+            "Please increase capacity of NodeIdx type.");
+    }
+#endif
+
+    term_caps.resize(crnt + num);
+    return crnt;
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+inline void ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::add_tweights(
+    NodeIdx i, Term cap_source, Term cap_sink, Term slope_source, Term slope_sink)
+{
+    assert(i >= 0 && i < term_caps.size());
+    TermCaps& tc = term_caps[i];
+    tc.source += cap_source;
+    tc.sink += cap_sink;
+    tc.source_slope += slope_source;
+    tc.sink_slope += slope_sink;
+    // Nested cuts require the source side to only get cheaper to join as lambda grows
+    assert(tc.source_slope >= 0);
+    assert(tc.sink_slope <= 0);
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+inline void ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::add_edge(
+    NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap)
+{
+    assert(i >= 0 && i < term_caps.size());
+    assert(j >= 0 && j < term_caps.size());
+    assert(i != j);
+    assert(cap >= 0);
+    assert(rev_cap >= 0);
+
+    if (cap == 0 && rev_cap == 0) {
+        return;
+    }
+    edges.emplace_back(i, j, cap, rev_cap);
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+inline typename ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::TermType
+ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::what_segment(NodeIdx i, LambdaIdx k) const
+{
+    return breakpoints[i] <= k ? Solver::SOURCE : Solver::SINK;
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+inline Term ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::eval(Term c, Term slope, Lambda lambda)
+{
+    Term out;
+    if (std::is_integral<Term>::value && !std::is_integral<Lambda>::value) {
+        // Rounding is monotone, so the rounded capacities still give nested cuts
+        out = c + static_cast<Term>(std::llround(slope * lambda));
+    } else {
+        out = c + static_cast<Term>(slope * lambda);
+    }
+    assert(out >= 0);
+    return out;
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+inline std::vector<Flow> ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::sweep(
+    const std::vector<Lambda>& lambdas)
+{
+    assert(std::is_sorted(lambdas.begin(), lambdas.end()));
+#ifndef REIMPLS_NO_OVERFLOW_CHECKS
+    if (lambdas.size() > std::numeric_limits<LambdaIdx>::max()) {
+        throw std::overflow_error("Number of lambdas exceeds capacity of LambdaIdx type.");
+    }
+#endif
+
+    const NodeIdx num_nodes = term_caps.size();
+    std::vector<Flow> flows;
+    flows.reserve(lambdas.size());
+    breakpoints.assign(num_nodes, lambdas.size());
+    if (lambdas.empty()) {
+        return flows;
+    }
+
+    Solver graph(num_nodes, edges.size());
+    graph.add_node(num_nodes);
+    for (const Edge& e : edges) {
+        graph.add_edge(e.i, e.j, e.cap, e.rev_cap);
+    }
+
+    // Only nodes with a non-zero slope change between lambdas, so only those need to be revisited
+    std::vector<NodeIdx> parametric_nodes;
+    for (NodeIdx i = 0; i < num_nodes; ++i) {
+        const TermCaps& tc = term_caps[i];
+        graph.add_tweights(i, eval(tc.source, tc.source_slope, lambdas[0]), eval(tc.sink, tc.sink_slope, lambdas[0]));
+        if (tc.is_parametric()) {
+            parametric_nodes.push_back(i);
+        }
+    }
+
+    for (LambdaIdx k = 0; k < lambdas.size(); ++k) {
+        if (k == 0) {
+            flows.push_back(graph.maxflow());
+        } else {
+            // Terminal capacities can only move towards the source, so the current flow stays feasible
+            // after cancelling any flow which now exceeds a sink capacity. This lets us keep the search trees.
+            for (NodeIdx i : parametric_nodes) {
+                const TermCaps& tc = term_caps[i];
+                Term delta_source = eval(tc.source, tc.source_slope, lambdas[k])
+                    - eval(tc.source, tc.source_slope, lambdas[k - 1]);
+                Term delta_sink = eval(tc.sink, tc.sink_slope, lambdas[k])
+                    - eval(tc.sink, tc.sink_slope, lambdas[k - 1]);
+                if (delta_source != 0 || delta_sink != 0) {
+                    graph.add_tweights(i, delta_source, delta_sink);
+                    graph.mark_node(i);
+                }
+            }
+            flows.push_back(graph.maxflow(true));
+        }
+
+        // Free nodes go to the sink so we get the minimal source set, which is the one that is nested
+        for (NodeIdx i = 0; i < num_nodes; ++i) {
+            if (breakpoints[i] == lambdas.size() && graph.what_segment(i, Solver::SINK) == Solver::SOURCE) {
+                breakpoints[i] = k;
+            }
+        }
+    }
+
+    return flows;
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+inline void ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::find_breakpoints(
+    const std::vector<Lambda>& lambdas)
+{
+    assert(std::is_sorted(lambdas.begin(), lambdas.end()));
+#ifndef REIMPLS_NO_OVERFLOW_CHECKS
+    if (lambdas.size() > std::numeric_limits<LambdaIdx>::max() - 1) {
+        throw std::overflow_error("Number of lambdas exceeds capacity of LambdaIdx type.");
+    }
+#endif
+
+    const NodeIdx num_nodes = term_caps.size();
+    breakpoints.assign(num_nodes, lambdas.size());
+    bp_lo.assign(num_nodes, 0);
+    bp_hi.assign(num_nodes, lambdas.size());
+    local_idx.assign(num_nodes, INVALID_NODE);
+    build_node_edges();
+
+    std::vector<NodeIdx> subset(num_nodes);
+    for (NodeIdx i = 0; i < num_nodes; ++i) {
+        subset[i] = i;
+    }
+    solve_interval(0, lambdas.size(), subset, lambdas);
+
+    // Free the scratch memory as it is as large as the graph
+    node_edges_start = std::vector<size_t>();
+    node_edges = std::vector<size_t>();
+    bp_lo = std::vector<LambdaIdx>();
+    bp_hi = std::vector<LambdaIdx>();
+    local_idx = std::vector<NodeIdx>();
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+inline void ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::build_node_edges()
+{
+    // Build a CSR list of incident edges for each node so subproblems only touch their own edges
+    const size_t num_nodes = term_caps.size();
+    node_edges_start.assign(num_nodes + 1, 0);
+    for (const Edge& e : edges) {
+        node_edges_start[e.i + 1]++;
+        node_edges_start[e.j + 1]++;
+    }
+    for (size_t i = 0; i < num_nodes; ++i) {
+        node_edges_start[i + 1] += node_edges_start[i];
+    }
+    node_edges.resize(node_edges_start[num_nodes]);
+    std::vector<size_t> pos(node_edges_start.begin(), node_edges_start.end() - 1);
+    for (size_t ei = 0; ei < edges.size(); ++ei) {
+        node_edges[pos[edges[ei].i]++] = ei;
+        node_edges[pos[edges[ei].j]++] = ei;
+    }
+}
+
+template <class Cap, class Term, class Flow, class ArcIdx, class NodeIdx, class Lambda>
+inline void ParametricGraph<Cap, Term, Flow, ArcIdx, NodeIdx, Lambda>::solve_interval(
+    LambdaIdx lo, LambdaIdx hi, std::vector<NodeIdx>& subset, const std::vector<Lambda>& lambdas)
+{
+    // All nodes in subset have their breakpoint in [lo, hi]. Every other node has a breakpoint outside this
+    // range, which means it is fixed to the source side (breakpoint < lo) or sink side (breakpoint > hi) for
+    // all lambdas considered here. Those nodes are contracted into the terminals.
+    if (subset.empty()) {
+        return;
+    }
+    if (lo == hi) {
+        for (NodeIdx i : subset) {
+            breakpoints[i] = lo;
+        }
+        return;
+    }
+
+    const LambdaIdx mid = lo + (hi - lo) / 2;
+    const Lambda lambda = lambdas[mid];
+
+    Solver graph(subset.size(), 0);
+    graph.add_node(subset.size());
+    for (NodeIdx li = 0; li < subset.size(); ++li) {
+        local_idx[subset[li]] = li;
+    }
+    for (NodeIdx li = 0; li < subset.size(); ++li) {
+        const NodeIdx i = subset[li];
+        const TermCaps& tc = term_caps[i];
+        Term cap_source = eval(tc.source, tc.source_slope, lambda);
+        Term cap_sink = eval(tc.sink, tc.sink_slope, lambda);
+        for (size_t k = node_edges_start[i]; k < node_edges_start[i + 1]; ++k) {
+            const Edge& e = edges[node_edges[k]];
+            const bool is_tail = e.i == i;
+            const NodeIdx j = is_tail ? e.j : e.i;
+            const Cap out_cap = is_tail ? e.cap : e.rev_cap;
+            const Cap in_cap = is_tail ? e.rev_cap : e.cap;
+            if (local_idx[j] != INVALID_NODE) {
+                if (is_tail) {
+                    // Add each internal edge only once
+                    graph.add_edge(li, local_idx[j], e.cap, e.rev_cap);
+                }
+            } else if (bp_hi[j] < lo) {
+                cap_source += in_cap;
+            } else {
+                assert(bp_lo[j] > hi);
+                cap_sink += out_cap;
+            }
+        }
+        graph.add_tweights(li, cap_source, cap_sink);
+    }
+
+    graph.maxflow();
+
+    std::vector<NodeIdx> source_subset, sink_subset;
+    for (NodeIdx li = 0; li < subset.size(); ++li) {
+        const NodeIdx i = subset[li];
+        local_idx[i] = INVALID_NODE;
+        if (graph.what_segment(li, Solver::SINK) == Solver::SOURCE) {
+            bp_hi[i] = mid;
+            source_subset.push_back(i);
+        } else {
+            bp_lo[i] = mid + 1;
+            sink_subset.push_back(i);
+        }
+    }
+    // Release memory before recursing
+    subset = std::vector<NodeIdx>();
+    graph = Solver();
+
+    solve_interval(lo, mid, source_subset, lambdas);
+    solve_interval(mid + 1, hi, sink_subset, lambdas);
+}
+
+} // namespace reimpls
+
+#endif // REIMPLS_PARAMETRIC_H__
@@ -14,7 +14,7 @@
 #include <cstdlib>
 #include <cinttypes>
 
-#include "graph.h"
+#include "block_solver.h"
 #include "util.h"
 
 namespace reimpls {
@@ -23,8 +23,10 @@ namespace reimpls {
  * Implementation of the parallel BK algorithm from:
  *     Parallel and Distributed Graph Cuts by Dual Decomposition
  *     Strandmark, P., Kahl, F., 2010, CVPR
+ * Each block is solved by a BlockSolver (see block_solver.h), which defaults to BK.
  */
-template <class Cap, class Term, class Flow, class NodeIdx = int32_t>
+template <class Cap, class Term, class Flow, class NodeIdx = int32_t,
+    class BlockSolver = MbkBlockSolver<Cap, Term, Flow>>
 class ParallelSkGraph {
     using BlockIdx = int16_t;
 
@@ -45,7 +47,7 @@ public:
     void add_edge(NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap);
     void add_tweights(NodeIdx i, Term source_cap, Term sink_cap);
 
-    int what_segment(NodeIdx i, int default_segment = SOURCE); // TODO: Use an enum
+    int what_segment(NodeIdx i, int default_segment = 0); // TODO: Use an enum
 
     Flow maxflow();
 
@@ -54,13 +56,16 @@ public:
     inline unsigned int get_max_iter() const noexcept { return max_iter; }
     inline void set_max_iter(unsigned int mi) const noexcept { max_iter = mi; }
 
+    inline ThreadPool& get_thread_pool() const noexcept { return *pool; }
+    inline void set_thread_pool(ThreadPool& p) noexcept { pool = &p; }
+
 private:
     Flow flow;
 
     unsigned int iter;
     unsigned int max_iter;
 
-    std::vector<std::shared_ptr<reimpls::Graph<Cap, Term, Flow>>> blocks;
+    std::vector<std::shared_ptr<BlockSolver>> blocks;
 
     size_t expected_edges_per_block;
     std::vector<BlockIdx> node_blocks;
@@ -69,7 +74,9 @@ private:
     std::vector<std::vector<NodeIdx>> shared_node_offsets;
     std::vector<NodeIdx> shared_nodes;
 
-    void update_graph(NodeIdx i, int diff, int prev_diff, Cap& step, uint8_t& has_flipped,
+    ThreadPool *pool;
+
+    void update_graph(NodeIdx i, int diff, int prev_diff, Term& step, uint8_t& has_flipped,
         BlockIdx b1, BlockIdx b2, NodeIdx offset1, NodeIdx offset2);
 
     NodeIdx shared_index(NodeIdx i) const;
@@ -80,8 +87,8 @@ private:
 
 };
 
-template<class Cap, class Term, class Flow, class NodeIdx>
-inline ParallelSkGraph<Cap, Term, Flow, NodeIdx>::ParallelSkGraph(
+template<class Cap, class Term, class Flow, class NodeIdx, class BlockSolver>
+inline ParallelSkGraph<Cap, Term, Flow, NodeIdx, BlockSolver>::ParallelSkGraph(
     size_t expected_nodes, size_t expected_edges_per_block) :
     flow(0),
     iter(0),
@@ -92,21 +99,22 @@ inline ParallelSkGraph<Cap, Term, Flow, NodeIdx>::ParallelSkGraph(
     node_offsets(),
     shared_node_blocks(),
     shared_node_offsets(),
-    shared_nodes()
+    shared_nodes(),
+    pool(&default_thread_pool())
 {
     node_blocks.reserve(expected_nodes);
     node_offsets.reserve(expected_nodes);
 }
 
-template<class Cap, class Term, class Flow, class NodeIdx>
-inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx>::add_node(NodeIdx num)
+template<class Cap, class Term, class Flow, class NodeIdx, class BlockSolver>
+inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx, BlockSolver>::add_node(NodeIdx num)
 {
     node_blocks.resize(num);
     node_offsets.resize(num, INVALID_NODE); // Need to init. so we can tell if node is shared
 }
 
-template<class Cap, class Term, class Flow, class NodeIdx>
-inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx>::add_nodes_to_block(
+template<class Cap, class Term, class Flow, class NodeIdx, class BlockSolver>
+inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx, BlockSolver>::add_nodes_to_block(
     NodeIdx begin, NodeIdx end, BlockIdx b)
 {
     if (b >= blocks.size()) {
@@ -114,7 +122,7 @@ inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx>::add_nodes_to_block(
     }
     if (blocks[b] == nullptr) {
         //blocks[b] = std::make_shared<bk::Graph<Cap, Term, Flow>>(end - begin, 0, bk_error_handler);
-        blocks[b] = std::make_shared<reimpls::Graph<Cap, Term, Flow>>(end - begin, expected_edges_per_block);
+        blocks[b] = std::make_shared<BlockSolver>(end - begin, expected_edges_per_block);
     }
 
     NodeIdx offset = begin - blocks[b]->add_node(end - begin);
@@ -142,8 +150,8 @@ inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx>::add_nodes_to_block(
     }
 }
 
-template<class Cap, class Term, class Flow, class NodeIdx>
-inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx>::add_edge(NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap)
+template<class Cap, class Term, class Flow, class NodeIdx, class BlockSolver>
+inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx, BlockSolver>::add_edge(NodeIdx i, NodeIdx j, Cap cap, Cap rev_cap)
 {
     assert(i != j);
     assert(cap >= 0);
@@ -180,8 +188,8 @@ inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx>::add_edge(NodeIdx i, NodeI
     }
 }
 
-template<class Cap, class Term, class Flow, class NodeIdx>
-inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx>::add_tweights(
+template<class Cap, class Term, class Flow, class NodeIdx, class BlockSolver>
+inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx, BlockSolver>::add_tweights(
     NodeIdx i, Term source_cap, Term sink_cap)
 {
     if (node_offsets[i] >= 0) {
@@ -210,103 +218,112 @@ inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx>::add_tweights(
     }
 }
 
-template<class Cap, class Term, class Flow, class NodeIdx>
-inline int ParallelSkGraph<Cap, Term, Flow, NodeIdx>::what_segment(NodeIdx i, int default_segment)
+template<class Cap, class Term, class Flow, class NodeIdx, class BlockSolver>
+inline int ParallelSkGraph<Cap, Term, Flow, NodeIdx, BlockSolver>::what_segment(NodeIdx i, int default_segment)
 {
-    return blocks[node_blocks[i][0]]->what_segment(i - node_offsets[i][0], default_segment);
+    if (node_offsets[i] >= 0) {
+        return blocks[node_blocks[i]]->what_segment(i - node_offsets[i], default_segment);
+    } else {
+        // Blocks agree on the labels of shared nodes once converged, so just use the first block
+        NodeIdx si = shared_index(i);
+        return blocks[shared_node_blocks[si][0]]->what_segment(i - shared_node_offsets[si][0], default_segment);
+    }
 }
 
-template<class Cap, class Term, class Flow, class NodeIdx>
-inline Flow ParallelSkGraph<Cap, Term, Flow, NodeIdx>::maxflow()
+template<class Cap, class Term, class Flow, class NodeIdx, class BlockSolver>
+inline Flow ParallelSkGraph<Cap, Term, Flow, NodeIdx, BlockSolver>::maxflow()
 {
-    Cap stepsize = 10;
+    Term stepsize = 10;
 
     Barrier barr(blocks.size() + 1); // Workers + master thread
 
     bool running = true;
     std::vector<Flow> block_flows(blocks.size(), 0);
-    std::vector<std::thread> threads;
 
     // Bookkeeping for steps
-    std::vector<Cap> steps(shared_nodes.size(), stepsize);
+    std::vector<Term> steps(shared_nodes.size(), stepsize);
     std::vector<int> prev_diffs(shared_nodes.size(), 0);
     std::vector<uint8_t> has_flipped(shared_nodes.size(), false); // uint8_t to avoid "vector of bool" optim.
 
-    // Launch worker threads
-    for (unsigned int t = 0; t < blocks.size(); ++t) {
-        threads.emplace_back([&](unsigned int t)
-        {
-            bool reuse_trees = false;
-            while (running) {
-                // First maxflow without reusing trees, then enable it
-                // This is essential for good performance
-                block_flows[t] = blocks[t]->maxflow(reuse_trees);
-                reuse_trees = true;
-
-                // Wait for all workers to finish
-                barr.wait(); // Stop 1
-
-                // Wait for the main thread to process the graphs
-                barr.wait(); // Stop 2
+    // Worker for block t
+    auto solve_block = [&](unsigned int t)
+    {
+        bool reuse_trees = false;
+        while (running) {
+            // First maxflow without reusing trees, then enable it
+            // This is essential for good performance
+            block_flows[t] = reuse_trees ? blocks[t]->resolve() : blocks[t]->solve();
+            reuse_trees = true;
+
+            // Wait for all workers to finish
+            barr.wait(); // Stop 1
+
+            // Wait for the main thread to process the graphs
+            barr.wait(); // Stop 2
+        }
+    };
+
+    // Master thread, which runs the supergradient ascent
+    auto update_blocks = [&]()
+    {
+        // Start supergradient ascent
+        iter = 0;
+        while (running) {
+            iter++;
+            // Wait for all blocks to finish
+            barr.wait(); // Stop 1
+
+            // Go through shared nodes and look at assigments
+            NodeIdx num_diff = 0;
+            for (NodeIdx si = 0; si < shared_nodes.size(); ++si) {
+                NodeIdx node = shared_nodes[si];
+                for (int i = 0; i < shared_node_blocks[si].size() - 1; ++i) {
+                    BlockIdx b1 = shared_node_blocks[si][i];
+                    BlockIdx b2 = shared_node_blocks[si][i + 1];
+                    NodeIdx offset1 = shared_node_offsets[si][i];
+                    NodeIdx offset2 = shared_node_offsets[si][i + 1];
+
+                    int l1 = blocks[b1]->what_segment(node - offset1);
+                    int l2 = blocks[b2]->what_segment(node - offset2);
+                    
+                    if (l1 != l2) {
+                        num_diff++;
+                        int diff = l1 - l2;
+                        update_graph(node, diff, prev_diffs[si], steps[si], has_flipped[si], 
+                            b1, b2, offset1, offset2);
+                        prev_diffs[si] = diff;
+                    }
+                }
             }
-        }, t);
-    }
 
-    // Start supergradient ascent
-    iter = 0;
-    while (running) {
-        iter++;
-        // Wait for all blocks to finish
-        barr.wait(); // Stop 1
-
-        // Go through shared nodes and look at assigments
-        NodeIdx num_diff = 0;
-        for (NodeIdx si = 0; si < shared_nodes.size(); ++si) {
-            NodeIdx node = shared_nodes[si];
-            for (int i = 0; i < shared_node_blocks[si].size() - 1; ++i) {
-                BlockIdx b1 = shared_node_blocks[si][i];
-                BlockIdx b2 = shared_node_blocks[si][i + 1];
-                NodeIdx offset1 = shared_node_offsets[si][i];
-                NodeIdx offset2 = shared_node_offsets[si][i + 1];
-
-                int l1 = blocks[b1]->what_segment(node - offset1);
-                int l2 = blocks[b2]->what_segment(node - offset2);
-                
-                if (l1 != l2) {
-                    num_diff++;
-                    int diff = l1 - l2;
-                    update_graph(node, diff, prev_diffs[si], steps[si], has_flipped[si], 
-                        b1, b2, offset1, offset2);
-                    prev_diffs[si] = diff;
-                }
+            if (num_diff == 0 || iter >= max_iter) {
+                // All blocks agreed or we ran out of iterations
+                running = false;
             }
-        }
 
-        if (num_diff == 0 || iter >= max_iter) {
-            // All blocks agreed or we ran out of iterations
-            running = false;
+            // We're done processing the graph and ready for the next iteration
+            barr.wait(); // Stop 2
         }
+    };
 
-        // We're done processing the graph and ready for the next iteration
-        barr.wait(); // Stop 2
-    }
+    // Thread 0 is the master and the rest are the workers
+    parallel_for_threads(*pool, blocks.size() + 1, [&](unsigned int t) {
+        if (t == 0) {
+            update_blocks();
+        } else {
+            solve_block(t - 1);
+        }
+    });
 
     // Sum up all subgraph flows
-    flow = std::accumulate(block_flows.begin(), block_flows.end(), 0);
-
-    // Wait for all theads to completely finish
-    for (auto& t : threads) {
-        if (t.joinable()) {
-            t.join();
-        }
-    }
+    flow = std::accumulate(block_flows.begin(), block_flows.end(), Flow(0));
 
     return flow;
 }
 
-template<class Cap, class Term, class Flow, class NodeIdx>
-inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx>::update_graph(
-    NodeIdx i, int diff, int prev_diff, Cap& step, uint8_t& has_flipped,
+template<class Cap, class Term, class Flow, class NodeIdx, class BlockSolver>
+inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx, BlockSolver>::update_graph(
+    NodeIdx i, int diff, int prev_diff, Term& step, uint8_t& has_flipped,
     BlockIdx b1, BlockIdx b2, NodeIdx offset1, NodeIdx offset2)
 {
     // For integer capacities we sometimes do nothing
@@ -318,7 +335,8 @@ inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx>::update_graph(
     if (prev_diff * diff == -1) {
         // Both labels flipped during last maxflow computation
         // This indicates the step is too large so decrease and don't increase again
-        step = std::max<Cap>(1, step / 2);
+        // Floating point steps may go below 1, as otherwise the labels can keep flipping forever
+        step = std::max<Term>(INTEGER_CAPACITIES ? Term(1) : residual_epsilon<Term>(), step / 2);
         has_flipped = true;
     } else if (prev_diff * diff == 1 && !has_flipped) {
         // Same difference as last time, and we haven't flipped yet
@@ -327,23 +345,20 @@ inline void ParallelSkGraph<Cap, Term, Flow, NodeIdx>::update_graph(
     }
 
     // Change graphs
-    Cap change = diff * step;
-    blocks[b1]->add_tweights(i - offset1, change, 0);
-    blocks[b2]->add_tweights(i - offset2, -change, 0);
-
-    blocks[b1]->mark_node(i - offset1);
-    blocks[b2]->mark_node(i - offset2);
+    Term change = diff * step;
+    blocks[b1]->update_tweights(i - offset1, change, 0);
+    blocks[b2]->update_tweights(i - offset2, -change, 0);
 }
 
-template<class Cap, class Term, class Flow, class NodeIdx>
-inline NodeIdx ParallelSkGraph<Cap, Term, Flow, NodeIdx>::shared_index(NodeIdx i) const
+template<class Cap, class Term, class Flow, class NodeIdx, class BlockSolver>
+inline NodeIdx ParallelSkGraph<Cap, Term, Flow, NodeIdx, BlockSolver>::shared_index(NodeIdx i) const
 {
     assert(is_shared(i));
     return -node_offsets[i] - 1;
 }
 
-template<class Cap, class Term, class Flow, class NodeIdx>
-inline NodeIdx ParallelSkGraph<Cap, Term, Flow, NodeIdx>::get_block_offset(NodeIdx node, BlockIdx b) const
+template<class Cap, class Term, class Flow, class NodeIdx, class BlockSolver>
+inline NodeIdx ParallelSkGraph<Cap, Term, Flow, NodeIdx, BlockSolver>::get_block_offset(NodeIdx node, BlockIdx b) const
 {
     NodeIdx si = shared_index(node);
     for (int i = 0; i < shared_node_blocks[si].size(); ++i) {
@@ -355,10 +370,10 @@ inline NodeIdx ParallelSkGraph<Cap, Term, Flow, NodeIdx>::get_block_offset(NodeI
     throw std::runtime_error("Node is not in given block");
 }
 
-template<class Cap, class Term, class Flow, class NodeIdx>
+template<class Cap, class Term, class Flow, class NodeIdx, class BlockSolver>
 inline std::vector<
-    std::tuple<typename ParallelSkGraph<Cap, Term, Flow, NodeIdx>::BlockIdx, NodeIdx, NodeIdx>>
-ParallelSkGraph<Cap, Term, Flow, NodeIdx>::get_shared_block_offsets(NodeIdx i, NodeIdx j) const
+    std::tuple<typename ParallelSkGraph<Cap, Term, Flow, NodeIdx, BlockSolver>::BlockIdx, NodeIdx, NodeIdx>>
+ParallelSkGraph<Cap, Term, Flow, NodeIdx, BlockSolver>::get_shared_block_offsets(NodeIdx i, NodeIdx j) const
 {
     std::vector<std::tuple<BlockIdx, NodeIdx, NodeIdx>> out;
     // We just use a naive search since all vectors are very short
@@ -2,8 +2,23 @@
 #define UTIL_H__
 
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <exception>
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <type_traits>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #ifdef __clang__
 #define REIMPLS_PACKED __attribute__((packed))
@@ -23,8 +38,528 @@
 #define REIMPLS_NO_INLINE __attribute__((noinline))
 #endif
 
+#ifdef _MSC_VER
+#include <xmmintrin.h>
+#define REIMPLS_PREFETCH(addr) _mm_prefetch(reinterpret_cast<const char *>(addr), _MM_HINT_T0)
+#else
+#define REIMPLS_PREFETCH(addr) __builtin_prefetch(addr)
+#endif
+
+// Residual capacities at or below this value are treated as saturated for floating point capacity types.
+#ifndef REIMPLS_FLOAT_EPSILON
+#define REIMPLS_FLOAT_EPSILON 1e-6
+#endif
+
 namespace reimpls {
 
+// Type used to accumulate sums of capacities, e.g. terminal capacities and excesses. Capacities smaller than
+// 32 bits are promoted so that a node with many arcs does not overflow.
+template <class Cap>
+using PromotedCap = typename std::conditional<
+    std::is_integral<Cap>::value && sizeof(Cap) < sizeof(int32_t), int32_t, Cap>::type;
+
+template <class Cap>
+constexpr Cap residual_epsilon() noexcept
+{
+    return std::is_floating_point<Cap>::value ? Cap(REIMPLS_FLOAT_EPSILON) : Cap(0);
+}
+
+// Test for a non-saturated arc. Integer types use an exact test. For floating point types, round-off from
+// repeated augmentations can leave tiny positive residuals which would only lead to negligible augmentations.
+template <class Cap>
+inline bool has_residual(Cap cap) noexcept
+{
+    return cap > residual_epsilon<Cap>();
+}
+
+// Test for a zero terminal capacity where the sign gives the terminal.
+template <class Term>
+inline bool is_zero_term(Term cap) noexcept
+{
+    return !has_residual(cap) && !has_residual<Term>(-cap);
+}
+
+// Atomic a += v. std::atomic only has fetch_add for floating point types from C++20, so these use a CAS loop.
+template <class T>
+inline typename std::enable_if<std::is_integral<T>::value>::type atomic_add(std::atomic<T>& a, T v) noexcept
+{
+    a.fetch_add(v);
+}
+
+template <class T>
+inline typename std::enable_if<!std::is_integral<T>::value>::type atomic_add(std::atomic<T>& a, T v) noexcept
+{
+    T old = a.load();
+    while (!a.compare_exchange_weak(old, old + v)) {
+        // Do nothing
+    }
+}
+
+// Pool of worker threads which are reused across parallel calls, so solvers that run many times do not pay for
+// creating and joining threads every time. All parallel solvers take a pool with set_thread_pool and default to
+// default_thread_pool(). Several solvers can share a pool concurrently.
+//
+// run(n, func) calls func(t) for t = 0, ..., n - 1, where t = 0 runs on the calling thread and the rest on
+// workers. Each call gets its own n - 1 workers, so the calls may wait for each other (e.g. with a Barrier),
+// and the pool grows if not enough workers are idle. Workers are only created when needed and never exit
+// before the pool is destroyed. Exceptions thrown by func are rethrown on the calling thread.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int num_workers = 0) :
+        mutex(),
+        work_cond(),
+        done_cond(),
+        workers(),
+        tickets(),
+        num_idle(0),
+        max_workers(0),
+        thread_init(),
+        thread_init_gen(0),
+        stop(false)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (workers.size() < num_workers) {
+            spawn_worker();
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        work_cond.notify_all();
+        for (auto& w : workers) {
+            w.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <class Func>
+    void run(unsigned int num_threads, Func func)
+    {
+        if (num_threads <= 1) {
+            func(0u);
+            return;
+        }
+
+        Job job;
+        job.invoke = [](void *ctx, unsigned int t) { (*static_cast<Func *>(ctx))(t); };
+        job.ctx = &func;
+        job.next_task.store(1, std::memory_order_relaxed);
+        job.pending = num_threads - 1;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (num_idle < num_threads - 1) {
+                spawn_worker();
+            }
+            num_idle -= num_threads - 1;
+            for (unsigned int t = 1; t < num_threads; ++t) {
+                tickets.push_back(&job);
+            }
+        }
+        work_cond.notify_all();
+
+        std::exception_ptr error;
+        try {
+            func(0u);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        // Workers use the job until they are done, so we must wait even if func threw
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cond.wait(lock, [&]() { return job.pending == 0; });
+        if (!error) {
+            error = job.error;
+        }
+        lock.unlock();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Number of threads to use for independent work, which can be split over any number of threads.
+    // With a limit on the workers, this is at most the caller plus the workers which are not busy within the
+    // limit, so solvers running at the same time share the workers instead of oversubscribing the cores.
+    unsigned int available_threads(unsigned int num_threads)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (max_workers == 0) {
+            return num_threads;
+        }
+        const size_t busy = workers.size() - num_idle;
+        const size_t allowed = max_workers > busy ? max_workers - busy : 0;
+        return static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(num_threads, allowed + 1)));
+    }
+
+    // Limit on workers used for independent work, see available_threads. Does not limit run.
+    inline unsigned int get_max_workers()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return max_workers;
+    }
+
+    inline void set_max_workers(unsigned int num)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        max_workers = num;
+    }
+
+    inline size_t get_num_workers()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return workers.size();
+    }
+
+    // Hook called on each worker with its index before it runs its next task, e.g. to pin it to a core with
+    // pin_thread_to_cpu. Existing workers call the new hook before their next task.
+    void set_thread_init(std::function<void(unsigned int)> init)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        thread_init = std::move(init);
+        thread_init_gen++;
+    }
+
+private:
+    struct Job {
+        void (*invoke)(void *, unsigned int);
+        void *ctx;
+        std::atomic<unsigned int> next_task;
+        unsigned int pending; // Guarded by mutex
+        std::exception_ptr error; // Guarded by mutex
+    };
+
+    std::mutex mutex;
+    std::condition_variable work_cond;
+    std::condition_variable done_cond;
+
+    std::vector<std::thread> workers;
+    std::deque<Job *> tickets; // One per task that has not been picked up by a worker yet
+    unsigned int num_idle; // Workers which are not running or reserved for a task
+    unsigned int max_workers; // Zero means no limit
+
+    std::function<void(unsigned int)> thread_init;
+    uint64_t thread_init_gen;
+
+    bool stop;
+
+    // @pre: mutex is locked
+    void spawn_worker()
+    {
+        workers.emplace_back(&ThreadPool::worker_loop, this, static_cast<unsigned int>(workers.size()));
+        num_idle++;
+    }
+
+    void worker_loop(unsigned int w)
+    {
+        uint64_t init_gen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            work_cond.wait(lock, [&]() { return stop || !tickets.empty(); });
+            if (tickets.empty()) {
+                return;
+            }
+            Job *job = tickets.front();
+            tickets.pop_front();
+            std::function<void(unsigned int)> init;
+            if (init_gen != thread_init_gen) {
+                init = thread_init;
+                init_gen = thread_init_gen;
+            }
+            lock.unlock();
+
+            std::exception_ptr error;
+            try {
+                if (init) {
+                    init(w);
+                }
+                job->invoke(job->ctx, job->next_task.fetch_add(1, std::memory_order_relaxed));
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            lock.lock();
+            if (error && !job->error) {
+                job->error = error;
+            }
+            num_idle++;
+            if (--job->pending == 0) {
+                done_cond.notify_all();
+            }
+        }
+    }
+};
+
+// Pool used by all parallel solvers unless they are given another one.
+inline ThreadPool& default_thread_pool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+// Pin the calling thread to a CPU. Returns false if this is not supported or failed.
+inline bool pin_thread_to_cpu(unsigned int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// Call func(t) for t = 0, ..., num_threads - 1, each on its own thread. Runs on the calling thread if only one
+// thread is requested.
+template <class Func>
+void parallel_for_threads(ThreadPool& pool, unsigned int num_threads, Func func)
+{
+    pool.run(num_threads, func);
+}
+
+template <class Func>
+void parallel_for_threads(unsigned int num_threads, Func func)
+{
+    parallel_for_threads(default_thread_pool(), num_threads, func);
+}
+
+// Call func(begin, end) on up to num_threads contiguous chunks of [0, n). Runs on the calling thread if only
+// one thread is requested.
+template <class Func>
+void parallel_for_blocks(ThreadPool& pool, size_t n, unsigned int num_threads, Func func)
+{
+    num_threads = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(num_threads, n)));
+    if (num_threads > 1) {
+        num_threads = pool.available_threads(num_threads);
+    }
+    if (num_threads == 1) {
+        func(size_t(0), n);
+        return;
+    }
+
+    size_t chunk = (n + num_threads - 1) / num_threads;
+    pool.run(num_threads, [&](unsigned int t) {
+        size_t begin = std::min(n, t * chunk);
+        size_t end = std::min(n, begin + chunk);
+        func(begin, end);
+    });
+}
+
+template <class Func>
+void parallel_for_blocks(size_t n, unsigned int num_threads, Func func)
+{
+    parallel_for_blocks(default_thread_pool(), n, num_threads, func);
+}
+
+// Call func(i) for i = 0, ..., n - 1 on up to num_threads threads. Each thread starts on its own contiguous
+// range of indices and then steals indices from the ranges of the other threads, so it suits tasks of very
+// different sizes, e.g. blocks.
+template <class Func>
+void parallel_for_each(ThreadPool& pool, size_t n, unsigned int num_threads, Func func)
+{
+    num_threads = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(num_threads, n)));
+    if (num_threads > 1) {
+        num_threads = pool.available_threads(num_threads);
+    }
+    if (num_threads == 1) {
+        for (size_t i = 0; i < n; ++i) {
+            func(i);
+        }
+        return;
+    }
+
+    struct alignas(64) Range {
+        std::atomic<size_t> next;
+        size_t end;
+    };
+    std::unique_ptr<Range[]> ranges(new Range[num_threads]);
+    for (unsigned int t = 0; t < num_threads; ++t) {
+        ranges[t].next.store(n * t / num_threads, std::memory_order_relaxed);
+        ranges[t].end = n * (t + 1) / num_threads;
+    }
+    pool.run(num_threads, [&](unsigned int t) {
+        for (unsigned int k = 0; k < num_threads; ++k) {
+            Range& range = ranges[(t + k) % num_threads];
+            for (size_t i = range.next.fetch_add(1); i < range.end; i = range.next.fetch_add(1)) {
+                func(i);
+            }
+        }
+    });
+}
+
+template <class Func>
+void parallel_for_each(size_t n, unsigned int num_threads, Func func)
+{
+    parallel_for_each(default_thread_pool(), n, num_threads, func);
+}
+
+// Call func(k, t) for k = 0, ..., n - 1 on up to num_threads threads, where t is the thread running task k.
+// Tasks are taken from one shared queue in index order, so with tasks sorted by decreasing work this is
+// longest-processing-time-first scheduling.
+template <class Func>
+void parallel_for_queue(ThreadPool& pool, size_t n, unsigned int num_threads, Func func)
+{
+    num_threads = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(num_threads, n)));
+    if (num_threads > 1) {
+        num_threads = pool.available_threads(num_threads);
+    }
+    if (num_threads == 1) {
+        for (size_t k = 0; k < n; ++k) {
+            func(k, 0u);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    pool.run(num_threads, [&](unsigned int t) {
+        for (size_t k = next.fetch_add(1); k < n; k = next.fetch_add(1)) {
+            func(k, t);
+        }
+    });
+}
+
+template <class Func>
+void parallel_for_queue(size_t n, unsigned int num_threads, Func func)
+{
+    parallel_for_queue(default_thread_pool(), n, num_threads, func);
+}
+
+// Call func(t, begin, end) on contiguous chunks of [0, n), one per thread t, where chunks have at least min_chunk
+// items unless there is only one. Returns the number of threads, so that func can collect results per thread.
+template <class Func>
+unsigned int parallel_for_chunks(ThreadPool& pool, size_t n, unsigned int num_threads, size_t min_chunk, Func func)
+{
+    num_threads = static_cast<unsigned int>(
+        std::max<size_t>(1, std::min<size_t>(num_threads, n / std::max<size_t>(1, min_chunk))));
+    if (num_threads > 1) {
+        num_threads = pool.available_threads(num_threads);
+    }
+    pool.run(num_threads, [&](unsigned int t) {
+        func(t, n * t / num_threads, n * (t + 1) / num_threads);
+    });
+    return num_threads;
+}
+
+// Replace values[0], ..., values[n - 1] by their exclusive prefix sums and return the total. Each thread sums
+// a contiguous chunk, the chunk sums are scanned serially, and then each thread scans its chunk from its offset.
+template <class T>
+T parallel_exclusive_scan(ThreadPool& pool, T *values, size_t n, unsigned int num_threads)
+{
+    num_threads = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(num_threads, n)));
+    if (num_threads > 1) {
+        num_threads = pool.available_threads(num_threads);
+    }
+
+    std::vector<T> chunk_sums(num_threads + 1, T(0));
+    auto chunk_begin = [&](unsigned int t) { return n * t / num_threads; };
+    if (num_threads > 1) {
+        pool.run(num_threads, [&](unsigned int t) {
+            T sum = T(0);
+            for (size_t i = chunk_begin(t); i < chunk_begin(t + 1); ++i) {
+                sum += values[i];
+            }
+            chunk_sums[t + 1] = sum;
+        });
+        for (unsigned int t = 0; t < num_threads; ++t) {
+            chunk_sums[t + 1] += chunk_sums[t];
+        }
+    }
+    pool.run(num_threads, [&](unsigned int t) {
+        T sum = chunk_sums[t];
+        for (size_t i = chunk_begin(t); i < chunk_begin(t + 1); ++i) {
+            T v = values[i];
+            values[i] = sum;
+            sum += v;
+        }
+        if (t == num_threads - 1) {
+            chunk_sums[num_threads] = sum;
+        }
+    });
+    return chunk_sums[num_threads];
+}
+
+// Fixed size set of bits which threads can test and set concurrently, e.g. to mark discovered nodes. The
+// operations are relaxed, so phases which use the bits must be ordered by other means, e.g. ThreadPool::run.
+class AtomicBitset {
+public:
+    explicit AtomicBitset(size_t n = 0) : words((n + 63) / 64) {}
+
+    inline bool test(size_t i) const noexcept
+    {
+        return (words[i / 64].load(std::memory_order_relaxed) >> (i % 64)) & 1;
+    }
+
+    // Set bit i and return whether it was already set
+    inline bool test_and_set(size_t i) noexcept
+    {
+        const uint64_t mask = uint64_t(1) << (i % 64);
+        return words[i / 64].fetch_or(mask, std::memory_order_relaxed) & mask;
+    }
+
+    inline void reset(size_t i) noexcept
+    {
+        words[i / 64].fetch_and(~(uint64_t(1) << (i % 64)), std::memory_order_relaxed);
+    }
+
+    void clear() noexcept
+    {
+        for (auto& w : words) {
+            w.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::vector<std::atomic<uint64_t>> words;
+};
+
+// How the bottom-up merging solvers schedule their blocks
+enum BlockPolicy : int {
+    BLOCK_POLICY_FIXED, // Solve and merge blocks in the order of the partition
+    BLOCK_POLICY_ADAPTIVE // Solve heavy blocks first and batch light ones, then merge the cheapest pairs first
+};
+
+// Order items by decreasing work and group them into tasks. An item with at least min_work is a task of its
+// own while lighter items are batched until the batch has min_work. Task k is made of the items
+// order[task_begin[k]], ..., order[task_begin[k + 1] - 1].
+inline void plan_work_tasks(const std::vector<double>& work, double min_work,
+    std::vector<size_t>& order, std::vector<size_t>& task_begin)
+{
+    order.resize(work.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return work[a] > work[b]; });
+
+    task_begin.clear();
+    double batch = 0;
+    for (size_t p = 0; p < order.size(); ++p) {
+        if (p == 0 || batch >= min_work) {
+            task_begin.push_back(p);
+            batch = 0;
+        }
+        batch += work[order[p]];
+    }
+    task_begin.push_back(order.size());
+}
+
+// Ratio of the max. to the mean busy time of a group of threads. 1 means the work was perfectly balanced.
+inline double load_imbalance(const std::vector<double>& busy)
+{
+    double sum = 0;
+    double max = 0;
+    for (double b : busy) {
+        sum += b;
+        max = std::max(max, b);
+    }
+    return sum > 0 ? max * busy.size() / sum : 1.0;
+}
+
 class Barrier {
     // Bare bones thread barrier implemenation adapted from boost::barrier
 public:
@@ -0,0 +1,336 @@
+#ifndef REORDER_H__
+#define REORDER_H__
+
+#include <stdexcept>
+#include <vector>
+#include <inttypes.h>
+#include <algorithm>
+#include <utility>
+#include <assert.h>
+
+#include "graph_io.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Node orders
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Permutation of the nodes of a graph. new_index[i] is the index of original node i in the reordered graph.
+ */
+struct NodeOrder {
+    std::vector<uint64_t> new_index;
+
+    /** Return the values of a per-node vector in the reordered numbering. */
+    template <class Ty>
+    std::vector<Ty> to_reordered(const std::vector<Ty>& original) const
+    {
+        assert(original.size() == new_index.size());
+        std::vector<Ty> out(original.size());
+        #pragma omp parallel for
+        for (int64_t i = 0; i < (int64_t)new_index.size(); ++i) {
+            out[new_index[i]] = original[i];
+        }
+        return out;
+    }
+
+    /** Return the values of a per-node vector in the original numbering. */
+    template <class Ty>
+    std::vector<Ty> to_original(const std::vector<Ty>& reordered) const
+    {
+        assert(reordered.size() == new_index.size());
+        std::vector<Ty> out(reordered.size());
+        #pragma omp parallel for
+        for (int64_t i = 0; i < (int64_t)new_index.size(); ++i) {
+            out[i] = reordered[new_index[i]];
+        }
+        return out;
+    }
+
+    /** Query the segment of an original node in a graph which was built from the reordered graph. */
+    template <class Graph, class... Args>
+    auto what_segment(const Graph& graph, uint64_t i, Args... args) const
+    {
+        return graph.what_segment(new_index[i], args...);
+    }
+};
+
+/** Make node order which places nodes in order of increasing key. Ties keep their original order. */
+inline NodeOrder order_from_keys(const std::vector<uint64_t>& keys)
+{
+    std::vector<std::pair<uint64_t, uint64_t>> key_nodes(keys.size());
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        key_nodes[i] = std::make_pair(keys[i], i);
+    }
+    std::sort(key_nodes.begin(), key_nodes.end());
+
+    NodeOrder order;
+    order.new_index.resize(keys.size());
+    for (uint64_t k = 0; k < key_nodes.size(); ++k) {
+        order.new_index[key_nodes[k].second] = k;
+    }
+    return order;
+}
+
+/**
+ * Breadth-first (Cuthill-McKee) order. Each connected component is traversed from a node of minimum degree
+ * and the neighbors of each node are visited in order of increasing degree.
+ */
+template <class capty, class tcapty>
+NodeOrder bfs_order(const BkGraph<capty, tcapty>& graph)
+{
+    const uint64_t num_nodes = graph.num_nodes;
+
+    // Build undirected adjacency lists in CSR format
+    std::vector<uint64_t> nbor_start(num_nodes + 1, 0);
+    for (const auto& narc : graph.neighbor_arcs) {
+        nbor_start[narc.i + 1]++;
+        nbor_start[narc.j + 1]++;
+    }
+    for (uint64_t i = 0; i < num_nodes; ++i) {
+        nbor_start[i + 1] += nbor_start[i];
+    }
+    std::vector<uint64_t> nbors(nbor_start[num_nodes]);
+    {
+        std::vector<uint64_t> pos(nbor_start.begin(), nbor_start.end() - 1);
+        for (const auto& narc : graph.neighbor_arcs) {
+            nbors[pos[narc.i]++] = narc.j;
+            nbors[pos[narc.j]++] = narc.i;
+        }
+    }
+    auto degree = [&](uint64_t i) { return nbor_start[i + 1] - nbor_start[i]; };
+
+    #pragma omp parallel for schedule(dynamic, 4096)
+    for (int64_t i = 0; i < (int64_t)num_nodes; ++i) {
+        std::sort(nbors.begin() + nbor_start[i], nbors.begin() + nbor_start[i + 1],
+            [&](uint64_t a, uint64_t b) { return degree(a) < degree(b); });
+    }
+
+    // Candidate start nodes in order of increasing degree
+    std::vector<uint64_t> starts(num_nodes);
+    for (uint64_t i = 0; i < num_nodes; ++i) {
+        starts[i] = i;
+    }
+    std::stable_sort(starts.begin(), starts.end(), [&](uint64_t a, uint64_t b) { return degree(a) < degree(b); });
+
+    static const uint64_t UNVISITED = ~uint64_t(0);
+    NodeOrder order;
+    order.new_index.assign(num_nodes, UNVISITED);
+    std::vector<uint64_t> queue(num_nodes);
+    uint64_t head = 0, tail = 0;
+    for (uint64_t s : starts) {
+        if (order.new_index[s] != UNVISITED) {
+            continue;
+        }
+        order.new_index[s] = tail;
+        queue[tail++] = s;
+        while (head < tail) {
+            uint64_t i = queue[head++];
+            for (uint64_t k = nbor_start[i]; k < nbor_start[i + 1]; ++k) {
+                uint64_t j = nbors[k];
+                if (order.new_index[j] == UNVISITED) {
+                    order.new_index[j] = tail;
+                    queue[tail++] = j;
+                }
+            }
+        }
+    }
+    return order;
+}
+
+/** Spread the lower 21 bits of x so there are two zero bits between each of them. */
+inline uint64_t spread_bits_3d(uint64_t x)
+{
+    x &= 0x1FFFFF;
+    x = (x | (x << 32)) & 0x1F00000000FFFF;
+    x = (x | (x << 16)) & 0x1F0000FF0000FF;
+    x = (x | (x << 8)) & 0x100F00F00F00F00F;
+    x = (x | (x << 4)) & 0x10C30C30C30C30C3;
+    x = (x | (x << 2)) & 0x1249249249249249;
+    return x;
+}
+
+/** Number of bits needed to represent all coordinates in [0, n). */
+inline int coord_bits(size_t n)
+{
+    int bits = 1;
+    while (bits < 32 && (size_t(1) << bits) < n) {
+        bits++;
+    }
+    return bits;
+}
+
+/**
+ * Morton (Z-curve) order for a grid graph where node i has coordinates
+ * x = i % width, y = (i / width) % height, z = i / (width * height).
+ */
+inline NodeOrder morton_order(size_t width, size_t height, size_t depth)
+{
+    if (coord_bits(std::max({ width, height, depth })) > 21) {
+        throw std::invalid_argument("Grid is too large for Morton order.");
+    }
+    const uint64_t num_nodes = width * height * depth;
+    std::vector<uint64_t> keys(num_nodes);
+    #pragma omp parallel for
+    for (int64_t i = 0; i < (int64_t)num_nodes; ++i) {
+        uint64_t x = i % width;
+        uint64_t y = (i / width) % height;
+        uint64_t z = i / (width * height);
+        keys[i] = spread_bits_3d(x) | (spread_bits_3d(y) << 1) | (spread_bits_3d(z) << 2);
+    }
+    return order_from_keys(keys);
+}
+
+/**
+ * Position along a Hilbert curve for a point with dims coordinates, each having the given number of bits.
+ * Uses the transpose algorithm from Skilling, "Programming the Hilbert curve", 2004, AIP Conf. Proc.
+ */
+inline uint64_t hilbert_index(uint32_t *coords, int dims, int bits)
+{
+    // Inverse undo excess work
+    const uint32_t m = uint32_t(1) << (bits - 1);
+    for (uint32_t q = m; q > 1; q >>= 1) {
+        uint32_t p = q - 1;
+        for (int d = 0; d < dims; ++d) {
+            if (coords[d] & q) {
+                coords[0] ^= p;
+            } else {
+                uint32_t t = (coords[0] ^ coords[d]) & p;
+                coords[0] ^= t;
+                coords[d] ^= t;
+            }
+        }
+    }
+    // Gray encode
+    for (int d = 1; d < dims; ++d) {
+        coords[d] ^= coords[d - 1];
+    }
+    uint32_t t = 0;
+    for (uint32_t q = m; q > 1; q >>= 1) {
+        if (coords[dims - 1] & q) {
+            t ^= q - 1;
+        }
+    }
+    for (int d = 0; d < dims; ++d) {
+        coords[d] ^= t;
+    }
+    // Interleave the transposed bits
+    uint64_t index = 0;
+    for (int b = bits - 1; b >= 0; --b) {
+        for (int d = 0; d < dims; ++d) {
+            index = (index << 1) | ((coords[d] >> b) & 1);
+        }
+    }
+    return index;
+}
+
+/**
+ * Hilbert curve order for a grid graph with the same node layout as morton_order. If depth is 1 a 2D curve
+ * is used.
+ */
+inline NodeOrder hilbert_order(size_t width, size_t height, size_t depth)
+{
+    const int dims = depth > 1 ? 3 : 2;
+    const int bits = coord_bits(std::max({ width, height, depth }));
+    if (dims * bits > 64) {
+        throw std::invalid_argument("Grid is too large for Hilbert order.");
+    }
+    const uint64_t num_nodes = width * height * depth;
+    std::vector<uint64_t> keys(num_nodes);
+    #pragma omp parallel for
+    for (int64_t i = 0; i < (int64_t)num_nodes; ++i) {
+        uint32_t coords[3] = {
+            uint32_t(i % width),
+            uint32_t((i / width) % height),
+            uint32_t(i / (width * height))
+        };
+        keys[i] = hilbert_index(coords, dims, bits);
+    }
+    return order_from_keys(keys);
+}
+
+/**
+ * Order which makes all blocks contiguous while keeping the original order within each block. If the graph
+ * has more nodes than node_blocks (e.g. for .bq files) the blocks are repeated.
+ */
+inline NodeOrder block_order(const std::vector<uint16_t>& node_blocks, uint64_t num_nodes)
+{
+    if (node_blocks.empty()) {
+        throw std::invalid_argument("Block order requires a non-empty block list.");
+    }
+    std::vector<uint64_t> block_start(size_t(UINT16_MAX) + 2, 0);
+    for (uint64_t i = 0; i < num_nodes; ++i) {
+        block_start[node_blocks[i % node_blocks.size()] + 1]++;
+    }
+    for (size_t b = 0; b + 1 < block_start.size(); ++b) {
+        block_start[b + 1] += block_start[b];
+    }
+
+    NodeOrder order;
+    order.new_index.resize(num_nodes);
+    for (uint64_t i = 0; i < num_nodes; ++i) {
+        order.new_index[i] = block_start[node_blocks[i % node_blocks.size()]]++;
+    }
+    return order;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Relabeling
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Relabel the nodes of a graph with the given order. Terminal and neighbor arcs are also sorted by their
+ * (first) node so the graph is built in the new order.
+ */
+template <class capty, class tcapty>
+BkGraph<capty, tcapty> relabel_graph(const BkGraph<capty, tcapty>& graph, const NodeOrder& order)
+{
+    assert(order.new_index.size() == graph.num_nodes);
+    const uint64_t num_nodes = graph.num_nodes;
+    const auto& new_index = order.new_index;
+
+    // Count arcs per new node so arcs can be scattered directly to their sorted position
+    std::vector<uint64_t> term_start(num_nodes + 1, 0);
+    std::vector<uint64_t> nbor_start(num_nodes + 1, 0);
+    for (const auto& tarc : graph.terminal_arcs) {
+        term_start[new_index[tarc.node] + 1]++;
+    }
+    for (const auto& narc : graph.neighbor_arcs) {
+        nbor_start[new_index[narc.i] + 1]++;
+    }
+    for (uint64_t i = 0; i < num_nodes; ++i) {
+        term_start[i + 1] += term_start[i];
+        nbor_start[i + 1] += nbor_start[i];
+    }
+
+    // Compute destination of each arc. This is the only serial part since it depends on the arc order.
+    std::vector<uint64_t> term_dst(graph.terminal_arcs.size());
+    std::vector<uint64_t> nbor_dst(graph.neighbor_arcs.size());
+    for (size_t k = 0; k < graph.terminal_arcs.size(); ++k) {
+        term_dst[k] = term_start[new_index[graph.terminal_arcs[k].node]]++;
+    }
+    for (size_t k = 0; k < graph.neighbor_arcs.size(); ++k) {
+        nbor_dst[k] = nbor_start[new_index[graph.neighbor_arcs[k].i]]++;
+    }
+
+    BkGraph<capty, tcapty> out;
+    out.num_nodes = num_nodes;
+    out.terminal_arcs.resize(graph.terminal_arcs.size());
+    out.neighbor_arcs.resize(graph.neighbor_arcs.size());
+
+    #pragma omp parallel for
+    for (int64_t k = 0; k < (int64_t)graph.terminal_arcs.size(); ++k) {
+        BkTermArc<tcapty> tarc = graph.terminal_arcs[k];
+        tarc.node = new_index[tarc.node];
+        out.terminal_arcs[term_dst[k]] = tarc;
+    }
+    #pragma omp parallel for
+    for (int64_t k = 0; k < (int64_t)graph.neighbor_arcs.size(); ++k) {
+        BkNborArc<capty> narc = graph.neighbor_arcs[k];
+        narc.i = new_index[narc.i];
+        narc.j = new_index[narc.j];
+        out.neighbor_arcs[nbor_dst[k]] = narc;
+    }
+    return out;
+}
+
+#endif // REORDER_H__
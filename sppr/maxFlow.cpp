@@ -12,13 +12,15 @@ const int statsInterval = 10000; // set to 0 to only print stats at the end
 #define GAP_HEURISTIC 0 // only works for RELABEL_TACTIC in {1, 2}
 #define EXCESS_SCALING 0
 #define P2L 0
-#define INCREMENTAL_GLREL 0
+#define INCREMENTAL_GLREL 1 // only tracked for RELABEL_TACTIC in {1, 2, 3}
 
 #if GAP_HEURISTIC && RELABEL_TACTIC > 2
 #    error "Not implemented: Gap heuristics with multi-relabel"
 #endif
 
 #include "parallel.h"
+// Before the ALPHA and BETA macros below
+#include "parallel_bfs.h"
 
 #define forSwitch(t,i,s,e,X) { \
                          intT __ss=(s), __ee=(e); \
@@ -270,6 +272,8 @@ intT hiLabel;
 pair<ll,Cap> *pushBuffer;
 intT *relabelsBuffer;
 intT *labelCounter;
+typedef reimpls::ParallelReverseBfs<intT, intT> ReverseBfs;
+ReverseBfs *bfs;
 
 intT *bufSize, *offset, *first;
 intT wSetSize;
@@ -318,6 +322,7 @@ void init() {
     first = new intT[m+n+1];
     wSetTmp = new intT[n];
     enew = new atomic<Cap>[n];
+    bfs = new ReverseBfs(n);
     for (intT i = 0; i < n; ++i) {
         Node& v = nodes[i];
         v.h = 0;
@@ -358,6 +363,7 @@ void deinit() {
     delete[] first;
     delete[] wSetTmp;
     delete[] enew;
+    delete bfs;
 #if GAP_HEURISTIC
     delete[] relabelsBuffer;
     delete[] labelCounter;
@@ -403,86 +409,63 @@ void checkSanity() {
     }
 }
 
-void revBfs(intT *frontier, intT sz, intT d, intT exclude) {
-    //cout << "BFS start" << endl;
-    timer t;
-    t.clear();
-    t.start();
-    intT *degs = new intT[n], *offset = new intT[n];
-    while (sz) {
-        //cout << "level " << d << " " << sz << endl;
+// Adapter for ReverseBfs, which relabels the nodes above label d
+struct RelabelGraph {
+    intT d;
+
+    ReverseBfs::NodeState init_node(intT i) {
+        Node& v = nodes[i];
+        if (i == source)
+            return ReverseBfs::DONE;
+        if (d == 0) {
+            if (i == sink)
+                return ReverseBfs::FIRST_LEVEL;
+        } else if (v.h <= d) {
+            return v.h == d ? ReverseBfs::FIRST_LEVEL : ReverseBfs::DONE;
+        }
+        v.h = hiLabel;
+#if RELABEL_TACTIC != 4
+        v.hnew = hiLabel;
+#endif
+        return ReverseBfs::OPEN;
+    }
+    intT first_arc(intT i) { return nodes[i].first; }
+    intT last_arc(intT i) { return nodes[i].last(); }
+    intT head(intT a) { return arcs[a].to; }
+    bool has_residual(intT a) { return arcs[a].resCap > 0; }
+    bool has_rev_residual(intT a) { return arcs[a].revResCap > 0; }
+    void set_label(intT i, intT l) {
+        nodes[i].h = l;
+#if RELABEL_TACTIC != 4
+        nodes[i].hnew = l;
+#endif
 #if GAP_HEURISTIC
-        labelCounter[d] = sz;
+        utils::writeAdd(&labelCounter[l], (intT)1);
 #endif
-        sppr_parallel_for (intT i = 0; i < sz; ++i)
-            degs[i] = outDegree(nodes[frontier[i]]);
-        intT maxNewSz = sequence::plusScan(degs, offset, sz);
-        globRelWork += maxNewSz;
-        globRelIters++;
-        intT *nxt = new intT[maxNewSz];
-        forSwitch(400, i, 0, sz, {
-            intT o = offset[i];
-            Node& v = nodes[frontier[i]];
-            forSwitch(1000, j, 0, degs[i], {
-                Arc& ar = arcs[v.first + j];
-                nxt[o + j] = -1;
-                if (!ar.revResCap) continue;
-                intT wi = ar.to;
-                if (wi == exclude) continue;
-                Node& w = nodes[wi];
-                if (CAS(&w.h, hiLabel, v.h + 1)) {
-//#if RELABEL_TACTIC != 4
-                    w.hnew = w.h;
-//#endif
-                    nxt[o + j] = wi;
-                }
-            })
-        })
-        sz = sequence::filter(nxt, frontier, maxNewSz, [](intT x) { return x >= 0; });
-        delete[] nxt;
-        d++;
     }
-    delete[] degs;
-    delete[] offset;
-    t.stop();
-    //cout << "BFS end time " << t.total() << " diameter " << d << endl;
-}
+};
 
 void globalRelabel() {
     //cout << "global relabeling (low = " << lowestChangedLabel << ") ... " << flush;
     //cout << "hiLabel=" << hiLabel <<    endl;
     workSinceUpdate = 0;
+    // No saturating push or relabel since the last update, so the labels are still exact
+    if (lowestChangedLabel >= hiLabel)
+        return;
     globalRelabelTime.start();
     globalRelabels++;
 
-    sppr_parallel_for (intT i = 0; i < n; ++i) {
-        Node& v = nodes[i];
-        if (v.h > lowestChangedLabel || (lowestChangedLabel == 0 && i != sink))
-            v.h = hiLabel;
 #if GAP_HEURISTIC
-        if (i > lowestChangedLabel)
-            labelCounter[i] = 0;
-#endif
-    }
-
-    intT *frontier = new intT[n];
-    intT sz = 0;
+    sppr_parallel_for (intT i = lowestChangedLabel + 1; i < hiLabel; ++i)
+        labelCounter[i] = 0;
     if (lowestChangedLabel == 0)
-        frontier[sz++] = sink;
-    else {
-        intT *tmp = new intT[n];
-        sppr_parallel_for (intT vi = 0; vi < n; ++vi) {
-            Node& v = nodes[vi];
-            if (v.h == lowestChangedLabel)
-                tmp[vi] = vi;
-            else
-                tmp[vi] = -1;
-        }
-        sz = sequence::filter(tmp, frontier, n, [](intT x) { return x >= 0; });
-        delete[] tmp;
-    }
-    revBfs(frontier, sz, lowestChangedLabel, source);
-    delete[] frontier;
+        labelCounter[0] = 1;
+#endif
+    RelabelGraph graph = { lowestChangedLabel };
+    bfs->set_num_threads(getWorkers());
+    bfs->run(graph, lowestChangedLabel);
+    globRelWork += bfs->scanned_arcs;
+    globRelIters += bfs->levels;
     globalRelabelTime.stop();
 #if INCREMENTAL_GLREL
     lowestChangedLabel = numeric_limits<intT>::max();
@@ -767,9 +750,11 @@ array<ll, 2> processNode(intT i, intT vi) {
             v.e -= delta;
             ass(v.e >= 0);
             increaseArcFlow(cur, delta);
-//#if INCREMENTAL_GLREL
-//            lowestChangedL = min(lowestChangedL, w.h);
-//#endif
+#if INCREMENTAL_GLREL
+            // Saturating the arc only lengthens paths into w, so labels up to w.h stay exact
+            if (delta == c)
+                lowestChangedL = min(lowestChangedL, w.h);
+#endif
             if (mode == MODE_RACE) {
                 enew[wi] += delta;
 /*#if P2L
@@ -815,6 +800,9 @@ array<ll, 2> processNode(intT i, intT vi) {
                                 << ")" << endl;)
             }
             ass(newh > v.h);
+#if INCREMENTAL_GLREL
+            lowestChangedL = min(lowestChangedL, newh - 1);
+#endif
             v.h = newh;
             resetArcPointers(v);
 #if RELABEL_TACTIC == 3